@@ -0,0 +1,147 @@
+// Throughput of the gamepad batch decoder kernels.
+//
+// Decodes a buffer of synthetic 20-byte reports (usb-gamepad/gamepad_batch.h)
+// with every kernel the CPU supports, checks each against the scalar one and
+// prints reports per second. The buffer is sized to stay in L2 so the
+// numbers compare the kernels rather than memory bandwidth.
+//
+// Usage: bench_gamepad_decode [seconds_per_kernel] [reports]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../usb-gamepad/gamepad_batch.h"
+
+typedef struct {
+    const char *name;
+    gamepad_batch_fn fn;
+    int supported;
+} Kernel;
+
+typedef struct {
+    uint16_t *buttons;
+    uint8_t *trigger_left;
+    uint8_t *trigger_right;
+    int16_t *axes[4];
+    GamepadColumns cols;
+} Columns;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int columns_alloc(Columns *c, size_t n) {
+    memset(c, 0, sizeof(*c));
+    c->buttons = calloc(n, sizeof(uint16_t));
+    c->trigger_left = calloc(n, 1);
+    c->trigger_right = calloc(n, 1);
+    for (int a = 0; a < 4; a++) c->axes[a] = calloc(n, sizeof(int16_t));
+    if (!c->buttons || !c->trigger_left || !c->trigger_right || !c->axes[0] || !c->axes[1] || !c->axes[2] || !c->axes[3]) {
+        return -1;
+    }
+    GamepadColumns cols = { c->buttons, c->trigger_left, c->trigger_right, c->axes[0], c->axes[1], c->axes[2], c->axes[3] };
+    c->cols = cols;
+    return 0;
+}
+
+static void columns_free(Columns *c) {
+    free(c->buttons);
+    free(c->trigger_left);
+    free(c->trigger_right);
+    for (int a = 0; a < 4; a++) free(c->axes[a]);
+}
+
+// Poison the outputs so a kernel that skips a column does not pass the check.
+static void columns_clear(Columns *c, size_t n) {
+    memset(c->buttons, 0xa5, n * sizeof(uint16_t));
+    memset(c->trigger_left, 0xa5, n);
+    memset(c->trigger_right, 0xa5, n);
+    for (int a = 0; a < 4; a++) memset(c->axes[a], 0xa5, n * sizeof(int16_t));
+}
+
+static int columns_equal(const Columns *a, const Columns *b, size_t n) {
+    if (memcmp(a->buttons, b->buttons, n * sizeof(uint16_t)) != 0) return 0;
+    if (memcmp(a->trigger_left, b->trigger_left, n) != 0) return 0;
+    if (memcmp(a->trigger_right, b->trigger_right, n) != 0) return 0;
+    for (int i = 0; i < 4; i++) {
+        if (memcmp(a->axes[i], b->axes[i], n * sizeof(int16_t)) != 0) return 0;
+    }
+    return 1;
+}
+
+// Random controls in the Xbox 360 layout.
+static void fill_reports(uint8_t *buf, size_t n) {
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t *r = buf + i * GAMEPAD_REPORT_SIZE;
+        memset(r, 0, GAMEPAD_REPORT_SIZE);
+        r[1] = GAMEPAD_REPORT_SIZE;
+        for (int b = 2; b < 14; b++) {
+            seed = seed * 1103515245u + 12345u;
+            r[b] = (uint8_t)(seed >> 16);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 0.5;
+    size_t n = argc > 2 ? (size_t)atol(argv[2]) : 8191; // not a multiple of 16: the tail runs too
+    const char *best_name;
+
+    Kernel kernels[] = {
+        { "scalar", gamepad_batch_decode_scalar, 1 },
+#ifdef GAMEPAD_BATCH_X86
+        { "sse2", gamepad_batch_decode_sse2, __builtin_cpu_supports("sse2") },
+        { "avx2", gamepad_batch_decode_avx2, __builtin_cpu_supports("avx2") },
+#endif
+#ifdef GAMEPAD_BATCH_NEON
+        { "neon", gamepad_batch_decode_neon, 1 },
+#endif
+    };
+    int num_kernels = (int)(sizeof(kernels) / sizeof(kernels[0]));
+
+    uint8_t *reports = malloc(n * GAMEPAD_REPORT_SIZE);
+    Columns reference, out;
+    if (!reports || columns_alloc(&reference, n) < 0 || columns_alloc(&out, n) < 0) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+    fill_reports(reports, n);
+    gamepad_batch_decode_scalar(reports, n, &reference.cols);
+    gamepad_batch_best(&best_name);
+    printf("%zu reports per batch, gamepad_batch_decode() uses %s\n", n, best_name);
+
+    int failed = 0;
+    for (int k = 0; k < num_kernels; k++) {
+        if (!kernels[k].supported) {
+            printf("%-7s not supported by this CPU\n", kernels[k].name);
+            continue;
+        }
+        columns_clear(&out, n);
+        kernels[k].fn(reports, n, &out.cols);
+        if (!columns_equal(&reference, &out, n)) {
+            printf("%-7s MISMATCH against the scalar kernel\n", kernels[k].name);
+            failed = 1;
+            continue;
+        }
+
+        uint64_t decoded = 0;
+        double start = now_sec(), elapsed;
+        do {
+            for (int rep = 0; rep < 16; rep++) kernels[k].fn(reports, n, &out.cols);
+            decoded += 16 * (uint64_t)n;
+            elapsed = now_sec() - start;
+        } while (elapsed < seconds);
+        printf("%-7s %12.1f Mreports/s %8.2f GB/s of reports\n", kernels[k].name,
+               decoded / elapsed / 1e6, decoded * GAMEPAD_REPORT_SIZE / elapsed / 1e9);
+    }
+
+    columns_free(&reference);
+    columns_free(&out);
+    free(reports);
+    return failed;
+}
@@ -0,0 +1,160 @@
+// Cost of the shared-memory gamepad state (usb-gamepad/gamepad_shm.h)
+// under contention.
+//
+// One writer thread publishes reports as fast as it can while 0, 1, 2, 4 ...
+// reader threads, each with its own read-only mapping of the file like a
+// separate process would have, read the latest state in a tight loop.
+// Prints nanoseconds per publish and per read, and how often a read had
+// to be retried because the writer was in the middle of a store. Every
+// field of a published report is derived from its sequence number, so a
+// reader can check that it never got a mix of two reports (torn). Then
+// the same with the writer paced to 8 kHz, the fastest a USB mouse or pad
+// reports, which is what readers of read_gamepad really see.
+//
+// Usage: bench_gamepad_shm [seconds_per_run] [max_readers] [file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../usb-gamepad/gamepad_shm.h"
+
+#define PACED_INTERVAL_NS 125000ull    // 8 kHz
+
+typedef struct {
+    const char *path;
+    atomic_int *stop;
+    pthread_t thread;
+    uint64_t reads;
+    uint64_t retries;
+    uint64_t torn;
+    uint64_t failed;
+    double seconds;
+} Reader;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void fill_report(GamepadReport *r, uint64_t seq) {
+    memset(r, 0, sizeof(*r));
+    r->length = sizeof(*r);
+    r->dpad_system = (uint8_t)seq;
+    r->buttons = (uint8_t)(seq >> 8);
+    r->trigger_left = (uint8_t)(seq * 3);
+    r->trigger_right = (uint8_t)~r->trigger_left;
+    r->left_x = (int16_t)seq;
+    r->left_y = (int16_t)~seq;
+    r->right_x = (int16_t)(seq >> 16);
+    r->right_y = (int16_t)(seq * 7);
+}
+
+static int state_consistent(const GamepadShmState *st) {
+    GamepadReport expect;
+    if (st->sequence == 0) return 1; // nothing published yet
+    fill_report(&expect, st->sequence);
+    return st->timestamp_ns == st->sequence * 3 && memcmp(&expect, &st->report, sizeof(expect)) == 0;
+}
+
+static void *reader_main(void *arg) {
+    Reader *rd = arg;
+    GamepadShm shm;
+    if (gamepad_shm_open(&shm, rd->path) < 0) {
+        rd->failed = 1;
+        return NULL;
+    }
+    uint64_t t0 = now_ns();
+    while (!atomic_load_explicit(rd->stop, memory_order_relaxed)) {
+        GamepadShmState st;
+        int r = gamepad_shm_read(&shm, &st);
+        if (r < 0) {
+            rd->failed++;
+            continue;
+        }
+        rd->retries += (uint64_t)r;
+        if (!state_consistent(&st)) rd->torn++;
+        rd->reads++;
+    }
+    rd->seconds = (double)(now_ns() - t0) / 1e9;
+    gamepad_shm_unmap(&shm);
+    return NULL;
+}
+
+static int run(const char *path, int readers, double seconds, int paced) {
+    GamepadShm shm;
+    Reader rd[64];
+    atomic_int stop = 0;
+
+    if (gamepad_shm_create(&shm, path) < 0) {
+        fprintf(stderr, "ERROR: Cannot create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < readers; i++) {
+        memset(&rd[i], 0, sizeof(rd[i]));
+        rd[i].path = path;
+        rd[i].stop = &stop;
+        if (pthread_create(&rd[i].thread, NULL, reader_main, &rd[i]) != 0) return -1;
+    }
+
+    GamepadReport report;
+    uint64_t publishes = 0;
+    double busy = 0;
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)(seconds * 1e9);
+    uint64_t next = start;
+    for (uint64_t now = start; now < end; now = now_ns()) {
+        if (paced && now < next) continue; // spin: sleeping would time the scheduler, not the store
+        uint64_t seq = shm.sequence + 1;
+        fill_report(&report, seq);
+        uint64_t t0 = now_ns();
+        gamepad_shm_publish(&shm, &report, seq * 3);
+        busy += (double)(now_ns() - t0);
+        publishes++;
+        next += PACED_INTERVAL_NS;
+    }
+    atomic_store(&stop, 1);
+
+    uint64_t reads = 0, retries = 0, torn = 0, failed = 0;
+    double read_seconds = 0;
+    for (int i = 0; i < readers; i++) {
+        pthread_join(rd[i].thread, NULL);
+        reads += rd[i].reads;
+        retries += rd[i].retries;
+        torn += rd[i].torn;
+        failed += rd[i].failed;
+        read_seconds += rd[i].seconds;
+    }
+    gamepad_shm_close(&shm);
+
+    printf("%-7s %2d readers %10llu publishes %7.1f ns each %12llu reads %7.1f ns each %8.4f%% retried, %llu torn, %llu failed\n",
+           paced ? "8 kHz" : "flat", readers, (unsigned long long)publishes, busy / (double)publishes,
+           (unsigned long long)reads, reads ? read_seconds * 1e9 / (double)reads : 0.0,
+           reads ? 100.0 * (double)retries / (double)reads : 0.0, (unsigned long long)torn, (unsigned long long)failed);
+    return torn || failed ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    int max_readers = argc > 2 ? atoi(argv[2]) : 4;
+    const char *path = argc > 3 ? argv[3] : "/tmp/bench_gamepad_shm.state";
+
+    if (seconds <= 0 || max_readers < 0 || max_readers > 64) {
+        fprintf(stderr, "Usage: %s [seconds_per_run] [max_readers (0..64)] [file]\n", argv[0]);
+        return 1;
+    }
+    printf("state file %s, %zu bytes mapped, %.1f s per run\n", path, sizeof(GamepadShmSegment), seconds);
+
+    int failed = 0;
+    for (int paced = 0; paced <= 1; paced++) {
+        for (int readers = 0; readers <= max_readers; readers = readers ? readers * 2 : 1) {
+            if (run(path, readers, seconds, paced) < 0) failed = 1;
+        }
+    }
+    unlink(path);
+    return failed;
+}
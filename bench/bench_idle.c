@@ -0,0 +1,120 @@
+// Wakeups and CPU time of the tools while their device sends nothing.
+//
+// Runs every command given on the command line with FAKEUSB_IDLE=1 set, so
+// a tool built against common/fakeusb finds a device that NAKs every IN
+// transfer. After a second of startup it reads from /proc how often the
+// command's threads went to sleep and were woken up again (voluntary
+// context switches) and how much CPU time they used over the next few
+// seconds, then stops the command with SIGINT like Ctrl+C would. Output and
+// terminal drawing go to /dev/null.
+//
+// Usage: bench_idle seconds "command args..." ["command args..." ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define STARTUP_SEC 1.0
+
+typedef struct {
+    uint64_t switches;  // voluntary context switches, all threads
+    uint64_t cpu_ns;    // time on the CPU, all threads
+    int threads;
+} ProcSample;
+
+static void sleep_sec(double seconds) {
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (double)(time_t)seconds) * 1e9) };
+    while (nanosleep(&ts, &ts) < 0) {
+    }
+}
+
+static int sample_process(pid_t pid, ProcSample *s) {
+    char path[32];
+    memset(s, 0, sizeof(*s));
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    DIR *dir = opendir(path);
+    if (!dir) return -1;
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        char file[300], line[128];
+        unsigned long long v;
+
+        snprintf(file, sizeof(file), "%s/%s/status", path, e->d_name);
+        FILE *f = fopen(file, "r");
+        if (!f) continue;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "voluntary_ctxt_switches: %llu", &v) == 1) s->switches += v;
+        }
+        fclose(f);
+
+        // First field: nanoseconds spent running.
+        snprintf(file, sizeof(file), "%s/%s/schedstat", path, e->d_name);
+        f = fopen(file, "r");
+        if (f) {
+            if (fscanf(f, "%llu", &v) == 1) s->cpu_ns += v;
+            fclose(f);
+        }
+        s->threads++;
+    }
+    closedir(dir);
+    return 0;
+}
+
+static int run(const char *command, double seconds) {
+    char shell_command[1024];
+    // env: the command may start with VAR=value settings.
+    snprintf(shell_command, sizeof(shell_command), "exec env %s", command);
+
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDWR);
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execl("/bin/sh", "sh", "-c", shell_command, (char *)NULL);
+        _exit(127);
+    }
+
+    ProcSample before, after;
+    int status;
+    sleep_sec(STARTUP_SEC);
+    int r = waitpid(pid, &status, WNOHANG) == 0 ? sample_process(pid, &before) : -1;
+    sleep_sec(seconds);
+    if (r == 0) r = sample_process(pid, &after);
+    if (r == 0) {
+        kill(pid, SIGINT);
+        waitpid(pid, &status, 0);
+    }
+    if (r < 0) {
+        printf("%-44s exited during startup (status %d)\n", command, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        return -1;
+    }
+    printf("%-44s %2d threads %9.1f wakeups/s %9.1f us CPU/s\n", command, after.threads,
+           (double)(after.switches - before.switches) / seconds,
+           (double)(after.cpu_ns - before.cpu_ns) / 1e3 / seconds);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 0;
+    if (argc < 3 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s seconds \"command args...\" [\"command args...\" ...]\n", argv[0]);
+        return 1;
+    }
+    setenv("FAKEUSB_IDLE", "1", 1);
+
+    int failed = 0;
+    for (int i = 2; i < argc; i++) {
+        if (run(argv[i], seconds) < 0) failed = 1;
+    }
+    return failed;
+}
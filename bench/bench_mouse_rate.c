@@ -0,0 +1,168 @@
+// Whether the read_mouse path keeps up with 1 to 8 kHz mice.
+//
+// Runs the simulated mouse of common/fakeusb at 1000, 2000, 4000 and 8000
+// reports per second with wide motion (FAKEUSB_MOUSE_RADIUS, default
+// 100000 counts: ~39 counts per report at 8 kHz, ~314 at 1 kHz) and reads
+// it the way read_mouse does: a queue of interrupt transfers, every report
+// decoded (usb-mouse/mouse_decode.h), added to the sub-cell position
+// (usb-mouse/mouse_motion.h) and timed (usb-mouse/mouse_reader.h). A loop
+// that falls behind leaves report slots without a queued transfer: the
+// fake mouse then folds their motion into a later report, which shows up
+// as fewer reports per second than the rate: "slots read" is the share of
+// the polling slots from the first report to the last that got their own
+// report. Late reports and gap
+// slots count arrival gaps on the host side, which also include reports
+// that were on time but handled late. Also prints the CPU time of the
+// whole process per report (the simulated device included) and the time
+// decode and accumulate take on their own.
+//
+// The queue depth defaults to what read_mouse picks for the rate
+// (mouse_queue_depth(): 8 ms of slots, at least 8).
+//
+// Usage: bench_mouse_rate [seconds_per_rate] [queue_depth]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <libusb-1.0/libusb.h>
+
+#include "../common/fakeusb/fakeusb.h"
+#include "../common/usb_async.h"
+#include "../common/usb_wait.h"
+#include "../usb-mouse/mouse_decode.h"
+#include "../usb-mouse/mouse_reader.h"
+#include "../usb-mouse/mouse_motion.h"
+
+#define ENDPOINT_IN 0x82
+#define PACKET_SIZE 8
+
+typedef struct {
+    MouseLayout layout;         // left invalid: the fake mouse has the fixed 16-bit layout
+    MouseMotion motion;
+    MouseReportStats stats;
+    double first_report;
+} RateRun;
+
+static int on_report(void *user, const unsigned char *data, int len) {
+    RateRun *run = user;
+    MouseReport report;
+    if (decode_mouse_report(&run->layout, data, len, &report) < 0) return 0;
+    mouse_motion_add(&run->motion, report.x, report.y);
+    if (run->first_report == 0) run->first_report = mouse_now_sec();
+    mouse_stats_note(&run->stats, mouse_now_sec(), report.x || report.y, report.x, report.y);
+    return 0;
+}
+
+static double cpu_sec(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (double)ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + (double)ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int run_rate(struct fakeusb_config *cfg, int rate, int depth, double seconds) {
+    libusb_context *context = NULL;
+    libusb_device_handle *handle = NULL;
+    usb_async_queue q = {0};
+    UsbWait wait;
+    RateRun run;
+
+    cfg->report_interval_us = 1000000u / (unsigned int)rate;
+    if (depth == 0) depth = mouse_queue_depth((int)cfg->report_interval_us);
+    fakeusb_configure(cfg);
+    if (libusb_init(&context) < 0 || libusb_wrap_sys_device(context, 0, &handle) < 0 ||
+        usb_wait_init(&wait, context) < 0) {
+        fprintf(stderr, "ERROR: fake transport init failed\n");
+        return -1;
+    }
+    memset(&run, 0, sizeof(run));
+    mouse_motion_init(&run.motion, 40, 20, 1000.0);
+    run.stats.interval_us = (int)cfg->report_interval_us;
+
+    double cpu0 = cpu_sec();
+    double start = mouse_now_sec();
+    if (usb_async_start(&q, handle, ENDPOINT_IN, LIBUSB_TRANSFER_TYPE_INTERRUPT, depth, PACKET_SIZE, 0, on_report, &run) < 0) {
+        fprintf(stderr, "ERROR: usb_async_start failed\n");
+        return -1;
+    }
+    double now;
+    while ((now = mouse_now_sec()) < start + seconds && !q.stopped) {
+        usb_wait_events(&wait, (long)((start + seconds - now) * 1e6));
+    }
+    double elapsed = mouse_now_sec() - start;
+    double cpu = cpu_sec() - cpu0;
+    usb_async_cancel(&q, context);
+
+    double slots = (run.stats.last_report - run.first_report) * rate + 1.0;
+    printf("%5d Hz %3d queued %9.0f reports/s %6.2f%% slots read %7llu late %7llu gap slots %5llu underruns %7.2f us CPU per report\n",
+           rate, depth, run.stats.reports / elapsed, run.stats.reports ? 100.0 * (double)run.stats.reports / slots : 0.0,
+           (unsigned long long)run.stats.late,
+           (unsigned long long)run.stats.gap_slots, (unsigned long long)q.underruns,
+           run.stats.reports ? cpu * 1e6 / (double)run.stats.reports : 0.0);
+
+    usb_async_free(&q);
+    usb_wait_close(&wait);
+    libusb_close(handle);
+    libusb_exit(context);
+    return 0;
+}
+
+// Decode and accumulate only, on reports with deltas of every size.
+static void time_decode(void) {
+    enum { N = 4096, ROUNDS = 2000 };
+    static unsigned char reports[N][PACKET_SIZE];
+    MouseLayout layout;
+    MouseMotion motion;
+    uint32_t seed = 1;
+
+    memset(&layout, 0, sizeof(layout));
+    for (int i = 0; i < N; i++) {
+        seed = seed * 1103515245u + 12345u;
+        int16_t dx = (int16_t)(seed >> 16);
+        int16_t dy = (int16_t)((int32_t)(seed >> 8) % 2000 - 1000);
+        unsigned char *r = reports[i];
+        r[0] = 0x02;
+        r[1] = (unsigned char)(seed & 7);
+        r[2] = (unsigned char)dx; r[3] = (unsigned char)(dx >> 8);
+        r[4] = (unsigned char)dy; r[5] = (unsigned char)(dy >> 8);
+        r[6] = (unsigned char)(i % 3 - 1);
+        r[7] = 0;
+    }
+    mouse_motion_init(&motion, 40, 20, 1000.0);
+
+    double t0 = mouse_now_sec();
+    uint32_t check = 0;
+    for (int k = 0; k < ROUNDS; k++) {
+        for (int i = 0; i < N; i++) {
+            MouseReport report;
+            decode_mouse_report(&layout, reports[i], PACKET_SIZE, &report);
+            mouse_motion_add(&motion, report.x, report.y);
+            check += (uint32_t)report.wheel + (uint32_t)motion.x;
+        }
+    }
+    double elapsed = mouse_now_sec() - t0;
+    printf("decode + accumulate: %.1f ns per report (check %08x)\n", elapsed / ((double)N * ROUNDS) * 1e9, check);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int depth = argc > 2 ? atoi(argv[2]) : 0;
+    static const int rates[] = { 1000, 2000, 4000, 8000 };
+    struct fakeusb_config cfg;
+
+    if (seconds <= 0 || depth < 0) {
+        fprintf(stderr, "Usage: %s [seconds_per_rate] [queue_depth]\n", argv[0]);
+        return 1;
+    }
+    fakeusb_default_config(&cfg);
+    cfg.device = FAKEUSB_DEVICE_MOUSE;
+    cfg.num_devices = 0;
+    if (!getenv("FAKEUSB_MOUSE_RADIUS")) cfg.mouse_radius = 100000.0;
+    printf("fake mouse: circle of %.0f counts every 2 s, %.1f s per rate\n", cfg.mouse_radius, seconds);
+
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        if (run_rate(&cfg, rates[i], depth, seconds) < 0) return 1;
+    }
+    time_decode();
+    return 0;
+}
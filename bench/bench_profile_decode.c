@@ -0,0 +1,247 @@
+// Generic against profile-specialised report decoding.
+//
+// For every device with a specialised decoder (usb-mouse/mouse_profiles.h,
+// usb-gamepad/gamepad_profiles.h) this compiles the report descriptor the
+// way the tools do, checks that the profile agrees with it, then decodes
+// the same buffer of random reports with the generic path and with the
+// specialised one and prints nanoseconds per report for both. The outputs
+// are compared report by report first, including every truncated length
+// and a wrong report ID, so a specialised decoder that is fast because it
+// is wrong fails the run.
+//
+// The mouse descriptor is read from the simulated Logitech receiver of
+// common/fakeusb. The DualShock 4 is not simulated; its descriptor below
+// is written out by hand with the input report layout of a USB DS4.
+//
+// Usage: bench_profile_decode [seconds_per_run] [reports]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libusb-1.0/libusb.h>
+
+#include "../common/fakeusb/fakeusb.h"
+#include "../common/hid_parser.h"
+#include "../usb-mouse/mouse_profiles.h"
+#include "../usb-gamepad/gamepad_profiles.h"
+
+#define MOUSE_REPORT 8
+#define PAD_REPORT 64
+
+// Input report 1 of a DualShock 4 on USB, up to the triggers.
+static const uint8_t ds4_report_desc[] = {
+    0x05, 0x01, 0x09, 0x05, 0xa1, 0x01,             // Usage Page (Generic Desktop), Usage (Gamepad), Collection (Application)
+    0x85, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x32, //   Report ID (1), Usage (X), Usage (Y), Usage (Z)
+    0x09, 0x35, 0x15, 0x00, 0x26, 0xff, 0x00,       //   Usage (Rz), Logical Minimum (0), Logical Maximum (255)
+    0x75, 0x08, 0x95, 0x04, 0x81, 0x02,             //   Report Size (8), Report Count (4), Input (Data, Variable, Absolute)
+    0x09, 0x39, 0x15, 0x00, 0x25, 0x07, 0x35, 0x00, //   Usage (Hat switch), Logical Minimum (0), Logical Maximum (7), Physical Minimum (0)
+    0x46, 0x3b, 0x01, 0x65, 0x14,                   //   Physical Maximum (315), Unit (Degrees)
+    0x75, 0x04, 0x95, 0x01, 0x81, 0x42,             //   Report Size (4), Report Count (1), Input (Data, Variable, Absolute, Null State)
+    0x65, 0x00, 0x05, 0x09, 0x19, 0x01, 0x29, 0x0e, //   Unit (None), Usage Page (Button), Usage Minimum (1), Usage Maximum (14)
+    0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x0e, //   Logical Minimum (0), Logical Maximum (1), Report Size (1), Report Count (14)
+    0x81, 0x02,                                     //   Input (Data, Variable, Absolute)
+    0x06, 0x00, 0xff, 0x09, 0x20, 0x75, 0x06,       //   Usage Page (Vendor), Usage (0x20), Report Size (6)
+    0x95, 0x01, 0x15, 0x00, 0x25, 0x7f, 0x81, 0x02, //   Report Count (1), Logical Minimum (0), Logical Maximum (127), Input
+    0x05, 0x01, 0x09, 0x33, 0x09, 0x34,             //   Usage Page (Generic Desktop), Usage (Rx), Usage (Ry)
+    0x15, 0x00, 0x26, 0xff, 0x00,                   //   Logical Minimum (0), Logical Maximum (255)
+    0x75, 0x08, 0x95, 0x02, 0x81, 0x02,             //   Report Size (8), Report Count (2), Input (Data, Variable, Absolute)
+    0xc0,                                           // End Collection
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void fill_random(uint8_t *buf, size_t n, uint8_t report_id, size_t report_size) {
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        buf[i] = (uint8_t)(seed >> 16);
+    }
+    for (size_t i = 0; i < n; i += report_size) buf[i] = report_id;
+}
+
+// The mouse layout as read_mouse compiles it from the fake receiver.
+static int mouse_descriptor_layout(MouseLayout *layout) {
+    struct fakeusb_config cfg;
+    libusb_context *context = NULL;
+    libusb_device_handle *handle = NULL;
+    uint8_t desc[512];
+    HidPlan plan;
+
+    fakeusb_default_config(&cfg);
+    cfg.device = FAKEUSB_DEVICE_MOUSE;
+    cfg.num_devices = 0;
+    fakeusb_configure(&cfg);
+    if (libusb_init(&context) < 0 || libusb_wrap_sys_device(context, 0, &handle) < 0) return -1;
+    const UsbProfile *p = usb_profile_find(handle, USB_KIND_MOUSE);
+    int len = hid_get_report_descriptor(handle, p->interface, desc, sizeof(desc));
+    libusb_close(handle);
+    libusb_exit(context);
+    if (p->id != USB_PROFILE_LOGITECH_C534 || len <= 0 || hid_plan_compile(&plan, desc, len) <= 0) return -1;
+    return mouse_layout_from_plan(layout, &plan);
+}
+
+static int mouse_same(int ra, const MouseReport *a, int rb, const MouseReport *b) {
+    if (ra != rb) return 0;
+    return ra < 0 || memcmp(a, b, sizeof(*a)) == 0;
+}
+
+static int run_mouse(double seconds, size_t reports) {
+    MouseLayout generic;
+    MouseDecoder decoder;
+    if (mouse_descriptor_layout(&generic) < 0) {
+        fprintf(stderr, "ERROR: No mouse layout from the fake receiver\n");
+        return -1;
+    }
+    mouse_decoder_select(&decoder, &usb_profiles[USB_PROFILE_LOGITECH_C534], &generic);
+    if (decoder.profile != USB_PROFILE_LOGITECH_C534) return -1;
+
+    size_t bytes = reports * MOUSE_REPORT;
+    uint8_t *buf = malloc(bytes);
+    if (!buf) return -1;
+    fill_random(buf, bytes, 2, MOUSE_REPORT);
+
+    // Same result for every report, every length and a foreign report ID.
+    size_t mismatches = 0;
+    for (size_t i = 0; i < reports; i++) {
+        uint8_t *r = buf + i * MOUSE_REPORT;
+        for (size_t len = 0; len <= MOUSE_REPORT; len++) {
+            MouseReport a, b;
+            memset(&a, 0xa5, sizeof(a));
+            memset(&b, 0xa5, sizeof(b));
+            int ra = decode_mouse_report(&generic, r, len, &a);
+            int rb = mouse_decoder_run(&decoder, r, len, &b);
+            if (!mouse_same(ra, &a, rb, &b)) mismatches++;
+        }
+        r[0] = 3;
+        MouseReport a, b;
+        if (!mouse_same(decode_mouse_report(&generic, r, MOUSE_REPORT, &a), &a,
+                        mouse_decoder_run(&decoder, r, MOUSE_REPORT, &b), &b)) {
+            mismatches++;
+        }
+        r[0] = 2;
+    }
+
+    double ns[2];
+    for (int specialised = 0; specialised <= 1; specialised++) {
+        uint32_t check = 0, first_pass = 0;
+        size_t decoded = 0;
+        double t0 = now_sec(), elapsed;
+        do {
+            for (size_t i = 0; i < reports; i++) {
+                MouseReport m = {0};
+                const uint8_t *r = buf + i * MOUSE_REPORT;
+                if (specialised) {
+                    mouse_decoder_run(&decoder, r, MOUSE_REPORT, &m);
+                } else {
+                    decode_mouse_report(&generic, r, MOUSE_REPORT, &m);
+                }
+                check += (uint32_t)(m.buttons + m.x * 3 + m.y * 5 + m.wheel * 7 + m.hwheel * 11);
+            }
+            if (decoded == 0) first_pass = check;
+            decoded += reports;
+            elapsed = now_sec() - t0;
+        } while (elapsed < seconds);
+        ns[specialised] = elapsed * 1e9 / (double)decoded;
+        printf("%-14s %-11s %7.2f ns per report %6.1f M reports/s (sum %08x)\n", "LOGITECH_C534",
+               specialised ? "specialised" : "generic", ns[specialised], (double)decoded / elapsed / 1e6, first_pass);
+    }
+    printf("%-14s %.2fx, %zu mismatches\n", "LOGITECH_C534", ns[0] / ns[1], mismatches);
+    free(buf);
+    return mismatches ? -1 : 0;
+}
+
+static int pad_same(int ra, const GamepadReport *a, int rb, const GamepadReport *b) {
+    if (ra != rb) return 0;
+    return ra < 0 || memcmp(a, b, sizeof(*a)) == 0;
+}
+
+static int run_pad(double seconds, size_t reports) {
+    HidPlan plan;
+    GamepadLayout generic;
+    GamepadDecoder decoder;
+    if (hid_plan_compile(&plan, ds4_report_desc, sizeof(ds4_report_desc)) <= 0 ||
+        gamepad_layout_from_plan(&generic, &plan) < 0) {
+        fprintf(stderr, "ERROR: The DualShock 4 descriptor does not compile\n");
+        return -1;
+    }
+    gamepad_decoder_select(&decoder, &usb_profiles[USB_PROFILE_DUALSHOCK4], &generic);
+    if (decoder.profile != USB_PROFILE_DUALSHOCK4) return -1;
+
+    size_t bytes = reports * PAD_REPORT;
+    uint8_t *buf = malloc(bytes);
+    if (!buf) return -1;
+    fill_random(buf, bytes, 1, PAD_REPORT);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < reports; i++) {
+        uint8_t *r = buf + i * PAD_REPORT;
+        for (int len = 0; len <= 12; len++) {
+            GamepadReport a, b;
+            memset(&a, 0xa5, sizeof(a));
+            memset(&b, 0xa5, sizeof(b));
+            int ra = gamepad_translate_report(&generic, r, len, &a);
+            int rb = gamepad_decoder_run(&decoder, r, len, &b);
+            if (!pad_same(ra, &a, rb, &b)) mismatches++;
+        }
+        GamepadReport a, b;
+        if (!pad_same(gamepad_translate_report(&generic, r, PAD_REPORT, &a), &a,
+                      gamepad_decoder_run(&decoder, r, PAD_REPORT, &b), &b)) {
+            mismatches++;
+        }
+        r[0] = 2;
+        if (!pad_same(gamepad_translate_report(&generic, r, PAD_REPORT, &a), &a,
+                      gamepad_decoder_run(&decoder, r, PAD_REPORT, &b), &b)) {
+            mismatches++;
+        }
+        r[0] = 1;
+    }
+
+    double ns[2];
+    for (int specialised = 0; specialised <= 1; specialised++) {
+        uint32_t check = 0, first_pass = 0;
+        size_t decoded = 0;
+        double t0 = now_sec(), elapsed;
+        do {
+            for (size_t i = 0; i < reports; i++) {
+                GamepadReport g = {0};
+                const uint8_t *r = buf + i * PAD_REPORT;
+                if (specialised) {
+                    gamepad_decoder_run(&decoder, r, PAD_REPORT, &g);
+                } else {
+                    gamepad_translate_report(&generic, r, PAD_REPORT, &g);
+                }
+                check += (uint32_t)(g.dpad_system + g.buttons * 3 + g.trigger_left * 5 + g.trigger_right * 7 +
+                                    g.left_x * 11 + g.left_y * 13 + g.right_x * 17 + g.right_y * 19);
+            }
+            if (decoded == 0) first_pass = check;
+            decoded += reports;
+            elapsed = now_sec() - t0;
+        } while (elapsed < seconds);
+        ns[specialised] = elapsed * 1e9 / (double)decoded;
+        printf("%-14s %-11s %7.2f ns per report %6.1f M reports/s (sum %08x)\n", "DUALSHOCK4",
+               specialised ? "specialised" : "generic", ns[specialised], (double)decoded / elapsed / 1e6, first_pass);
+    }
+    printf("%-14s %.2fx, %zu mismatches\n", "DUALSHOCK4", ns[0] / ns[1], mismatches);
+    free(buf);
+    return mismatches ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    long reports = argc > 2 ? atol(argv[2]) : 4096;
+
+    if (seconds <= 0 || reports < 1) {
+        fprintf(stderr, "Usage: %s [seconds_per_run] [reports]\n", argv[0]);
+        return 1;
+    }
+    printf("%ld random reports per device, %.1f s per run\n", reports, seconds);
+    int failed = 0;
+    if (run_mouse(seconds, (size_t)reports) < 0) failed = 1;
+    if (run_pad(seconds, (size_t)reports) < 0) failed = 1;
+    return failed;
+}
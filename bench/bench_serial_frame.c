@@ -0,0 +1,290 @@
+// Throughput of the serial framing stage.
+//
+// Builds a synthetic stream of a few MB for each mode of
+// usb-serial/serial_framer.h (text lines, COBS frames, SLIP frames with
+// escapes), cuts it into chunks of one USB packet and of one async
+// transfer, and frames it with every delimiter scan kernel the CPU supports.
+// The reference is the usual byte-at-a-time state machine that copies each
+// message into its own buffer; every kernel's messages are checked against
+// it first. Prints MB/s of stream and millions of messages per second.
+//
+// Usage: bench_serial_frame [megabytes] [seconds_per_kernel]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../usb-serial/serial_framer.h"
+
+#define MAX_MESSAGE 1024
+
+typedef struct {
+    const char *name;
+    serial_framer_split_fn split; // NULL: byte-at-a-time reference
+    int supported;
+} Kernel;
+
+// What the consumer saw; equal sums mean the same messages in the same order.
+typedef struct {
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t hash;
+} Digest;
+
+// Byte-at-a-time framing with a copy of every message.
+typedef struct {
+    SerialFrameMode mode;
+    unsigned char msg[MAX_MESSAGE];
+    size_t len;
+    int code;     // COBS: bytes left in the current group, 0 at a code byte
+    int last;     // COBS: the group code, SLIP: previous byte was ESC
+    int bad;
+    Digest *digest;
+} Bytewise;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int digest_message(void *user, const unsigned char *msg, size_t len) {
+    Digest *d = user;
+    d->messages++;
+    d->bytes += len;
+    d->hash = d->hash * 31 + len + (len ? msg[0] * 7u + msg[len - 1] : 0);
+    return 0;
+}
+
+static void bytewise_end(Bytewise *b) {
+    if (!b->bad && !(b->mode != SERIAL_FRAME_LINES && b->len == 0 && b->last == 0)) {
+        if (b->mode == SERIAL_FRAME_LINES && b->len && b->msg[b->len - 1] == '\r') b->len--;
+        digest_message(b->digest, b->msg, b->len);
+    }
+    b->len = 0;
+    b->code = 0;
+    b->last = 0;
+    b->bad = 0;
+}
+
+static void bytewise_put(Bytewise *b, unsigned char c) {
+    if (b->len == MAX_MESSAGE) b->bad = 1;
+    else b->msg[b->len++] = c;
+}
+
+static void bytewise_feed(Bytewise *b, const unsigned char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = data[i];
+        switch (b->mode) {
+            case SERIAL_FRAME_LINES:
+                if (c == '\n') bytewise_end(b);
+                else bytewise_put(b, c);
+                break;
+            case SERIAL_FRAME_COBS:
+                if (c == 0) {
+                    if (b->code) b->bad = 1;
+                    bytewise_end(b);
+                } else if (b->code == 0) {
+                    if (b->last && b->last < 0xff) bytewise_put(b, 0);
+                    b->last = c;
+                    b->code = c - 1;
+                } else {
+                    bytewise_put(b, c);
+                    b->code--;
+                }
+                break;
+            case SERIAL_FRAME_SLIP:
+                if (c == SLIP_END) {
+                    if (b->last) b->bad = 1;
+                    if (b->len || b->bad) bytewise_end(b);
+                    b->last = 0;
+                    b->bad = 0;
+                } else if (b->last) {
+                    b->last = 0;
+                    if (c == SLIP_ESC_END) bytewise_put(b, SLIP_END);
+                    else if (c == SLIP_ESC_ESC) bytewise_put(b, SLIP_ESC);
+                    else b->bad = 1;
+                } else if (c == SLIP_ESC) {
+                    b->last = 1;
+                } else {
+                    bytewise_put(b, c);
+                }
+                break;
+        }
+    }
+}
+
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 16;
+}
+
+// Messages of 8..120 bytes until `size` bytes of stream: printable text for
+// lines, random bytes with plenty of 0x00, END and ESC for COBS and SLIP.
+static size_t fill_stream(SerialFrameMode mode, unsigned char *buf, size_t size) {
+    uint32_t seed = 12345;
+    size_t len = 0;
+    for (;;) {
+        unsigned char msg[120];
+        size_t n = 8 + next_random(&seed) % 113;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t r = next_random(&seed);
+            if (mode == SERIAL_FRAME_LINES) msg[i] = (unsigned char)(' ' + r % 95);
+            else if (r % 8 == 0) msg[i] = (unsigned char)(r & 0x100 ? 0x00 : r & 0x200 ? SLIP_END : SLIP_ESC);
+            else msg[i] = (unsigned char)r;
+        }
+        if (len + 2 * n + 2 > size) break;
+
+        unsigned char *out = buf + len;
+        if (mode == SERIAL_FRAME_LINES) {
+            memcpy(out, msg, n);
+            out[n] = '\n';
+            len += n + 1;
+        } else if (mode == SERIAL_FRAME_COBS) {
+            size_t o = 1, code_at = 0;
+            for (size_t i = 0; i < n; i++) {
+                if (msg[i] == 0) {
+                    out[code_at] = (unsigned char)(o - code_at);
+                    code_at = o++;
+                } else {
+                    out[o++] = msg[i];
+                }
+            }
+            out[code_at] = (unsigned char)(o - code_at);
+            out[o++] = 0;
+            len += o;
+        } else {
+            size_t o = 0;
+            out[o++] = SLIP_END;
+            for (size_t i = 0; i < n; i++) {
+                if (msg[i] == SLIP_END) {
+                    out[o++] = SLIP_ESC;
+                    out[o++] = SLIP_ESC_END;
+                } else if (msg[i] == SLIP_ESC) {
+                    out[o++] = SLIP_ESC;
+                    out[o++] = SLIP_ESC_ESC;
+                } else {
+                    out[o++] = msg[i];
+                }
+            }
+            out[o++] = SLIP_END;
+            len += o;
+        }
+    }
+    return len;
+}
+
+// One pass over `work` (a fresh copy of the stream: decoding is in place)
+// in chunks of `chunk` bytes.
+static void run_pass(const Kernel *k, SerialFrameMode mode, unsigned char *work, size_t len, size_t chunk,
+                     Digest *digest, SerialFramer *framer, Bytewise *bytewise) {
+    if (!k->split) {
+        memset(bytewise, 0, sizeof(*bytewise));
+        bytewise->mode = mode;
+        bytewise->digest = digest;
+        for (size_t off = 0; off < len; off += chunk) {
+            bytewise_feed(bytewise, work + off, len - off < chunk ? len - off : chunk);
+        }
+        return;
+    }
+    framer->split = k->split;
+    for (size_t off = 0; off < len; off += chunk) {
+        serial_framer_feed(framer, work + off, len - off < chunk ? len - off : chunk);
+    }
+    serial_framer_finish(framer);
+}
+
+int main(int argc, char **argv) {
+    double megabytes = argc > 1 ? atof(argv[1]) : 8;
+    double seconds = argc > 2 ? atof(argv[2]) : 0.5;
+    const SerialFrameMode modes[] = { SERIAL_FRAME_LINES, SERIAL_FRAME_COBS, SERIAL_FRAME_SLIP };
+    const size_t chunks[] = { 64, 16384 };
+    const char *best_name;
+
+    Kernel kernels[] = {
+        { "bytewise", NULL, 1 },
+        { "memchr", serial_framer_split_scalar, 1 },
+#ifdef SERIAL_FRAMER_X86
+        { "sse2", serial_framer_split_sse2, __builtin_cpu_supports("sse2") },
+        { "avx2", serial_framer_split_avx2, __builtin_cpu_supports("avx2") },
+#endif
+#ifdef SERIAL_FRAMER_NEON
+        { "neon", serial_framer_split_neon, 1 },
+#endif
+    };
+    int num_kernels = (int)(sizeof(kernels) / sizeof(kernels[0]));
+
+    size_t size = (size_t)(megabytes * 1e6);
+    if (size < 4096 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s [megabytes] [seconds_per_kernel]\n", argv[0]);
+        return 1;
+    }
+    unsigned char *stream = malloc(size);
+    unsigned char *work = malloc(size);
+    Bytewise *bytewise = malloc(sizeof(*bytewise));
+    if (!stream || !work || !bytewise) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+    serial_framer_best(&best_name);
+    printf("serial_framer_feed() uses %s\n", best_name);
+
+    int failed = 0;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        size_t len = fill_stream(modes[m], stream, size);
+        for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+            Digest reference = {0};
+            printf("%s, %.1f MB stream in %zu byte chunks\n", serial_frame_mode_name(modes[m]), len / 1e6, chunks[c]);
+
+            for (int k = 0; k < num_kernels; k++) {
+                if (!kernels[k].supported) {
+                    printf("  %-9s not supported by this CPU\n", kernels[k].name);
+                    continue;
+                }
+                Digest digest = {0};
+                SerialFramer framer;
+                if (serial_framer_init(&framer, modes[m], MAX_MESSAGE, digest_message, &digest) < 0) {
+                    fprintf(stderr, "ERROR: out of memory\n");
+                    return 1;
+                }
+
+                memcpy(work, stream, len);
+                run_pass(&kernels[k], modes[m], work, len, chunks[c], &digest, &framer, bytewise);
+                if (k == 0) {
+                    reference = digest;
+                } else if (memcmp(&digest, &reference, sizeof(digest)) != 0) {
+                    printf("  %-9s MISMATCH against the bytewise reference (%llu messages, expected %llu)\n",
+                           kernels[k].name, (unsigned long long)digest.messages,
+                           (unsigned long long)reference.messages);
+                    failed = 1;
+                    serial_framer_free(&framer);
+                    continue;
+                }
+                uint64_t carried_bytes = framer.carried_bytes;
+
+                uint64_t bytes = 0, messages = 0;
+                double elapsed = 0;
+                do {
+                    memcpy(work, stream, len);
+                    digest.messages = 0;
+                    double t0 = now_sec();
+                    run_pass(&kernels[k], modes[m], work, len, chunks[c], &digest, &framer, bytewise);
+                    elapsed += now_sec() - t0;
+                    bytes += len;
+                    messages += digest.messages;
+                } while (elapsed < seconds);
+                // Bytes copied per pass: every byte for the reference, only messages cut by a chunk boundary here.
+                printf("  %-9s %9.1f MB/s %8.2f Mmessages/s %6.1f%% of the stream copied\n", kernels[k].name,
+                       bytes / elapsed / 1e6, messages / elapsed / 1e6,
+                       k == 0 ? 100.0 : 100.0 * (double)carried_bytes / (double)len);
+                serial_framer_free(&framer);
+            }
+        }
+    }
+
+    free(stream);
+    free(work);
+    free(bytewise);
+    return failed;
+}
@@ -0,0 +1,79 @@
+// Throughput of the read_serial bulk loops against the fake transport.
+//
+// Compares the original one-packet-at-a-time loop (serial_read_sync) with
+// the queued async reader (serial_read_async) at several queue depths and
+// transfer sizes. The fake device models a fixed per-URB turnaround and a
+// shared bus bandwidth, see common/fakeusb/fakeusb.h.
+//
+// Usage: bench_serial_read [seconds_per_run]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <libusb-1.0/libusb.h>
+
+#include "../common/fakeusb/fakeusb.h"
+#include "../usb-serial/serial_reader.h"
+
+#define ENDPOINT_IN 0x83
+#define PACKET_SIZE 64
+
+typedef struct {
+    double deadline;
+} RunLimit;
+
+static int stop_at_deadline(void *user, const unsigned char *data, int len) {
+    RunLimit *limit = user;
+    (void)data;
+    (void)len;
+    return serial_now_sec() >= limit->deadline;
+}
+
+static void report(const char *name, int depth, int size, const SerialReadStats *stats) {
+    printf("%-6s depth=%-3d size=%-6d %10llu bytes %8llu transfers %8.3f MB/s\n",
+           name, depth, size, (unsigned long long)stats->bytes,
+           (unsigned long long)stats->transfers, serial_stats_mb_per_sec(stats));
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    struct fakeusb_config cfg;
+    libusb_context *context = NULL;
+    libusb_device_handle *handle = NULL;
+    UsbWait wait;
+
+    fakeusb_default_config(&cfg);
+    fakeusb_configure(&cfg);
+    printf("fake transport: latency %u us, bandwidth %.0f B/s, wMaxPacketSize %d\n",
+           cfg.latency_us, cfg.bytes_per_sec, cfg.max_packet_size);
+
+    if (libusb_init(&context) < 0 || libusb_wrap_sys_device(context, 0, &handle) < 0 ||
+        usb_wait_init(&wait, context) < 0) {
+        fprintf(stderr, "ERROR: fake transport init failed\n");
+        return 1;
+    }
+
+    RunLimit limit;
+    SerialReadStats stats = {0};
+    SerialReadHandler handler = { stop_at_deadline, NULL, &limit, NULL, NULL };
+
+    limit.deadline = serial_now_sec() + seconds;
+    serial_read_sync(handle, ENDPOINT_IN, PACKET_SIZE, SERIAL_QUIET_MS, &handler, &stats);
+    report("sync", 1, PACKET_SIZE, &stats);
+
+    static const int depths[] = { 1, 2, 4, 8, 16 };
+    static const int sizes[] = { 512, 4096, 16384 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+            SerialReadStats astats = {0};
+            int size = serial_round_transfer_size(sizes[s], cfg.max_packet_size);
+            limit.deadline = serial_now_sec() + seconds;
+            serial_read_async(&wait, handle, ENDPOINT_IN, depths[d], size, SERIAL_QUIET_MS, &handler, &astats);
+            report("async", depths[d], size, &astats);
+        }
+    }
+
+    usb_wait_close(&wait);
+    libusb_close(handle);
+    libusb_exit(context);
+    return 0;
+}
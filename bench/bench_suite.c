@@ -0,0 +1,366 @@
+// Decode and render microbenchmarks with diffable JSON results.
+//
+// Runs every per-report function of the tools on a synthetic corpus and
+// prints one JSON object per benchmark: nanoseconds per op, ops (reports
+// or chunks) per second and bytes per second in and out. Decoders write
+// no output and run once ("sink": "none"). Renderers run with their output
+// on /dev/null, which is the cost of formatting and of the write() calls,
+// and on a pipe drained by another thread, which adds the copy into the
+// pipe and the wakeups of a terminal or consumer reading it.
+//
+// Every benchmark first makes one check pass. Decoders hash their output
+// structs and renderers hash what came out of the pipe (FNV-1a), so
+// "checksum" and "out_bytes" only change if the output does; decoders of the
+// same corpus, generic and specialised, print the same checksum. The corpus,
+// the op counts and the clock the tools are given are fixed, so those
+// fields are the same on every run. The timing fields are the median of
+// several passes. The renderers are the tools' own code, compiled in from
+// their main files (bench_suite.h).
+//
+//   read_mouse.draw_ui                    apply_report() + draw_ui(), a frame for every report
+//   read_gamepad.interpret_gamepad_report the screen of a pad whose sticks move on every report
+//   read_gamepad.events_text              the same reports through -e text events
+//   read_serial.sink_chunk                64-byte bulk packets of text through the output sink
+//
+// Usage: bench_suite [repeats] [scale]
+//   repeats: timed passes per benchmark and sink (default 5); scale multiplies the op counts.
+//   bench/bench_suite_diff.sh compares two result files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../usb-mouse/mouse_profiles.h"
+#include "../usb-gamepad/gamepad_profiles.h"
+#include "bench_suite.h"
+
+#define MAX_REPEATS 31
+#define CORPUS_REPORTS 4096
+#define MOUSE_REPORT 8
+#define PAD_REPORT 20
+#define DS4_REPORT 64
+#define SERIAL_CHUNK 64
+#define REPORT_INTERVAL_NS 125000ull   // synthetic clock: 8 kHz
+
+enum { SINK_NONE, SINK_DEVNULL, SINK_PIPE };
+static const char *const sink_names[] = { "none", "devnull", "pipe" };
+
+typedef struct {
+    const char *name;
+    int renders;                // 0: decoder, no output
+    size_t in_size;             // input bytes per op
+    unsigned long ops;          // per pass, before scaling
+    void (*reset)(void);
+    uint64_t (*pass)(unsigned long ops, int hash);  // returns the output hash if `hash`
+} Bench;
+
+static uint8_t mouse_corpus[CORPUS_REPORTS][MOUSE_REPORT];     // wide random motion
+static uint8_t motion_corpus[CORPUS_REPORTS][MOUSE_REPORT];    // a hand moving the mouse
+static uint8_t pad_corpus[CORPUS_REPORTS][PAD_REPORT];
+static uint8_t ds4_corpus[CORPUS_REPORTS][DS4_REPORT];
+static uint8_t serial_corpus[CORPUS_REPORTS][SERIAL_CHUNK];
+
+static MouseLayout mouse_layout;
+static MouseDecoder mouse_decoder;
+static GamepadLayout ds4_layout;
+static GamepadDecoder ds4_decoder;
+
+static volatile uint64_t keep;  // timed decoder passes store their sum here
+static FILE *json;              // the real stdout: fds 1 and 2 point at the sink during a pass
+static FILE *diag;
+static int results_printed;     // a separator goes before every result but the first
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+#define FNV_SEED 0xcbf29ce484222325ull
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+static void build_corpora(void) {
+    uint32_t seed = 1;
+    for (int i = 0; i < CORPUS_REPORTS; i++) {
+        uint8_t *r = mouse_corpus[i];
+        for (int b = 0; b < MOUSE_REPORT; b++) r[b] = (uint8_t)next_random(&seed);
+        r[0] = 2;
+
+        // A few counts per report, a button held now and then, wheel clicks.
+        int dx = (int)(next_random(&seed) % 5) - 2, dy = (int)(next_random(&seed) % 5) - 2;
+        r = motion_corpus[i];
+        memset(r, 0, MOUSE_REPORT);
+        r[0] = 2;
+        r[1] = (i / 256) % 4 == 1 ? 0x01 : (i / 256) % 4 == 3 ? 0x02 : 0x00;
+        r[2] = (uint8_t)dx; r[3] = (uint8_t)(dx >> 8);
+        r[4] = (uint8_t)dy; r[5] = (uint8_t)(dy >> 8);
+        r[6] = i % 64 == 0 ? 0x01 : i % 64 == 32 ? 0xff : 0x00;
+
+        // Sticks sweeping, a trigger ramp, a button every 16 reports.
+        r = pad_corpus[i];
+        memset(r, 0, PAD_REPORT);
+        r[1] = PAD_REPORT;
+        r[2] = (uint8_t)((i / 16) % 2 ? DPAD_UP : 0);
+        r[3] = (uint8_t)((i / 16) % 3 == 1 ? BTN_A : 0);
+        r[4] = (uint8_t)(i & 0xff);
+        int16_t axes[4] = { (int16_t)(i * 16), (int16_t)(-i * 16), (int16_t)(next_random(&seed) & 0x0fff), (int16_t)(i * 7) };
+        for (int a = 0; a < 4; a++) {
+            r[6 + 2 * a] = (uint8_t)axes[a];
+            r[7 + 2 * a] = (uint8_t)(axes[a] >> 8);
+        }
+
+        r = ds4_corpus[i];
+        for (int b = 0; b < DS4_REPORT; b++) r[b] = (uint8_t)next_random(&seed);
+        r[0] = 1;
+
+        // Text lines as a board would print them.
+        char line[SERIAL_CHUNK + 1];
+        snprintf(line, sizeof(line), "t=%010d adc=%04u,%04u,%04u,%04u status=ok seq=%08d\n", i * 125,
+                 next_random(&seed) % 4096, next_random(&seed) % 4096, next_random(&seed) % 4096,
+                 next_random(&seed) % 4096, i);
+        memset(serial_corpus[i], ' ', SERIAL_CHUNK);
+        memcpy(serial_corpus[i], line, strlen(line) < SERIAL_CHUNK ? strlen(line) : SERIAL_CHUNK);
+        serial_corpus[i][SERIAL_CHUNK - 1] = '\n';
+    }
+}
+
+/* ---------------- decoders ---------------- */
+
+#define DECODE_PASS(fn, corpus, size, Out, call) \
+    static uint64_t fn(unsigned long ops, int hash) { \
+        uint64_t h = FNV_SEED, sum = 0; \
+        for (unsigned long i = 0; i < ops; i++) { \
+            const uint8_t *r = corpus[i % CORPUS_REPORTS]; \
+            Out out; \
+            memset(&out, 0, sizeof(out)); \
+            call; \
+            if (hash) { \
+                h = fnv1a(h, &out, sizeof(out)); \
+            } else { \
+                sum += out.buttons; \
+            } \
+        } \
+        return hash ? h : sum; \
+    }
+
+DECODE_PASS(pass_interpret_mouse, mouse_corpus, MOUSE_REPORT, MouseReport, out = interpret_mouse_report(r, MOUSE_REPORT))
+DECODE_PASS(pass_decode_mouse, mouse_corpus, MOUSE_REPORT, MouseReport, decode_mouse_report(&mouse_layout, r, MOUSE_REPORT, &out))
+DECODE_PASS(pass_mouse_decoder, mouse_corpus, MOUSE_REPORT, MouseReport, mouse_decoder_run(&mouse_decoder, r, MOUSE_REPORT, &out))
+DECODE_PASS(pass_translate_pad, ds4_corpus, DS4_REPORT, GamepadReport, gamepad_translate_report(&ds4_layout, r, DS4_REPORT, &out))
+DECODE_PASS(pass_pad_decoder, ds4_corpus, DS4_REPORT, GamepadReport, gamepad_decoder_run(&ds4_decoder, r, DS4_REPORT, &out))
+
+/* ---------------- renderers ---------------- */
+
+static uint64_t pass_mouse_frame(unsigned long ops, int hash) {
+    (void)hash;
+    for (unsigned long i = 0; i < ops; i++) {
+        suite_mouse_frame(motion_corpus[i % CORPUS_REPORTS], MOUSE_REPORT, (i + 1) * REPORT_INTERVAL_NS);
+    }
+    return 0;
+}
+
+static uint64_t pass_pad_report(unsigned long ops, int hash) {
+    (void)hash;
+    for (unsigned long i = 0; i < ops; i++) {
+        suite_gamepad_report(pad_corpus[i % CORPUS_REPORTS], PAD_REPORT, (i + 1) * REPORT_INTERVAL_NS);
+    }
+    return 0;
+}
+
+static uint64_t pass_serial(unsigned long ops, int hash) {
+    (void)hash;
+    for (unsigned long i = 0; i < ops; i++) suite_serial_chunk(serial_corpus[i % CORPUS_REPORTS], SERIAL_CHUNK);
+    suite_serial_finish();
+    return 0;
+}
+
+static void reset_none(void) {}
+static void reset_pad_screen(void) { suite_gamepad_reset(0); }
+static void reset_pad_events(void) { suite_gamepad_reset(1); }
+static void reset_serial(void) { suite_serial_reset(STDOUT_FILENO); }
+
+static const Bench benches[] = {
+    { "mouse.interpret_mouse_report", 0, MOUSE_REPORT, 1ul << 22, reset_none, pass_interpret_mouse },
+    { "mouse.decode_mouse_report", 0, MOUSE_REPORT, 1ul << 22, reset_none, pass_decode_mouse },
+    { "mouse.mouse_decoder_run", 0, MOUSE_REPORT, 1ul << 22, reset_none, pass_mouse_decoder },
+    { "gamepad.gamepad_translate_report", 0, DS4_REPORT, 1ul << 20, reset_none, pass_translate_pad },
+    { "gamepad.gamepad_decoder_run", 0, DS4_REPORT, 1ul << 20, reset_none, pass_pad_decoder },
+    { "read_mouse.draw_ui", 1, MOUSE_REPORT, 1ul << 15, suite_mouse_reset, pass_mouse_frame },
+    { "read_gamepad.interpret_gamepad_report", 1, PAD_REPORT, 1ul << 15, reset_pad_screen, pass_pad_report },
+    { "read_gamepad.events_text", 1, PAD_REPORT, 1ul << 16, reset_pad_events, pass_pad_report },
+    { "read_serial.sink_chunk", 1, SERIAL_CHUNK, 1ul << 18, reset_serial, pass_serial },
+};
+
+/* ---------------- sinks ---------------- */
+
+typedef struct {
+    int fd;
+    pthread_t thread;
+    uint64_t bytes;
+    uint64_t hash;
+} Drain;
+
+static void *drain_main(void *arg) {
+    Drain *d = arg;
+    static unsigned char buf[65536];
+    for (;;) {
+        ssize_t n = read(d->fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        d->bytes += (uint64_t)n;
+        d->hash = fnv1a(d->hash, buf, (size_t)n);
+    }
+    return NULL;
+}
+
+static int saved_out = -1, saved_err = -1;
+
+// Point stdout and stderr at the sink. Returns 0, or -1.
+static int sink_open(int sink, Drain *drain) {
+    int fd;
+    if (sink == SINK_DEVNULL) {
+        fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (fd < 0) return -1;
+    } else {
+        int p[2];
+        if (pipe(p) < 0) return -1;
+        memset(drain, 0, sizeof(*drain));
+        drain->fd = p[0];
+        drain->hash = FNV_SEED;
+        if (pthread_create(&drain->thread, NULL, drain_main, drain) != 0) {
+            close(p[0]);
+            close(p[1]);
+            return -1;
+        }
+        fd = p[1];
+    }
+    fflush(stdout);
+    fflush(stderr);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    return 0;
+}
+
+static void sink_close(int sink, Drain *drain) {
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    if (sink == SINK_PIPE) {
+        pthread_join(drain->thread, NULL); // the last write end is gone: EOF
+        close(drain->fd);
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_result(const Bench *b, int sink, unsigned long ops, uint64_t out_bytes, uint64_t checksum,
+                         double ns_per_op) {
+    double ops_per_sec = 1e9 / ns_per_op;
+    fprintf(json,
+            "%s    {\"name\": \"%s\", \"sink\": \"%s\", \"ops\": %lu, \"in_bytes\": %llu, \"out_bytes\": %llu, "
+            "\"checksum\": \"%016llx\", \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f, \"in_bytes_per_sec\": %.0f, "
+            "\"out_bytes_per_sec\": %.0f}",
+            results_printed++ ? ",\n" : "", b->name, sink_names[sink], ops, (unsigned long long)(ops * b->in_size), (unsigned long long)out_bytes,
+            (unsigned long long)checksum, ns_per_op, ops_per_sec, ops_per_sec * (double)b->in_size,
+            ops_per_sec * (double)out_bytes / (double)ops);
+}
+
+// Check pass, then `repeats` timed passes per sink. Returns 0, or -1.
+static int run_bench(const Bench *b, int repeats, unsigned long scale) {
+    unsigned long ops = b->ops * scale;
+    uint64_t checksum, out_bytes = 0;
+    Drain drain;
+
+    b->reset();
+    if (b->renders) {
+        if (sink_open(SINK_PIPE, &drain) < 0) return -1;
+        b->reset();
+        b->pass(ops, 1);
+        sink_close(SINK_PIPE, &drain);
+        checksum = drain.hash;
+        out_bytes = drain.bytes;
+    } else {
+        checksum = b->pass(ops, 1);
+    }
+
+    int first = b->renders ? SINK_DEVNULL : SINK_NONE;
+    int end = b->renders ? SINK_PIPE : SINK_NONE;
+    for (int sink = first; sink <= end; sink++) {
+        double ns[MAX_REPEATS];
+        for (int r = 0; r < repeats; r++) {
+            if (sink != SINK_NONE && sink_open(sink, &drain) < 0) return -1;
+            b->reset();
+            uint64_t t0 = now_ns();
+            keep += b->pass(ops, 0);
+            ns[r] = (double)(now_ns() - t0) / (double)ops;
+            if (sink != SINK_NONE) sink_close(sink, &drain);
+            if (sink == SINK_PIPE && (drain.bytes != out_bytes || drain.hash != checksum)) {
+                fprintf(diag, "ERROR: %s wrote different output on pass %d\n", b->name, r + 1);
+                return -1;
+            }
+        }
+        qsort(ns, (size_t)repeats, sizeof(ns[0]), compare_double);
+        fprintf(diag, "%-40s %-7s %9.2f ns per op (min %.2f, max %.2f)\n", b->name, sink_names[sink],
+                ns[repeats / 2], ns[0], ns[repeats - 1]);
+        print_result(b, sink, ops, out_bytes, checksum, ns[repeats / 2]);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int repeats = argc > 1 ? atoi(argv[1]) : 5;
+    long scale = argc > 2 ? atol(argv[2]) : 1;
+
+    if (repeats < 1 || repeats > MAX_REPEATS || scale < 1) {
+        fprintf(stderr, "Usage: %s [repeats (1..%d)] [scale]\n", argv[0], MAX_REPEATS);
+        return 1;
+    }
+    saved_out = dup(STDOUT_FILENO);
+    saved_err = dup(STDERR_FILENO);
+    json = fdopen(saved_out, "w");
+    diag = fdopen(saved_err, "w");
+    if (!json || !diag) return 1;
+    setvbuf(diag, NULL, _IONBF, 0);
+
+    build_corpora();
+    mouse_profile_layout(USB_PROFILE_LOGITECH_C534, &mouse_layout);  // what the descriptor compiles to
+    mouse_decoder_select(&mouse_decoder, &usb_profiles[USB_PROFILE_LOGITECH_C534], &mouse_layout);
+    gamepad_profile_layout(USB_PROFILE_DUALSHOCK4, &ds4_layout);
+    gamepad_decoder_select(&ds4_decoder, &usb_profiles[USB_PROFILE_DUALSHOCK4], &ds4_layout);
+
+    int n = (int)(sizeof(benches) / sizeof(benches[0]));
+    fprintf(json, "{\n  \"suite\": \"bench_suite\",\n  \"version\": 1,\n  \"repeats\": %d,\n  \"scale\": %ld,\n"
+            "  \"results\": [\n", repeats, scale);
+    int failed = 0;
+    for (int i = 0; i < n; i++) {
+        if (run_bench(&benches[i], repeats, (unsigned long)scale) < 0) {
+            fprintf(diag, "ERROR: %s failed\n", benches[i].name);
+            failed = 1;
+        }
+    }
+    fprintf(json, "\n  ]\n}\n");
+    fflush(json);
+    return failed;
+}
@@ -0,0 +1,35 @@
+#ifndef BENCH_SUITE_H
+#define BENCH_SUITE_H
+
+/*
+ * Hooks into the tools for bench/bench_suite.c
+ *
+ * The renderers under test are static functions of the tools' main
+ * files, with their state in file-scope variables. Rather than moving them
+ * out for the bench's sake, each suite_read_*.c wrapper compiles one tool
+ * as is (its main() renamed) and exports the few entry points below. The
+ * renderers write where the tools write: read_mouse and the read_gamepad
+ * screen to stderr, read_gamepad -e to stdout; bench_suite points those at
+ * the sink under test.
+ */
+
+#include <stdint.h>
+
+// read_mouse: apply_report() then draw_ui(), one frame per report.
+// `complete_ns` is the report's transfer completion time; the bench passes
+// a synthetic clock so the output does not depend on when it ran.
+void suite_mouse_reset(void);
+void suite_mouse_frame(const unsigned char *data, int len, uint64_t complete_ns);
+
+// read_gamepad: handle_report() on a 20-byte report, drawing the screen
+// (interpret_gamepad_report()) or, with events set, writing -e text events.
+void suite_gamepad_reset(int events);
+void suite_gamepad_report(unsigned char *data, int len, uint64_t complete_ns);
+
+// read_serial: the output path of the default mode (sink_chunk() into an
+// OutSink with the default flush thresholds) on `fd`.
+int suite_serial_reset(int fd);
+int suite_serial_chunk(const unsigned char *data, int len);
+void suite_serial_finish(void);
+
+#endif // BENCH_SUITE_H
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Compare two bench_suite result files (make bench writes bench/results.json).
+#
+# Prints the ns per op of every benchmark in both files and the change in
+# percent, and flags a benchmark whose output changed: a different
+# checksum, op count or out_bytes. Exits 1 if any output changed.
+#
+# Usage: bench_suite_diff.sh old.json new.json
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 old.json new.json" >&2
+    exit 2
+fi
+
+# bench_suite writes one result per line, so a line is parsed by its keys.
+awk '
+function field(line, key,    s) {
+    if (!match(line, "\"" key "\": \"?[^,\"}]*")) return ""
+    s = substr(line, RSTART, RLENGTH)
+    sub(/^"[^"]*": "?/, "", s)
+    return s
+}
+FNR == 1 { file++ }
+/"name":/ {
+    id = field($0, "name") " " field($0, "sink")
+    out = field($0, "ops") " " field($0, "out_bytes") " " field($0, "checksum")
+    ns = field($0, "ns_per_op")
+    if (file == 1) {
+        old_ns[id] = ns
+        old_out[id] = out
+        next
+    }
+    if (!(id in old_ns)) {
+        printf "%-48s %10s %10.2f      new\n", id, "", ns
+        next
+    }
+    note = (old_out[id] == out) ? "" : "   OUTPUT CHANGED"
+    if (note != "") changed = 1
+    change = (old_ns[id] > 0) ? 100 * (ns - old_ns[id]) / old_ns[id] : 0
+    printf "%-48s %10.2f %10.2f %+7.1f%%%s\n", id, old_ns[id], ns, change, note
+    seen[id] = 1
+}
+END {
+    for (id in old_ns) if (!(id in seen)) printf "%-48s %10.2f %10s      gone\n", id, old_ns[id], ""
+    exit changed
+}
+' "$1" "$2"
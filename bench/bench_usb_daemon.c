@@ -0,0 +1,133 @@
+// CPU cost of one event loop for many devices against one process per device.
+//
+// Runs N simulated devices (mouse, gamepad and CDC board in turn, from
+// common/fakeusb) for a few seconds, first all in one process on one
+// usb_daemon loop (usb-daemon/usb_daemon.h), then as N processes with one
+// device each, the way N termux-usb invocations of the single-device tools
+// would run. Prints the CPU time (user + system) both setups used per
+// second and per report; the simulated devices run in the same processes,
+// so their cost is in both numbers.
+//
+// Usage: bench_usb_daemon [devices] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "../usb-daemon/usb_daemon.h"
+#include "fakeusb.h"
+
+typedef struct {
+    uint64_t reports;
+    uint64_t wakeups;
+} LoopResult;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Devices first .. first+count-1 on one loop for `seconds`, in this process.
+static int run_loop(int first, int count, double seconds, LoopResult *result) {
+    static const char *types[] = { "mouse", "gamepad", "serial" };
+    static const enum fakeusb_device kinds[] = { FAKEUSB_DEVICE_MOUSE, FAKEUSB_DEVICE_GAMEPAD, FAKEUSB_DEVICE_CDC };
+    struct fakeusb_config cfg;
+    UsbDaemon d;
+    char err[160];
+
+    if (usb_daemon_init(&d) < 0) return -1;
+    fakeusb_default_config(&cfg);
+    cfg.num_devices = 0;
+    for (int i = first; i < first + count; i++) {
+        cfg.device = kinds[i % 3];
+        fakeusb_configure(&cfg);
+        if (usb_daemon_add(&d, types[i % 3], open("/dev/null", O_RDONLY), open("/dev/null", O_WRONLY), err, sizeof(err)) < 0) {
+            fprintf(stderr, "ERROR: device %d: %s\n", i, err);
+            return -1;
+        }
+    }
+
+    double end = now_sec() + seconds;
+    while (now_sec() < end && d.num_devices > 0) {
+        int ready[1];
+        usb_daemon_step(&d, ready, 1, NULL);
+    }
+    memset(result, 0, sizeof(*result));
+    for (int i = 0; i < d.num_devices; i++) result->reports += d.devices[i]->reports;
+    result->wakeups = d.wakeups;
+    usb_daemon_close(&d);
+    return 0;
+}
+
+// Fork one child per group of devices; add up their results and CPU time.
+static int run_children(int devices, int per_process, double seconds, LoopResult *total, double *cpu) {
+    int pipes[USB_DAEMON_MAX_DEVICES][2];
+    pid_t pids[USB_DAEMON_MAX_DEVICES];
+    int children = 0;
+
+    memset(total, 0, sizeof(*total));
+    *cpu = 0;
+    for (int first = 0; first < devices; first += per_process) {
+        if (pipe(pipes[children]) < 0) return -1;
+        pid_t pid = fork();
+        if (pid < 0) return -1;
+        if (pid == 0) {
+            LoopResult r;
+            int count = devices - first < per_process ? devices - first : per_process;
+            close(pipes[children][0]);
+            if (run_loop(first, count, seconds, &r) < 0) _exit(1);
+            if (write(pipes[children][1], &r, sizeof(r)) != (ssize_t)sizeof(r)) _exit(1);
+            _exit(0);
+        }
+        close(pipes[children][1]);
+        pids[children++] = pid;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < children; i++) {
+        LoopResult r;
+        struct rusage ru;
+        int status;
+        if (read(pipes[i][0], &r, sizeof(r)) == (ssize_t)sizeof(r)) {
+            total->reports += r.reports;
+            total->wakeups += r.wakeups;
+        }
+        close(pipes[i][0]);
+        if (wait4(pids[i], &status, 0, &ru) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = 1;
+        *cpu += (double)ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + (double)ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    }
+    return failed ? -1 : 0;
+}
+
+static void print_result(const char *name, double seconds, const LoopResult *r, double cpu) {
+    printf("%-24s %8.1f ms CPU per second %8.2f us CPU per report %10llu reports %9llu wakeups\n", name,
+           cpu * 1e3 / seconds, r->reports ? cpu * 1e6 / (double)r->reports : 0.0,
+           (unsigned long long)r->reports, (unsigned long long)r->wakeups);
+}
+
+int main(int argc, char **argv) {
+    int devices = argc > 1 ? atoi(argv[1]) : 6;
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    LoopResult r;
+    double cpu;
+    char name[64];
+
+    if (devices < 1 || devices > USB_DAEMON_MAX_DEVICES || seconds <= 0) {
+        fprintf(stderr, "Usage: %s [devices (1..%d)] [seconds]\n", argv[0], USB_DAEMON_MAX_DEVICES);
+        return 1;
+    }
+    printf("%d devices (mouse, gamepad, CDC in turn), %.1f s each\n", devices, seconds);
+
+    if (run_children(devices, devices, seconds, &r, &cpu) < 0) return 1;
+    print_result("1 process, 1 loop", seconds, &r, cpu);
+
+    if (run_children(devices, 1, seconds, &r, &cpu) < 0) return 1;
+    snprintf(name, sizeof(name), "%d processes", devices);
+    print_result(name, seconds, &r, cpu);
+    return 0;
+}
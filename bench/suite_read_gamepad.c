@@ -0,0 +1,26 @@
+// read_gamepad compiled for bench_suite (see bench_suite.h).
+
+#define main read_gamepad_main
+#include "../usb-gamepad/read_gamepad.c"
+#undef main
+
+#include "bench_suite.h"
+
+// An Xbox 360 pad (no translation), the screen not drawn yet, thresholds
+// of the defaults of -e.
+void suite_gamepad_reset(int events_mode) {
+    static int built = 0;
+    if (!built) {
+        build_screen_template();
+        built = 1;
+    }
+    screen_drawn = 0;
+    last_length = -1;
+    reports_received = reports_skipped = 0;
+    event_mode = events_mode;
+    gamepad_events_init(&events, GAMEPAD_EVENTS_TEXT, 512, 4);
+}
+
+void suite_gamepad_report(unsigned char *data, int len, uint64_t complete_ns) {
+    handle_report(data, len, complete_ns);
+}
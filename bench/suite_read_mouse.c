@@ -0,0 +1,29 @@
+// read_mouse compiled for bench_suite (see bench_suite.h).
+
+#define main read_mouse_main
+#include "../usb-mouse/read_mouse.c"
+#undef main
+
+#include "bench_suite.h"
+
+// A fresh box, the cursor in the middle, 1 count per cell (the default -s).
+void suite_mouse_reset(void) {
+    static int selected = 0;
+    if (!selected) {
+        MouseLayout none = {0};
+        mouse_decoder_select(&report_decoder, &usb_profiles[USB_PROFILE_LOGITECH_C534], &none);
+        selected = 1;
+    }
+    mouse_motion_init(&motion, SCREEN_WIDTH, SCREEN_HEIGHT, 1.0);
+    mouse_x = mouse_motion_cell_x(&motion);
+    mouse_y = mouse_motion_cell_y(&motion);
+    mouse_buttons = 0;
+    mouse_wheel = mouse_hwheel = 0;
+    drawn_status[0] = '\0';
+    ui_restart();
+}
+
+void suite_mouse_frame(const unsigned char *data, int len, uint64_t complete_ns) {
+    apply_report(data, len, complete_ns);
+    draw_ui();
+}
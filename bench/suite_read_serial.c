@@ -0,0 +1,22 @@
+// read_serial compiled for bench_suite (see bench_suite.h).
+
+#define main read_serial_main
+#include "../usb-serial/read_serial.c"
+#undef main
+
+#include "bench_suite.h"
+
+static OutSink suite_sink;
+
+int suite_serial_reset(int fd) {
+    if (suite_sink.buf) out_sink_close(&suite_sink);
+    return out_sink_init(&suite_sink, fd, DEFAULT_FLUSH_BYTES, DEFAULT_FLUSH_US);
+}
+
+int suite_serial_chunk(const unsigned char *data, int len) {
+    return sink_chunk(&suite_sink, data, len);
+}
+
+void suite_serial_finish(void) {
+    out_sink_flush(&suite_sink);
+}
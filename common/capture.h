@@ -0,0 +1,360 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/*
+ * Capture file: timestamped USB transfers, seekable by time
+ *
+ * File layout (all integers little endian):
+ *
+ *   CaptureFileHeader                      64 bytes
+ *   chunk 0, chunk 1, ...                  CAPTURE_CHUNK_SIZE bytes each
+ *
+ * A chunk starts with a CaptureChunkHeader (first and last timestamp,
+ * record count, bytes used) followed by records that never cross into
+ * the next chunk; the unused tail is zero. Chunk k is at a fixed offset,
+ * so the chunk headers double as the time index: a reader maps the file
+ * and binary searches them, then scans one chunk.
+ *
+ *   CaptureRecord    t_ns (CLOCK_MONOTONIC), endpoint, status, len
+ *   payload          len bytes
+ *
+ * Writing: the polling thread calls capture_record(), which only copies
+ * the transfer into the chunk being filled. Chunks are built in place in
+ * a preallocated SpscRing (common/spsc_ring.h) and a writer thread
+ * write()s each one when it is full. If the writer falls behind and the
+ * ring is full, records are dropped and counted rather than blocking the
+ * poll. Only whole chunks are ever written, so the file is append-only
+ * and a crash loses at most the chunks still in memory.
+ *
+ * Usage:
+ *   CaptureWriter w;
+ *   capture_open(&w, "session.cap");
+ *   capture_record(&w, 0x81, 0, data, actual_length);   // per transfer
+ *   capture_close(&w);
+ *
+ *   CaptureReader r;
+ *   CaptureCursor c;
+ *   capture_reader_open(&r, "session.cap");
+ *   capture_seek(&r, r.header->start_ns + 3600000000000ull, &c);  // 1 h in
+ *   while (capture_next(&r, &c, &rec, &payload)) ...
+ *   capture_reader_close(&r);
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "spsc_ring.h"
+
+#define CAPTURE_MAGIC "TUSBCAP1"
+#define CAPTURE_VERSION 1
+#define CAPTURE_CHUNK_MAGIC 0x4b4e4843u   // "CHNK"
+#define CAPTURE_CHUNK_SIZE (64 * 1024)
+#define CAPTURE_RING_CHUNKS 16             // 1 MiB buffered between poll and disk
+
+#pragma pack(push, 1)
+typedef struct {
+    char magic[8];              // CAPTURE_MAGIC
+    uint32_t version;
+    uint32_t chunk_size;
+    uint64_t start_ns;          // CLOCK_MONOTONIC when the capture started
+    uint64_t start_realtime_ns; // CLOCK_REALTIME at the same moment
+    uint8_t reserved[32];
+} CaptureFileHeader;
+
+typedef struct {
+    uint32_t magic;             // CAPTURE_CHUNK_MAGIC
+    uint32_t used;              // bytes used including this header
+    uint32_t records;
+    uint32_t seq;               // chunk number
+    uint64_t first_ns;
+    uint64_t last_ns;
+} CaptureChunkHeader;
+
+typedef struct {
+    uint64_t t_ns;              // CLOCK_MONOTONIC when the transfer completed
+    uint8_t endpoint;
+    uint8_t status;             // 0 = completed, otherwise a libusb transfer status
+    uint16_t len;
+} CaptureRecord;
+#pragma pack(pop)
+
+#define CAPTURE_MAX_PAYLOAD (CAPTURE_CHUNK_SIZE - (int)sizeof(CaptureChunkHeader) - (int)sizeof(CaptureRecord))
+
+static inline uint64_t capture_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* ---------------- writing ---------------- */
+
+typedef struct {
+    int fd;
+    SpscRing ring;
+    pthread_t thread;
+    int thread_started;
+
+    // Chunk being filled, inside the ring but not produced yet.
+    unsigned char *chunk;
+    CaptureChunkHeader current;
+    uint32_t next_seq;
+
+    uint64_t records;           // records accepted
+    uint64_t dropped;           // records lost because the ring was full
+    uint64_t bytes_written;     // written by the writer thread
+    int write_error;            // errno of the first failed write, set by the writer thread
+} CaptureWriter;
+
+static inline int capture_write_all(int fd, const unsigned char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static inline void *capture_writer_thread(void *arg) {
+    CaptureWriter *w = arg;
+    for (;;) {
+        const unsigned char *p;
+        spsc_ring_wait_readable(&w->ring, -1);
+        size_t n = spsc_ring_read_span(&w->ring, &p);
+        if (n == 0) {
+            if (spsc_ring_drained(&w->ring)) break;
+            continue;
+        }
+        // Keep consuming after an error so the poll side never stalls.
+        if (!w->write_error) {
+            if (capture_write_all(w->fd, p, n) < 0) {
+                w->write_error = errno;
+            } else {
+                w->bytes_written += n;
+            }
+        }
+        spsc_ring_consume(&w->ring, n);
+    }
+    return NULL;
+}
+
+// Create (or truncate) `path`, write the file header and start the writer
+// thread. Returns 0 or -1 with errno set.
+static inline int capture_open(CaptureWriter *w, const char *path) {
+    memset(w, 0, sizeof(*w));
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (w->fd < 0) return -1;
+
+    CaptureFileHeader h;
+    struct timespec rt;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CAPTURE_MAGIC, sizeof(h.magic));
+    h.version = CAPTURE_VERSION;
+    h.chunk_size = CAPTURE_CHUNK_SIZE;
+    h.start_ns = capture_now_ns();
+    clock_gettime(CLOCK_REALTIME, &rt);
+    h.start_realtime_ns = (uint64_t)rt.tv_sec * 1000000000ull + (uint64_t)rt.tv_nsec;
+
+    if (capture_write_all(w->fd, (const unsigned char *)&h, sizeof(h)) < 0 ||
+        spsc_ring_init(&w->ring, (size_t)CAPTURE_CHUNK_SIZE * CAPTURE_RING_CHUNKS) < 0) {
+        int saved = errno;
+        close(w->fd);
+        spsc_ring_free(&w->ring);
+        errno = saved;
+        return -1;
+    }
+    // Touch the ring now so page faults do not land in the polling loop.
+    memset(w->ring.buf, 0, w->ring.capacity);
+
+    if (pthread_create(&w->thread, NULL, capture_writer_thread, w) != 0) {
+        close(w->fd);
+        spsc_ring_free(&w->ring);
+        errno = EAGAIN;
+        return -1;
+    }
+    w->thread_started = 1;
+    return 0;
+}
+
+// Finish the chunk being filled and hand it to the writer thread.
+static inline void capture_seal_chunk(CaptureWriter *w) {
+    if (!w->chunk) return;
+    memset(w->chunk + w->current.used, 0, CAPTURE_CHUNK_SIZE - w->current.used);
+    memcpy(w->chunk, &w->current, sizeof(w->current));
+    spsc_ring_produce(&w->ring, CAPTURE_CHUNK_SIZE);
+    w->chunk = NULL;
+}
+
+// Append one transfer, stamped now. Never blocks; returns 0, or -1 if the
+// record was dropped (ring full or payload larger than a chunk).
+static inline int capture_record(CaptureWriter *w, uint8_t endpoint, uint8_t status, const void *data, int len) {
+    uint64_t now = capture_now_ns();
+    uint32_t need = (uint32_t)sizeof(CaptureRecord) + (uint32_t)len;
+
+    if (len < 0 || len > CAPTURE_MAX_PAYLOAD) {
+        w->dropped++;
+        return -1;
+    }
+    if (w->chunk && w->current.used + need > CAPTURE_CHUNK_SIZE) capture_seal_chunk(w);
+    if (!w->chunk) {
+        unsigned char *p;
+        // Chunks are produced whole, so a free span is always chunk aligned.
+        if (spsc_ring_write_span(&w->ring, &p) < CAPTURE_CHUNK_SIZE) {
+            w->ring.full_events++;
+            w->dropped++;
+            return -1;
+        }
+        w->chunk = p;
+        memset(&w->current, 0, sizeof(w->current));
+        w->current.magic = CAPTURE_CHUNK_MAGIC;
+        w->current.used = sizeof(CaptureChunkHeader);
+        w->current.seq = w->next_seq++;
+        w->current.first_ns = now;
+    }
+
+    CaptureRecord rec = { now, endpoint, status, (uint16_t)len };
+    memcpy(w->chunk + w->current.used, &rec, sizeof(rec));
+    if (len > 0) memcpy(w->chunk + w->current.used + sizeof(rec), data, (size_t)len);
+    w->current.used += need;
+    w->current.records++;
+    w->current.last_ns = now;
+    w->records++;
+    return 0;
+}
+
+// Flush the last chunk, stop the writer thread and close the file.
+// Returns 0, or -1 with errno set if any write failed.
+static inline int capture_close(CaptureWriter *w) {
+    if (!w->thread_started) return 0;
+    capture_seal_chunk(w);
+    spsc_ring_close(&w->ring);
+    pthread_join(w->thread, NULL);
+    w->thread_started = 0;
+    int r = w->write_error ? -1 : 0;
+    if (close(w->fd) < 0 && r == 0) r = -1;
+    spsc_ring_free(&w->ring);
+    if (w->write_error) errno = w->write_error;
+    return r;
+}
+
+/* ---------------- reading ---------------- */
+
+typedef struct {
+    const uint8_t *map;
+    size_t size;
+    const CaptureFileHeader *header;
+    size_t num_chunks;          // complete, valid chunks
+} CaptureReader;
+
+typedef struct {
+    size_t chunk;
+    uint32_t offset;            // within the chunk; 0 = at its first record
+} CaptureCursor;
+
+static inline const CaptureChunkHeader *capture_chunk(const CaptureReader *r, size_t k) {
+    return (const CaptureChunkHeader *)(r->map + sizeof(CaptureFileHeader) + k * CAPTURE_CHUNK_SIZE);
+}
+
+// Map `path` read-only. Returns 0, or -1 if it cannot be opened or is not a capture.
+static inline int capture_reader_open(CaptureReader *r, const char *path) {
+    struct stat st;
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CaptureFileHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    r->map = map;
+    r->size = (size_t)st.st_size;
+    r->header = (const CaptureFileHeader *)r->map;
+    if (memcmp(r->header->magic, CAPTURE_MAGIC, sizeof(r->header->magic)) != 0 ||
+        r->header->chunk_size != CAPTURE_CHUNK_SIZE) {
+        munmap(map, r->size);
+        memset(r, 0, sizeof(*r));
+        errno = EINVAL;
+        return -1;
+    }
+    // Sequential access by default; seeks touch only a few pages per probe.
+    madvise(map, r->size, MADV_SEQUENTIAL);
+
+    // A capture cut short by a crash may end in a partial or unwritten chunk.
+    size_t n = (r->size - sizeof(CaptureFileHeader)) / CAPTURE_CHUNK_SIZE;
+    while (n > 0) {
+        const CaptureChunkHeader *c = capture_chunk(r, n - 1);
+        if (c->magic == CAPTURE_CHUNK_MAGIC && c->used <= CAPTURE_CHUNK_SIZE) break;
+        n--;
+    }
+    r->num_chunks = n;
+    return 0;
+}
+
+static inline void capture_reader_close(CaptureReader *r) {
+    if (r->map) munmap((void *)r->map, r->size);
+    memset(r, 0, sizeof(*r));
+}
+
+// Position `c` at the first record with t_ns >= `t_ns`: a binary search over
+// the chunk headers, then a scan of one chunk.
+static inline void capture_seek(const CaptureReader *r, uint64_t t_ns, CaptureCursor *c) {
+    size_t lo = 0, hi = r->num_chunks;
+    while (lo < hi) { // first chunk whose last record is not before t_ns
+        size_t mid = lo + (hi - lo) / 2;
+        if (capture_chunk(r, mid)->last_ns < t_ns) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    c->chunk = lo;
+    c->offset = 0;
+    if (lo == r->num_chunks) return;
+
+    const CaptureChunkHeader *h = capture_chunk(r, lo);
+    const uint8_t *base = (const uint8_t *)h;
+    uint32_t off = sizeof(CaptureChunkHeader);
+    while (off + sizeof(CaptureRecord) <= h->used) {
+        CaptureRecord rec;
+        memcpy(&rec, base + off, sizeof(rec));
+        if (rec.t_ns >= t_ns) break;
+        off += (uint32_t)sizeof(rec) + rec.len;
+    }
+    c->offset = off;
+}
+
+// Read the record at `c` and advance. Returns 1, or 0 at the end of the capture.
+static inline int capture_next(const CaptureReader *r, CaptureCursor *c, CaptureRecord *rec, const uint8_t **payload) {
+    while (c->chunk < r->num_chunks) {
+        const CaptureChunkHeader *h = capture_chunk(r, c->chunk);
+        const uint8_t *base = (const uint8_t *)h;
+        if (c->offset == 0) c->offset = sizeof(CaptureChunkHeader);
+        if (c->offset + sizeof(CaptureRecord) <= h->used) {
+            memcpy(rec, base + c->offset, sizeof(*rec));
+            if (c->offset + sizeof(CaptureRecord) + rec->len <= h->used) {
+                *payload = base + c->offset + sizeof(CaptureRecord);
+                c->offset += (uint32_t)sizeof(CaptureRecord) + rec->len;
+                return 1;
+            }
+        }
+        c->chunk++;
+        c->offset = 0;
+    }
+    return 0;
+}
+
+#endif // CAPTURE_H
@@ -0,0 +1,417 @@
+#ifndef DESC_CACHE_H
+#define DESC_CACHE_H
+
+/*
+ * On-disk cache of the descriptors a device answers over EP0
+ *
+ * The device and configuration descriptors come with the fd from the
+ * kernel, but every string and every HID report descriptor is a control
+ * transfer on endpoint 0: a few milliseconds each, and the tools ask for
+ * the same ones on every start. DescCache keeps them in a file per device
+ * so that only the first run pays for them:
+ *
+ *   $XDG_CACHE_HOME/termux-usb/VVVV-PPPP-BBBB[-serial].desc
+ *   (~/.cache/termux-usb if XDG_CACHE_HOME is not set)
+ *
+ * keyed by idVendor, idProduct, bcdDevice and the serial number string, so
+ * a firmware update or another unit of the same model gets its own entry.
+ * Reading the serial number is the one request a cache hit still sends
+ * (it is the key, so it cannot come from the file); a device without one
+ * costs no request at all.
+ * The file holds the raw configuration descriptors (all configurations,
+ * rebuilt from what libusb parsed, class-specific descriptors included),
+ * the string descriptors as ASCII and the HID report descriptors by
+ * interface. Requests the device stalls are cached too, so a vendor-class
+ * pad is not asked for its missing report descriptor again; timeouts and
+ * other errors are not. A cache whose configuration blob differs from the
+ * device's is thrown away.
+ *
+ * Usage:
+ *   DescCache cache;
+ *   desc_cache_open(&cache, handle, refresh);      // refresh: ignore the file
+ *   desc_cache_string(&cache, handle, desc.iProduct, buf, sizeof(buf));
+ *   desc_cache_report_descriptor(&cache, handle, interface_number, desc, sizeof(desc));
+ *   desc_cache_endpoint(&cache, 0x82, &ep);        // no device access
+ *   desc_cache_close(&cache);                      // writes the file if anything was added
+ *
+ * Lookups return the same values as the libusb calls they stand for: a
+ * length, or a libusb error code. The file is written in native byte order
+ * to a temporary name and renamed over the old one, so a reader never sees
+ * half a file.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <libusb-1.0/libusb.h>
+
+#include "hid_parser.h"
+
+#define DESC_CACHE_MAGIC "TUSBDSC1"
+#define DESC_CACHE_MAX_CONFIG 4096
+#define DESC_CACHE_MAX_STRINGS 32
+#define DESC_CACHE_MAX_REPORTS 8
+#define DESC_CACHE_MAX_REPORT 512
+#define DESC_CACHE_LANGID_EN_US 0x0409
+
+typedef struct {
+    uint8_t index;
+    int8_t status;          // 0, or the libusb error the device answered with
+    char text[128];
+} DescCacheString;
+
+typedef struct {
+    uint8_t interface;
+    int16_t len;            // descriptor length, or the libusb error
+    unsigned char data[DESC_CACHE_MAX_REPORT];
+} DescCacheReport;
+
+typedef struct {
+    uint8_t interface;
+    uint8_t attributes;     // bmAttributes: transfer type in the low bits
+    uint16_t max_packet;
+    uint8_t interval;       // bInterval
+} DescCacheEndpoint;
+
+typedef struct {
+    char path[512];         // "" if the cache is not stored
+    uint16_t vid, pid, bcd;
+    char serial[64];        // "" if the device has none
+    int loaded;             // contents came from the file
+    int dirty;              // something was added since
+
+    int config_len;
+    unsigned char config[DESC_CACHE_MAX_CONFIG];
+    int num_strings;
+    DescCacheString strings[DESC_CACHE_MAX_STRINGS];
+    int num_reports;
+    DescCacheReport reports[DESC_CACHE_MAX_REPORTS];
+
+    unsigned hits;          // requests answered from the cache
+    unsigned misses;        // requests sent to the device
+} DescCache;
+
+typedef struct {
+    char magic[8];
+    uint16_t vid, pid, bcd;
+    uint16_t config_len;
+    uint8_t num_strings;
+    uint8_t num_reports;
+    uint8_t reserved[6];
+    char serial[64];
+} DescCacheFileHeader;
+
+// Only a stall means the device has no such descriptor; anything else may
+// go away on the next try.
+static inline int desc_cache_keep_error(int r) {
+    return r == LIBUSB_ERROR_PIPE || r == LIBUSB_ERROR_NOT_FOUND;
+}
+
+/* ---------------- configuration blob ---------------- */
+
+static inline int desc_cache_put(unsigned char *out, int pos, int max, const void *data, int len) {
+    if (pos < 0 || pos + len > max) return -1;
+    memcpy(out + pos, data, (size_t)len);
+    return pos + len;
+}
+
+// Rebuild configuration `index` from libusb's parsed copy as it came off the
+// wire: every descriptor followed by the class-specific bytes libusb kept in
+// `extra`. Returns the new end of `out`, or -1 if it does not fit.
+static inline int desc_cache_put_config(const struct libusb_config_descriptor *c, unsigned char *out, int pos, int max) {
+    int start = pos;
+    unsigned char b[9] = { 9, LIBUSB_DT_CONFIG, 0, 0, c->bNumInterfaces, c->bConfigurationValue,
+                           c->iConfiguration, c->bmAttributes, c->MaxPower };
+    pos = desc_cache_put(out, pos, max, b, 9);
+    pos = desc_cache_put(out, pos, max, c->extra, c->extra_length);
+    for (int i = 0; i < c->bNumInterfaces; i++) {
+        for (int a = 0; a < c->interface[i].num_altsetting; a++) {
+            const struct libusb_interface_descriptor *alt = &c->interface[i].altsetting[a];
+            unsigned char ib[9] = { 9, LIBUSB_DT_INTERFACE, alt->bInterfaceNumber, alt->bAlternateSetting,
+                                    alt->bNumEndpoints, alt->bInterfaceClass, alt->bInterfaceSubClass,
+                                    alt->bInterfaceProtocol, alt->iInterface };
+            pos = desc_cache_put(out, pos, max, ib, 9);
+            pos = desc_cache_put(out, pos, max, alt->extra, alt->extra_length);
+            for (int e = 0; e < alt->bNumEndpoints; e++) {
+                const struct libusb_endpoint_descriptor *ep = &alt->endpoint[e];
+                // Audio endpoints carry two more bytes (bLength 9).
+                unsigned char eb[9] = { ep->bLength == 9 ? 9 : 7, LIBUSB_DT_ENDPOINT, ep->bEndpointAddress, ep->bmAttributes,
+                                        (unsigned char)(ep->wMaxPacketSize & 0xff), (unsigned char)(ep->wMaxPacketSize >> 8),
+                                        ep->bInterval, ep->bRefresh, ep->bSynchAddress };
+                pos = desc_cache_put(out, pos, max, eb, eb[0]);
+                pos = desc_cache_put(out, pos, max, ep->extra, ep->extra_length);
+            }
+        }
+    }
+    if (pos < 0) return -1;
+    out[start + 2] = (unsigned char)((pos - start) & 0xff);
+    out[start + 3] = (unsigned char)((pos - start) >> 8);
+    return pos;
+}
+
+// All configurations of the device, one after the other. Returns the
+// length, or -1 if they do not fit or libusb has none.
+static inline int desc_cache_build_config(libusb_device *dev, int num_configs, unsigned char *out, int max) {
+    int pos = 0;
+    for (int i = 0; i < num_configs && pos >= 0; i++) {
+        struct libusb_config_descriptor *c;
+        if (libusb_get_config_descriptor(dev, (uint8_t)i, &c) < 0) return -1;
+        pos = desc_cache_put_config(c, out, pos, max);
+        libusb_free_config_descriptor(c);
+    }
+    return pos;
+}
+
+// Find `endpoint` in the cached configuration blob (first configuration,
+// first alternate setting that has it). Returns 0 or LIBUSB_ERROR_NOT_FOUND.
+static inline int desc_cache_endpoint(const DescCache *c, unsigned char endpoint, DescCacheEndpoint *out) {
+    int interface = -1;
+    int configs = 0;
+    for (int pos = 0; pos + 2 <= c->config_len; ) {
+        const unsigned char *d = c->config + pos;
+        if (d[0] < 2 || pos + d[0] > c->config_len) break;
+        if (d[1] == LIBUSB_DT_CONFIG && ++configs > 1) break;
+        if (d[1] == LIBUSB_DT_INTERFACE && d[0] >= 9) interface = d[2];
+        if (d[1] == LIBUSB_DT_ENDPOINT && d[0] >= 7 && d[2] == endpoint && interface >= 0) {
+            out->interface = (uint8_t)interface;
+            out->attributes = d[3];
+            out->max_packet = (uint16_t)(d[4] | d[5] << 8);
+            out->interval = d[6];
+            return 0;
+        }
+        pos += d[0];
+    }
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+/* ---------------- file ---------------- */
+
+static inline void desc_cache_make_path(DescCache *c) {
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[400];
+
+    c->path[0] = '\0';
+    if (base && base[0]) {
+        snprintf(dir, sizeof(dir), "%s/termux-usb", base);
+    } else if (home && home[0]) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        mkdir(dir, 0700);
+        snprintf(dir, sizeof(dir), "%s/.cache/termux-usb", home);
+    } else {
+        return;
+    }
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) return;
+
+    // The serial number goes into the file name; keep it to safe characters.
+    char serial[sizeof(c->serial)];
+    int n = 0;
+    for (const char *s = c->serial; *s && n < (int)sizeof(serial) - 1; s++) {
+        serial[n++] = (*s >= '0' && *s <= '9') || (*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z') ? *s : '_';
+    }
+    serial[n] = '\0';
+    snprintf(c->path, sizeof(c->path), "%s/%04x-%04x-%04x%s%s.desc", dir, c->vid, c->pid, c->bcd, n ? "-" : "", serial);
+}
+
+static inline int desc_cache_load(DescCache *c) {
+    DescCacheFileHeader h;
+    FILE *f = c->path[0] ? fopen(c->path, "rb") : NULL;
+    if (!f) return -1;
+
+    int ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, DESC_CACHE_MAGIC, 8) == 0 &&
+             h.vid == c->vid && h.pid == c->pid && h.bcd == c->bcd &&
+             strncmp(h.serial, c->serial, sizeof(h.serial)) == 0 &&
+             h.config_len <= DESC_CACHE_MAX_CONFIG && h.num_strings <= DESC_CACHE_MAX_STRINGS &&
+             h.num_reports <= DESC_CACHE_MAX_REPORTS &&
+             fread(c->config, 1, h.config_len, f) == h.config_len;
+    for (int i = 0; ok && i < h.num_strings; i++) {
+        DescCacheString *s = &c->strings[i];
+        unsigned char rec[3];
+        ok = fread(rec, 3, 1, f) == 1 && rec[2] < sizeof(s->text) && fread(s->text, 1, rec[2], f) == rec[2];
+        s->index = rec[0];
+        s->status = (int8_t)rec[1];
+        if (ok) s->text[rec[2]] = '\0';
+    }
+    for (int i = 0; ok && i < h.num_reports; i++) {
+        DescCacheReport *r = &c->reports[i];
+        ok = fread(&r->interface, 1, 1, f) == 1 && fread(&r->len, sizeof(r->len), 1, f) == 1 &&
+             r->len <= DESC_CACHE_MAX_REPORT && (r->len <= 0 || fread(r->data, 1, (size_t)r->len, f) == (size_t)r->len);
+    }
+    fclose(f);
+    if (!ok) return -1;
+    c->config_len = h.config_len;
+    c->num_strings = h.num_strings;
+    c->num_reports = h.num_reports;
+    return 0;
+}
+
+static inline int desc_cache_save(DescCache *c) {
+    DescCacheFileHeader h;
+    char tmp[sizeof(c->path) + 8];
+
+    if (!c->path[0]) return -1;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DESC_CACHE_MAGIC, 8);
+    h.vid = c->vid;
+    h.pid = c->pid;
+    h.bcd = c->bcd;
+    h.config_len = (uint16_t)c->config_len;
+    h.num_strings = (uint8_t)c->num_strings;
+    h.num_reports = (uint8_t)c->num_reports;
+    memcpy(h.serial, c->serial, sizeof(h.serial));
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", c->path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(c->config, 1, (size_t)c->config_len, f) == (size_t)c->config_len;
+    for (int i = 0; ok && i < c->num_strings; i++) {
+        const DescCacheString *s = &c->strings[i];
+        unsigned char rec[3] = { s->index, (unsigned char)s->status, (unsigned char)strlen(s->text) };
+        ok = fwrite(rec, 3, 1, f) == 1 && fwrite(s->text, 1, rec[2], f) == rec[2];
+    }
+    for (int i = 0; ok && i < c->num_reports; i++) {
+        const DescCacheReport *r = &c->reports[i];
+        ok = fwrite(&r->interface, 1, 1, f) == 1 && fwrite(&r->len, sizeof(r->len), 1, f) == 1 &&
+             (r->len <= 0 || fwrite(r->data, 1, (size_t)r->len, f) == (size_t)r->len);
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, c->path) < 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* ---------------- lookups ---------------- */
+
+// Read string `index` from the device into `out` as ASCII ('?' outside of
+// it). Asks in US English straight away, which nearly every device has,
+// and only reads the language table if that is refused.
+static inline int desc_cache_fetch_string(libusb_device_handle *handle, uint8_t index, char *out, int size) {
+    unsigned char buf[255];
+    int r = libusb_get_string_descriptor(handle, index, DESC_CACHE_LANGID_EN_US, buf, sizeof(buf));
+    if (r < 2 || buf[1] != LIBUSB_DT_STRING) {
+        return libusb_get_string_descriptor_ascii(handle, index, (unsigned char *)out, size);
+    }
+    if (buf[0] < r) r = buf[0];
+    int n = 0;
+    for (int i = 2; i + 1 < r && n < size - 1; i += 2) {
+        out[n++] = buf[i + 1] || buf[i] & 0x80 ? '?' : (char)buf[i];
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// Like libusb_get_string_descriptor_ascii(). Each index is read from the
+// device at most once, however often it is asked for.
+static inline int desc_cache_string(DescCache *c, libusb_device_handle *handle, uint8_t index, char *out, int size) {
+    if (index == 0 || size < 1) return LIBUSB_ERROR_INVALID_PARAM;
+    for (int i = 0; i < c->num_strings; i++) {
+        const DescCacheString *s = &c->strings[i];
+        if (s->index != index) continue;
+        c->hits++;
+        if (s->status < 0) return s->status;
+        snprintf(out, (size_t)size, "%s", s->text);
+        return (int)strlen(out);
+    }
+
+    DescCacheString s;
+    c->misses++;
+    int r = desc_cache_fetch_string(handle, index, s.text, sizeof(s.text));
+    if ((r >= 0 || desc_cache_keep_error(r)) && c->num_strings < DESC_CACHE_MAX_STRINGS) {
+        s.index = index;
+        s.status = (int8_t)(r < 0 ? r : 0);
+        if (r < 0) s.text[0] = '\0';
+        c->strings[c->num_strings++] = s;
+        c->dirty = 1;
+    }
+    if (r < 0) return r;
+    snprintf(out, (size_t)size, "%s", s.text);
+    return (int)strlen(out);
+}
+
+// Like hid_get_report_descriptor().
+static inline int desc_cache_report_descriptor(DescCache *c, libusb_device_handle *handle, int interface_number,
+                                               unsigned char *buf, int size) {
+    for (int i = 0; i < c->num_reports; i++) {
+        const DescCacheReport *r = &c->reports[i];
+        if (r->interface != interface_number) continue;
+        c->hits++;
+        if (r->len <= 0) return r->len;
+        int n = r->len < size ? r->len : size;
+        memcpy(buf, r->data, (size_t)n);
+        return n;
+    }
+
+    c->misses++;
+    int len = hid_get_report_descriptor(handle, interface_number, buf, size);
+    if ((len >= 0 || desc_cache_keep_error(len)) && c->num_reports < DESC_CACHE_MAX_REPORTS) {
+        DescCacheReport *r = &c->reports[c->num_reports++];
+        r->interface = (uint8_t)interface_number;
+        r->len = (int16_t)(len > DESC_CACHE_MAX_REPORT ? DESC_CACHE_MAX_REPORT : len);
+        if (r->len > 0) memcpy(r->data, buf, (size_t)r->len);
+        c->dirty = 1;
+    }
+    return len;
+}
+
+/* ---------------- open / close ---------------- */
+
+// Work out the key of the device behind `handle` (the serial number is read
+// from the device, if it has one) and load its cache file unless `refresh`
+// is set. Keeps no state between calls, so several caches can be open at once.
+static inline void desc_cache_open(DescCache *c, libusb_device_handle *handle, int refresh) {
+    libusb_device *dev = libusb_get_device(handle);
+    struct libusb_device_descriptor desc;
+    unsigned char config[DESC_CACHE_MAX_CONFIG];
+
+    memset(c, 0, sizeof(*c));
+    if (libusb_get_device_descriptor(dev, &desc) < 0) return;
+    c->vid = desc.idVendor;
+    c->pid = desc.idProduct;
+    c->bcd = desc.bcdDevice;
+    int config_len = desc_cache_build_config(dev, desc.bNumConfigurations, config, sizeof(config));
+    if (desc.iSerialNumber) {
+        char serial[sizeof(c->serial)];
+        if (desc_cache_fetch_string(handle, desc.iSerialNumber, serial, sizeof(serial)) > 0) {
+            snprintf(c->serial, sizeof(c->serial), "%s", serial);
+        }
+        c->misses++;
+    }
+    desc_cache_make_path(c);
+
+    if (!refresh && desc_cache_load(c) == 0) {
+        if (config_len < 0 || (c->config_len == config_len && memcmp(c->config, config, (size_t)config_len) == 0)) {
+            c->loaded = 1;
+            fprintf(stderr, "DEBUG: Descriptors from cache %s\n", c->path);
+            return;
+        }
+        fprintf(stderr, "WARN: Cached configuration of %04x:%04x differs from the device, reading it again.\n", c->vid, c->pid);
+    }
+    c->num_strings = 0;
+    c->num_reports = 0;
+    c->config_len = config_len > 0 ? config_len : 0;
+    memcpy(c->config, config, (size_t)c->config_len);
+    if (desc.iSerialNumber && c->serial[0]) {
+        c->strings[0].index = desc.iSerialNumber;
+        c->strings[0].status = 0;
+        snprintf(c->strings[0].text, sizeof(c->strings[0].text), "%s", c->serial);
+        c->num_strings = 1;
+    }
+    c->dirty = 1;
+}
+
+// Write the file if anything was added and print how much it saved.
+static inline void desc_cache_close(DescCache *c) {
+    if (c->dirty && desc_cache_save(c) < 0 && c->path[0]) {
+        fprintf(stderr, "WARN: Cannot write descriptor cache %s: %s\n", c->path, strerror(errno));
+    }
+    fprintf(stderr, "DEBUG: Descriptor cache: %u requests answered from the cache, %u sent to the device.\n",
+            c->hits, c->misses);
+    c->dirty = 0;
+}
+
+#endif // DESC_CACHE_H
@@ -0,0 +1,1200 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "libusb-1.0/libusb.h"
+#include "fakeusb.h"
+#include "../capture.h"
+
+#define FAKE_NUM_ENDPOINTS 32
+#define FAKE_NEVER UINT64_MAX
+
+// Private part of every transfer, allocated in front of the public struct.
+struct fake_itransfer {
+    struct fake_itransfer *next;
+    uint64_t due_ns;
+    enum libusb_transfer_status final_status;
+    int in_flight;
+    int completed;  // set for synchronous wrappers
+    unsigned char report[32]; // interrupt IN: report decided at schedule time
+    int report_len;
+    const uint8_t *replay_data; // replay: payload inside the mapped capture
+    int replay_len;
+    struct libusb_transfer transfer; // must be last (flexible iso array)
+};
+
+struct libusb_context {
+    pthread_mutex_t lock;
+    int wake_fd;
+    int timer_fd;                   // readable when the earliest pending transfer is due
+    uint64_t timer_due;             // what timer_fd is armed for, FAKE_NEVER: disarmed
+    struct fake_itransfer *pending;
+    struct libusb_pollfd wake_pollfd;
+    struct libusb_pollfd timer_pollfd;
+};
+
+struct libusb_device {
+    struct libusb_device_descriptor desc;
+    const struct libusb_config_descriptor *config;
+    int speed;                      // LIBUSB_SPEED_HIGH when report slots are shorter than a frame
+};
+
+struct libusb_device_handle {
+    libusb_context *ctx;
+    struct libusb_device dev;
+    struct fakeusb_config cfg;
+    uint64_t bus_free_ns[FAKE_NUM_ENDPOINTS];   // bulk/control: end of the last scheduled data phase
+    uint64_t next_slot_ns[FAKE_NUM_ENDPOINTS];  // interrupt: first slot not yet taken by a URB
+    uint64_t created_ns;
+    uint64_t pattern_offset;
+
+    // Interrupt report source (mouse, gamepad): slots are counted from
+    // created_ns in steps of slot_us.
+    unsigned int slot_us;
+    uint64_t last_report_slot;
+    int64_t mouse_sum_dx;
+    int64_t mouse_sum_dy;
+
+    // Replay of a capture file instead of the simulated device.
+    int replaying;
+    CaptureReader replay;
+    CaptureCursor replay_cursor[FAKE_NUM_ENDPOINTS];
+    uint64_t replay_start_ns;       // first IN transfer: the capture's start maps here
+    uint64_t replay_due_ns[FAKE_NUM_ENDPOINTS]; // latest completion handed out, keeps the order
+    int replay_offset[FAKE_NUM_ENDPOINTS];      // bulk: bytes of the current record already delivered
+    uint64_t replay_done_ns;        // when the first transfer found the capture exhausted
+    uint64_t stat_replay_records;
+
+    // Device-side counters, printed at libusb_close() when FAKEUSB_STATS is set.
+    uint64_t stat_in_transfers;
+    uint64_t stat_in_bytes;
+    uint64_t stat_out_transfers;
+    uint64_t stat_out_bytes;
+    uint32_t stat_out_hash;         // FNV-1a of everything received on OUT endpoints
+    uint64_t stat_slots_coalesced;
+};
+
+static struct fakeusb_config active_config;
+static int active_config_set = 0;
+
+static const char fake_pattern[] =
+    "fakeusb: the quick brown fox jumps over the lazy dog 0123456789\n";
+
+static uint64_t fake_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Arm the timer fd for the earliest pending completion, to the nanosecond,
+// like the timerfd of libusb's Linux backend: a loop sleeping in poll() on
+// the pollfds wakes up when the simulated device answers, also at 8 kHz,
+// instead of at the next whole millisecond of its timeout. Re-arming also
+// clears an expiry nobody read; an unchanged deadline is left alone.
+static void fake_arm_timer(libusb_context *ctx) {
+    uint64_t next_due = FAKE_NEVER;
+    pthread_mutex_lock(&ctx->lock);
+    for (struct fake_itransfer *it = ctx->pending; it; it = it->next) {
+        if (it->due_ns < next_due) next_due = it->due_ns;
+    }
+    int unchanged = next_due == ctx->timer_due;
+    ctx->timer_due = next_due;
+    pthread_mutex_unlock(&ctx->lock);
+    if (unchanged) return;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next_due != FAKE_NEVER) {
+        if (next_due == 0) next_due = 1; // cancelled: due at once; all zero would disarm
+        its.it_value.tv_sec = (time_t)(next_due / 1000000000ull);
+        its.it_value.tv_nsec = (long)(next_due % 1000000000ull);
+    }
+    timerfd_settime(ctx->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static struct fake_itransfer *fake_itransfer_of(struct libusb_transfer *transfer) {
+    return (struct fake_itransfer *)((char *)transfer - offsetof(struct fake_itransfer, transfer));
+}
+
+static int fake_endpoint_slot(unsigned char endpoint) {
+    return (endpoint & LIBUSB_ENDPOINT_ADDRESS_MASK) | ((endpoint & LIBUSB_ENDPOINT_DIR_MASK) ? 16 : 0);
+}
+
+static void fake_wake(libusb_context *ctx) {
+    uint64_t one = 1;
+    if (write(ctx->wake_fd, &one, sizeof(one)) < 0) {
+        // Counter overflow is harmless: the loop is already awake.
+    }
+}
+
+// The caller is about to re-check its state anyway; a level-triggered poll
+// on the wake fd (libusb_get_pollfds) must not keep firing after that.
+static void fake_drain_wake(libusb_context *ctx) {
+    uint64_t v;
+    if (read(ctx->wake_fd, &v, sizeof(v)) < 0) {
+        // EAGAIN: nothing pending.
+    }
+}
+
+static enum fakeusb_device fake_parse_device(const char *s, size_t len) {
+    if (len == 5 && strncmp(s, "mouse", len) == 0) return FAKEUSB_DEVICE_MOUSE;
+    if (len == 7 && strncmp(s, "gamepad", len) == 0) return FAKEUSB_DEVICE_GAMEPAD;
+    return FAKEUSB_DEVICE_CDC;
+}
+
+/* =========================================================
+ * Configuration
+ * ========================================================= */
+
+void fakeusb_default_config(struct fakeusb_config *cfg) {
+    const char *s;
+    cfg->device = FAKEUSB_DEVICE_CDC;
+    cfg->latency_us = 1000;
+    cfg->bytes_per_sec = 1000000.0;
+    cfg->out_bytes_per_sec = 0;
+    cfg->max_packet_size = 64;
+    cfg->report_interval_us = 0;
+    cfg->mouse_radius = 1000.0;
+    cfg->replay_path = getenv("FAKEUSB_REPLAY");
+    cfg->replay_speed = 1.0;
+    cfg->num_devices = 0;
+    cfg->idle = getenv("FAKEUSB_IDLE") != NULL;
+    if ((s = getenv("FAKEUSB_DEVICE")) != NULL) {
+        // "mouse,gamepad,cdc": one entry per wrapped device, in turn.
+        while (cfg->num_devices < FAKEUSB_MAX_DEVICES) {
+            size_t len = strcspn(s, ",");
+            cfg->devices[cfg->num_devices++] = fake_parse_device(s, len);
+            if (s[len] == '\0') break;
+            s += len + 1;
+        }
+        cfg->device = cfg->devices[0];
+    }
+    if ((s = getenv("FAKEUSB_LATENCY_US")) != NULL) cfg->latency_us = (unsigned int)strtoul(s, NULL, 0);
+    if ((s = getenv("FAKEUSB_BANDWIDTH")) != NULL) cfg->bytes_per_sec = strtod(s, NULL);
+    if ((s = getenv("FAKEUSB_OUT_RATE")) != NULL) cfg->out_bytes_per_sec = strtod(s, NULL);
+    if ((s = getenv("FAKEUSB_MAX_PACKET")) != NULL) cfg->max_packet_size = (int)strtol(s, NULL, 0);
+    if ((s = getenv("FAKEUSB_REPORT_US")) != NULL) cfg->report_interval_us = (unsigned int)strtoul(s, NULL, 0);
+    if ((s = getenv("FAKEUSB_MOUSE_RADIUS")) != NULL) cfg->mouse_radius = strtod(s, NULL);
+    if ((s = getenv("FAKEUSB_REPLAY_SPEED")) != NULL) cfg->replay_speed = strtod(s, NULL);
+    if (cfg->replay_speed < 0) cfg->replay_speed = 0;
+    if (cfg->bytes_per_sec <= 0) cfg->bytes_per_sec = 1000000.0;
+    if (cfg->max_packet_size <= 0) cfg->max_packet_size = 64;
+}
+
+void fakeusb_configure(const struct fakeusb_config *cfg) {
+    active_config = *cfg;
+    active_config_set = 1;
+}
+
+/* =========================================================
+ * Context / device
+ * ========================================================= */
+
+int libusb_init(libusb_context **ctx) {
+    libusb_context *c = calloc(1, sizeof(*c));
+    if (!c) return LIBUSB_ERROR_NO_MEM;
+    c->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    c->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (c->wake_fd < 0 || c->timer_fd < 0) {
+        if (c->wake_fd >= 0) close(c->wake_fd);
+        if (c->timer_fd >= 0) close(c->timer_fd);
+        free(c);
+        return LIBUSB_ERROR_OTHER;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    c->wake_pollfd.fd = c->wake_fd;
+    c->wake_pollfd.events = POLLIN;
+    c->timer_pollfd.fd = c->timer_fd;
+    c->timer_pollfd.events = POLLIN;
+    c->timer_due = FAKE_NEVER;
+    if (!active_config_set) {
+        fakeusb_default_config(&active_config);
+        active_config_set = 1;
+    }
+    *ctx = c;
+    return LIBUSB_SUCCESS;
+}
+
+void libusb_exit(libusb_context *ctx) {
+    if (!ctx) return;
+    close(ctx->wake_fd);
+    close(ctx->timer_fd);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx);
+}
+
+int libusb_set_option(libusb_context *ctx, enum libusb_option option, ...) {
+    (void)ctx;
+    (void)option;
+    return LIBUSB_SUCCESS;
+}
+
+const char *libusb_error_name(int errcode) {
+    switch (errcode) {
+        case LIBUSB_SUCCESS: return "LIBUSB_SUCCESS";
+        case LIBUSB_ERROR_IO: return "LIBUSB_ERROR_IO";
+        case LIBUSB_ERROR_INVALID_PARAM: return "LIBUSB_ERROR_INVALID_PARAM";
+        case LIBUSB_ERROR_ACCESS: return "LIBUSB_ERROR_ACCESS";
+        case LIBUSB_ERROR_NO_DEVICE: return "LIBUSB_ERROR_NO_DEVICE";
+        case LIBUSB_ERROR_NOT_FOUND: return "LIBUSB_ERROR_NOT_FOUND";
+        case LIBUSB_ERROR_BUSY: return "LIBUSB_ERROR_BUSY";
+        case LIBUSB_ERROR_TIMEOUT: return "LIBUSB_ERROR_TIMEOUT";
+        case LIBUSB_ERROR_OVERFLOW: return "LIBUSB_ERROR_OVERFLOW";
+        case LIBUSB_ERROR_PIPE: return "LIBUSB_ERROR_PIPE";
+        case LIBUSB_ERROR_INTERRUPTED: return "LIBUSB_ERROR_INTERRUPTED";
+        case LIBUSB_ERROR_NO_MEM: return "LIBUSB_ERROR_NO_MEM";
+        case LIBUSB_ERROR_NOT_SUPPORTED: return "LIBUSB_ERROR_NOT_SUPPORTED";
+        case LIBUSB_ERROR_OTHER: return "LIBUSB_ERROR_OTHER";
+        default: return "**UNKNOWN**";
+    }
+}
+
+/*
+ * CDC-ACM board: interface 0 (communications, interrupt IN 0x81) and
+ * interface 1 (data, bulk OUT 0x02 / bulk IN 0x83).
+ */
+static const struct libusb_endpoint_descriptor fake_comm_endpoints[] = {
+    { LIBUSB_DT_ENDPOINT_SIZE, LIBUSB_DT_ENDPOINT, 0x81, LIBUSB_TRANSFER_TYPE_INTERRUPT, 16, 64, 0, 0, NULL, 0 },
+};
+static const struct libusb_endpoint_descriptor fake_data_endpoints[] = {
+    { LIBUSB_DT_ENDPOINT_SIZE, LIBUSB_DT_ENDPOINT, 0x02, LIBUSB_TRANSFER_TYPE_BULK, 64, 0, 0, 0, NULL, 0 },
+    { LIBUSB_DT_ENDPOINT_SIZE, LIBUSB_DT_ENDPOINT, 0x83, LIBUSB_TRANSFER_TYPE_BULK, 64, 0, 0, 0, NULL, 0 },
+};
+static const struct libusb_interface_descriptor fake_cdc_altsettings[] = {
+    { LIBUSB_DT_INTERFACE_SIZE, LIBUSB_DT_INTERFACE, 0, 0, 1, LIBUSB_CLASS_COMM, 0x02, 0x01, 0, fake_comm_endpoints, NULL, 0 },
+    { LIBUSB_DT_INTERFACE_SIZE, LIBUSB_DT_INTERFACE, 1, 0, 2, LIBUSB_CLASS_DATA, 0x00, 0x00, 0, fake_data_endpoints, NULL, 0 },
+};
+static const struct libusb_interface fake_cdc_interfaces[] = {
+    { &fake_cdc_altsettings[0], 1 },
+    { &fake_cdc_altsettings[1], 1 },
+};
+static const struct libusb_config_descriptor fake_cdc_config = {
+    LIBUSB_DT_CONFIG_SIZE, LIBUSB_DT_CONFIG, 75, 2, 1, 0, 0x80, 250, fake_cdc_interfaces, NULL, 0
+};
+
+/*
+ * Mouse (receiver-style composite): interface 0 keyboard (interrupt IN 0x81),
+ * interface 1 mouse (interrupt IN 0x82). Mouse reports are 8 bytes:
+ *   [0] report id 0x02, [1] buttons, [2-3] X, [4-5] Y (int16 LE), [6] wheel, [7] AC pan
+ */
+static const struct libusb_endpoint_descriptor fake_kbd_endpoints[] = {
+    { LIBUSB_DT_ENDPOINT_SIZE, LIBUSB_DT_ENDPOINT, 0x81, LIBUSB_TRANSFER_TYPE_INTERRUPT, 8, 10, 0, 0, NULL, 0 },
+};
+static const struct libusb_endpoint_descriptor fake_mouse_endpoints[] = {
+    { LIBUSB_DT_ENDPOINT_SIZE, LIBUSB_DT_ENDPOINT, 0x82, LIBUSB_TRANSFER_TYPE_INTERRUPT, 8, 1, 0, 0, NULL, 0 },
+};
+static const struct libusb_interface_descriptor fake_mouse_altsettings[] = {
+    { LIBUSB_DT_INTERFACE_SIZE, LIBUSB_DT_INTERFACE, 0, 0, 1, LIBUSB_CLASS_HID, 0x01, 0x01, 0, fake_kbd_endpoints, NULL, 0 },
+    { LIBUSB_DT_INTERFACE_SIZE, LIBUSB_DT_INTERFACE, 1, 0, 1, LIBUSB_CLASS_HID, 0x01, 0x02, 0, fake_mouse_endpoints, NULL, 0 },
+};
+static const struct libusb_interface fake_mouse_interfaces[] = {
+    { &fake_mouse_altsettings[0], 1 },
+    { &fake_mouse_altsettings[1], 1 },
+};
+static const struct libusb_config_descriptor fake_mouse_config = {
+    LIBUSB_DT_CONFIG_SIZE, LIBUSB_DT_CONFIG, 59, 2, 1, 0, 0xa0, 50, fake_mouse_interfaces, NULL, 0
+};
+
+// HID report descriptors served by GET_DESCRIPTOR(REPORT) on interfaces 0 and 1.
+static const unsigned char fake_kbd_report_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xa1, 0x01,             // Usage Page (Generic Desktop), Usage (Keyboard), Collection (Application)
+    0x05, 0x07, 0x19, 0xe0, 0x29, 0xe7,             //   Usage Page (Keyboard), Usage Minimum (0xe0), Usage Maximum (0xe7)
+    0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, //   Logical Minimum (0), Logical Maximum (1), Report Size (1), Report Count (8)
+    0x81, 0x02,                                     //   Input (Data, Variable, Absolute): modifiers
+    0x75, 0x08, 0x95, 0x01, 0x81, 0x01,             //   Report Size (8), Report Count (1), Input (Constant): reserved
+    0x19, 0x00, 0x29, 0x65, 0x15, 0x00, 0x25, 0x65, //   Usage Minimum (0), Usage Maximum (0x65), Logical Minimum (0), Logical Maximum (0x65)
+    0x75, 0x08, 0x95, 0x06, 0x81, 0x00,             //   Report Size (8), Report Count (6), Input (Data, Array): keys
+    0xc0,                                           // End Collection
+};
+static const unsigned char fake_mouse_report_desc[] = {
+    0x05, 0x01, 0x09, 0x02, 0xa1, 0x01,             // Usage Page (Generic Desktop), Usage (Mouse), Collection (Application)
+    0x85, 0x02, 0x09, 0x01, 0xa1, 0x00,             //   Report ID (2), Usage (Pointer), Collection (Physical)
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x08,             //     Usage Page (Button), Usage Minimum (1), Usage Maximum (8)
+    0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, //     Logical Minimum (0), Logical Maximum (1), Report Size (1), Report Count (8)
+    0x81, 0x02,                                     //     Input (Data, Variable, Absolute)
+    0x05, 0x01, 0x16, 0x01, 0x80, 0x26, 0xff, 0x7f, //     Usage Page (Generic Desktop), Logical Minimum (-32767), Logical Maximum (32767)
+    0x75, 0x10, 0x95, 0x02, 0x09, 0x30, 0x09, 0x31, //     Report Size (16), Report Count (2), Usage (X), Usage (Y)
+    0x81, 0x06,                                     //     Input (Data, Variable, Relative)
+    0x15, 0x81, 0x25, 0x7f, 0x75, 0x08, 0x95, 0x01, //     Logical Minimum (-127), Logical Maximum (127), Report Size (8), Report Count (1)
+    0x09, 0x38, 0x81, 0x06,                         //     Usage (Wheel), Input (Data, Variable, Relative)
+    0x05, 0x0c, 0x0a, 0x38, 0x02, 0x81, 0x06,       //     Usage Page (Consumer), Usage (AC Pan), Input (Data, Variable, Relative)
+    0xc0, 0xc0,                                     //   End Collection, End Collection
+};
+
+/*
+ * Gamepad (Xbox 360 wired layout): vendor-specific interface 0 with
+ * interrupt IN 0x81 (20-byte reports, see usb-gamepad/gamepad_decode.h)
+ * and interrupt OUT 0x02 (rumble / LEDs).
+ */
+static const struct libusb_endpoint_descriptor fake_gamepad_endpoints[] = {
+    { LIBUSB_DT_ENDPOINT_SIZE, LIBUSB_DT_ENDPOINT, 0x81, LIBUSB_TRANSFER_TYPE_INTERRUPT, 32, 4, 0, 0, NULL, 0 },
+    { LIBUSB_DT_ENDPOINT_SIZE, LIBUSB_DT_ENDPOINT, 0x02, LIBUSB_TRANSFER_TYPE_INTERRUPT, 32, 8, 0, 0, NULL, 0 },
+};
+static const struct libusb_interface_descriptor fake_gamepad_altsettings[] = {
+    { LIBUSB_DT_INTERFACE_SIZE, LIBUSB_DT_INTERFACE, 0, 0, 2, LIBUSB_CLASS_VENDOR_SPEC, 0x5d, 0x01, 0, fake_gamepad_endpoints, NULL, 0 },
+};
+static const struct libusb_interface fake_gamepad_interfaces[] = {
+    { &fake_gamepad_altsettings[0], 1 },
+};
+static const struct libusb_config_descriptor fake_gamepad_config = {
+    LIBUSB_DT_CONFIG_SIZE, LIBUSB_DT_CONFIG, 48, 1, 1, 0, 0xa0, 250, fake_gamepad_interfaces, NULL, 0
+};
+
+static const struct libusb_endpoint_descriptor *fake_find_endpoint(const struct libusb_config_descriptor *config,
+                                                                   unsigned char address) {
+    for (int i = 0; i < config->bNumInterfaces; i++) {
+        const struct libusb_interface_descriptor *alt = &config->interface[i].altsetting[0];
+        for (int e = 0; e < alt->bNumEndpoints; e++) {
+            if (alt->endpoint[e].bEndpointAddress == address) return &alt->endpoint[e];
+        }
+    }
+    return NULL;
+}
+
+int libusb_wrap_sys_device(libusb_context *ctx, intptr_t sys_dev, libusb_device_handle **dev_handle) {
+    (void)sys_dev;
+    libusb_device_handle *h = calloc(1, sizeof(*h));
+    if (!h) return LIBUSB_ERROR_NO_MEM;
+    h->ctx = ctx;
+    h->cfg = active_config;
+    h->stat_out_hash = 2166136261u;
+    if (active_config.num_devices > 1) {
+        static int wrapped;
+        h->cfg.device = active_config.devices[wrapped++ % active_config.num_devices];
+    }
+    if (h->cfg.replay_path && h->cfg.replay_path[0]) {
+        if (capture_reader_open(&h->replay, h->cfg.replay_path) < 0) {
+            fprintf(stderr, "fakeusb: cannot replay %s: %s\n", h->cfg.replay_path, strerror(errno));
+            free(h);
+            return LIBUSB_ERROR_NOT_FOUND;
+        }
+        h->replaying = 1;
+    }
+    h->created_ns = fake_now_ns();
+
+    struct libusb_device_descriptor *d = &h->dev.desc;
+    d->bLength = LIBUSB_DT_DEVICE_SIZE;
+    d->bDescriptorType = LIBUSB_DT_DEVICE;
+    d->bcdUSB = 0x0200;
+    d->bDeviceClass = 0xef;
+    d->bDeviceSubClass = 0x02;
+    d->bDeviceProtocol = 0x01;
+    d->bMaxPacketSize0 = 64;
+    d->idVendor = 0x2341;
+    d->idProduct = 0x8036;
+    d->bcdDevice = 0x0100;
+    d->iManufacturer = 1;
+    d->iProduct = 2;
+    d->iSerialNumber = 3;
+    d->bNumConfigurations = 1;
+    h->dev.config = &fake_cdc_config;
+
+    if (h->cfg.device == FAKEUSB_DEVICE_MOUSE) {
+        d->bDeviceClass = 0;
+        d->bDeviceSubClass = 0;
+        d->bDeviceProtocol = 0;
+        d->bMaxPacketSize0 = 8;
+        d->idVendor = 0x046d;
+        d->idProduct = 0xc534;
+        d->bcdDevice = 0x2901;
+        d->iSerialNumber = 0;
+        h->dev.config = &fake_mouse_config;
+    } else if (h->cfg.device == FAKEUSB_DEVICE_GAMEPAD) {
+        d->bDeviceClass = 0xff;
+        d->bDeviceSubClass = 0xff;
+        d->bDeviceProtocol = 0xff;
+        d->bMaxPacketSize0 = 8;
+        d->idVendor = 0x045e;
+        d->idProduct = 0x028e;
+        d->bcdDevice = 0x0114;
+        d->iSerialNumber = 0;
+        h->dev.config = &fake_gamepad_config;
+    }
+
+    // Report slots follow bInterval (full speed: milliseconds) unless overridden.
+    h->slot_us = h->cfg.report_interval_us;
+    if (h->slot_us == 0) {
+        unsigned char ep = h->cfg.device == FAKEUSB_DEVICE_MOUSE ? 0x82 : 0x81;
+        const struct libusb_endpoint_descriptor *desc = fake_find_endpoint(h->dev.config, ep);
+        h->slot_us = desc && desc->bInterval ? desc->bInterval * 1000u : 1000u;
+    }
+    // Faster than one report per 1 ms frame takes a high-speed device (8 kHz: bInterval 1 = 125 us).
+    h->dev.speed = h->slot_us < 1000 ? LIBUSB_SPEED_HIGH : LIBUSB_SPEED_FULL;
+
+    *dev_handle = h;
+    return LIBUSB_SUCCESS;
+}
+
+libusb_device *libusb_get_device(libusb_device_handle *dev_handle) {
+    return &dev_handle->dev;
+}
+
+void libusb_close(libusb_device_handle *dev_handle) {
+    if (getenv("FAKEUSB_STATS")) {
+        fprintf(stderr, "fakeusb: %llu IN transfers, %llu bytes",
+                (unsigned long long)dev_handle->stat_in_transfers, (unsigned long long)dev_handle->stat_in_bytes);
+        if (dev_handle->cfg.device == FAKEUSB_DEVICE_MOUSE) {
+            fprintf(stderr, ", motion sent dx=%lld dy=%lld",
+                    (long long)dev_handle->mouse_sum_dx, (long long)dev_handle->mouse_sum_dy);
+        }
+        if (dev_handle->cfg.device != FAKEUSB_DEVICE_CDC) {
+            fprintf(stderr, ", %llu unpolled report slots coalesced",
+                    (unsigned long long)dev_handle->stat_slots_coalesced);
+        }
+        fprintf(stderr, "\n");
+        if (dev_handle->stat_out_transfers) {
+            fprintf(stderr, "fakeusb: %llu OUT transfers, %llu bytes, FNV-1a %08x\n",
+                    (unsigned long long)dev_handle->stat_out_transfers, (unsigned long long)dev_handle->stat_out_bytes,
+                    dev_handle->stat_out_hash);
+        }
+        if (dev_handle->replaying) {
+            uint64_t end = dev_handle->replay_done_ns ? dev_handle->replay_done_ns : fake_now_ns();
+            uint64_t start = dev_handle->replay_start_ns ? dev_handle->replay_start_ns : end;
+            double secs = (double)(end - start) / 1e9;
+            uint64_t n = dev_handle->stat_replay_records;
+            fprintf(stderr, "fakeusb: replayed %llu transfers in %.3f s: %.0f ns per transfer, %.3f MB/s%s\n",
+                    (unsigned long long)n, secs, n ? secs * 1e9 / (double)n : 0.0,
+                    secs > 0 ? (double)dev_handle->stat_in_bytes / secs / 1e6 : 0.0,
+                    dev_handle->replay_done_ns ? "" : " (stopped before the end of the capture)");
+        }
+    }
+    if (dev_handle->replaying) capture_reader_close(&dev_handle->replay);
+    free(dev_handle);
+}
+
+int libusb_get_device_descriptor(libusb_device *dev, struct libusb_device_descriptor *desc) {
+    *desc = dev->desc;
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_get_active_config_descriptor(libusb_device *dev, struct libusb_config_descriptor **config) {
+    return libusb_get_config_descriptor(dev, 0, config);
+}
+
+int libusb_get_config_descriptor(libusb_device *dev, uint8_t config_index, struct libusb_config_descriptor **config) {
+    if (config_index != 0) return LIBUSB_ERROR_NOT_FOUND;
+    *config = (struct libusb_config_descriptor *)dev->config;
+    return LIBUSB_SUCCESS;
+}
+
+void libusb_free_config_descriptor(struct libusb_config_descriptor *config) {
+    (void)config; // static
+}
+
+int libusb_get_max_packet_size(libusb_device *dev, unsigned char endpoint) {
+    libusb_device_handle *h = (libusb_device_handle *)((char *)dev - offsetof(struct libusb_device_handle, dev));
+    const struct libusb_endpoint_descriptor *ep = fake_find_endpoint(dev->config, endpoint);
+    if (!ep) return LIBUSB_ERROR_NOT_FOUND;
+    if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) == LIBUSB_TRANSFER_TYPE_BULK) return h->cfg.max_packet_size;
+    return ep->wMaxPacketSize;
+}
+
+int libusb_get_device_speed(libusb_device *dev) {
+    return dev->speed;
+}
+
+int libusb_kernel_driver_active(libusb_device_handle *dev_handle, int interface_number) {
+    (void)dev_handle;
+    (void)interface_number;
+    return 0;
+}
+
+int libusb_detach_kernel_driver(libusb_device_handle *dev_handle, int interface_number) {
+    (void)dev_handle;
+    (void)interface_number;
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+int libusb_attach_kernel_driver(libusb_device_handle *dev_handle, int interface_number) {
+    (void)dev_handle;
+    (void)interface_number;
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+int libusb_set_auto_detach_kernel_driver(libusb_device_handle *dev_handle, int enable) {
+    (void)dev_handle;
+    (void)enable;
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number) {
+    (void)dev_handle;
+    return (interface_number >= 0 && interface_number < 32) ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+
+int libusb_release_interface(libusb_device_handle *dev_handle, int interface_number) {
+    (void)dev_handle;
+    (void)interface_number;
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_clear_halt(libusb_device_handle *dev_handle, unsigned char endpoint) {
+    (void)dev_handle;
+    (void)endpoint;
+    return LIBUSB_SUCCESS;
+}
+
+/* =========================================================
+ * Simulated device behaviour
+ * ========================================================= */
+
+static void fake_fill_pattern(libusb_device_handle *h, unsigned char *buf, int len) {
+    const size_t plen = sizeof(fake_pattern) - 1;
+    size_t off = (size_t)(h->pattern_offset % plen);
+    int done = 0;
+    while (done < len) {
+        size_t n = plen - off;
+        if (n > (size_t)(len - done)) n = (size_t)(len - done);
+        memcpy(buf + done, fake_pattern + off, n);
+        done += (int)n;
+        off = 0;
+    }
+    h->pattern_offset += (uint64_t)len;
+}
+
+static int fake_string_descriptor(uint8_t index, unsigned char *out, int max_len) {
+    static const char *strings[] = { NULL, "Fake USB", "Fake CDC-ACM Board", "FAKE0001" };
+    if (index == 0) {
+        if (max_len < 4) return LIBUSB_ERROR_OVERFLOW;
+        out[0] = 4; out[1] = LIBUSB_DT_STRING; out[2] = 0x09; out[3] = 0x04;
+        return 4;
+    }
+    if (index >= sizeof(strings) / sizeof(strings[0])) return LIBUSB_ERROR_PIPE;
+    const char *s = strings[index];
+    int n = 2 + 2 * (int)strlen(s);
+    if (n > max_len) n = max_len & ~1;
+    out[0] = (unsigned char)n;
+    out[1] = LIBUSB_DT_STRING;
+    for (int i = 2; i + 1 < n; i += 2) {
+        out[i] = (unsigned char)s[(i - 2) / 2];
+        out[i + 1] = 0;
+    }
+    return n;
+}
+
+// Produce the result of a control request; returns bytes in the data stage or an error.
+static int fake_control_request(libusb_device_handle *h, struct libusb_control_setup *setup, unsigned char *data) {
+    if ((setup->bmRequestType & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT) {
+        return setup->wLength;
+    }
+    if (setup->bRequest == LIBUSB_REQUEST_GET_DESCRIPTOR) {
+        uint8_t type = (uint8_t)(setup->wValue >> 8);
+        uint8_t index = (uint8_t)(setup->wValue & 0xff);
+        if (type == LIBUSB_DT_STRING) {
+            return fake_string_descriptor(index, data, setup->wLength);
+        }
+        if (type == LIBUSB_DT_REPORT && h->cfg.device == FAKEUSB_DEVICE_MOUSE && setup->wIndex <= 1) {
+            // The Xbox 360 pad is vendor-class and has no report descriptor.
+            const unsigned char *desc = setup->wIndex == 0 ? fake_kbd_report_desc : fake_mouse_report_desc;
+            int n = setup->wIndex == 0 ? (int)sizeof(fake_kbd_report_desc) : (int)sizeof(fake_mouse_report_desc);
+            if (n > setup->wLength) n = setup->wLength;
+            memcpy(data, desc, (size_t)n);
+            return n;
+        }
+        return LIBUSB_ERROR_PIPE;
+    }
+    memset(data, 0, setup->wLength);
+    return setup->wLength;
+}
+
+/*
+ * Interrupt IN report sources. A source computes the report the device
+ * would send at slot `slot` when it last sent one at slot `last`, or
+ * returns 0 if it has nothing new and NAKs the poll. The device state is
+ * a pure function of the slot number, so scheduling a URB can look ahead
+ * to the first slot with news.
+ */
+typedef int (*fake_report_fn)(libusb_device_handle *h, uint64_t last, uint64_t slot, unsigned char *report);
+
+/*
+ * Synthetic mouse: the pointer runs a circle of `mouse_radius` counts
+ * (FAKEUSB_MOUSE_RADIUS, default 1000) every 2 s, the left button is held during odd seconds and the wheel
+ * ticks every 0.5 s. A report carries the motion since the last report,
+ * so motion from slots nobody polled is folded into the next one and the
+ * sum of all delivered deltas never loses a count.
+ */
+#define FAKE_SCAN_LIMIT 100000
+
+typedef struct {
+    int32_t x, y, wheel;
+    uint8_t buttons;
+} FakeMouseState;
+
+static double fake_slot_seconds(libusb_device_handle *h, uint64_t slot) {
+    return (double)slot * h->slot_us / 1e6;
+}
+
+static FakeMouseState fake_mouse_state(libusb_device_handle *h, uint64_t slot) {
+    FakeMouseState st;
+    double t = fake_slot_seconds(h, slot);
+    st.x = (int32_t)lround(h->cfg.mouse_radius * (cos(t * M_PI) - 1.0));
+    st.y = (int32_t)lround(h->cfg.mouse_radius * sin(t * M_PI));
+    st.wheel = (int32_t)(t * 2.0);
+    st.buttons = ((uint64_t)t % 2 == 1) ? 0x01 : 0x00;
+    return st;
+}
+
+static int fake_mouse_report(libusb_device_handle *h, uint64_t last, uint64_t slot, unsigned char *report) {
+    FakeMouseState from = fake_mouse_state(h, last);
+    FakeMouseState to = fake_mouse_state(h, slot);
+    if (from.x == to.x && from.y == to.y && from.wheel == to.wheel && from.buttons == to.buttons) return 0;
+
+    int32_t dx = to.x - from.x;
+    int32_t dy = to.y - from.y;
+    int32_t wheel = to.wheel - from.wheel;
+    if (dx > INT16_MAX) dx = INT16_MAX;
+    if (dx < INT16_MIN) dx = INT16_MIN;
+    if (dy > INT16_MAX) dy = INT16_MAX;
+    if (dy < INT16_MIN) dy = INT16_MIN;
+    if (wheel > INT8_MAX) wheel = INT8_MAX;
+    report[0] = 0x02;
+    report[1] = to.buttons;
+    report[2] = (unsigned char)(dx & 0xff);
+    report[3] = (unsigned char)((dx >> 8) & 0xff);
+    report[4] = (unsigned char)(dy & 0xff);
+    report[5] = (unsigned char)((dy >> 8) & 0xff);
+    report[6] = (unsigned char)wheel;
+    report[7] = 0;
+    return 8;
+}
+
+/*
+ * Synthetic gamepad: during even seconds the left stick circles once per
+ * second, the right stick once every 3 s and the triggers ramp; during odd
+ * seconds the analog controls rest. A different face/D-pad button is held
+ * every 250 ms. Like most pads it sends its full state on every poll,
+ * changed or not, so an unpolled slot is simply superseded.
+ */
+static void fake_gamepad_state(libusb_device_handle *h, uint64_t slot, unsigned char *r) {
+    double t = fake_slot_seconds(h, slot);
+    unsigned step = (unsigned)(t * 4.0) % 12;
+    if ((uint64_t)t % 2 == 1) t = floor(t); // analog controls rest
+    int16_t lx = (int16_t)lround(32767.0 * cos(t * 2.0 * M_PI));
+    int16_t ly = (int16_t)lround(32767.0 * sin(t * 2.0 * M_PI));
+    int16_t rx = (int16_t)lround(16000.0 * cos(t * 2.0 * M_PI / 3.0));
+    int16_t ry = (int16_t)lround(16000.0 * sin(t * 2.0 * M_PI / 3.0));
+
+    memset(r, 0, 20);
+    r[0] = 0x00;
+    r[1] = 0x14;
+    if (step < 4) r[2] = (unsigned char)(1u << step);           // D-pad
+    else if (step < 8) r[3] = (unsigned char)(0x10u << (step - 4)); // A, B, X, Y
+    else if (step < 10) r[3] = (unsigned char)(1u << (step - 8));   // L1, R1
+    else r[2] = (unsigned char)(0x10u << (step - 10));             // Start, Back
+    r[4] = (unsigned char)((uint64_t)(t * 128.0) % 256);
+    r[5] = (unsigned char)(255 - r[4]);
+    r[6] = (unsigned char)(lx & 0xff); r[7] = (unsigned char)((lx >> 8) & 0xff);
+    r[8] = (unsigned char)(ly & 0xff); r[9] = (unsigned char)((ly >> 8) & 0xff);
+    r[10] = (unsigned char)(rx & 0xff); r[11] = (unsigned char)((rx >> 8) & 0xff);
+    r[12] = (unsigned char)(ry & 0xff); r[13] = (unsigned char)((ry >> 8) & 0xff);
+}
+
+static int fake_gamepad_report(libusb_device_handle *h, uint64_t last, uint64_t slot, unsigned char *report) {
+    (void)last;
+    fake_gamepad_state(h, slot, report);
+    return 20;
+}
+
+// The report source behind an endpoint, NULL for endpoints using the bulk timing model.
+static fake_report_fn fake_report_source(libusb_device_handle *h, const struct libusb_transfer *t) {
+    if (t->type != LIBUSB_TRANSFER_TYPE_INTERRUPT || !(t->endpoint & LIBUSB_ENDPOINT_IN)) return NULL;
+    if (h->cfg.device == FAKEUSB_DEVICE_MOUSE && t->endpoint == 0x82) return fake_mouse_report;
+    if (h->cfg.device == FAKEUSB_DEVICE_GAMEPAD && t->endpoint == 0x81) return fake_gamepad_report;
+    return NULL;
+}
+
+// Interrupt IN with a report source: the URB completes at the first polled
+// slot that has news since the last report, or times out.
+static void fake_schedule_interrupt(libusb_device_handle *h, struct fake_itransfer *it, uint64_t now, fake_report_fn source) {
+    struct libusb_transfer *t = &it->transfer;
+    int ep = fake_endpoint_slot(t->endpoint);
+    uint64_t period = (uint64_t)h->slot_us * 1000ull;
+    uint64_t first = h->next_slot_ns[ep] > now ? (h->next_slot_ns[ep] - h->created_ns) / period
+                                               : (now - h->created_ns + period - 1) / period;
+    uint64_t limit = first + FAKE_SCAN_LIMIT;
+    if (t->timeout) limit = first + ((uint64_t)t->timeout * 1000000ull + period - 1) / period;
+
+    // Slots between the previous report and `first` that had news but were
+    // not polled (no URB queued): their content ends up coalesced.
+    unsigned char scratch[sizeof(it->report)];
+    for (uint64_t s = h->last_report_slot + 1; s < first && s < h->last_report_slot + FAKE_SCAN_LIMIT; s++) {
+        if (source(h, s - 1, s, scratch)) h->stat_slots_coalesced++;
+    }
+
+    for (uint64_t s = first; s < limit; s++) {
+        int n = source(h, h->last_report_slot, s, it->report);
+        if (n > 0) {
+            it->report_len = n;
+            it->due_ns = h->created_ns + s * period;
+            it->final_status = LIBUSB_TRANSFER_COMPLETED;
+            h->last_report_slot = s;
+            h->next_slot_ns[ep] = it->due_ns + period;
+            return;
+        }
+    }
+
+    // Nothing to report before the timeout: every slot up to it was NAKed.
+    it->report_len = 0;
+    it->final_status = LIBUSB_TRANSFER_TIMED_OUT;
+    it->due_ns = t->timeout ? now + (uint64_t)t->timeout * 1000000ull : FAKE_NEVER;
+    h->next_slot_ns[ep] = h->created_ns + limit * period;
+}
+
+// Replay: the next recorded transfer of this endpoint, due at its recorded
+// time (scaled by the replay speed) or immediately at speed 0. Completions
+// of one endpoint never overtake each other, so the end of the capture is
+// only reported after every queued record. Bulk IN is a byte stream: a
+// record longer than the transfer is split across several transfers.
+static void fake_schedule_replay(libusb_device_handle *h, struct fake_itransfer *it, uint64_t now) {
+    struct libusb_transfer *t = &it->transfer;
+    int ep = fake_endpoint_slot(t->endpoint);
+    CaptureCursor c = h->replay_cursor[ep];
+    CaptureRecord rec;
+    const uint8_t *payload = NULL;
+    int found = 0;
+
+    if (!h->replay_start_ns) h->replay_start_ns = now;
+    while (capture_next(&h->replay, &c, &rec, &payload)) {
+        if (rec.endpoint == t->endpoint) {
+            found = 1;
+            break;
+        }
+    }
+    it->replay_data = NULL;
+    it->replay_len = 0;
+    uint64_t due = now > h->replay_due_ns[ep] ? now : h->replay_due_ns[ep];
+    if (!found) {
+        h->replay_cursor[ep] = c;
+        if (!h->replay_done_ns) h->replay_done_ns = due;
+        it->final_status = LIBUSB_TRANSFER_NO_DEVICE;
+        it->due_ns = due;
+        return;
+    }
+
+
+    if (h->cfg.replay_speed > 0) {
+        uint64_t offset = rec.t_ns > h->replay.header->start_ns ? rec.t_ns - h->replay.header->start_ns : 0;
+        uint64_t at = h->replay_start_ns + (uint64_t)((double)offset / h->cfg.replay_speed);
+        if (at > due) due = at;
+    }
+    if (t->timeout && due > now + (uint64_t)t->timeout * 1000000ull) {
+        // Not due yet: this URB times out and the record stays for the next one.
+        it->final_status = LIBUSB_TRANSFER_TIMED_OUT;
+        it->due_ns = now + (uint64_t)t->timeout * 1000000ull;
+        return;
+    }
+    int offset = h->replay_offset[ep];
+    int len = rec.len - offset;
+    if (t->type == LIBUSB_TRANSFER_TYPE_BULK && len > t->length) {
+        len = t->length;
+        h->replay_offset[ep] += len;
+    } else {
+        h->replay_cursor[ep] = c;
+        h->replay_offset[ep] = 0;
+    }
+    h->replay_due_ns[ep] = due;
+    it->replay_data = payload + offset;
+    it->replay_len = len;
+    it->final_status = rec.status ? (enum libusb_transfer_status)rec.status : LIBUSB_TRANSFER_COMPLETED;
+    it->due_ns = due;
+}
+
+// Called with the context lock held when a transfer is queued.
+static void fake_schedule(libusb_device_handle *h, struct fake_itransfer *it, uint64_t now) {
+    struct libusb_transfer *t = &it->transfer;
+    int slot = fake_endpoint_slot(t->endpoint);
+    if (h->cfg.idle && t->type != LIBUSB_TRANSFER_TYPE_CONTROL && (t->endpoint & LIBUSB_ENDPOINT_IN)) {
+        // A quiet device: the URB waits on the bus for its timeout, if any.
+        it->final_status = LIBUSB_TRANSFER_TIMED_OUT;
+        it->due_ns = t->timeout ? now + (uint64_t)t->timeout * 1000000ull : FAKE_NEVER;
+        return;
+    }
+    if (h->replaying && t->type != LIBUSB_TRANSFER_TYPE_CONTROL && (t->endpoint & LIBUSB_ENDPOINT_IN)) {
+        fake_schedule_replay(h, it, now);
+        return;
+    }
+    fake_report_fn source = fake_report_source(h, t);
+    if (source) {
+        fake_schedule_interrupt(h, it, now, source);
+        return;
+    }
+    uint64_t latency = (uint64_t)h->cfg.latency_us * 1000ull;
+    int payload = t->type == LIBUSB_TRANSFER_TYPE_CONTROL ? 0 : t->length;
+    double rate = h->cfg.bytes_per_sec;
+    if (t->type != LIBUSB_TRANSFER_TYPE_CONTROL && !(t->endpoint & LIBUSB_ENDPOINT_IN) &&
+        h->cfg.out_bytes_per_sec > 0 && h->cfg.out_bytes_per_sec < rate) {
+        // The device NAKs OUT packets while its buffer is full, so data only
+        // goes through as fast as it drains.
+        rate = h->cfg.out_bytes_per_sec;
+    }
+    uint64_t wire = (uint64_t)((double)payload * 1e9 / rate);
+
+    uint64_t start = now + latency;
+    if (h->bus_free_ns[slot] > start) start = h->bus_free_ns[slot];
+    it->due_ns = start + wire;
+    it->final_status = LIBUSB_TRANSFER_COMPLETED;
+    h->bus_free_ns[slot] = it->due_ns;
+
+    if (t->timeout && it->due_ns > now + (uint64_t)t->timeout * 1000000ull) {
+        it->due_ns = now + (uint64_t)t->timeout * 1000000ull;
+        it->final_status = LIBUSB_TRANSFER_TIMED_OUT;
+        h->bus_free_ns[slot] = it->due_ns;
+    }
+}
+
+// Called without the lock, right before the user callback runs.
+static void fake_finish(struct fake_itransfer *it) {
+    struct libusb_transfer *t = &it->transfer;
+    libusb_device_handle *h = t->dev_handle;
+
+    t->status = it->final_status;
+    t->actual_length = 0;
+    if (t->status != LIBUSB_TRANSFER_COMPLETED) return;
+
+    if (t->type == LIBUSB_TRANSFER_TYPE_CONTROL) {
+        struct libusb_control_setup *setup = libusb_control_transfer_get_setup(t);
+        int r = fake_control_request(h, setup, libusb_control_transfer_get_data(t));
+        if (r < 0) {
+            t->status = LIBUSB_TRANSFER_STALL;
+        } else {
+            t->actual_length = r;
+        }
+    } else if (t->endpoint & LIBUSB_ENDPOINT_IN) {
+        if (h->replaying) {
+            int n = it->replay_len;
+            if (n > t->length) {
+                n = t->length;
+                t->status = LIBUSB_TRANSFER_OVERFLOW;
+            }
+            memcpy(t->buffer, it->replay_data, (size_t)n);
+            t->actual_length = n;
+            h->stat_replay_records++;
+        } else if (fake_report_source(h, t)) {
+            int n = it->report_len < t->length ? it->report_len : t->length;
+            memcpy(t->buffer, it->report, (size_t)n);
+            t->actual_length = n;
+            if (h->cfg.device == FAKEUSB_DEVICE_MOUSE) {
+                h->mouse_sum_dx += (int16_t)(it->report[2] | (it->report[3] << 8));
+                h->mouse_sum_dy += (int16_t)(it->report[4] | (it->report[5] << 8));
+            }
+        } else {
+            fake_fill_pattern(h, t->buffer, t->length);
+            t->actual_length = t->length;
+        }
+        h->stat_in_transfers++;
+        h->stat_in_bytes += (uint64_t)t->actual_length;
+    } else {
+        t->actual_length = t->length;
+        for (int i = 0; i < t->length; i++) h->stat_out_hash = (h->stat_out_hash ^ t->buffer[i]) * 16777619u;
+        h->stat_out_transfers++;
+        h->stat_out_bytes += (uint64_t)t->length;
+    }
+}
+
+/* =========================================================
+ * Asynchronous API
+ * ========================================================= */
+
+struct libusb_transfer *libusb_alloc_transfer(int iso_packets) {
+    size_t size = sizeof(struct fake_itransfer) + (size_t)iso_packets * sizeof(struct libusb_iso_packet_descriptor);
+    struct fake_itransfer *it = calloc(1, size);
+    if (!it) return NULL;
+    it->transfer.num_iso_packets = iso_packets;
+    return &it->transfer;
+}
+
+void libusb_free_transfer(struct libusb_transfer *transfer) {
+    if (!transfer) return;
+    if (transfer->flags & LIBUSB_TRANSFER_FREE_BUFFER) free(transfer->buffer);
+    free(fake_itransfer_of(transfer));
+}
+
+int libusb_submit_transfer(struct libusb_transfer *transfer) {
+    struct fake_itransfer *it = fake_itransfer_of(transfer);
+    libusb_device_handle *h = transfer->dev_handle;
+    libusb_context *ctx = h->ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (it->in_flight) {
+        pthread_mutex_unlock(&ctx->lock);
+        return LIBUSB_ERROR_BUSY;
+    }
+    it->in_flight = 1;
+    it->completed = 0;
+    fake_schedule(h, it, fake_now_ns());
+    it->next = ctx->pending;
+    ctx->pending = it;
+    pthread_mutex_unlock(&ctx->lock);
+    fake_arm_timer(ctx);
+    fake_wake(ctx);
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_cancel_transfer(struct libusb_transfer *transfer) {
+    struct fake_itransfer *it = fake_itransfer_of(transfer);
+    libusb_context *ctx = transfer->dev_handle->ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (!it->in_flight || it->final_status == LIBUSB_TRANSFER_CANCELLED) {
+        pthread_mutex_unlock(&ctx->lock);
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+    it->final_status = LIBUSB_TRANSFER_CANCELLED;
+    it->due_ns = 0;
+    // Release the bus time the URB had reserved.
+    transfer->dev_handle->bus_free_ns[fake_endpoint_slot(transfer->endpoint)] = fake_now_ns();
+    pthread_mutex_unlock(&ctx->lock);
+    fake_wake(ctx);
+    return LIBUSB_SUCCESS;
+}
+
+static int fake_handle_events(libusb_context *ctx, struct timeval *tv, int *completed) {
+    uint64_t deadline = FAKE_NEVER;
+    if (tv) {
+        deadline = fake_now_ns() + (uint64_t)tv->tv_sec * 1000000000ull + (uint64_t)tv->tv_usec * 1000ull;
+    }
+
+    for (;;) {
+        struct fake_itransfer *ready = NULL;
+        uint64_t next_due = FAKE_NEVER;
+        uint64_t now = fake_now_ns();
+
+        pthread_mutex_lock(&ctx->lock);
+        if (completed && *completed) {
+            pthread_mutex_unlock(&ctx->lock);
+            return LIBUSB_SUCCESS;
+        }
+        struct fake_itransfer **pp = &ctx->pending;
+        while (*pp) {
+            struct fake_itransfer *it = *pp;
+            if (it->due_ns <= now) {
+                *pp = it->next;
+                it->next = ready;
+                ready = it;
+            } else {
+                if (it->due_ns < next_due) next_due = it->due_ns;
+                pp = &it->next;
+            }
+        }
+        pthread_mutex_unlock(&ctx->lock);
+
+        if (ready) {
+            // `pending` is newest first, so `ready` came out oldest first:
+            // complete in submission order within the batch.
+            while (ready) {
+                struct fake_itransfer *it = ready;
+                ready = it->next;
+                it->next = NULL;
+                fake_finish(it);
+                pthread_mutex_lock(&ctx->lock);
+                it->in_flight = 0;
+                pthread_mutex_unlock(&ctx->lock);
+                struct libusb_transfer *t = &it->transfer;
+                int free_after = t->flags & LIBUSB_TRANSFER_FREE_TRANSFER;
+                if (t->callback) t->callback(t);
+                if (free_after) libusb_free_transfer(t);
+            }
+            fake_drain_wake(ctx);
+            return LIBUSB_SUCCESS;
+        }
+
+        if (now >= deadline) {
+            fake_drain_wake(ctx);
+            return LIBUSB_SUCCESS;
+        }
+
+        uint64_t wait_until = next_due < deadline ? next_due : deadline;
+        struct pollfd pfd = { ctx->wake_fd, POLLIN, 0 };
+        struct timespec ts, *tsp = NULL;
+        if (wait_until != FAKE_NEVER) {
+            uint64_t d = wait_until - now;
+            ts.tv_sec = (time_t)(d / 1000000000ull);
+            ts.tv_nsec = (long)(d % 1000000000ull);
+            tsp = &ts;
+        }
+        int pr = ppoll(&pfd, 1, tsp, NULL);
+        if (pr < 0 && errno == EINTR) return LIBUSB_ERROR_INTERRUPTED;
+        if (pr > 0) {
+            uint64_t v;
+            if (read(ctx->wake_fd, &v, sizeof(v)) < 0) {
+                // Spurious wakeup, nothing to drain.
+            }
+            // A submit/cancel or an explicit interrupt: let the caller re-check its state.
+            if (!completed) return LIBUSB_SUCCESS;
+        }
+    }
+}
+
+int libusb_handle_events_timeout_completed(libusb_context *ctx, struct timeval *tv, int *completed) {
+    int r = fake_handle_events(ctx, tv, completed);
+    fake_arm_timer(ctx);
+    return r;
+}
+
+int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv) {
+    return libusb_handle_events_timeout_completed(ctx, tv, NULL);
+}
+
+int libusb_handle_events_completed(libusb_context *ctx, int *completed) {
+    struct timeval tv = { 60, 0 };
+    return libusb_handle_events_timeout_completed(ctx, &tv, completed);
+}
+
+int libusb_handle_events(libusb_context *ctx) {
+    return libusb_handle_events_completed(ctx, NULL);
+}
+
+void libusb_interrupt_event_handler(libusb_context *ctx) {
+    fake_wake(ctx);
+}
+
+const struct libusb_pollfd **libusb_get_pollfds(libusb_context *ctx) {
+    const struct libusb_pollfd **list = calloc(3, sizeof(*list));
+    if (!list) return NULL;
+    list[0] = &ctx->wake_pollfd;
+    list[1] = &ctx->timer_pollfd;
+    return list;
+}
+
+void libusb_free_pollfds(const struct libusb_pollfd **pollfds) {
+    free((void *)pollfds);
+}
+
+void libusb_set_pollfd_notifiers(libusb_context *ctx,
+    libusb_pollfd_added_cb added_cb, libusb_pollfd_removed_cb removed_cb, void *user_data) {
+    (void)ctx;
+    (void)added_cb;
+    (void)removed_cb;
+    (void)user_data;
+}
+
+int libusb_get_next_timeout(libusb_context *ctx, struct timeval *tv) {
+    uint64_t next_due = FAKE_NEVER;
+    pthread_mutex_lock(&ctx->lock);
+    for (struct fake_itransfer *it = ctx->pending; it; it = it->next) {
+        if (it->due_ns < next_due) next_due = it->due_ns;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    if (next_due == FAKE_NEVER) return 0;
+    uint64_t now = fake_now_ns();
+    uint64_t d = next_due > now ? next_due - now : 0;
+    tv->tv_sec = (time_t)(d / 1000000000ull);
+    tv->tv_usec = (suseconds_t)((d % 1000000000ull) / 1000);
+    return 1;
+}
+
+/* =========================================================
+ * Synchronous API (built on the async one, like libusb's sync.c)
+ * ========================================================= */
+
+static void LIBUSB_CALL fake_sync_cb(struct libusb_transfer *transfer) {
+    int *completed = transfer->user_data;
+    *completed = 1;
+}
+
+static int fake_sync_wait(struct libusb_transfer *t, int *completed) {
+    libusb_context *ctx = t->dev_handle->ctx;
+    int r = libusb_submit_transfer(t);
+    if (r < 0) return r;
+    while (!*completed) {
+        r = libusb_handle_events_completed(ctx, completed);
+        if (r < 0 && r != LIBUSB_ERROR_INTERRUPTED) {
+            libusb_cancel_transfer(t);
+            continue;
+        }
+    }
+    switch (t->status) {
+        case LIBUSB_TRANSFER_COMPLETED: return LIBUSB_SUCCESS;
+        case LIBUSB_TRANSFER_TIMED_OUT: return LIBUSB_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_STALL: return LIBUSB_ERROR_PIPE;
+        case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+        case LIBUSB_TRANSFER_OVERFLOW: return LIBUSB_ERROR_OVERFLOW;
+        case LIBUSB_TRANSFER_CANCELLED: return LIBUSB_ERROR_INTERRUPTED;
+        default: return LIBUSB_ERROR_IO;
+    }
+}
+
+int libusb_control_transfer(libusb_device_handle *dev_handle,
+    uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+    unsigned char *data, uint16_t wLength, unsigned int timeout) {
+    int completed = 0;
+    unsigned char *buffer = malloc(LIBUSB_CONTROL_SETUP_SIZE + wLength);
+    struct libusb_transfer *t = libusb_alloc_transfer(0);
+    if (!buffer || !t) {
+        free(buffer);
+        libusb_free_transfer(t);
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    libusb_fill_control_setup(buffer, request_type, bRequest, wValue, wIndex, wLength);
+    if ((request_type & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT && wLength) {
+        memcpy(buffer + LIBUSB_CONTROL_SETUP_SIZE, data, wLength);
+    }
+    libusb_fill_control_transfer(t, dev_handle, buffer, fake_sync_cb, &completed, timeout);
+    int r = fake_sync_wait(t, &completed);
+    if (r == LIBUSB_SUCCESS) {
+        r = t->actual_length;
+        if ((request_type & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN && r > 0) {
+            memcpy(data, buffer + LIBUSB_CONTROL_SETUP_SIZE, (size_t)r);
+        }
+    }
+    free(buffer);
+    libusb_free_transfer(t);
+    return r;
+}
+
+static int fake_sync_transfer(libusb_device_handle *dev_handle, unsigned char type,
+    unsigned char endpoint, unsigned char *data, int length, int *actual_length, unsigned int timeout) {
+    int completed = 0;
+    struct libusb_transfer *t = libusb_alloc_transfer(0);
+    if (!t) return LIBUSB_ERROR_NO_MEM;
+    libusb_fill_bulk_transfer(t, dev_handle, endpoint, data, length, fake_sync_cb, &completed, timeout);
+    t->type = type;
+    int r = fake_sync_wait(t, &completed);
+    if (actual_length) *actual_length = t->actual_length;
+    libusb_free_transfer(t);
+    return r;
+}
+
+int libusb_bulk_transfer(libusb_device_handle *dev_handle, unsigned char endpoint,
+    unsigned char *data, int length, int *actual_length, unsigned int timeout) {
+    return fake_sync_transfer(dev_handle, LIBUSB_TRANSFER_TYPE_BULK, endpoint, data, length, actual_length, timeout);
+}
+
+int libusb_interrupt_transfer(libusb_device_handle *dev_handle, unsigned char endpoint,
+    unsigned char *data, int length, int *actual_length, unsigned int timeout) {
+    return fake_sync_transfer(dev_handle, LIBUSB_TRANSFER_TYPE_INTERRUPT, endpoint, data, length, actual_length, timeout);
+}
+
+int libusb_get_string_descriptor_ascii(libusb_device_handle *dev_handle, uint8_t desc_index,
+    unsigned char *data, int length) {
+    unsigned char tbuf[255];
+    if (desc_index == 0) return LIBUSB_ERROR_INVALID_PARAM;
+
+    // Same two EP0 round trips as libusb: language table, then the string.
+    int r = libusb_get_string_descriptor(dev_handle, 0, 0, tbuf, sizeof(tbuf));
+    if (r < 0) return r;
+    if (r < 4) return LIBUSB_ERROR_IO;
+    uint16_t langid = (uint16_t)(tbuf[2] | (tbuf[3] << 8));
+
+    r = libusb_get_string_descriptor(dev_handle, desc_index, langid, tbuf, sizeof(tbuf));
+    if (r < 0) return r;
+    if (tbuf[1] != LIBUSB_DT_STRING || tbuf[0] > r) return LIBUSB_ERROR_IO;
+
+    int di = 0;
+    for (int si = 2; si < tbuf[0] && di < length - 1; si += 2) {
+        data[di++] = (tbuf[si] & 0x80 || tbuf[si + 1]) ? '?' : tbuf[si];
+    }
+    data[di] = 0;
+    return di;
+}
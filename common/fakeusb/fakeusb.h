@@ -0,0 +1,86 @@
+#ifndef FAKEUSB_H
+#define FAKEUSB_H
+
+/*
+ * Fake USB transport
+ *
+ * fakeusb.c implements the libusb subset declared in libusb-1.0/libusb.h
+ * on top of a simulated device, so the tools and benchmarks in this tree
+ * can run on a machine without libusb or a physical device.
+ *
+ * Timing model (per endpoint):
+ *   every URB pays `latency_us` of turnaround after it is submitted, and
+ *   the payload then occupies the bus for len / bytes_per_sec.  URBs on
+ *   the same endpoint are serialised, so a single synchronous 64-byte
+ *   transfer costs latency + 64 / bandwidth while a queue of large URBs
+ *   overlaps the turnaround of one with the data phase of another.
+ *
+ * The report endpoints of the mouse and gamepad are polled on fixed slots
+ * of bInterval (or `report_interval_us`). A queued URB completes at the
+ * first free slot where the device has something new and NAKs the others;
+ * slots that pass with no URB queued are not polled, and like a real mouse
+ * the device folds their motion into the next report it gets to send.
+ *
+ * The mouse answers GET_DESCRIPTOR(REPORT) for both of its HID interfaces;
+ * the gamepad is vendor class and stalls it, like a real Xbox 360 pad.
+ *
+ * Tools pick the configuration up from the environment:
+ *   FAKEUSB_DEVICE        simulated device: "cdc", "mouse" or "gamepad" (default cdc); a
+ *                         list like "mouse,gamepad,cdc" assigns them to wrapped devices in turn
+ *   FAKEUSB_LATENCY_US    URB turnaround in microseconds      (default 1000)
+ *   FAKEUSB_BANDWIDTH     bus bandwidth in bytes per second   (default 1000000)
+ *   FAKEUSB_OUT_RATE      bytes per second the device takes on OUT endpoints; it NAKs
+ *                         the rest, like a board whose UART drains slower (default: bus)
+ *   FAKEUSB_MAX_PACKET    wMaxPacketSize of bulk endpoints    (default 64)
+ *   FAKEUSB_REPORT_US     interrupt polling interval in us    (default: bInterval); below 1000
+ *                         the device reports high speed, 125 is an 8 kHz mouse
+ *   FAKEUSB_MOUSE_RADIUS  counts the mouse moves per 2 s circle (default 1000); 100000
+ *                         is a fast swipe of a high-DPI mouse, ~39 counts per 8 kHz report
+ *   FAKEUSB_STATS         print device-side counters at libusb_close() if set, including
+ *                         an FNV-1a hash of the OUT data to check it arrived intact
+ *   FAKEUSB_REPLAY        capture file (common/capture.h) to replay instead of the simulation
+ *   FAKEUSB_REPLAY_SPEED  1 = recorded timing (default), N = N times faster, 0 = as fast as possible
+ *   FAKEUSB_IDLE          if set, the device has nothing to send: every bulk and interrupt IN
+ *                         transfer is NAKed until it times out (or forever, with no timeout)
+ *
+ * Replay: IN transfers (bulk and interrupt) complete with the recorded
+ * transfers of their endpoint, in order, at their recorded time relative
+ * to the start of the capture, scaled by the speed. A transfer whose
+ * record is not due before its timeout times out and the record waits
+ * for the next one. After the last record every IN transfer fails with
+ * LIBUSB_TRANSFER_NO_DEVICE, which the tools treat as a disconnect and
+ * exit. Descriptors and control requests still come from FAKEUSB_DEVICE,
+ * so set it to the kind of device that was captured. With FAKEUSB_STATS
+ * the replay rate is printed at libusb_close() (ns per transfer, MB/s).
+ */
+
+enum fakeusb_device {
+    FAKEUSB_DEVICE_CDC,      // Arduino-style CDC-ACM board
+    FAKEUSB_DEVICE_MOUSE,    // HID mouse on interface 1, interrupt IN 0x82
+    FAKEUSB_DEVICE_GAMEPAD,  // Xbox 360 style pad on interface 0, interrupt IN 0x81
+};
+
+#define FAKEUSB_MAX_DEVICES 16
+
+struct fakeusb_config {
+    enum fakeusb_device device;
+    enum fakeusb_device devices[FAKEUSB_MAX_DEVICES]; // FAKEUSB_DEVICE list, used if num_devices > 1
+    int num_devices;
+    unsigned int latency_us;
+    double bytes_per_sec;
+    double out_bytes_per_sec;         // 0: same as bytes_per_sec
+    int max_packet_size;
+    unsigned int report_interval_us;  // 0: use the endpoint's bInterval
+    double mouse_radius;              // counts, see fake_mouse_state()
+    const char *replay_path;          // NULL: simulate the device
+    double replay_speed;              // 0: as fast as possible
+    int idle;                         // NAK every bulk/interrupt IN transfer
+};
+
+// Fill `cfg` with the defaults, overridden by FAKEUSB_* environment variables.
+void fakeusb_default_config(struct fakeusb_config *cfg);
+
+// Replace the active configuration. Applies to devices wrapped afterwards.
+void fakeusb_configure(const struct fakeusb_config *cfg);
+
+#endif // FAKEUSB_H
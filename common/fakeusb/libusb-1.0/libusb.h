@@ -0,0 +1,418 @@
+#ifndef FAKEUSB_LIBUSB_H
+#define FAKEUSB_LIBUSB_H
+
+/*
+ * Source-compatible subset of <libusb-1.0/libusb.h>.
+ *
+ * Building a tool with -Icommon/fakeusb and linking common/fakeusb/fakeusb.c
+ * instead of -lusb-1.0 runs it against a fake transport (see fakeusb.h).
+ * Only the API used in this tree is declared; names, constants and
+ * signatures match libusb 1.0 so the same sources build against both.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+#define LIBUSB_CALL
+
+/* =========================================================
+ * Descriptor / request constants
+ * ========================================================= */
+
+enum libusb_class_code {
+    LIBUSB_CLASS_PER_INTERFACE = 0x00,
+    LIBUSB_CLASS_AUDIO = 0x01,
+    LIBUSB_CLASS_COMM = 0x02,
+    LIBUSB_CLASS_HID = 0x03,
+    LIBUSB_CLASS_MASS_STORAGE = 0x08,
+    LIBUSB_CLASS_HUB = 0x09,
+    LIBUSB_CLASS_DATA = 0x0a,
+    LIBUSB_CLASS_VENDOR_SPEC = 0xff
+};
+
+enum libusb_descriptor_type {
+    LIBUSB_DT_DEVICE = 0x01,
+    LIBUSB_DT_CONFIG = 0x02,
+    LIBUSB_DT_STRING = 0x03,
+    LIBUSB_DT_INTERFACE = 0x04,
+    LIBUSB_DT_ENDPOINT = 0x05,
+    LIBUSB_DT_HID = 0x21,
+    LIBUSB_DT_REPORT = 0x22
+};
+
+#define LIBUSB_DT_DEVICE_SIZE 18
+#define LIBUSB_DT_CONFIG_SIZE 9
+#define LIBUSB_DT_INTERFACE_SIZE 9
+#define LIBUSB_DT_ENDPOINT_SIZE 7
+
+#define LIBUSB_ENDPOINT_ADDRESS_MASK 0x0f
+#define LIBUSB_ENDPOINT_DIR_MASK 0x80
+
+enum libusb_endpoint_direction {
+    LIBUSB_ENDPOINT_OUT = 0x00,
+    LIBUSB_ENDPOINT_IN = 0x80
+};
+
+#define LIBUSB_TRANSFER_TYPE_MASK 0x03
+
+enum libusb_endpoint_transfer_type {
+    LIBUSB_ENDPOINT_TRANSFER_TYPE_CONTROL = 0x0,
+    LIBUSB_ENDPOINT_TRANSFER_TYPE_ISOCHRONOUS = 0x1,
+    LIBUSB_ENDPOINT_TRANSFER_TYPE_BULK = 0x2,
+    LIBUSB_ENDPOINT_TRANSFER_TYPE_INTERRUPT = 0x3
+};
+
+enum libusb_standard_request {
+    LIBUSB_REQUEST_GET_STATUS = 0x00,
+    LIBUSB_REQUEST_CLEAR_FEATURE = 0x01,
+    LIBUSB_REQUEST_SET_FEATURE = 0x03,
+    LIBUSB_REQUEST_SET_ADDRESS = 0x05,
+    LIBUSB_REQUEST_GET_DESCRIPTOR = 0x06,
+    LIBUSB_REQUEST_SET_DESCRIPTOR = 0x07,
+    LIBUSB_REQUEST_GET_CONFIGURATION = 0x08,
+    LIBUSB_REQUEST_SET_CONFIGURATION = 0x09,
+    LIBUSB_REQUEST_GET_INTERFACE = 0x0a,
+    LIBUSB_REQUEST_SET_INTERFACE = 0x0b
+};
+
+enum libusb_request_type {
+    LIBUSB_REQUEST_TYPE_STANDARD = (0x00 << 5),
+    LIBUSB_REQUEST_TYPE_CLASS = (0x01 << 5),
+    LIBUSB_REQUEST_TYPE_VENDOR = (0x02 << 5),
+    LIBUSB_REQUEST_TYPE_RESERVED = (0x03 << 5)
+};
+
+enum libusb_request_recipient {
+    LIBUSB_RECIPIENT_DEVICE = 0x00,
+    LIBUSB_RECIPIENT_INTERFACE = 0x01,
+    LIBUSB_RECIPIENT_ENDPOINT = 0x02,
+    LIBUSB_RECIPIENT_OTHER = 0x03
+};
+
+/* =========================================================
+ * Descriptors
+ * ========================================================= */
+
+struct libusb_device_descriptor {
+    uint8_t  bLength;
+    uint8_t  bDescriptorType;
+    uint16_t bcdUSB;
+    uint8_t  bDeviceClass;
+    uint8_t  bDeviceSubClass;
+    uint8_t  bDeviceProtocol;
+    uint8_t  bMaxPacketSize0;
+    uint16_t idVendor;
+    uint16_t idProduct;
+    uint16_t bcdDevice;
+    uint8_t  iManufacturer;
+    uint8_t  iProduct;
+    uint8_t  iSerialNumber;
+    uint8_t  bNumConfigurations;
+};
+
+struct libusb_endpoint_descriptor {
+    uint8_t  bLength;
+    uint8_t  bDescriptorType;
+    uint8_t  bEndpointAddress;
+    uint8_t  bmAttributes;
+    uint16_t wMaxPacketSize;
+    uint8_t  bInterval;
+    uint8_t  bRefresh;
+    uint8_t  bSynchAddress;
+    const unsigned char *extra;
+    int extra_length;
+};
+
+struct libusb_interface_descriptor {
+    uint8_t  bLength;
+    uint8_t  bDescriptorType;
+    uint8_t  bInterfaceNumber;
+    uint8_t  bAlternateSetting;
+    uint8_t  bNumEndpoints;
+    uint8_t  bInterfaceClass;
+    uint8_t  bInterfaceSubClass;
+    uint8_t  bInterfaceProtocol;
+    uint8_t  iInterface;
+    const struct libusb_endpoint_descriptor *endpoint;
+    const unsigned char *extra;
+    int extra_length;
+};
+
+struct libusb_interface {
+    const struct libusb_interface_descriptor *altsetting;
+    int num_altsetting;
+};
+
+struct libusb_config_descriptor {
+    uint8_t  bLength;
+    uint8_t  bDescriptorType;
+    uint16_t wTotalLength;
+    uint8_t  bNumInterfaces;
+    uint8_t  bConfigurationValue;
+    uint8_t  iConfiguration;
+    uint8_t  bmAttributes;
+    uint8_t  MaxPower;
+    const struct libusb_interface *interface;
+    const unsigned char *extra;
+    int extra_length;
+};
+
+struct libusb_control_setup {
+    uint8_t  bmRequestType;
+    uint8_t  bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+};
+
+#define LIBUSB_CONTROL_SETUP_SIZE (sizeof(struct libusb_control_setup))
+
+/* =========================================================
+ * Opaque handles, errors, options
+ * ========================================================= */
+
+typedef struct libusb_context libusb_context;
+typedef struct libusb_device libusb_device;
+typedef struct libusb_device_handle libusb_device_handle;
+
+enum libusb_error {
+    LIBUSB_SUCCESS = 0,
+    LIBUSB_ERROR_IO = -1,
+    LIBUSB_ERROR_INVALID_PARAM = -2,
+    LIBUSB_ERROR_ACCESS = -3,
+    LIBUSB_ERROR_NO_DEVICE = -4,
+    LIBUSB_ERROR_NOT_FOUND = -5,
+    LIBUSB_ERROR_BUSY = -6,
+    LIBUSB_ERROR_TIMEOUT = -7,
+    LIBUSB_ERROR_OVERFLOW = -8,
+    LIBUSB_ERROR_PIPE = -9,
+    LIBUSB_ERROR_INTERRUPTED = -10,
+    LIBUSB_ERROR_NO_MEM = -11,
+    LIBUSB_ERROR_NOT_SUPPORTED = -12,
+    LIBUSB_ERROR_OTHER = -99
+};
+
+enum libusb_speed {
+    LIBUSB_SPEED_UNKNOWN = 0,
+    LIBUSB_SPEED_LOW = 1,
+    LIBUSB_SPEED_FULL = 2,
+    LIBUSB_SPEED_HIGH = 3,
+    LIBUSB_SPEED_SUPER = 4,
+    LIBUSB_SPEED_SUPER_PLUS = 5
+};
+
+enum libusb_option {
+    LIBUSB_OPTION_LOG_LEVEL = 0,
+    LIBUSB_OPTION_USE_USBDK = 1,
+    LIBUSB_OPTION_NO_DEVICE_DISCOVERY = 2,
+    LIBUSB_OPTION_WEAK_AUTHORITY = 2
+};
+
+/* =========================================================
+ * Asynchronous transfers
+ * ========================================================= */
+
+enum libusb_transfer_type {
+    LIBUSB_TRANSFER_TYPE_CONTROL = 0,
+    LIBUSB_TRANSFER_TYPE_ISOCHRONOUS = 1,
+    LIBUSB_TRANSFER_TYPE_BULK = 2,
+    LIBUSB_TRANSFER_TYPE_INTERRUPT = 3,
+    LIBUSB_TRANSFER_TYPE_BULK_STREAM = 4
+};
+
+enum libusb_transfer_status {
+    LIBUSB_TRANSFER_COMPLETED,
+    LIBUSB_TRANSFER_ERROR,
+    LIBUSB_TRANSFER_TIMED_OUT,
+    LIBUSB_TRANSFER_CANCELLED,
+    LIBUSB_TRANSFER_STALL,
+    LIBUSB_TRANSFER_NO_DEVICE,
+    LIBUSB_TRANSFER_OVERFLOW
+};
+
+enum libusb_transfer_flags {
+    LIBUSB_TRANSFER_SHORT_NOT_OK = (1U << 0),
+    LIBUSB_TRANSFER_FREE_BUFFER = (1U << 1),
+    LIBUSB_TRANSFER_FREE_TRANSFER = (1U << 2),
+    LIBUSB_TRANSFER_ADD_ZERO_PACKET = (1U << 3)
+};
+
+struct libusb_iso_packet_descriptor {
+    unsigned int length;
+    unsigned int actual_length;
+    enum libusb_transfer_status status;
+};
+
+struct libusb_transfer;
+
+typedef void (LIBUSB_CALL *libusb_transfer_cb_fn)(struct libusb_transfer *transfer);
+
+struct libusb_transfer {
+    libusb_device_handle *dev_handle;
+    uint8_t flags;
+    unsigned char endpoint;
+    unsigned char type;
+    unsigned int timeout;
+    enum libusb_transfer_status status;
+    int length;
+    int actual_length;
+    libusb_transfer_cb_fn callback;
+    void *user_data;
+    unsigned char *buffer;
+    int num_iso_packets;
+    struct libusb_iso_packet_descriptor iso_packet_desc[];
+};
+
+struct libusb_pollfd {
+    int fd;
+    short events;
+};
+
+typedef void (LIBUSB_CALL *libusb_pollfd_added_cb)(int fd, short events, void *user_data);
+typedef void (LIBUSB_CALL *libusb_pollfd_removed_cb)(int fd, void *user_data);
+
+/* =========================================================
+ * Functions
+ * ========================================================= */
+
+int LIBUSB_CALL libusb_init(libusb_context **ctx);
+void LIBUSB_CALL libusb_exit(libusb_context *ctx);
+int LIBUSB_CALL libusb_set_option(libusb_context *ctx, enum libusb_option option, ...);
+const char * LIBUSB_CALL libusb_error_name(int errcode);
+
+int LIBUSB_CALL libusb_wrap_sys_device(libusb_context *ctx, intptr_t sys_dev, libusb_device_handle **dev_handle);
+libusb_device * LIBUSB_CALL libusb_get_device(libusb_device_handle *dev_handle);
+void LIBUSB_CALL libusb_close(libusb_device_handle *dev_handle);
+
+int LIBUSB_CALL libusb_get_device_descriptor(libusb_device *dev, struct libusb_device_descriptor *desc);
+int LIBUSB_CALL libusb_get_active_config_descriptor(libusb_device *dev, struct libusb_config_descriptor **config);
+int LIBUSB_CALL libusb_get_config_descriptor(libusb_device *dev, uint8_t config_index, struct libusb_config_descriptor **config);
+void LIBUSB_CALL libusb_free_config_descriptor(struct libusb_config_descriptor *config);
+int LIBUSB_CALL libusb_get_max_packet_size(libusb_device *dev, unsigned char endpoint);
+int LIBUSB_CALL libusb_get_device_speed(libusb_device *dev);
+int LIBUSB_CALL libusb_get_string_descriptor_ascii(libusb_device_handle *dev_handle, uint8_t desc_index, unsigned char *data, int length);
+
+int LIBUSB_CALL libusb_kernel_driver_active(libusb_device_handle *dev_handle, int interface_number);
+int LIBUSB_CALL libusb_detach_kernel_driver(libusb_device_handle *dev_handle, int interface_number);
+int LIBUSB_CALL libusb_attach_kernel_driver(libusb_device_handle *dev_handle, int interface_number);
+int LIBUSB_CALL libusb_set_auto_detach_kernel_driver(libusb_device_handle *dev_handle, int enable);
+int LIBUSB_CALL libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number);
+int LIBUSB_CALL libusb_release_interface(libusb_device_handle *dev_handle, int interface_number);
+int LIBUSB_CALL libusb_clear_halt(libusb_device_handle *dev_handle, unsigned char endpoint);
+
+int LIBUSB_CALL libusb_control_transfer(libusb_device_handle *dev_handle,
+    uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+    unsigned char *data, uint16_t wLength, unsigned int timeout);
+int LIBUSB_CALL libusb_bulk_transfer(libusb_device_handle *dev_handle,
+    unsigned char endpoint, unsigned char *data, int length,
+    int *actual_length, unsigned int timeout);
+int LIBUSB_CALL libusb_interrupt_transfer(libusb_device_handle *dev_handle,
+    unsigned char endpoint, unsigned char *data, int length,
+    int *actual_length, unsigned int timeout);
+
+struct libusb_transfer * LIBUSB_CALL libusb_alloc_transfer(int iso_packets);
+void LIBUSB_CALL libusb_free_transfer(struct libusb_transfer *transfer);
+int LIBUSB_CALL libusb_submit_transfer(struct libusb_transfer *transfer);
+int LIBUSB_CALL libusb_cancel_transfer(struct libusb_transfer *transfer);
+
+int LIBUSB_CALL libusb_handle_events(libusb_context *ctx);
+int LIBUSB_CALL libusb_handle_events_completed(libusb_context *ctx, int *completed);
+int LIBUSB_CALL libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv);
+int LIBUSB_CALL libusb_handle_events_timeout_completed(libusb_context *ctx, struct timeval *tv, int *completed);
+void LIBUSB_CALL libusb_interrupt_event_handler(libusb_context *ctx);
+
+const struct libusb_pollfd ** LIBUSB_CALL libusb_get_pollfds(libusb_context *ctx);
+void LIBUSB_CALL libusb_free_pollfds(const struct libusb_pollfd **pollfds);
+void LIBUSB_CALL libusb_set_pollfd_notifiers(libusb_context *ctx,
+    libusb_pollfd_added_cb added_cb, libusb_pollfd_removed_cb removed_cb, void *user_data);
+int LIBUSB_CALL libusb_get_next_timeout(libusb_context *ctx, struct timeval *tv);
+
+/* =========================================================
+ * Inline helpers (identical to libusb.h)
+ * ========================================================= */
+
+static inline unsigned char *libusb_control_transfer_get_data(struct libusb_transfer *transfer)
+{
+    return transfer->buffer + LIBUSB_CONTROL_SETUP_SIZE;
+}
+
+static inline struct libusb_control_setup *libusb_control_transfer_get_setup(struct libusb_transfer *transfer)
+{
+    return (struct libusb_control_setup *)(void *)transfer->buffer;
+}
+
+static inline void libusb_fill_control_setup(unsigned char *buffer,
+    uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength)
+{
+    struct libusb_control_setup *setup = (struct libusb_control_setup *)(void *)buffer;
+    setup->bmRequestType = bmRequestType;
+    setup->bRequest = bRequest;
+    setup->wValue = wValue;
+    setup->wIndex = wIndex;
+    setup->wLength = wLength;
+}
+
+static inline void libusb_fill_control_transfer(struct libusb_transfer *transfer,
+    libusb_device_handle *dev_handle, unsigned char *buffer,
+    libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout)
+{
+    struct libusb_control_setup *setup = (struct libusb_control_setup *)(void *)buffer;
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint = 0;
+    transfer->type = LIBUSB_TRANSFER_TYPE_CONTROL;
+    transfer->timeout = timeout;
+    transfer->buffer = buffer;
+    if (setup)
+        transfer->length = (int)(LIBUSB_CONTROL_SETUP_SIZE + setup->wLength);
+    transfer->user_data = user_data;
+    transfer->callback = callback;
+}
+
+static inline void libusb_fill_bulk_transfer(struct libusb_transfer *transfer,
+    libusb_device_handle *dev_handle, unsigned char endpoint,
+    unsigned char *buffer, int length, libusb_transfer_cb_fn callback,
+    void *user_data, unsigned int timeout)
+{
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint = endpoint;
+    transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+    transfer->timeout = timeout;
+    transfer->buffer = buffer;
+    transfer->length = length;
+    transfer->user_data = user_data;
+    transfer->callback = callback;
+}
+
+static inline void libusb_fill_interrupt_transfer(struct libusb_transfer *transfer,
+    libusb_device_handle *dev_handle, unsigned char endpoint,
+    unsigned char *buffer, int length, libusb_transfer_cb_fn callback,
+    void *user_data, unsigned int timeout)
+{
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint = endpoint;
+    transfer->type = LIBUSB_TRANSFER_TYPE_INTERRUPT;
+    transfer->timeout = timeout;
+    transfer->buffer = buffer;
+    transfer->length = length;
+    transfer->user_data = user_data;
+    transfer->callback = callback;
+}
+
+static inline int libusb_get_descriptor(libusb_device_handle *dev_handle,
+    uint8_t desc_type, uint8_t desc_index, unsigned char *data, int length)
+{
+    return libusb_control_transfer(dev_handle, LIBUSB_ENDPOINT_IN,
+        LIBUSB_REQUEST_GET_DESCRIPTOR, (uint16_t)((desc_type << 8) | desc_index),
+        0, data, (uint16_t)length, 1000);
+}
+
+static inline int libusb_get_string_descriptor(libusb_device_handle *dev_handle,
+    uint8_t desc_index, uint16_t langid, unsigned char *data, int length)
+{
+    return libusb_control_transfer(dev_handle, LIBUSB_ENDPOINT_IN,
+        LIBUSB_REQUEST_GET_DESCRIPTOR, (uint16_t)((LIBUSB_DT_STRING << 8) | desc_index),
+        langid, data, (uint16_t)length, 1000);
+}
+
+#endif // FAKEUSB_LIBUSB_H
@@ -0,0 +1,368 @@
+#ifndef HID_PARSER_H
+#define HID_PARSER_H
+
+/*
+ * HID report descriptor parser
+ *
+ * hid_plan_compile() walks a report descriptor once and flattens every
+ * Input item into a table of extraction ops: (report id, bit offset, bit
+ * size, signedness, usage page, usage). Decoding a report is then a loop
+ * over that table with hid_extract(), no parsing and no allocation per
+ * report.
+ *
+ * Usage:
+ *   unsigned char desc[512];
+ *   int len = hid_get_report_descriptor(handle, interface_number, desc, sizeof(desc));
+ *   HidPlan plan;
+ *   if (len > 0 && hid_plan_compile(&plan, desc, len) > 0) {
+ *       int x = hid_plan_find(&plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_X);
+ *       ...
+ *       int32_t dx = hid_field_value(&plan.fields[x], report, report_len);
+ *   }
+ *
+ * Bit offsets count from the first byte after the report ID (if the
+ * descriptor uses report IDs) and hid_field_value() skips that byte, so a
+ * field's offset is the same whether or not the interface numbers its
+ * reports.
+ *
+ * Only Input reports are compiled; Output and Feature items do not move
+ * Input bit offsets and are skipped. Array inputs (keyboards, some hats) are kept as
+ * one op per slot with HID_FIELD_ARRAY set and the usage minimum as usage.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <libusb-1.0/libusb.h>
+
+#define HID_MAX_FIELDS 128
+#define HID_MAX_USAGES 32
+#define HID_MAX_REPORT_IDS 16
+#define HID_MAX_GLOBAL_STACK 4
+#define HID_MAX_REPORT_BITS (4096 * 8)  // one Input report, without its ID byte
+
+// Usage pages and usages used by the tools in this tree.
+#define HID_PAGE_GENERIC_DESKTOP 0x01
+#define HID_PAGE_SIMULATION      0x02
+#define HID_PAGE_BUTTON          0x09
+#define HID_PAGE_CONSUMER        0x0c
+
+#define HID_USAGE_POINTER   0x01
+#define HID_USAGE_MOUSE     0x02
+#define HID_USAGE_JOYSTICK  0x04
+#define HID_USAGE_GAMEPAD   0x05
+#define HID_USAGE_X         0x30
+#define HID_USAGE_Y         0x31
+#define HID_USAGE_Z         0x32
+#define HID_USAGE_RX        0x33
+#define HID_USAGE_RY        0x34
+#define HID_USAGE_RZ        0x35
+#define HID_USAGE_WHEEL     0x38
+#define HID_USAGE_HAT       0x39
+#define HID_USAGE_AC_PAN    0x0238  // consumer page
+
+// HidField.flags
+#define HID_FIELD_RELATIVE  0x01
+#define HID_FIELD_ARRAY     0x02
+#define HID_FIELD_NULL      0x04    // has a null state (hat switches)
+
+typedef struct {
+    uint16_t bit_offset;    // from the first byte after the report ID
+    uint8_t bit_size;       // 1..32
+    uint8_t is_signed;      // logical minimum < 0
+    uint8_t report_id;      // 0 if the descriptor has no report IDs
+    uint8_t flags;
+    uint16_t usage_page;
+    uint16_t usage;
+    int32_t logical_min;
+    int32_t logical_max;
+} HidField;
+
+typedef struct {
+    HidField fields[HID_MAX_FIELDS];
+    int count;
+    int uses_report_ids;
+    int overflow;                                   // fields that did not fit in the table
+    uint8_t report_ids[HID_MAX_REPORT_IDS];         // input reports seen, in descriptor order
+    uint16_t report_bits[HID_MAX_REPORT_IDS];       // their payload size in bits
+    int num_reports;
+} HidPlan;
+
+/* ---------------- decoding ---------------- */
+
+// Read `bit_size` bits at `bit_offset` (little endian, LSB first) from `data`.
+// Bits beyond `len` read as zero.
+static inline uint32_t hid_extract(const uint8_t *data, int len, unsigned bit_offset, unsigned bit_size) {
+    unsigned first = bit_offset >> 3;
+    unsigned shift = bit_offset & 7;
+    unsigned nbytes = (shift + bit_size + 7) >> 3;
+    uint64_t raw = 0;
+    for (unsigned i = 0; i < nbytes; i++) {
+        if ((int)(first + i) < len) raw |= (uint64_t)data[first + i] << (8 * i);
+    }
+    raw >>= shift;
+    return bit_size >= 32 ? (uint32_t)raw : (uint32_t)(raw & ((1ull << bit_size) - 1));
+}
+
+static inline int32_t hid_sign_extend(uint32_t value, unsigned bit_size) {
+    if (bit_size >= 32) return (int32_t)value;
+    uint32_t sign = 1u << (bit_size - 1);
+    return (int32_t)((value ^ sign) - sign);
+}
+
+// Value of `field` in a report as received from the endpoint (report ID
+// byte included if the plan uses IDs). The caller checks the report ID.
+static inline int32_t hid_field_value(const HidField *field, const uint8_t *report, int len) {
+    uint32_t raw = hid_extract(report, len, field->bit_offset + (field->report_id ? 8u : 0u), field->bit_size);
+    return field->is_signed ? hid_sign_extend(raw, field->bit_size) : (int32_t)raw;
+}
+
+// Report ID of a received report, 0 if the plan does not use IDs.
+static inline uint8_t hid_report_id(const HidPlan *plan, const uint8_t *report, int len) {
+    return plan->uses_report_ids && len > 0 ? report[0] : 0;
+}
+
+// Decode every field of the report's ID into values[i] (indexes match
+// plan->fields); fields of other reports are left untouched. Returns the
+// number of fields decoded.
+static inline int hid_plan_decode(const HidPlan *plan, const uint8_t *report, int len, int32_t *values) {
+    uint8_t id = hid_report_id(plan, report, len);
+    int n = 0;
+    for (int i = 0; i < plan->count; i++) {
+        const HidField *f = &plan->fields[i];
+        if (f->report_id != id) continue;
+        values[i] = hid_field_value(f, report, len);
+        n++;
+    }
+    return n;
+}
+
+// Index of the first field with this usage, or -1.
+static inline int hid_plan_find(const HidPlan *plan, uint16_t usage_page, uint16_t usage) {
+    for (int i = 0; i < plan->count; i++) {
+        if (plan->fields[i].usage_page == usage_page && plan->fields[i].usage == usage &&
+            !(plan->fields[i].flags & HID_FIELD_ARRAY)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* ---------------- compiling ---------------- */
+
+typedef struct {
+    uint16_t usage_page;
+    int32_t logical_min;
+    int32_t logical_max;
+    uint32_t report_size;
+    uint32_t report_count;
+    uint8_t report_id;
+} HidGlobals;
+
+static inline int hid_plan_report_slot(HidPlan *plan, uint8_t report_id) {
+    for (int i = 0; i < plan->num_reports; i++) {
+        if (plan->report_ids[i] == report_id) return i;
+    }
+    if (plan->num_reports == HID_MAX_REPORT_IDS) return -1;
+    plan->report_ids[plan->num_reports] = report_id;
+    plan->report_bits[plan->num_reports] = 0;
+    return plan->num_reports++;
+}
+
+// Compile `desc` into `plan`. Returns the number of fields, or -1 if the
+// descriptor is malformed (truncated item, unbalanced push/pop or
+// collections, a report longer than HID_MAX_REPORT_BITS).
+static inline int hid_plan_compile(HidPlan *plan, const uint8_t *desc, int len) {
+    HidGlobals g = {0}, stack[HID_MAX_GLOBAL_STACK];
+    int stack_depth = 0;
+    uint32_t usages[HID_MAX_USAGES];     // (page << 16) | id
+    int num_usages = 0;
+    uint32_t usage_min = 0, usage_max = 0;
+    int have_range = 0;
+    int collection_depth = 0;
+
+    memset(plan, 0, sizeof(*plan));
+
+    int pos = 0;
+    while (pos < len) {
+        uint8_t prefix = desc[pos++];
+        if (prefix == 0xfe) { // long item: skip
+            if (pos + 2 > len) return -1;
+            pos += 2 + desc[pos];
+            continue;
+        }
+        int size = prefix & 0x03;
+        if (size == 3) size = 4;
+        if (pos + size > len) return -1;
+        uint32_t udata = 0;
+        for (int i = 0; i < size; i++) udata |= (uint32_t)desc[pos + i] << (8 * i);
+        int32_t sdata = size == 0 ? 0 : hid_sign_extend(udata, (unsigned)size * 8);
+        pos += size;
+
+        int type = (prefix >> 2) & 0x03;
+        int tag = prefix >> 4;
+
+        if (type == 1) { // global
+            switch (tag) {
+                case 0x0: g.usage_page = (uint16_t)udata; break;
+                case 0x1: g.logical_min = sdata; break;
+                case 0x2:
+                    // A maximum is read unsigned when the minimum is not negative.
+                    g.logical_max = g.logical_min >= 0 ? (int32_t)udata : sdata;
+                    break;
+                case 0x7: g.report_size = udata; break;
+                case 0x8:
+                    g.report_id = (uint8_t)udata;
+                    plan->uses_report_ids = 1;
+                    break;
+                case 0x9: g.report_count = udata; break;
+                case 0xa:
+                    if (stack_depth == HID_MAX_GLOBAL_STACK) return -1;
+                    stack[stack_depth++] = g;
+                    break;
+                case 0xb:
+                    if (stack_depth == 0) return -1;
+                    g = stack[--stack_depth];
+                    break;
+                default: break; // physical min/max, unit, exponent
+            }
+        } else if (type == 2) { // local
+            // Usages given with 4 bytes carry their own page in the high word.
+            uint32_t full = size == 4 ? udata : ((uint32_t)g.usage_page << 16) | (udata & 0xffff);
+            switch (tag) {
+                case 0x0:
+                    if (num_usages < HID_MAX_USAGES) usages[num_usages++] = full;
+                    break;
+                case 0x1: usage_min = full; have_range = 1; break;
+                case 0x2: usage_max = full; have_range = 1; break;
+                default: break;
+            }
+        } else if (type == 0) { // main
+            if (tag == 0x8) { // Input
+                int slot = hid_plan_report_slot(plan, g.report_id);
+                if (slot < 0) return -1;
+                // Checked before the loop, which runs once per item: a
+                // hostile count would spin and wrap the 16-bit offsets.
+                if (g.report_count > HID_MAX_REPORT_BITS ||
+                    plan->report_bits[slot] + (uint64_t)g.report_count * g.report_size > HID_MAX_REPORT_BITS) {
+                    return -1;
+                }
+                int constant = udata & 0x01;
+                int variable = udata & 0x02;
+                for (uint32_t i = 0; i < g.report_count; i++) {
+                    uint32_t offset = plan->report_bits[slot];
+                    plan->report_bits[slot] = (uint16_t)(offset + g.report_size);
+                    if (constant || g.report_size == 0 || g.report_size > 32) continue; // padding
+                    if (plan->count == HID_MAX_FIELDS) {
+                        plan->overflow++;
+                        continue;
+                    }
+
+                    uint32_t usage;
+                    if (!variable) {
+                        usage = have_range ? usage_min : (num_usages ? usages[0] : 0);
+                    } else if (num_usages > 0) {
+                        usage = usages[i < (uint32_t)num_usages ? i : (uint32_t)num_usages - 1];
+                    } else if (have_range) {
+                        usage = usage_min + i <= usage_max ? usage_min + i : usage_max;
+                    } else {
+                        usage = 0;
+                    }
+
+                    HidField *f = &plan->fields[plan->count++];
+                    f->bit_offset = (uint16_t)offset;
+                    f->bit_size = (uint8_t)g.report_size;
+                    f->is_signed = g.logical_min < 0;
+                    f->report_id = g.report_id;
+                    f->usage_page = (uint16_t)(usage >> 16);
+                    f->usage = (uint16_t)usage;
+                    f->logical_min = g.logical_min;
+                    f->logical_max = g.logical_max;
+                    f->flags = (uint8_t)(((udata & 0x04) ? HID_FIELD_RELATIVE : 0) |
+                                         (variable ? 0 : HID_FIELD_ARRAY) |
+                                         ((udata & 0x40) ? HID_FIELD_NULL : 0));
+                }
+            } else if (tag == 0xa) {
+                collection_depth++;
+            } else if (tag == 0xc) {
+                if (collection_depth == 0) return -1;
+                collection_depth--;
+            }
+            // Local items apply to one main item only.
+            num_usages = 0;
+            have_range = 0;
+            usage_min = usage_max = 0;
+        }
+    }
+    if (collection_depth != 0) return -1;
+    return plan->count;
+}
+
+// Input report size in bytes for `report_id`, including the ID byte; 0 if unknown.
+static inline int hid_plan_report_bytes(const HidPlan *plan, uint8_t report_id) {
+    for (int i = 0; i < plan->num_reports; i++) {
+        if (plan->report_ids[i] == report_id) {
+            return (plan->report_bits[i] + 7) / 8 + (report_id ? 1 : 0);
+        }
+    }
+    return 0;
+}
+
+static inline const char *hid_usage_name(uint16_t page, uint16_t usage) {
+    if (page == HID_PAGE_GENERIC_DESKTOP) {
+        switch (usage) {
+            case HID_USAGE_X: return "X";
+            case HID_USAGE_Y: return "Y";
+            case HID_USAGE_Z: return "Z";
+            case HID_USAGE_RX: return "Rx";
+            case HID_USAGE_RY: return "Ry";
+            case HID_USAGE_RZ: return "Rz";
+            case HID_USAGE_WHEEL: return "Wheel";
+            case HID_USAGE_HAT: return "Hat switch";
+            default: return "Generic Desktop";
+        }
+    }
+    if (page == HID_PAGE_BUTTON) return "Button";
+    if (page == HID_PAGE_CONSUMER && usage == HID_USAGE_AC_PAN) return "AC Pan";
+    if (page == HID_PAGE_CONSUMER) return "Consumer";
+    if (page == 0x07) return "Keyboard";
+    if (page == 0x08) return "LED";
+    if (page >= 0xff00) return "Vendor";
+    return "Usage";
+}
+
+// One line per field, `indent` spaces in front.
+static inline void hid_plan_print(const HidPlan *plan, FILE *out, int indent) {
+    for (int i = 0; i < plan->num_reports; i++) {
+        fprintf(out, "%*sInput report %u: %d bytes\n", indent, "", plan->report_ids[i],
+                hid_plan_report_bytes(plan, plan->report_ids[i]));
+    }
+    for (int i = 0; i < plan->count; i++) {
+        const HidField *f = &plan->fields[i];
+        fprintf(out, "%*s[%2d] id %u  bits %3u+%-2u %s %-15s page %02x usage %04x  %d..%d%s%s\n",
+                indent, "", i, f->report_id, f->bit_offset, f->bit_size, f->is_signed ? "s" : "u",
+                hid_usage_name(f->usage_page, f->usage), f->usage_page, f->usage,
+                f->logical_min, f->logical_max,
+                (f->flags & HID_FIELD_RELATIVE) ? " rel" : "",
+                (f->flags & HID_FIELD_ARRAY) ? " array" : "");
+    }
+    if (plan->overflow) {
+        fprintf(out, "%*s(%d more fields did not fit in the table)\n", indent, "", plan->overflow);
+    }
+}
+
+/* ---------------- fetching ---------------- */
+
+// Read the report descriptor of HID interface `interface_number`.
+// libusb_get_descriptor() always sends wIndex 0, so this is a plain
+// GET_DESCRIPTOR control request addressed to the interface.
+// Returns the descriptor length or a libusb error code.
+static inline int hid_get_report_descriptor(libusb_device_handle *handle, int interface_number,
+                                            unsigned char *buf, int size) {
+    return libusb_control_transfer(handle,
+                                   LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_STANDARD | LIBUSB_RECIPIENT_INTERFACE,
+                                   LIBUSB_REQUEST_GET_DESCRIPTOR, (uint16_t)(LIBUSB_DT_REPORT << 8),
+                                   (uint16_t)interface_number, buf, (uint16_t)size, 1000);
+}
+
+#endif // HID_PARSER_H
@@ -0,0 +1,130 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+/*
+ * Fixed-size latency histograms for the input tools
+ *
+ * Values are nanoseconds in log-linear buckets, HDR histogram style: every
+ * power of two is split into 128 buckets, so a recorded value is known to
+ * within 1/128 (0.8%) from 1 ns up to ~18 minutes. Recording is a clz, a
+ * shift and an increment into a static array: no allocation, no lock, cheap
+ * enough to leave on. The histograms belong to the thread that records into
+ * them; printing is requested through a flag (e.g. from SIGUSR1) and done
+ * by that same thread.
+ *
+ * ReportLatency bundles the three histograms the input tools keep:
+ *
+ *   arrival  time between two consecutive reports
+ *   decode   transfer returned to the program -> report decoded
+ *   render   report decoded -> the frame showing it written to the terminal
+ *
+ * A report that changes nothing on screen is not waiting to be rendered;
+ * when several reports land in one frame, the oldest one is measured.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#define LATENCY_SUB_BITS 7
+#define LATENCY_SUB (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS 40  // larger values are clamped (2^40 ns = ~18 min)
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB)
+
+typedef struct {
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} LatencyHist;
+
+typedef struct {
+    LatencyHist arrival;
+    LatencyHist decode;
+    LatencyHist render;
+    uint64_t last_arrival_ns;   // 0 before the first report
+    uint64_t pending_ns;        // decode time of the oldest report not on screen yet, 0 if none
+} ReportLatency;
+
+static inline uint64_t latency_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline int latency_bucket(uint64_t ns) {
+    if (ns < LATENCY_SUB) return (int)ns;
+    if (ns >> LATENCY_MAX_BITS) ns = (1ull << LATENCY_MAX_BITS) - 1;
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - LATENCY_SUB_BITS;
+    return (shift + 1) * LATENCY_SUB + (int)(ns >> shift) - LATENCY_SUB;
+}
+
+// Largest value that falls into bucket `b`.
+static inline uint64_t latency_bucket_top(int b) {
+    if (b < LATENCY_SUB) return (uint64_t)b;
+    int shift = b / LATENCY_SUB - 1;
+    uint64_t mantissa = (uint64_t)(b % LATENCY_SUB + LATENCY_SUB);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+static inline void latency_hist_record(LatencyHist *h, uint64_t ns) {
+    h->counts[latency_bucket(ns)]++;
+    h->total++;
+    if (ns > h->max) h->max = ns;
+}
+
+// Smallest value that `fraction` (0..1) of the recorded values do not exceed.
+static inline uint64_t latency_hist_percentile(const LatencyHist *h, double fraction) {
+    if (h->total == 0) return 0;
+    uint64_t rank = (uint64_t)(fraction * (double)h->total + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= rank) {
+            uint64_t top = latency_bucket_top(b);
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
+
+static inline void latency_hist_print(const LatencyHist *h, const char *name, FILE *out) {
+    if (h->total == 0) {
+        fprintf(out, "DEBUG: %-28s no samples\n", name);
+        return;
+    }
+    fprintf(out, "DEBUG: %-28s n=%-9llu p50 %9.1f us  p99 %9.1f us  p99.9 %9.1f us  max %9.1f us\n", name,
+            (unsigned long long)h->total,
+            latency_hist_percentile(h, 0.50) / 1e3, latency_hist_percentile(h, 0.99) / 1e3,
+            latency_hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+}
+
+// A report's transfer returned at `complete_ns` and it was decoded at
+// `decoded_ns`. `visible` is nonzero if the screen now differs from what is
+// shown, i.e. a frame is owed for it.
+static inline void latency_note_report(ReportLatency *l, uint64_t complete_ns, uint64_t decoded_ns, int visible) {
+    if (l->last_arrival_ns) latency_hist_record(&l->arrival, complete_ns - l->last_arrival_ns);
+    l->last_arrival_ns = complete_ns;
+    latency_hist_record(&l->decode, decoded_ns - complete_ns);
+    if (!visible) {
+        l->pending_ns = 0;
+    } else if (!l->pending_ns) {
+        l->pending_ns = decoded_ns;
+    }
+}
+
+// A frame was written at `now_ns`.
+static inline void latency_note_frame(ReportLatency *l, uint64_t now_ns) {
+    if (!l->pending_ns) return;
+    latency_hist_record(&l->render, now_ns - l->pending_ns);
+    l->pending_ns = 0;
+}
+
+static inline void latency_print(const ReportLatency *l, FILE *out) {
+    latency_hist_print(&l->arrival, "Report inter-arrival:", out);
+    latency_hist_print(&l->decode, "Transfer complete -> decode:", out);
+    latency_hist_print(&l->render, "Decode -> render:", out);
+}
+
+#endif // LATENCY_HIST_H
@@ -0,0 +1,139 @@
+#ifndef OUT_SINK_H
+#define OUT_SINK_H
+
+/*
+ * Batched, binary-safe output sink
+ *
+ * Collects raw bytes in one preallocated buffer and writes them out with a
+ * single writev() when either
+ *   - `flush_bytes` bytes are pending, or
+ *   - the oldest pending byte is older than `flush_us` microseconds.
+ * A chunk that would overflow the buffer is written together with the
+ * pending bytes in the same writev() call instead of being copied.
+ *
+ * The deadline is only checked when the sink is touched, so event loops
+ * should sleep at most out_sink_timeout_us() and then call out_sink_poll().
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+typedef struct {
+    int fd;
+    unsigned char *buf;
+    size_t len;
+    size_t flush_bytes;
+    uint64_t flush_ns;
+    uint64_t oldest_ns;       // time the first pending byte was buffered
+    int error;                // errno of the first failed write, 0 if none
+
+    uint64_t bytes_written;
+    uint64_t writes;
+} OutSink;
+
+static inline uint64_t out_sink_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Returns 0 or -1 (out of memory).
+static inline int out_sink_init(OutSink *sink, int fd, size_t flush_bytes, unsigned int flush_us) {
+    memset(sink, 0, sizeof(*sink));
+    sink->fd = fd;
+    sink->flush_bytes = flush_bytes ? flush_bytes : 1;
+    sink->flush_ns = (uint64_t)flush_us * 1000ull;
+    sink->buf = malloc(sink->flush_bytes);
+    return sink->buf ? 0 : -1;
+}
+
+// Write every iovec completely, retrying on short writes and EINTR.
+static inline int out_sink_writev_all(OutSink *sink, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(sink->fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            sink->error = errno;
+            return -1;
+        }
+        sink->writes++;
+        sink->bytes_written += (uint64_t)n;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+static inline int out_sink_flush(OutSink *sink) {
+    if (sink->len == 0 || sink->error) return sink->error ? -1 : 0;
+    struct iovec iov = { sink->buf, sink->len };
+    sink->len = 0;
+    return out_sink_writev_all(sink, &iov, 1);
+}
+
+// Queue `len` raw bytes. Returns 0, or -1 once the sink has failed (see sink->error).
+static inline int out_sink_write(OutSink *sink, const void *data, size_t len) {
+    if (sink->error) return -1;
+    if (len == 0) return 0;
+
+    if (sink->len + len >= sink->flush_bytes) {
+        // Pending bytes and the new chunk leave in one system call.
+        struct iovec iov[2];
+        int n = 0;
+        if (sink->len) {
+            iov[n].iov_base = sink->buf;
+            iov[n].iov_len = sink->len;
+            n++;
+        }
+        iov[n].iov_base = (void *)data;
+        iov[n].iov_len = len;
+        n++;
+        sink->len = 0;
+        return out_sink_writev_all(sink, iov, n);
+    }
+
+    uint64_t now = out_sink_now_ns();
+    if (sink->len == 0) sink->oldest_ns = now;
+    memcpy(sink->buf + sink->len, data, len);
+    sink->len += len;
+    if (now - sink->oldest_ns >= sink->flush_ns) return out_sink_flush(sink);
+    return 0;
+}
+
+// Flush if the deadline of the oldest pending byte has passed.
+static inline int out_sink_poll(OutSink *sink) {
+    if (sink->len && out_sink_now_ns() - sink->oldest_ns >= sink->flush_ns) {
+        return out_sink_flush(sink);
+    }
+    return sink->error ? -1 : 0;
+}
+
+// Microseconds until the next deadline, or -1 if nothing is pending.
+static inline long out_sink_timeout_us(const OutSink *sink) {
+    if (sink->len == 0) return -1;
+    uint64_t age = out_sink_now_ns() - sink->oldest_ns;
+    if (age >= sink->flush_ns) return 0;
+    return (long)((sink->flush_ns - age + 999) / 1000);
+}
+
+// Flush and release the buffer. The file descriptor is left open.
+static inline int out_sink_close(OutSink *sink) {
+    int r = out_sink_flush(sink);
+    free(sink->buf);
+    sink->buf = NULL;
+    return r;
+}
+
+#endif // OUT_SINK_H
@@ -0,0 +1,191 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+/*
+ * Lock-free single-producer / single-consumer byte ring
+ *
+ * One thread writes, one thread reads; the data path uses only atomic
+ * loads and stores of `head` and `tail`. The buffer is allocated once
+ * (capacity rounded up to a power of two) and never resized.
+ *
+ * Waiting is optional: a side that finds the ring empty (or full) can
+ * block in spsc_ring_wait_readable()/spsc_ring_wait_writable(), which
+ * sleep on a futex and are woken by the other side only when it knows
+ * there is a waiter, so the fast path makes no system calls.
+ *
+ * Counters for backpressure reporting:
+ *   full_events  producer found less space than it needed
+ *   high_water   largest fill level seen by the producer
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SPSC_CACHELINE 64
+
+typedef struct {
+    _Alignas(SPSC_CACHELINE) atomic_size_t head;   // next byte to write, owned by the producer
+    _Alignas(SPSC_CACHELINE) atomic_size_t tail;   // next byte to read, owned by the consumer
+    _Alignas(SPSC_CACHELINE) atomic_uint data_seq; // bumped after every produce
+    atomic_uint data_waiters;
+    atomic_uint space_seq;                         // bumped after every consume
+    atomic_uint space_waiters;
+    atomic_int closed;
+
+    _Alignas(SPSC_CACHELINE) unsigned char *buf;
+    size_t capacity;
+    size_t mask;
+
+    // Producer-side statistics.
+    uint64_t full_events;
+    size_t high_water;
+} SpscRing;
+
+static inline int spsc_futex_wait(atomic_uint *word, unsigned int expected, long timeout_us) {
+    struct timespec ts, *tsp = NULL;
+    if (timeout_us >= 0) {
+        ts.tv_sec = timeout_us / 1000000;
+        ts.tv_nsec = (timeout_us % 1000000) * 1000;
+        tsp = &ts;
+    }
+    return (int)syscall(SYS_futex, (unsigned int *)word, FUTEX_WAIT_PRIVATE, expected, tsp, NULL, 0);
+}
+
+static inline void spsc_futex_wake(atomic_uint *word) {
+    syscall(SYS_futex, (unsigned int *)word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Returns 0 or -1 (out of memory).
+static inline int spsc_ring_init(SpscRing *ring, size_t min_capacity) {
+    size_t capacity = 4096;
+    while (capacity < min_capacity) capacity <<= 1;
+    memset(ring, 0, sizeof(*ring));
+    ring->buf = malloc(capacity);
+    if (!ring->buf) return -1;
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+    return 0;
+}
+
+static inline void spsc_ring_free(SpscRing *ring) {
+    free(ring->buf);
+    ring->buf = NULL;
+}
+
+static inline size_t spsc_ring_used(SpscRing *ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire) -
+           atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+/* ---------------- producer side ---------------- */
+
+// Contiguous free space starting at *ptr (may be less than the total free space at the wrap point).
+static inline size_t spsc_ring_write_span(SpscRing *ring, unsigned char **ptr) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t free_bytes = ring->capacity - (head - tail);
+    size_t to_end = ring->capacity - (head & ring->mask);
+    *ptr = ring->buf + (head & ring->mask);
+    return free_bytes < to_end ? free_bytes : to_end;
+}
+
+static inline void spsc_ring_produce(SpscRing *ring, size_t n) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed) + n;
+    atomic_store_explicit(&ring->head, head, memory_order_seq_cst);
+    size_t used = head - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (used > ring->high_water) ring->high_water = used;
+    atomic_fetch_add_explicit(&ring->data_seq, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->data_waiters, memory_order_seq_cst)) {
+        spsc_futex_wake(&ring->data_seq);
+    }
+}
+
+// Copy as much of `data` as fits; returns the number of bytes written.
+static inline size_t spsc_ring_write(SpscRing *ring, const void *data, size_t len) {
+    const unsigned char *src = data;
+    size_t done = 0;
+    while (done < len) {
+        unsigned char *dst;
+        size_t span = spsc_ring_write_span(ring, &dst);
+        if (span == 0) break;
+        if (span > len - done) span = len - done;
+        memcpy(dst, src + done, span);
+        done += span;
+        // Publish per span so the consumer can start on the first half early.
+        spsc_ring_produce(ring, span);
+    }
+    if (done < len) ring->full_events++;
+    return done;
+}
+
+// Block until at least `need` bytes are free, the ring is closed, or timeout_us passes (-1 = forever).
+static inline void spsc_ring_wait_writable(SpscRing *ring, size_t need, long timeout_us) {
+    if (need > ring->capacity) need = ring->capacity;
+    for (;;) {
+        unsigned int seq = atomic_load_explicit(&ring->space_seq, memory_order_seq_cst);
+        if (ring->capacity - spsc_ring_used(ring) >= need || atomic_load(&ring->closed)) return;
+        atomic_fetch_add_explicit(&ring->space_waiters, 1, memory_order_seq_cst);
+        if (ring->capacity - spsc_ring_used(ring) < need && !atomic_load(&ring->closed)) {
+            spsc_futex_wait(&ring->space_seq, seq, timeout_us);
+        }
+        atomic_fetch_sub_explicit(&ring->space_waiters, 1, memory_order_seq_cst);
+        if (timeout_us >= 0) return;
+    }
+}
+
+// Producer is done; the consumer drains what is left and then sees the ring as closed.
+static inline void spsc_ring_close(SpscRing *ring) {
+    atomic_store(&ring->closed, 1);
+    atomic_fetch_add(&ring->data_seq, 1);
+    atomic_fetch_add(&ring->space_seq, 1);
+    spsc_futex_wake(&ring->data_seq);
+    spsc_futex_wake(&ring->space_seq);
+}
+
+/* ---------------- consumer side ---------------- */
+
+// Contiguous readable bytes starting at *ptr.
+static inline size_t spsc_ring_read_span(SpscRing *ring, const unsigned char **ptr) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t avail = head - tail;
+    size_t to_end = ring->capacity - (tail & ring->mask);
+    *ptr = ring->buf + (tail & ring->mask);
+    return avail < to_end ? avail : to_end;
+}
+
+static inline void spsc_ring_consume(SpscRing *ring, size_t n) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed) + n;
+    atomic_store_explicit(&ring->tail, tail, memory_order_seq_cst);
+    atomic_fetch_add_explicit(&ring->space_seq, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->space_waiters, memory_order_seq_cst)) {
+        spsc_futex_wake(&ring->space_seq);
+    }
+}
+
+// True once the producer closed the ring and every byte has been consumed.
+static inline int spsc_ring_drained(SpscRing *ring) {
+    return atomic_load(&ring->closed) && spsc_ring_used(ring) == 0;
+}
+
+// Block until data is readable, the ring is closed, or timeout_us passes (-1 = forever).
+static inline void spsc_ring_wait_readable(SpscRing *ring, long timeout_us) {
+    for (;;) {
+        unsigned int seq = atomic_load_explicit(&ring->data_seq, memory_order_seq_cst);
+        if (spsc_ring_used(ring) || atomic_load(&ring->closed)) return;
+        atomic_fetch_add_explicit(&ring->data_waiters, 1, memory_order_seq_cst);
+        if (!spsc_ring_used(ring) && !atomic_load(&ring->closed)) {
+            spsc_futex_wait(&ring->data_seq, seq, timeout_us);
+        }
+        atomic_fetch_sub_explicit(&ring->data_waiters, 1, memory_order_seq_cst);
+        if (timeout_us >= 0) return;
+    }
+}
+
+#endif // SPSC_RING_H
@@ -0,0 +1,103 @@
+#ifndef TERM_BUF_H
+#define TERM_BUF_H
+
+/*
+ * Frame buffer for terminal output
+ *
+ * A renderer appends text and cursor movements for one frame and hands the
+ * whole frame to the terminal with a single write(). Cursor movements are
+ * relative (CUU/CUD/CUF/CUB), so the caller tracks where the terminal cursor
+ * is and term_buf_move() emits the shortest sequence to get elsewhere.
+ *
+ * The buffer is fixed-size; a frame that does not fit is truncated and
+ * counted in `overflows` rather than allocated.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TERM_BUF_SIZE 8192
+
+typedef struct {
+    char data[TERM_BUF_SIZE];
+    size_t len;
+
+    uint64_t frames;     // flushes that wrote something
+    uint64_t bytes;      // bytes written to the terminal
+    uint64_t overflows;  // appends that did not fit
+} TermBuf;
+
+static inline void term_buf_putn(TermBuf *b, const char *s, size_t n) {
+    if (n > TERM_BUF_SIZE - b->len) {
+        n = TERM_BUF_SIZE - b->len;
+        b->overflows++;
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static inline void term_buf_puts(TermBuf *b, const char *s) {
+    term_buf_putn(b, s, strlen(s));
+}
+
+static inline void term_buf_printf(TermBuf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(b->data + b->len, TERM_BUF_SIZE - b->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n >= TERM_BUF_SIZE - b->len) {
+        b->len = TERM_BUF_SIZE - 1; // drop vsnprintf's terminator
+        b->overflows++;
+    } else {
+        b->len += (size_t)n;
+    }
+}
+
+// Cursor movement by `n` cells: `dir` is 'A' up, 'B' down, 'C' right, 'D' left.
+static inline void term_buf_step(TermBuf *b, int n, char dir) {
+    if (n == 1) {
+        term_buf_printf(b, "\033[%c", dir);
+    } else {
+        term_buf_printf(b, "\033[%d%c", n, dir);
+    }
+}
+
+// Move the cursor from (row, col) to (to_row, to_col); rows and columns are
+// relative to any fixed origin the caller chooses.
+static inline void term_buf_move(TermBuf *b, int row, int col, int to_row, int to_col) {
+    if (to_col == 0 && col != 0) {
+        term_buf_putn(b, "\r", 1);
+        col = 0;
+    }
+    if (to_row < row) term_buf_step(b, row - to_row, 'A');
+    if (to_row > row) term_buf_step(b, to_row - row, 'B');
+    if (to_col < col) term_buf_step(b, col - to_col, 'D');
+    if (to_col > col) term_buf_step(b, to_col - col, 'C');
+}
+
+// Write the frame to `fd` and empty the buffer. Returns 0 or -1 on a write error.
+static inline int term_buf_flush(TermBuf *b, int fd) {
+    size_t done = 0;
+    while (done < b->len) {
+        ssize_t n = write(fd, b->data + done, b->len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            b->len = 0;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    if (b->len > 0) {
+        b->frames++;
+        b->bytes += b->len;
+    }
+    b->len = 0;
+    return 0;
+}
+
+#endif // TERM_BUF_H
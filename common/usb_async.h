@@ -0,0 +1,198 @@
+#ifndef USB_ASYNC_H
+#define USB_ASYNC_H
+
+/*
+ * Queue of asynchronous IN transfers on one endpoint
+ *
+ * Keeps `depth` URBs of `transfer_size` bytes submitted at all times, so the
+ * host controller always has a buffer to fill while the previous one is
+ * being processed. Completed data is handed to `on_data` from inside
+ * libusb_handle_events*(); the transfer is resubmitted right after.
+ *
+ * Usage:
+ *   usb_async_queue q;
+ *   usb_async_start(&q, handle, 0x83, LIBUSB_TRANSFER_TYPE_BULK, 8, 16384, 2000, on_data, ctx);
+ *   while (!q.stopped) libusb_handle_events(context);
+ *   usb_async_cancel(&q, context);
+ *   usb_async_free(&q);
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libusb-1.0/libusb.h>
+
+// Return nonzero to stop the queue (no further resubmission).
+typedef int (*usb_async_data_cb)(void *user, const unsigned char *data, int len);
+
+typedef struct {
+    libusb_device_handle *handle;
+    unsigned char endpoint;
+    unsigned char type;          // LIBUSB_TRANSFER_TYPE_BULK or _INTERRUPT
+    int depth;
+    int transfer_size;
+    unsigned int timeout_ms;
+
+    struct libusb_transfer **transfers;
+    unsigned char *buffers;
+
+    usb_async_data_cb on_data;
+    void *user;
+
+    int in_flight;
+    int stopped;                 // set on stop request, fatal error or disconnect
+    int stalled;                 // endpoint halted; caller clears it and calls usb_async_resubmit()
+    int error;                   // first fatal libusb_transfer_status seen, 0 if none
+    int consecutive_timeouts;
+
+    uint64_t bytes;
+    uint64_t completions;
+    uint64_t timeouts;
+    uint64_t underruns;          // completions that left no transfer queued on the endpoint
+} usb_async_queue;
+
+static inline void LIBUSB_CALL usb_async_transfer_cb(struct libusb_transfer *transfer) {
+    usb_async_queue *q = transfer->user_data;
+    q->in_flight--;
+    if (q->in_flight == 0 && !q->stopped) q->underruns++;
+
+    switch (transfer->status) {
+        case LIBUSB_TRANSFER_COMPLETED:
+            q->consecutive_timeouts = 0;
+            q->completions++;
+            if (transfer->actual_length > 0) {
+                q->bytes += (uint64_t)transfer->actual_length;
+                if (q->on_data && q->on_data(q->user, transfer->buffer, transfer->actual_length)) {
+                    q->stopped = 1;
+                }
+            }
+            break;
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            // A timed-out bulk URB may still carry a partial payload.
+            q->timeouts++;
+            q->consecutive_timeouts++;
+            if (transfer->actual_length > 0) {
+                q->bytes += (uint64_t)transfer->actual_length;
+                if (q->on_data && q->on_data(q->user, transfer->buffer, transfer->actual_length)) {
+                    q->stopped = 1;
+                }
+            }
+            break;
+        case LIBUSB_TRANSFER_STALL:
+            q->stalled = 1;
+            return;
+        case LIBUSB_TRANSFER_CANCELLED:
+            return;
+        default: // ERROR, NO_DEVICE, OVERFLOW
+            if (!q->error) q->error = transfer->status;
+            q->stopped = 1;
+            return;
+    }
+
+    if (q->stopped || q->stalled) return;
+    if (libusb_submit_transfer(transfer) == LIBUSB_SUCCESS) {
+        q->in_flight++;
+    } else {
+        if (!q->error) q->error = LIBUSB_TRANSFER_ERROR;
+        q->stopped = 1;
+    }
+}
+
+static inline void usb_async_free(usb_async_queue *q) {
+    if (q->transfers) {
+        for (int i = 0; i < q->depth; i++) {
+            libusb_free_transfer(q->transfers[i]);
+        }
+    }
+    free(q->transfers);
+    free(q->buffers);
+    q->transfers = NULL;
+    q->buffers = NULL;
+}
+
+// Allocate and submit the queue. Returns 0 or a libusb error code; on an
+// error the queue is stopped with `error` set.
+static inline int usb_async_start(usb_async_queue *q, libusb_device_handle *handle,
+                                  unsigned char endpoint, unsigned char type,
+                                  int depth, int transfer_size, unsigned int timeout_ms,
+                                  usb_async_data_cb on_data, void *user) {
+    memset(q, 0, sizeof(*q));
+    q->handle = handle;
+    q->endpoint = endpoint;
+    q->type = type;
+    q->depth = depth;
+    q->transfer_size = transfer_size;
+    q->timeout_ms = timeout_ms;
+    q->on_data = on_data;
+    q->user = user;
+
+    q->transfers = calloc((size_t)depth, sizeof(*q->transfers));
+    q->buffers = malloc((size_t)depth * (size_t)transfer_size);
+    if (!q->transfers || !q->buffers) {
+        usb_async_free(q);
+        q->stopped = 1;
+        q->error = LIBUSB_TRANSFER_ERROR;
+        return LIBUSB_ERROR_NO_MEM;
+    }
+
+    for (int i = 0; i < depth; i++) {
+        struct libusb_transfer *t = libusb_alloc_transfer(0);
+        if (!t) {
+            usb_async_free(q);  // nothing submitted yet
+            q->stopped = 1;
+            q->error = LIBUSB_TRANSFER_ERROR;
+            return LIBUSB_ERROR_NO_MEM;
+        }
+        q->transfers[i] = t;
+        unsigned char *buf = q->buffers + (size_t)i * (size_t)transfer_size;
+        if (type == LIBUSB_TRANSFER_TYPE_INTERRUPT) {
+            libusb_fill_interrupt_transfer(t, handle, endpoint, buf, transfer_size, usb_async_transfer_cb, q, timeout_ms);
+        } else {
+            libusb_fill_bulk_transfer(t, handle, endpoint, buf, transfer_size, usb_async_transfer_cb, q, timeout_ms);
+        }
+    }
+
+    for (int i = 0; i < depth; i++) {
+        int r = libusb_submit_transfer(q->transfers[i]);
+        if (r < 0) {
+            // The ones already submitted are the caller's to cancel.
+            q->stopped = 1;
+            q->error = LIBUSB_TRANSFER_ERROR;
+            return r;
+        }
+        q->in_flight++;
+    }
+    return 0;
+}
+
+// Resubmit every idle transfer, e.g. after libusb_clear_halt() on a stalled endpoint.
+static inline int usb_async_resubmit(usb_async_queue *q) {
+    q->stalled = 0;
+    // Transfers are idle exactly when fewer than `depth` are in flight; libusb
+    // rejects resubmitting a busy one with LIBUSB_ERROR_BUSY, which we skip.
+    for (int i = 0; i < q->depth && q->in_flight < q->depth; i++) {
+        int r = libusb_submit_transfer(q->transfers[i]);
+        if (r == LIBUSB_SUCCESS) {
+            q->in_flight++;
+        } else if (r != LIBUSB_ERROR_BUSY) {
+            q->stopped = 1;
+            return r;
+        }
+    }
+    return 0;
+}
+
+// Cancel everything still in flight and wait until libusb has returned all transfers.
+static inline void usb_async_cancel(usb_async_queue *q, libusb_context *context) {
+    q->stopped = 1;
+    if (!q->transfers) return;
+    for (int i = 0; i < q->depth; i++) {
+        if (q->transfers[i]) libusb_cancel_transfer(q->transfers[i]);
+    }
+    while (q->in_flight > 0) {
+        struct timeval tv = { 1, 0 };
+        if (libusb_handle_events_timeout(context, &tv) < 0) break;
+    }
+}
+
+#endif // USB_ASYNC_H
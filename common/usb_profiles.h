@@ -0,0 +1,118 @@
+#ifndef USB_PROFILES_H
+#define USB_PROFILES_H
+
+/*
+ * Known devices, by vendor and product ID
+ *
+ * Each tool used to hard-code the interface and endpoints of the one
+ * device it was written against. The table below lists the devices the
+ * tools know, and usb_profile_find() picks the row for the wrapped device
+ * from its device descriptor (no I/O: libusb read it when the fd was
+ * wrapped). A device that is not listed gets the generic profile of its
+ * kind, the numbers the tools always used.
+ *
+ * The table is an X-macro: USB_PROFILES(X) calls X once per device, so
+ * the enum of profile IDs, the table itself and the per-kind decoder
+ * tables that key on the profile name (usb-mouse/mouse_profiles.h,
+ * usb-gamepad/gamepad_profiles.h) all come from the same list. Adding a
+ * device is one line here, plus one in the decoder table if its reports
+ * should get a specialised decoder. The lookup is a switch generated from
+ * the same list, so a VID:PID listed twice does not compile.
+ *
+ * Usage:
+ *   const UsbProfile *p = usb_profile_find(handle, USB_KIND_MOUSE);
+ *   usb_session_claim(&session, p->interface);
+ *   usb_async_start(&q, handle, p->endpoint_in, ...);
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <libusb-1.0/libusb.h>
+
+typedef enum {
+    USB_KIND_MOUSE,
+    USB_KIND_GAMEPAD,
+    USB_KIND_SERIAL,
+    USB_NUM_KINDS
+} UsbKind;
+
+// X(name, vendor, product, kind, interface, endpoint_in, control_interface, endpoint_out, description)
+// control_interface: also claimed if >= 0 (the CDC control interface of a serial board).
+// endpoint_out: 0 if the tools do not write to the device.
+#define USB_PROFILES(X) \
+    X(LOGITECH_C534,     0x046d, 0xc534, USB_KIND_MOUSE,   1, 0x82, -1, 0x00, "Logitech receiver (mouse interface)") \
+    X(XBOX360_PAD,       0x045e, 0x028e, USB_KIND_GAMEPAD, 0, 0x81, -1, 0x00, "Xbox 360 controller and clones") \
+    X(DUALSHOCK4,        0x054c, 0x05c4, USB_KIND_GAMEPAD, 3, 0x84, -1, 0x00, "Sony DualShock 4") \
+    X(ARDUINO_LEONARDO,  0x2341, 0x8036, USB_KIND_SERIAL,  1, 0x83,  0, 0x02, "Arduino Leonardo")
+
+// The numbers the tools used before there was a table.
+#define USB_GENERIC_PROFILES(X) \
+    X(GENERIC_MOUSE,     0, 0, USB_KIND_MOUSE,   1, 0x82, -1, 0x00, "generic mouse") \
+    X(GENERIC_GAMEPAD,   0, 0, USB_KIND_GAMEPAD, 0, 0x81, -1, 0x00, "generic gamepad") \
+    X(GENERIC_SERIAL,    0, 0, USB_KIND_SERIAL,  1, 0x83,  0, 0x02, "generic CDC-ACM board")
+
+typedef enum {
+#define USB_PROFILE_ENUM(name, vid, pid, kind, intf, ep_in, ctrl, ep_out, desc) USB_PROFILE_##name,
+    USB_PROFILES(USB_PROFILE_ENUM)
+    USB_GENERIC_PROFILES(USB_PROFILE_ENUM)
+#undef USB_PROFILE_ENUM
+    USB_NUM_PROFILES
+} UsbProfileId;
+
+typedef struct {
+    UsbProfileId id;
+    const char *name;
+    uint16_t vendor;
+    uint16_t product;
+    UsbKind kind;
+    int interface;
+    unsigned char endpoint_in;
+    int control_interface;      // -1: none
+    unsigned char endpoint_out; // 0: none
+    const char *description;
+} UsbProfile;
+
+static const UsbProfile usb_profiles[USB_NUM_PROFILES] = {
+#define USB_PROFILE_ROW(name, vid, pid, kind, intf, ep_in, ctrl, ep_out, desc) \
+    { USB_PROFILE_##name, #name, vid, pid, kind, intf, ep_in, ctrl, ep_out, desc },
+    USB_PROFILES(USB_PROFILE_ROW)
+    USB_GENERIC_PROFILES(USB_PROFILE_ROW)
+#undef USB_PROFILE_ROW
+};
+
+static inline const UsbProfile *usb_profile_generic(UsbKind kind) {
+    switch (kind) {
+        case USB_KIND_GAMEPAD: return &usb_profiles[USB_PROFILE_GENERIC_GAMEPAD];
+        case USB_KIND_SERIAL: return &usb_profiles[USB_PROFILE_GENERIC_SERIAL];
+        default: return &usb_profiles[USB_PROFILE_GENERIC_MOUSE];
+    }
+}
+
+// The profile of `vendor`:`product` if it is a device of `kind`, else the
+// generic one of that kind.
+static inline const UsbProfile *usb_profile_lookup(uint16_t vendor, uint16_t product, UsbKind kind) {
+    switch ((uint32_t)vendor << 16 | product) {
+#define USB_PROFILE_CASE(name, vid, pid, k, intf, ep_in, ctrl, ep_out, desc) \
+        case (uint32_t)(vid) << 16 | (pid): \
+            if ((k) == kind) return &usb_profiles[USB_PROFILE_##name]; \
+            break;
+        USB_PROFILES(USB_PROFILE_CASE)
+#undef USB_PROFILE_CASE
+    }
+    return usb_profile_generic(kind);
+}
+
+// Profile of the wrapped device; prints which one was picked.
+static inline const UsbProfile *usb_profile_find(libusb_device_handle *handle, UsbKind kind) {
+    struct libusb_device_descriptor desc;
+    if (libusb_get_device_descriptor(libusb_get_device(handle), &desc) < 0) {
+        fprintf(stderr, "WARN: No device descriptor, using the generic profile.\n");
+        return usb_profile_generic(kind);
+    }
+    const UsbProfile *p = usb_profile_lookup(desc.idVendor, desc.idProduct, kind);
+    fprintf(stderr, "DEBUG: Device %04x:%04x, profile %s (%s): interface %d, endpoint 0x%02x\n", desc.idVendor,
+            desc.idProduct, p->name, p->description, p->interface, p->endpoint_in);
+    return p;
+}
+
+#endif // USB_PROFILES_H
@@ -0,0 +1,253 @@
+#ifndef USB_SESSION_H
+#define USB_SESSION_H
+
+/*
+ * Device bring-up for the tools that get a file descriptor from termux-usb
+ *
+ * usb_session_open() creates a libusb context without device discovery and
+ * wraps the descriptor; usb_session_claim() claims an interface. Kernel
+ * drivers are detached through libusb's auto-detach: on Linux that is one
+ * USBDEVFS_DISCONNECT_CLAIM ioctl instead of asking for the driver,
+ * detaching it and claiming in three, and libusb reattaches the driver when
+ * the interface is released. Where auto-detach is not supported the session
+ * falls back to the manual sequence and reattaches on close itself.
+ *
+ * usb_session_control_out() queues a class request (CDC SET_LINE_CODING,
+ * ...) on endpoint 0 and returns at once. Several requests go out back to
+ * back instead of one round trip each, and they complete while the read
+ * loop already waits for data; a failed one prints a WARN: line. Nothing
+ * sleeps to let the device settle: IN transfers wait until it sends.
+ *
+ * Every step is timed. usb_session_mark() ends a phase of the tool's own
+ * (reading descriptors, ...), usb_session_first_data() notes the first
+ * report, and usb_session_report() prints the breakdown, e.g.
+ *   DEBUG: Startup: libusb_init 0.41 ms, wrap 0.06 ms, claim 0.02 ms, control 0.01 ms;
+ *          2 control requests done at 1.12 ms; first data at 1.85 ms
+ *
+ * Usage:
+ *   static UsbSession session;
+ *   if (usb_session_open(&session, fd) < 0) return 1;
+ *   if (usb_session_claim(&session, 1) < 0) goto out;
+ *   ...                                   // usb_session_first_data(&session) in the report handler
+ * out:
+ *   usb_session_report(&session);
+ *   usb_session_close(&session);          // releases the interfaces, libusb_exit()
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <libusb-1.0/libusb.h>
+
+#define USB_SESSION_MAX_PHASES 8
+#define USB_SESSION_MAX_INTERFACES 4
+#define USB_SESSION_MAX_CONTROL 4
+#define USB_SESSION_CONTROL_DATA 64
+#define USB_SESSION_CONTROL_TIMEOUT_MS 1000
+
+typedef struct {
+    const char *name;
+    double seconds;
+} UsbSessionPhase;
+
+typedef struct {
+    libusb_context *ctx;
+    libusb_device_handle *handle;
+
+    int interfaces[USB_SESSION_MAX_INTERFACES];
+    int detached[USB_SESSION_MAX_INTERFACES];  // detached by hand, reattached on close
+    int num_interfaces;
+    int auto_detach;                            // libusb detaches and reattaches itself
+
+    struct libusb_transfer *control[USB_SESSION_MAX_CONTROL];
+    const char *control_name[USB_SESSION_MAX_CONTROL];
+    unsigned char control_buf[USB_SESSION_MAX_CONTROL][LIBUSB_CONTROL_SETUP_SIZE + USB_SESSION_CONTROL_DATA];
+    int num_control;
+    int control_pending;
+    int control_failed;
+    double control_done;                        // when the last one came back, 0 before
+
+    double start;                               // usb_session_open() called
+    double last;                                // end of the previous phase
+    double first_data;                          // 0 before the first report
+    UsbSessionPhase phases[USB_SESSION_MAX_PHASES];
+    int num_phases;
+} UsbSession;
+
+static inline double usb_session_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// End the current phase; the time since the previous one is booked on
+// `name` (added up if the previous phase had the same name).
+static inline void usb_session_mark(UsbSession *s, const char *name) {
+    double now = usb_session_now();
+    UsbSessionPhase *p = s->num_phases ? &s->phases[s->num_phases - 1] : NULL;
+    if (!p || strcmp(p->name, name) != 0) {
+        if (s->num_phases == USB_SESSION_MAX_PHASES) return;
+        p = &s->phases[s->num_phases++];
+        p->name = name;
+        p->seconds = 0;
+    }
+    p->seconds += now - s->last;
+    s->last = now;
+}
+
+// Returns 0 or a libusb error code (already printed).
+static inline int usb_session_open(UsbSession *s, int fd) {
+    memset(s, 0, sizeof(*s));
+    s->start = s->last = usb_session_now();
+
+    libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
+    int r = libusb_init(&s->ctx);
+    if (r < 0) {
+        fprintf(stderr, "ERROR: libusb_init failed: %s\n", libusb_error_name(r));
+        s->ctx = NULL;
+        return r;
+    }
+    usb_session_mark(s, "libusb_init");
+
+    r = libusb_wrap_sys_device(s->ctx, (intptr_t)fd, &s->handle);
+    if (r < 0 || !s->handle) {
+        fprintf(stderr, "ERROR: libusb_wrap_sys_device failed: %s\n", libusb_error_name(r < 0 ? r : LIBUSB_ERROR_OTHER));
+        libusb_exit(s->ctx);
+        s->ctx = NULL;
+        s->handle = NULL;
+        return r < 0 ? r : LIBUSB_ERROR_OTHER;
+    }
+    s->auto_detach = libusb_set_auto_detach_kernel_driver(s->handle, 1) == LIBUSB_SUCCESS;
+    usb_session_mark(s, "wrap");
+    return 0;
+}
+
+// Claim `interface_number`, detaching its kernel driver if one is bound.
+// Returns 0 or a libusb error code (already printed).
+static inline int usb_session_claim(UsbSession *s, int interface_number) {
+    int detached = 0;
+    if (s->num_interfaces == USB_SESSION_MAX_INTERFACES) {
+        fprintf(stderr, "ERROR: Cannot claim interface %d: already holding %d interfaces\n",
+                interface_number, USB_SESSION_MAX_INTERFACES);
+        return LIBUSB_ERROR_OVERFLOW;
+    }
+
+    if (!s->auto_detach && libusb_kernel_driver_active(s->handle, interface_number) == 1) {
+        int r = libusb_detach_kernel_driver(s->handle, interface_number);
+        if (r < 0) {
+            fprintf(stderr, "ERROR: libusb_detach_kernel_driver failed (interface %d): %s\n",
+                    interface_number, libusb_error_name(r));
+            return r;
+        }
+        detached = 1;
+    }
+    int r = libusb_claim_interface(s->handle, interface_number);
+    if (r < 0) {
+        fprintf(stderr, "ERROR: libusb_claim_interface failed (interface %d): %s\n", interface_number, libusb_error_name(r));
+        if (detached) libusb_attach_kernel_driver(s->handle, interface_number);
+        return r;
+    }
+    s->interfaces[s->num_interfaces] = interface_number;
+    s->detached[s->num_interfaces] = detached;
+    s->num_interfaces++;
+    usb_session_mark(s, "claim");
+    return 0;
+}
+
+static inline void LIBUSB_CALL usb_session_control_cb(struct libusb_transfer *transfer) {
+    UsbSession *s = transfer->user_data;
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+        for (int i = 0; i < s->num_control; i++) {
+            if (s->control[i] != transfer) continue;
+            fprintf(stderr, "WARN: %s failed (transfer status %d)\n", s->control_name[i], transfer->status);
+        }
+        s->control_failed++;
+    }
+    if (--s->control_pending == 0) s->control_done = usb_session_now();
+}
+
+// Queue a host-to-device control request with up to USB_SESSION_CONTROL_DATA
+// bytes of data and return without waiting for it. `name` is used in
+// messages. Returns 0 or a libusb error code.
+static inline int usb_session_control_out(UsbSession *s, const char *name, uint8_t request_type, uint8_t request,
+                                          uint16_t value, uint16_t index, const unsigned char *data, uint16_t len) {
+    if (s->num_control == USB_SESSION_MAX_CONTROL || len > USB_SESSION_CONTROL_DATA) return LIBUSB_ERROR_INVALID_PARAM;
+
+    struct libusb_transfer *t = libusb_alloc_transfer(0);
+    if (!t) return LIBUSB_ERROR_NO_MEM;
+    unsigned char *buf = s->control_buf[s->num_control];
+    libusb_fill_control_setup(buf, request_type, request, value, index, len);
+    if (len) memcpy(buf + LIBUSB_CONTROL_SETUP_SIZE, data, len);
+    libusb_fill_control_transfer(t, s->handle, buf, usb_session_control_cb, s, USB_SESSION_CONTROL_TIMEOUT_MS);
+
+    int r = libusb_submit_transfer(t);
+    if (r < 0) {
+        fprintf(stderr, "WARN: %s could not be submitted: %s\n", name, libusb_error_name(r));
+        libusb_free_transfer(t);
+        return r;
+    }
+    s->control[s->num_control] = t;
+    s->control_name[s->num_control] = name;
+    s->num_control++;
+    s->control_pending++;
+    usb_session_mark(s, "control");
+    return 0;
+}
+
+// Note the arrival of data. Only the first call does anything.
+static inline void usb_session_first_data(UsbSession *s) {
+    if (s->first_data == 0) s->first_data = usb_session_now();
+}
+
+static inline void usb_session_report(const UsbSession *s) {
+    char line[512];
+    size_t n = (size_t)snprintf(line, sizeof(line), "DEBUG: Startup:");
+
+    for (int i = 0; i < s->num_phases && n < sizeof(line); i++) {
+        n += (size_t)snprintf(line + n, sizeof(line) - n, "%s %s %.2f ms", i ? "," : "",
+                              s->phases[i].name, s->phases[i].seconds * 1e3);
+    }
+    if (s->num_control && n < sizeof(line)) {
+        if (s->control_pending) {
+            n += (size_t)snprintf(line + n, sizeof(line) - n, "; %d of %d control requests still pending",
+                                  s->control_pending, s->num_control);
+        } else {
+            n += (size_t)snprintf(line + n, sizeof(line) - n, "; %d control request%s done at %.2f ms",
+                                  s->num_control, s->num_control == 1 ? "" : "s", (s->control_done - s->start) * 1e3);
+            if (s->control_failed && n < sizeof(line)) {
+                n += (size_t)snprintf(line + n, sizeof(line) - n, " (%d failed)", s->control_failed);
+            }
+        }
+    }
+    if (s->first_data > 0 && n < sizeof(line)) {
+        snprintf(line + n, sizeof(line) - n, "; first data at %.2f ms", (s->first_data - s->start) * 1e3);
+    }
+    fprintf(stderr, "%s\n", line);
+}
+
+// Wait for queued control requests, release the interfaces (reattaching
+// kernel drivers), close the device and the context. Safe after a failed
+// usb_session_open().
+static inline void usb_session_close(UsbSession *s) {
+    while (s->control_pending > 0) {
+        // Bounded by USB_SESSION_CONTROL_TIMEOUT_MS.
+        struct timeval tv = { 0, 100000 };
+        if (libusb_handle_events_timeout_completed(s->ctx, &tv, NULL) < 0) break;
+    }
+    if (s->control_pending == 0) {
+        for (int i = 0; i < s->num_control; i++) libusb_free_transfer(s->control[i]);
+        s->num_control = 0;
+    }
+    for (int i = s->num_interfaces - 1; i >= 0; i--) {
+        libusb_release_interface(s->handle, s->interfaces[i]);
+        if (s->detached[i]) libusb_attach_kernel_driver(s->handle, s->interfaces[i]);
+    }
+    s->num_interfaces = 0;
+    if (s->handle) libusb_close(s->handle);
+    if (s->ctx) libusb_exit(s->ctx);
+    s->handle = NULL;
+    s->ctx = NULL;
+}
+
+#endif // USB_SESSION_H
@@ -0,0 +1,155 @@
+#ifndef USB_WAIT_H
+#define USB_WAIT_H
+
+/*
+ * Blocking libusb event handling for transfers without a timeout
+ *
+ * A loop around libusb_interrupt_transfer() or libusb_handle_events_timeout()
+ * with a short timeout wakes up on every expiry, also when the device has
+ * nothing to say. usb_wait_events() instead sleeps in epoll_wait() on the
+ * context's file descriptors (libusb_get_pollfds, kept current through the
+ * pollfd notifiers) until a transfer completes, libusb has a timeout of its
+ * own to expire or the caller's deadline passes. With the transfers
+ * submitted with timeout 0, an idle device costs no wakeups at all.
+ *
+ * Ctrl+C: a signal only interrupts the wait if it is delivered to the
+ * thread sleeping in it, and a capture or writer thread may get it instead.
+ * The signal handler therefore calls usb_wait_wake() after setting its flag;
+ * that writes to an eventfd in the same epoll set, which also covers a
+ * signal that arrives between checking the flag and going to sleep.
+ *
+ * Other file descriptors the loop serves (a listening socket, say) can be
+ * added with usb_wait_watch(): when one of them is readable the wait
+ * returns and sets `watched_ready`, and the caller services them itself.
+ *
+ * Usage:
+ *   static UsbWait waiter;                        // the signal handler wakes it
+ *   usb_wait_init(&waiter, context);
+ *   usb_async_start(&q, handle, 0x81, LIBUSB_TRANSFER_TYPE_INTERRUPT, 8, 32, 0, on_data, ctx);
+ *   while (!stop_requested && !q.stopped) {
+ *       usb_wait_events(&waiter, -1);             // or microseconds until the next deadline
+ *   }
+ *   usb_async_cancel(&q, context);
+ *   usb_wait_close(&waiter);
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <libusb-1.0/libusb.h>
+
+typedef struct {
+    libusb_context *ctx;
+    int epfd;
+    int wake_fd;
+    volatile sig_atomic_t active;  // set while wake_fd may be written
+    int watched_ready;             // a usb_wait_watch() fd woke the wait; the caller clears it
+} UsbWait;
+
+#define USB_WAIT_WATCHED (1ull << 32)  // epoll data tag of usb_wait_watch() fds; libusb's have data.fd only
+
+static inline void LIBUSB_CALL usb_wait_pollfd_added(int fd, short events, void *user) {
+    UsbWait *w = user;
+    struct epoll_event ev = { 0 };
+    ev.events = (events & POLLIN ? EPOLLIN : 0) | (events & POLLOUT ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno == EEXIST) {
+        epoll_ctl(w->epfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+}
+
+static inline void LIBUSB_CALL usb_wait_pollfd_removed(int fd, void *user) {
+    UsbWait *w = user;
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+// Returns 0 or a libusb error code.
+static inline int usb_wait_init(UsbWait *w, libusb_context *ctx) {
+    w->ctx = ctx;
+    w->active = 0;
+    w->watched_ready = 0;
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    w->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w->epfd < 0 || w->wake_fd < 0) {
+        if (w->epfd >= 0) close(w->epfd);
+        if (w->wake_fd >= 0) close(w->wake_fd);
+        return LIBUSB_ERROR_OTHER;
+    }
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN;
+    ev.data.fd = w->wake_fd;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wake_fd, &ev);
+
+    libusb_set_pollfd_notifiers(ctx, usb_wait_pollfd_added, usb_wait_pollfd_removed, w);
+    const struct libusb_pollfd **fds = libusb_get_pollfds(ctx);
+    for (int i = 0; fds && fds[i]; i++) usb_wait_pollfd_added(fds[i]->fd, fds[i]->events, w);
+    libusb_free_pollfds(fds);
+    w->active = 1;
+    return 0;
+}
+
+// Also wake up when `fd` becomes readable. Returns 0, or -1 with errno set.
+static inline int usb_wait_watch(UsbWait *w, int fd) {
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN;
+    ev.data.u64 = USB_WAIT_WATCHED | (uint32_t)fd;
+    return epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// Make the current or next usb_wait_events() return. Async-signal-safe.
+static inline void usb_wait_wake(UsbWait *w) {
+    if (!w->active) return;
+    int saved_errno = errno;
+    uint64_t one = 1;
+    if (write(w->wake_fd, &one, sizeof(one)) < 0) {
+        // Counter already nonzero: the wait returns anyway.
+    }
+    errno = saved_errno;
+}
+
+// Sleep until libusb has work or `timeout_us` has passed (-1: no limit of
+// the caller's), then handle the events without blocking. Returns 0 or a
+// libusb error code.
+static inline int usb_wait_events(UsbWait *w, long timeout_us) {
+    struct epoll_event events[8];
+    struct timeval tv;
+
+    if (libusb_get_next_timeout(w->ctx, &tv) == 1) {
+        long t = (long)tv.tv_sec * 1000000L + tv.tv_usec;
+        if (timeout_us < 0 || t < timeout_us) timeout_us = t;
+    }
+    int timeout_ms = timeout_us < 0 ? -1 : (int)((timeout_us + 999) / 1000);
+
+    int n = epoll_wait(w->epfd, events, 8, timeout_ms);
+    if (n < 0 && errno != EINTR) return LIBUSB_ERROR_OTHER;
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.u64 & USB_WAIT_WATCHED) {
+            w->watched_ready = 1;
+        } else if (events[i].data.fd == w->wake_fd) {
+            uint64_t v;
+            if (read(w->wake_fd, &v, sizeof(v)) < 0) {
+                // EAGAIN: drained already.
+            }
+        }
+    }
+
+    // Also on a plain timeout: libusb expires its own transfer timeouts here.
+    struct timeval zero = { 0, 0 };
+    int r = libusb_handle_events_timeout_completed(w->ctx, &zero, NULL);
+    return r == LIBUSB_ERROR_INTERRUPTED ? 0 : r;
+}
+
+static inline void usb_wait_close(UsbWait *w) {
+    w->active = 0;
+    libusb_set_pollfd_notifiers(w->ctx, NULL, NULL, NULL);
+    close(w->wake_fd);
+    close(w->epfd);
+}
+
+#endif // USB_WAIT_H
@@ -0,0 +1,269 @@
+#define _GNU_SOURCE // accept4, MSG_CMSG_CLOEXEC
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <libusb-1.0/libusb.h>
+
+#include "usb_daemon.h"
+
+#define MAX_CLIENTS 8
+
+// What `usb_daemon add` sends, together with the USB fd and its stdout as SCM_RIGHTS.
+typedef struct {
+    char type[16];
+} AddRequest;
+
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t stats_requested = 0;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void handle_stats_signal(int sig) {
+    (void)sig;
+    stats_requested = 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s socket]                           run the daemon\n", prog);
+    fprintf(stderr, "       %s [-s socket] add <type> <file_descriptor>  hand a device to it\n", prog);
+    fprintf(stderr, "  -s socket   Unix socket path (default $TMPDIR/usb_daemon.sock)\n");
+    fprintf(stderr, "  type        mouse, gamepad or serial; its output goes to this command's stdout\n");
+    fprintf(stderr, "Send SIGUSR1 to the daemon to print per-device counters.\n");
+}
+
+static void default_socket_path(char *out, size_t size) {
+    const char *dir = getenv("TMPDIR");
+    snprintf(out, size, "%s/usb_daemon.sock", dir && dir[0] ? dir : "/tmp");
+}
+
+static int make_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "ERROR: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/* =========================================================
+ * Client: run by termux-usb with the device fd
+ * ========================================================= */
+
+static int add_device(const char *socket_path, const char *type, int usb_fd) {
+    struct sockaddr_un addr;
+    AddRequest req;
+    char reply[256];
+
+    if (make_address(&addr, socket_path) < 0) return 1;
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0 || connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "ERROR: Cannot connect to %s: %s (is the daemon running?)\n", socket_path, strerror(errno));
+        return 1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    snprintf(req.type, sizeof(req.type), "%s", type);
+    int fds[2] = { usb_fd, STDOUT_FILENO };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    if (sendmsg(s, &msg, 0) != (ssize_t)sizeof(req)) {
+        fprintf(stderr, "ERROR: Sending the device failed: %s\n", strerror(errno));
+        close(s);
+        return 1;
+    }
+    ssize_t n = recv(s, reply, sizeof(reply) - 1, 0);
+    close(s);
+    if (n <= 0) {
+        fprintf(stderr, "ERROR: No reply from the daemon\n");
+        return 1;
+    }
+    reply[n] = '\0';
+    fprintf(stderr, "%s", reply);
+    return strncmp(reply, "OK", 2) == 0 ? 0 : 1;
+}
+
+/* =========================================================
+ * Daemon
+ * ========================================================= */
+
+// One request per connection: receive it, add the device, reply. Returns 0
+// when the connection is done with, 1 if the request has not arrived yet.
+static int serve_client(UsbDaemon *d, int s) {
+    AddRequest req;
+    char reply[256];
+    int fds[2] = { -1, -1 };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n = recvmsg(s, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return 1;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS && c->cmsg_len == CMSG_LEN(sizeof(fds))) {
+            memcpy(fds, CMSG_DATA(c), sizeof(fds));
+        }
+    }
+
+    if (n != (ssize_t)sizeof(req) || fds[0] < 0 || fds[1] < 0) {
+        snprintf(reply, sizeof(reply), "ERROR: malformed request\n");
+        if (fds[0] >= 0) close(fds[0]);
+        if (fds[1] >= 0) close(fds[1]);
+    } else {
+        char err[160];
+        req.type[sizeof(req.type) - 1] = '\0';
+        int id = usb_daemon_add(d, req.type, fds[0], fds[1], err, sizeof(err));
+        if (id < 0) {
+            snprintf(reply, sizeof(reply), "ERROR: %s\n", err);
+        } else {
+            snprintf(reply, sizeof(reply), "OK: device %d (%s)\n", id, req.type);
+        }
+    }
+    fprintf(stderr, "DEBUG: %s", reply);
+    if (send(s, reply, strlen(reply), MSG_NOSIGNAL) < 0) {
+        // The client gave up; the device stays added.
+    }
+    return 0;
+}
+
+static int run_daemon(const char *socket_path) {
+    struct sockaddr_un addr;
+    UsbDaemon d;
+    int clients[MAX_CLIENTS];
+    int num_clients = 0;
+
+    if (make_address(&addr, socket_path) < 0) return 1;
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        fprintf(stderr, "ERROR: socket: %s\n", strerror(errno));
+        return 1;
+    }
+    unlink(socket_path);
+    mode_t old_umask = umask(077); // only this user may hand us devices
+    int r = bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+    if (r < 0 || listen(listener, MAX_CLIENTS) < 0) {
+        fprintf(stderr, "ERROR: Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        close(listener);
+        return 1;
+    }
+
+    r = usb_daemon_init(&d);
+    if (r < 0) {
+        fprintf(stderr, "ERROR: libusb_init failed: %s\n", libusb_error_name(r));
+        close(listener);
+        unlink(socket_path);
+        return 1;
+    }
+    usb_daemon_watch(&d, listener);
+
+    // The signals are only delivered inside epoll_pwait(), so a Ctrl+C
+    // between the flag check and the wait cannot be missed.
+    sigset_t block, wait_mask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &block, &wait_mask);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = handle_stats_signal;
+    sigaction(SIGUSR1, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "DEBUG: Listening on %s (Ctrl+C to stop).\n", socket_path);
+    while (!stop_requested) {
+        int ready[MAX_CLIENTS + 1];
+        int n = usb_daemon_step(&d, ready, MAX_CLIENTS + 1, &wait_mask);
+        if (stats_requested) {
+            stats_requested = 0;
+            usb_daemon_print(&d, stderr);
+        }
+        for (int i = 0; i < n; i++) {
+            if (ready[i] == listener) {
+                int s;
+                while ((s = accept4(listener, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+                    if (num_clients == MAX_CLIENTS) {
+                        close(s);
+                        continue;
+                    }
+                    clients[num_clients++] = s;
+                    usb_daemon_watch(&d, s);
+                }
+                continue;
+            }
+            if (serve_client(&d, ready[i])) continue;
+            usb_daemon_unwatch(&d, ready[i]);
+            close(ready[i]);
+            for (int c = 0; c < num_clients; c++) {
+                if (clients[c] == ready[i]) clients[c] = clients[--num_clients];
+            }
+        }
+    }
+
+    fprintf(stderr, "\nDEBUG: Stopping.\n");
+    usb_daemon_print(&d, stderr);
+    for (int c = 0; c < num_clients; c++) close(clients[c]);
+    usb_daemon_close(&d);
+    close(listener);
+    unlink(socket_path);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    char socket_path[108];
+    int opt;
+
+    default_socket_path(socket_path, sizeof(socket_path));
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+            case 's': snprintf(socket_path, sizeof(socket_path), "%s", optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (optind == argc) return run_daemon(socket_path);
+
+    int usb_fd;
+    if (strcmp(argv[optind], "add") != 0 || argc - optind != 3 || sscanf(argv[optind + 2], "%d", &usb_fd) != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    return add_device(socket_path, argv[optind + 1], usb_fd);
+}
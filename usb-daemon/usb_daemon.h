@@ -0,0 +1,566 @@
+#ifndef USB_DAEMON_H
+#define USB_DAEMON_H
+
+/*
+ * One libusb context and one epoll loop for many devices
+ *
+ * Every device fd handed to the daemon is wrapped on the same context and
+ * gets an async queue (common/usb_async.h) on its IN endpoint. The loop
+ * sleeps in epoll_pwait() on the context's file descriptors
+ * (libusb_get_pollfds, kept current through the pollfd notifiers), the
+ * caller's own fds (e.g. the listening socket) and the earliest deadline of
+ * libusb timeouts and output flushes, then lets libusb complete whatever is
+ * ready without blocking. All transfers of all devices are driven from that
+ * one thread.
+ *
+ * What a device does with its data is decided by its handler, looked up by
+ * name in usb_daemon_handlers[]: it names the kind of device, whose profile
+ * (common/usb_profiles.h, picked by VID:PID) gives the interfaces and the
+ * endpoint to read, optionally configures the device after the claim, and
+ * turns each transfer into output on the device's OutSink (the fd the
+ * client passed along with the device). Mice and pads get the decoder the
+ * tools would pick (usb-mouse/mouse_profiles.h, usb-gamepad/gamepad_profiles.h).
+ * The setup only queues control requests (line coding, report descriptor);
+ * their answers are handled in the loop like any other transfer, so a slow
+ * or stalling endpoint 0 holds up only its own device.
+ *
+ * Usage:
+ *   UsbDaemon d;
+ *   usb_daemon_init(&d);
+ *   usb_daemon_add(&d, "mouse", usb_fd, out_fd, errbuf, sizeof(errbuf));
+ *   while (!stop) usb_daemon_step(&d, ready, 8, &orig_mask);
+ *   usb_daemon_close(&d);
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <libusb-1.0/libusb.h>
+
+#include "../common/usb_async.h"
+#include "../common/out_sink.h"
+#include "../common/usb_profiles.h"
+#include "../usb-mouse/mouse_profiles.h"
+#include "../usb-gamepad/gamepad_profiles.h"
+
+#define USB_DAEMON_MAX_DEVICES 32
+#define USB_DAEMON_FLUSH_BYTES 16384
+#define USB_DAEMON_FLUSH_US 10000
+#define USB_DAEMON_MAX_CONTROL 2
+#define USB_DAEMON_CONTROL_TIMEOUT_MS 1000
+#define USB_DAEMON_MAX_REPORT_DESC 512
+
+// epoll_data.u64: kind in the high half, fd in the low half.
+#define USB_DAEMON_EV_LIBUSB 1ull
+#define USB_DAEMON_EV_USER 2ull
+
+typedef struct UsbDevice UsbDevice;
+
+// Result of a request queued by usb_daemon_control_in(): the data stage,
+// or NULL and the libusb error the request failed with.
+typedef void (*UsbDaemonControlDone)(UsbDevice *dev, const unsigned char *data, int len);
+
+typedef struct {
+    const char *name;
+    UsbKind kind;               // the profile of this kind gives interfaces and endpoint
+    unsigned char type;         // LIBUSB_TRANSFER_TYPE_BULK or _INTERRUPT
+    int depth;
+    int transfer_size;          // 0: wMaxPacketSize
+    unsigned int timeout_ms;    // 0: wait forever (interrupt endpoints just NAK)
+    int (*setup)(UsbDevice *dev);    // after the claim, optional, must not block; < 0 fails the add
+    usb_async_data_cb on_data;       // user = the UsbDevice
+} UsbDeviceHandler;
+
+struct UsbDevice {
+    int id;
+    const UsbDeviceHandler *handler;
+    const UsbProfile *profile;
+    libusb_device_handle *handle;
+    int usb_fd;
+    int out_fd;
+    OutSink out;
+    usb_async_queue queue;
+    int claimed;
+    int claimed_control;
+    int detached;
+    int detached_control;
+
+    // Control requests queued by the setup (usb_daemon_control_out/_in()).
+    struct libusb_transfer *control[USB_DAEMON_MAX_CONTROL];
+    const char *control_name[USB_DAEMON_MAX_CONTROL];
+    UsbDaemonControlDone control_done[USB_DAEMON_MAX_CONTROL];
+    int num_control;
+    int control_pending;
+
+    int decoder_ready;          // report descriptor answered (or refused), mouse/pad selected
+    MouseDecoder mouse;
+    GamepadDecoder pad;
+    unsigned char last_report[32];
+    int last_length;
+    uint64_t reports;
+};
+
+typedef struct {
+    libusb_context *ctx;
+    int epfd;
+    UsbDevice *devices[USB_DAEMON_MAX_DEVICES];
+    int num_devices;
+    int next_id;
+    uint64_t wakeups;
+} UsbDaemon;
+
+/* =========================================================
+ * Handlers
+ * ========================================================= */
+
+// The libusb error a failed transfer stands for, as the synchronous calls return it.
+static inline int usb_daemon_transfer_error(enum libusb_transfer_status status) {
+    switch (status) {
+        case LIBUSB_TRANSFER_STALL: return LIBUSB_ERROR_PIPE;
+        case LIBUSB_TRANSFER_TIMED_OUT: return LIBUSB_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+        case LIBUSB_TRANSFER_OVERFLOW: return LIBUSB_ERROR_OVERFLOW;
+        default: return LIBUSB_ERROR_IO;
+    }
+}
+
+static inline void LIBUSB_CALL usb_daemon_control_cb(struct libusb_transfer *transfer) {
+    UsbDevice *dev = transfer->user_data;
+    dev->control_pending--;
+    if (transfer->status == LIBUSB_TRANSFER_CANCELLED) return;     // the device is being freed
+    for (int i = 0; i < dev->num_control; i++) {
+        if (dev->control[i] != transfer) continue;
+        if (dev->control_done[i]) {
+            if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+                dev->control_done[i](dev, libusb_control_transfer_get_data(transfer), transfer->actual_length);
+            } else {
+                dev->control_done[i](dev, NULL, usb_daemon_transfer_error(transfer->status));
+            }
+        } else if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+            fprintf(stderr, "WARN: device %d: %s failed (transfer status %d)\n", dev->id, dev->control_name[i],
+                    transfer->status);
+        }
+    }
+}
+
+// Queue a control request with a `len`-byte data stage (copied from `data`
+// for host-to-device requests) and return at once: the loop must not wait
+// on one device's endpoint 0. Returns 0 or a libusb error code.
+static inline int usb_daemon_control_submit(UsbDevice *dev, const char *name, uint8_t request_type, uint8_t request,
+                                            uint16_t value, uint16_t index, const unsigned char *data, uint16_t len,
+                                            UsbDaemonControlDone done) {
+    if (dev->num_control == USB_DAEMON_MAX_CONTROL) return LIBUSB_ERROR_INVALID_PARAM;
+
+    struct libusb_transfer *t = libusb_alloc_transfer(0);
+    unsigned char *buf = malloc(LIBUSB_CONTROL_SETUP_SIZE + (size_t)len);
+    if (!t || !buf) {
+        libusb_free_transfer(t);
+        free(buf);
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    libusb_fill_control_setup(buf, request_type, request, value, index, len);
+    if (data && len) memcpy(buf + LIBUSB_CONTROL_SETUP_SIZE, data, len);
+    libusb_fill_control_transfer(t, dev->handle, buf, usb_daemon_control_cb, dev, USB_DAEMON_CONTROL_TIMEOUT_MS);
+    t->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+
+    int r = libusb_submit_transfer(t);
+    if (r < 0) {
+        libusb_free_transfer(t);
+        return r;
+    }
+    dev->control[dev->num_control] = t;
+    dev->control_name[dev->num_control] = name;
+    dev->control_done[dev->num_control] = done;
+    dev->num_control++;
+    dev->control_pending++;
+    return 0;
+}
+
+// Host-to-device request, like usb_session_control_out(). A failure is
+// printed when it arrives in usb_daemon_control_cb().
+static inline int usb_daemon_control_out(UsbDevice *dev, const char *name, uint8_t request_type, uint8_t request,
+                                         uint16_t value, uint16_t index, const unsigned char *data, uint16_t len) {
+    return usb_daemon_control_submit(dev, name, request_type, request, value, index, data, len, NULL);
+}
+
+// Device-to-host request of up to `len` bytes; `done` gets the answer.
+static inline int usb_daemon_control_in(UsbDevice *dev, const char *name, uint8_t request_type, uint8_t request,
+                                        uint16_t value, uint16_t index, uint16_t len, UsbDaemonControlDone done) {
+    return usb_daemon_control_submit(dev, name, request_type, request, value, index, NULL, len, done);
+}
+
+// Queue the GET_DESCRIPTOR(REPORT) of hid_get_report_descriptor() on the
+// profile's interface; `done` compiles it and selects the decoder. If the
+// request cannot be queued, `done` runs at once without a descriptor.
+static inline int usb_daemon_report_descriptor(UsbDevice *dev, UsbDaemonControlDone done) {
+    int r = usb_daemon_control_in(dev, "GET_DESCRIPTOR(REPORT)",
+                                  LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_STANDARD | LIBUSB_RECIPIENT_INTERFACE,
+                                  LIBUSB_REQUEST_GET_DESCRIPTOR, (uint16_t)(LIBUSB_DT_REPORT << 8),
+                                  (uint16_t)dev->profile->interface, USB_DAEMON_MAX_REPORT_DESC, done);
+    if (r < 0) {
+        fprintf(stderr, "WARN: device %d: report descriptor request could not be queued: %s\n", dev->id, libusb_error_name(r));
+        done(dev, NULL, r);
+    }
+    return 0;
+}
+
+static inline void usb_daemon_mouse_descriptor(UsbDevice *dev, const unsigned char *desc, int len) {
+    HidPlan plan;
+    MouseLayout layout = {0};
+    if (len > 0 && hid_plan_compile(&plan, desc, len) > 0 && mouse_layout_from_plan(&layout, &plan) < 0) {
+        memset(&layout, 0, sizeof(layout));
+    }
+    mouse_decoder_select(&dev->mouse, dev->profile, &layout);
+    dev->decoder_ready = 1;
+}
+
+static inline int usb_daemon_mouse_setup(UsbDevice *dev) {
+    return usb_daemon_report_descriptor(dev, usb_daemon_mouse_descriptor);
+}
+
+// One line per report: buttons, motion and wheel. Reports that arrive before
+// the report descriptor are dropped.
+static inline int usb_daemon_mouse_data(void *user, const unsigned char *data, int len) {
+    UsbDevice *dev = user;
+    MouseReport r;
+    char line[64];
+    if (!dev->decoder_ready) return 0;
+    if (mouse_decoder_run(&dev->mouse, data, (size_t)len, &r) < 0) return 0;
+    dev->reports++;
+    int n = snprintf(line, sizeof(line), "buttons=%u dx=%d dy=%d wheel=%d\n", r.buttons, r.x, r.y, r.wheel);
+    out_sink_write(&dev->out, line, (size_t)n);
+    return 0;
+}
+
+// Xbox 360 pads have no report descriptor (the request stalls) and already
+// send the 20-byte layout.
+static inline void usb_daemon_gamepad_descriptor(UsbDevice *dev, const unsigned char *desc, int len) {
+    HidPlan plan;
+    GamepadLayout layout = {0};
+    if (len > 0 && hid_plan_compile(&plan, desc, len) > 0 && gamepad_layout_from_plan(&layout, &plan) < 0) {
+        memset(&layout, 0, sizeof(layout));
+    }
+    gamepad_decoder_select(&dev->pad, dev->profile, &layout);
+    dev->decoder_ready = 1;
+}
+
+static inline int usb_daemon_gamepad_setup(UsbDevice *dev) {
+    dev->last_length = -1;
+    return usb_daemon_report_descriptor(dev, usb_daemon_gamepad_descriptor);
+}
+
+// One line per change of state; pads resend an unchanged state on every poll.
+// Reports that arrive before the report descriptor are dropped.
+static inline int usb_daemon_gamepad_data(void *user, const unsigned char *data, int len) {
+    UsbDevice *dev = user;
+    GamepadReport r;
+    char line[128];
+    if (!dev->decoder_ready) return 0;
+    if (dev->pad.layout.valid) {
+        if (gamepad_decoder_run(&dev->pad, data, len, &r) < 0) return 0;
+    } else {
+        if (len < (int)sizeof(r)) return 0;
+        memcpy(&r, data, sizeof(r));
+    }
+    dev->reports++;
+    if (dev->last_length == (int)sizeof(r) && memcmp(dev->last_report, &r, sizeof(r)) == 0) return 0;
+    memcpy(dev->last_report, &r, sizeof(r));
+    dev->last_length = (int)sizeof(r);
+    int n = snprintf(line, sizeof(line), "dpad=%02x buttons=%02x lt=%u rt=%u lx=%d ly=%d rx=%d ry=%d\n",
+                     r.dpad_system, r.buttons, r.trigger_left, r.trigger_right,
+                     r.left_x, r.left_y, r.right_x, r.right_y);
+    out_sink_write(&dev->out, line, (size_t)n);
+    return 0;
+}
+
+// 9600 8-N-1 and DTR/RTS, like read_serial. Both requests are only queued;
+// they complete in the loop while the bulk IN queue already waits for data.
+static inline int usb_daemon_serial_setup(UsbDevice *dev) {
+    unsigned char line_coding[7] = { 0x80, 0x25, 0x00, 0x00, 0x00, 0x00, 0x08 };
+    int ctrl = dev->profile->control_interface;
+    if (ctrl < 0) return 0;
+    int r = usb_daemon_control_out(dev, "SET_LINE_CODING", 0x21, 0x20, 0, (uint16_t)ctrl, line_coding, sizeof(line_coding));
+    if (r == 0) r = usb_daemon_control_out(dev, "SET_CONTROL_LINE_STATE", 0x21, 0x22, 0x03, (uint16_t)ctrl, NULL, 0);
+    if (r < 0) fprintf(stderr, "WARN: device %d: CDC line setup could not be queued: %s\n", dev->id, libusb_error_name(r));
+    return 0;
+}
+
+// Raw bytes, unchanged.
+static inline int usb_daemon_serial_data(void *user, const unsigned char *data, int len) {
+    UsbDevice *dev = user;
+    dev->reports++;
+    out_sink_write(&dev->out, data, (size_t)len);
+    return 0;
+}
+
+static const UsbDeviceHandler usb_daemon_handlers[] = {
+    { "mouse",   USB_KIND_MOUSE,   LIBUSB_TRANSFER_TYPE_INTERRUPT, 8, 0,     0,    usb_daemon_mouse_setup,   usb_daemon_mouse_data },
+    { "gamepad", USB_KIND_GAMEPAD, LIBUSB_TRANSFER_TYPE_INTERRUPT, 8, 0,     0,    usb_daemon_gamepad_setup, usb_daemon_gamepad_data },
+    { "serial",  USB_KIND_SERIAL,  LIBUSB_TRANSFER_TYPE_BULK,      8, 16384, 2000, usb_daemon_serial_setup,  usb_daemon_serial_data },
+};
+
+static inline const UsbDeviceHandler *usb_daemon_find_handler(const char *name) {
+    for (size_t i = 0; i < sizeof(usb_daemon_handlers) / sizeof(usb_daemon_handlers[0]); i++) {
+        if (strcmp(usb_daemon_handlers[i].name, name) == 0) return &usb_daemon_handlers[i];
+    }
+    return NULL;
+}
+
+/* =========================================================
+ * Event loop
+ * ========================================================= */
+
+static inline void LIBUSB_CALL usb_daemon_pollfd_added(int fd, short events, void *user) {
+    UsbDaemon *d = user;
+    struct epoll_event ev = { 0 };
+    ev.events = (events & POLLIN ? EPOLLIN : 0) | (events & POLLOUT ? EPOLLOUT : 0);
+    ev.data.u64 = (USB_DAEMON_EV_LIBUSB << 32) | (uint32_t)fd;
+    if (epoll_ctl(d->epfd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno == EEXIST) {
+        epoll_ctl(d->epfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+}
+
+static inline void LIBUSB_CALL usb_daemon_pollfd_removed(int fd, void *user) {
+    UsbDaemon *d = user;
+    epoll_ctl(d->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+// Returns 0 or a libusb error code.
+static inline int usb_daemon_init(UsbDaemon *d) {
+    memset(d, 0, sizeof(*d));
+    d->next_id = 1;
+    d->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (d->epfd < 0) return LIBUSB_ERROR_OTHER;
+
+    libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
+    int r = libusb_init(&d->ctx);
+    if (r < 0) {
+        close(d->epfd);
+        return r;
+    }
+    libusb_set_pollfd_notifiers(d->ctx, usb_daemon_pollfd_added, usb_daemon_pollfd_removed, d);
+    const struct libusb_pollfd **fds = libusb_get_pollfds(d->ctx);
+    for (int i = 0; fds && fds[i]; i++) usb_daemon_pollfd_added(fds[i]->fd, fds[i]->events, d);
+    libusb_free_pollfds(fds);
+    return 0;
+}
+
+// Have usb_daemon_step() report `fd` when it is readable.
+static inline int usb_daemon_watch(UsbDaemon *d, int fd) {
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN;
+    ev.data.u64 = (USB_DAEMON_EV_USER << 32) | (uint32_t)fd;
+    return epoll_ctl(d->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static inline void usb_daemon_unwatch(UsbDaemon *d, int fd) {
+    epoll_ctl(d->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static inline void usb_daemon_print_device(const UsbDevice *dev, FILE *out) {
+    fprintf(out, "DEBUG: device %d (%s): %llu reports, %llu bytes, %llu transfers, queue ran empty %llu times, %llu bytes of output\n",
+            dev->id, dev->handler->name, (unsigned long long)dev->reports,
+            (unsigned long long)dev->queue.bytes, (unsigned long long)dev->queue.completions,
+            (unsigned long long)dev->queue.underruns, (unsigned long long)dev->out.bytes_written);
+}
+
+static inline void usb_daemon_print(const UsbDaemon *d, FILE *out) {
+    fprintf(out, "DEBUG: %d devices, %llu loop wakeups\n", d->num_devices, (unsigned long long)d->wakeups);
+    for (int i = 0; i < d->num_devices; i++) usb_daemon_print_device(d->devices[i], out);
+}
+
+// Undo everything usb_daemon_add() did and close the fds the device came with.
+static inline void usb_daemon_free_device(UsbDaemon *d, UsbDevice *dev) {
+    for (int i = 0; i < dev->num_control; i++) libusb_cancel_transfer(dev->control[i]);
+    while (dev->control_pending > 0) {
+        struct timeval tv = { 1, 0 };
+        if (libusb_handle_events_timeout(d->ctx, &tv) < 0) break;
+    }
+    for (int i = 0; i < dev->num_control; i++) libusb_free_transfer(dev->control[i]);
+    usb_async_cancel(&dev->queue, d->ctx);
+    usb_async_free(&dev->queue);
+    if (dev->out.buf) out_sink_close(&dev->out);
+    if (dev->handle) {
+        const UsbProfile *p = dev->profile;
+        if (dev->claimed) libusb_release_interface(dev->handle, p->interface);
+        if (dev->claimed_control) libusb_release_interface(dev->handle, p->control_interface);
+        if (dev->detached) libusb_attach_kernel_driver(dev->handle, p->interface);
+        if (dev->detached_control) libusb_attach_kernel_driver(dev->handle, p->control_interface);
+        libusb_close(dev->handle);
+    }
+    if (dev->usb_fd >= 0) close(dev->usb_fd);
+    if (dev->out_fd >= 0) close(dev->out_fd);
+    free(dev);
+}
+
+static inline int usb_daemon_claim(UsbDevice *dev, int interface, int *claimed, int *detached) {
+    if (libusb_kernel_driver_active(dev->handle, interface) == 1) {
+        int r = libusb_detach_kernel_driver(dev->handle, interface);
+        if (r < 0) return r;
+        *detached = 1;
+    }
+    int r = libusb_claim_interface(dev->handle, interface);
+    if (r == 0) *claimed = 1;
+    return r;
+}
+
+// Take over `usb_fd` (from termux-usb) and `out_fd` and start reading with
+// the handler called `type`. The daemon owns both fds from here on, also on
+// failure. Returns the device id, or -1 with a message in `err`.
+static inline int usb_daemon_add(UsbDaemon *d, const char *type, int usb_fd, int out_fd, char *err, size_t err_size) {
+    const UsbDeviceHandler *h = usb_daemon_find_handler(type);
+    UsbDevice *dev = calloc(1, sizeof(*dev));
+    int r;
+
+    if (!dev) {
+        snprintf(err, err_size, "out of memory");
+        close(usb_fd);
+        close(out_fd);
+        return -1;
+    }
+    dev->handler = h;
+    dev->usb_fd = usb_fd;
+    dev->out_fd = out_fd;
+    if (!h) {
+        snprintf(err, err_size, "unknown device type '%s'", type);
+        goto fail;
+    }
+    if (d->num_devices == USB_DAEMON_MAX_DEVICES) {
+        snprintf(err, err_size, "too many devices (%d)", USB_DAEMON_MAX_DEVICES);
+        goto fail;
+    }
+    dev->id = d->next_id;
+    if (out_sink_init(&dev->out, out_fd, USB_DAEMON_FLUSH_BYTES, USB_DAEMON_FLUSH_US) < 0) {
+        snprintf(err, err_size, "out of memory");
+        goto fail;
+    }
+    r = libusb_wrap_sys_device(d->ctx, (intptr_t)usb_fd, &dev->handle);
+    if (r < 0) {
+        dev->handle = NULL;
+        snprintf(err, err_size, "libusb_wrap_sys_device: %s", libusb_error_name(r));
+        goto fail;
+    }
+    const UsbProfile *p = dev->profile = usb_profile_find(dev->handle, h->kind);
+    if (p->control_interface >= 0) {
+        r = usb_daemon_claim(dev, p->control_interface, &dev->claimed_control, &dev->detached_control);
+        if (r < 0) {
+            snprintf(err, err_size, "claim interface %d: %s", p->control_interface, libusb_error_name(r));
+            goto fail;
+        }
+    }
+    r = usb_daemon_claim(dev, p->interface, &dev->claimed, &dev->detached);
+    if (r < 0) {
+        snprintf(err, err_size, "claim interface %d: %s", p->interface, libusb_error_name(r));
+        goto fail;
+    }
+    if (h->setup && h->setup(dev) < 0) {
+        snprintf(err, err_size, "%s setup failed", h->name);
+        goto fail;
+    }
+
+    int size = h->transfer_size;
+    int max_packet = libusb_get_max_packet_size(libusb_get_device(dev->handle), p->endpoint_in);
+    if (size <= 0) size = max_packet > 0 ? max_packet : 64;
+    r = usb_async_start(&dev->queue, dev->handle, p->endpoint_in, h->type, h->depth, size, h->timeout_ms, h->on_data, dev);
+    if (r < 0) {
+        snprintf(err, err_size, "submit transfers: %s", libusb_error_name(r));
+        goto fail;
+    }
+
+    d->next_id++;
+    d->devices[d->num_devices++] = dev;
+    return dev->id;
+
+fail:
+    usb_daemon_free_device(d, dev);
+    return -1;
+}
+
+// Stop and drop device `i`, e.g. after it was unplugged.
+static inline void usb_daemon_remove(UsbDaemon *d, int i) {
+    UsbDevice *dev = d->devices[i];
+    d->devices[i] = d->devices[--d->num_devices];
+    usb_daemon_free_device(d, dev);
+}
+
+// Sleep until USB activity, an output deadline or one of the watched fds,
+// then handle libusb events, flush due output and drop devices that went
+// away. Returns the number of watched fds that are readable (stored in
+// `ready`), or -1 if a signal interrupted the wait. Signals the caller
+// handles should be blocked outside this call; `sigmask` is the mask to
+// wait with (NULL: leave the mask alone).
+static inline int usb_daemon_step(UsbDaemon *d, int *ready, int max_ready, const sigset_t *sigmask) {
+    struct epoll_event events[16];
+    struct timeval tv;
+    long timeout_us = -1;
+    int n_ready = 0;
+
+    if (libusb_get_next_timeout(d->ctx, &tv) == 1) {
+        timeout_us = (long)tv.tv_sec * 1000000L + tv.tv_usec;
+    }
+    for (int i = 0; i < d->num_devices; i++) {
+        long t = out_sink_timeout_us(&d->devices[i]->out);
+        if (t >= 0 && (timeout_us < 0 || t < timeout_us)) timeout_us = t;
+    }
+    int timeout_ms = timeout_us < 0 ? -1 : (int)((timeout_us + 999) / 1000);
+
+    int n = epoll_pwait(d->epfd, events, 16, timeout_ms, sigmask);
+    if (n < 0) return errno == EINTR ? -1 : 0;
+    d->wakeups++;
+    for (int i = 0; i < n; i++) {
+        if ((events[i].data.u64 >> 32) == USB_DAEMON_EV_USER && n_ready < max_ready) {
+            ready[n_ready++] = (int)(uint32_t)events[i].data.u64;
+        }
+    }
+
+    // Also on a plain timeout: libusb expires its own transfer timeouts here.
+    struct timeval zero = { 0, 0 };
+    libusb_handle_events_timeout_completed(d->ctx, &zero, NULL);
+
+    for (int i = d->num_devices - 1; i >= 0; i--) {
+        UsbDevice *dev = d->devices[i];
+        out_sink_poll(&dev->out);
+        if (dev->queue.stalled) {
+            int r = libusb_clear_halt(dev->handle, dev->profile->endpoint_in);
+            if (r < 0) {
+                fprintf(stderr, "WARN: device %d (%s): could not clear halt: %s, removing it\n",
+                        dev->id, dev->handler->name, libusb_error_name(r));
+            } else if ((r = usb_async_resubmit(&dev->queue)) < 0) {
+                fprintf(stderr, "WARN: device %d (%s): could not resubmit transfers after clearing the halt: %s, removing it\n",
+                        dev->id, dev->handler->name, libusb_error_name(r));
+            }
+            if (r < 0) {
+                usb_daemon_print_device(dev, stderr);
+                usb_daemon_remove(d, i);
+                continue;
+            }
+        }
+        if (dev->queue.stopped || dev->out.error) {
+            if (dev->out.error) {
+                fprintf(stderr, "WARN: device %d (%s): output failed: %s, removing it\n",
+                        dev->id, dev->handler->name, strerror(dev->out.error));
+            } else {
+                fprintf(stderr, "DEBUG: device %d (%s) stopped (transfer status %d), removing it\n",
+                        dev->id, dev->handler->name, dev->queue.error);
+            }
+            usb_daemon_print_device(dev, stderr);
+            usb_daemon_remove(d, i);
+        }
+    }
+    return n_ready;
+}
+
+static inline void usb_daemon_close(UsbDaemon *d) {
+    while (d->num_devices > 0) usb_daemon_remove(d, d->num_devices - 1);
+    libusb_set_pollfd_notifiers(d->ctx, NULL, NULL, NULL);
+    libusb_exit(d->ctx);
+    close(d->epfd);
+}
+
+#endif // USB_DAEMON_H
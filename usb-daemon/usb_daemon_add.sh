@@ -0,0 +1,7 @@
+#!/bin/bash
+# Hand a device to the running usb_daemon, e.g.: ./usb_daemon_add.sh mouse /dev/bus/usb/001/002
+# termux-usb runs the command with only the device fd as argument, so the type goes through the environment.
+if [ -n "$USB_DAEMON_TYPE" ]; then
+    exec "$(dirname "$0")/usb_daemon" add "$USB_DAEMON_TYPE" "$1"
+fi
+USB_DAEMON_TYPE="$1" exec termux-usb -r -e "$0" "$2"
@@ -0,0 +1,427 @@
+#ifndef GAMEPAD_AXES_H
+#define GAMEPAD_AXES_H
+
+/*
+ * Conditioning of the six gamepad axes: calibration, deadzone, filter
+ *
+ * gamepad_axes_process() rewrites the sticks and triggers of a
+ * GamepadReport in place, in this order:
+ *   1. calibration: the rest position is subtracted and each side of an
+ *      axis is scaled so that the travel seen so far maps to the full range
+ *   2. deadzone: radial for the sticks (the X/Y pair is scaled together by
+ *      its distance from the center, so the direction is kept), linear for
+ *      the triggers; the travel left outside the deadzone is stretched back
+ *      to the full range
+ *   3. one-euro filter: a low-pass whose cutoff grows with the axis' speed,
+ *      so a resting stick is smoothed hard and a moving one lags little.
+ *      Values at rest (0) and at the ends pass unfiltered: pads that only
+ *      report changes would otherwise leave the output short of them.
+ *
+ * The six axes are the 16-bit lanes of one 128-bit register (sticks
+ * -32767..32767, triggers 0..32767, two lanes unused), and every stage is
+ * a few SSE2 or NEON instructions on all of them: products are formed at
+ * 32 bits and saturated back to 16. Differences that could overflow 16 bits
+ * are taken of halved values. Not vectorized: the deadzone scale (two
+ * integer square roots, four divisions, skipped at rest) and the filter
+ * coefficient, looked up per lane in a table built at init.
+ *
+ * Calibration is learned while reading. Samples near the current rest
+ * estimate update a Welford mean and variance per axis (the rest position
+ * and its noise); the extremes give the travel. The noise also widens the
+ * deadzone: it is at least GAMEPAD_AXES_NOISE_SIGMAS standard deviations.
+ * The parameters are recomputed every GAMEPAD_AXES_UPDATE_EVERY reports.
+ *
+ * gamepad_axes_process_scalar() is the same computation lane by lane; it
+ * is used where neither SSE2 nor NEON is available, and by
+ * bench/bench_gamepad_axes for comparison.
+ *
+ * Usage:
+ *   GamepadAxes axes;
+ *   gamepad_axes_init(&axes, NULL);      // or a GamepadAxesConfig
+ *   gamepad_axes_process(&axes, &report);
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "gamepad_decode.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define GAMEPAD_AXES_SSE2 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define GAMEPAD_AXES_NEON 1
+#endif
+
+#define GAMEPAD_AXES_LANES 8                  // GAMEPAD_NUM_AXES, padded to 128 bits
+#define GAMEPAD_AXES_FULL 32767
+#define GAMEPAD_AXES_GAIN_SHIFT 12            // gains are Q12, at most 8x
+#define GAMEPAD_AXES_SCALE_SHIFT 14           // deadzone scales are Q14, at most 1.5x
+#define GAMEPAD_AXES_ALPHA_SHIFT 15           // filter coefficients are Q15
+#define GAMEPAD_AXES_SPEED_SHIFT 5            // filter table index: |speed| >> 5
+#define GAMEPAD_AXES_SPEED_STEPS (32768 >> GAMEPAD_AXES_SPEED_SHIFT)
+#define GAMEPAD_AXES_WELFORD_MAX 4096         // afterwards the statistics follow slow drift
+#define GAMEPAD_AXES_REST_WINDOW 3000         // samples closer than this to the rest estimate update it
+#define GAMEPAD_AXES_NOISE_SIGMAS 4
+#define GAMEPAD_AXES_UPDATE_EVERY 32
+
+typedef struct {
+    int stick_deadzone;         // radius, out of 32767
+    int trigger_deadzone;       // travel, out of 32767
+    double min_cutoff_hz;       // filter cutoff at rest
+    double beta;                // cutoff added per full range per second of speed
+    double derivative_cutoff_hz;
+    double report_interval_s;
+} GamepadAxesConfig;
+
+// Learned per axis, in input units.
+typedef struct {
+    int64_t n;
+    int64_t mean_q8;            // rest position << 8
+    int64_t m2_q16;             // sum of squared deviations << 16
+    int32_t min;
+    int32_t max;
+} GamepadAxisStats;
+
+typedef struct {
+    GamepadAxesConfig config;
+
+    // Per lane, loaded into vectors.
+    int16_t center[GAMEPAD_AXES_LANES];
+    int16_t gain_pos[GAMEPAD_AXES_LANES];
+    int16_t gain_neg[GAMEPAD_AXES_LANES];
+    int16_t lo[GAMEPAD_AXES_LANES];
+    int16_t hi[GAMEPAD_AXES_LANES];
+    int16_t prev[GAMEPAD_AXES_LANES];       // filter: previous input
+    int16_t speed[GAMEPAD_AXES_LANES];      // filter: smoothed change per report
+    int16_t out[GAMEPAD_AXES_LANES];        // filter: output
+    int16_t derivative_alpha[GAMEPAD_AXES_LANES];
+    int32_t deadzone[4];                    // left stick, right stick, left trigger, right trigger
+
+    int16_t alpha[GAMEPAD_AXES_SPEED_STEPS];
+
+    GamepadAxisStats stats[GAMEPAD_NUM_AXES];
+    uint64_t reports;
+} GamepadAxes;
+
+static const GamepadAxesConfig gamepad_axes_defaults = {
+    .stick_deadzone = 4000,
+    .trigger_deadzone = 1000,
+    .min_cutoff_hz = 1.0,
+    .beta = 4.0,
+    .derivative_cutoff_hz = 2.5,
+    .report_interval_s = 0.004,
+};
+
+// Smoothing factor of a first-order low-pass at `cutoff_hz`, sampled every `interval_s`.
+static inline int16_t gamepad_axes_lowpass_alpha(double cutoff_hz, double interval_s) {
+    double tau = 1.0 / (2.0 * M_PI * cutoff_hz);
+    return (int16_t)lrint((double)((1 << GAMEPAD_AXES_ALPHA_SHIFT) - 1) / (1.0 + tau / interval_s));
+}
+
+static inline uint32_t gamepad_axes_isqrt(uint32_t v) {
+    uint32_t r = 0, bit = 1u << 30;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
+
+static inline int gamepad_axes_is_trigger(int lane) {
+    return lane == GAMEPAD_AXIS_LT || lane == GAMEPAD_AXIS_RT;
+}
+
+// Gains, rest positions and deadzones from the statistics.
+static inline void gamepad_axes_update(GamepadAxes *ax) {
+    int32_t noise[GAMEPAD_NUM_AXES];
+    for (int a = 0; a < GAMEPAD_NUM_AXES; a++) {
+        const GamepadAxisStats *s = &ax->stats[a];
+        int32_t center = (int32_t)(s->mean_q8 >> 8);
+        ax->center[a] = (int16_t)center;
+        noise[a] = s->n > 1 ? (int32_t)gamepad_axes_isqrt((uint32_t)((s->m2_q16 / s->n) >> 16)) : 0;
+
+        // Until an axis has been pushed over half way, assume it reaches the nominal end.
+        int32_t pos = s->max - center, neg = center - s->min;
+        int32_t nominal_pos = GAMEPAD_AXES_FULL - center, nominal_neg = GAMEPAD_AXES_FULL + center;
+        if (pos < nominal_pos / 2) pos = nominal_pos;
+        if (neg < nominal_neg / 2) neg = nominal_neg;
+        int64_t one = (int64_t)GAMEPAD_AXES_FULL << GAMEPAD_AXES_GAIN_SHIFT;
+        int64_t gp = pos > 0 ? one / pos : 1 << GAMEPAD_AXES_GAIN_SHIFT;
+        int64_t gn = neg > 0 ? one / neg : 1 << GAMEPAD_AXES_GAIN_SHIFT;
+        ax->gain_pos[a] = (int16_t)(gp > INT16_MAX ? INT16_MAX : gp);
+        ax->gain_neg[a] = (int16_t)(gn > INT16_MAX ? INT16_MAX : gn);
+    }
+
+    int32_t stick_noise[2] = {
+        noise[GAMEPAD_AXIS_LX] > noise[GAMEPAD_AXIS_LY] ? noise[GAMEPAD_AXIS_LX] : noise[GAMEPAD_AXIS_LY],
+        noise[GAMEPAD_AXIS_RX] > noise[GAMEPAD_AXIS_RY] ? noise[GAMEPAD_AXIS_RX] : noise[GAMEPAD_AXIS_RY],
+    };
+    int32_t wanted[4] = {
+        GAMEPAD_AXES_NOISE_SIGMAS * stick_noise[0], GAMEPAD_AXES_NOISE_SIGMAS * stick_noise[1],
+        GAMEPAD_AXES_NOISE_SIGMAS * noise[GAMEPAD_AXIS_LT], GAMEPAD_AXES_NOISE_SIGMAS * noise[GAMEPAD_AXIS_RT],
+    };
+    for (int i = 0; i < 4; i++) {
+        int32_t dz = i < 2 ? ax->config.stick_deadzone : ax->config.trigger_deadzone;
+        if (wanted[i] > dz) dz = wanted[i];
+        if (dz < 0) dz = 0;
+        ax->deadzone[i] = dz > GAMEPAD_AXES_FULL / 2 ? GAMEPAD_AXES_FULL / 2 : dz;
+    }
+}
+
+// `config` NULL: gamepad_axes_defaults.
+static inline void gamepad_axes_init(GamepadAxes *ax, const GamepadAxesConfig *config) {
+    memset(ax, 0, sizeof(*ax));
+    ax->config = config ? *config : gamepad_axes_defaults;
+    double interval = ax->config.report_interval_s;
+    for (int lane = 0; lane < GAMEPAD_AXES_LANES; lane++) {
+        ax->gain_pos[lane] = ax->gain_neg[lane] = 1 << GAMEPAD_AXES_GAIN_SHIFT;
+        ax->lo[lane] = lane >= GAMEPAD_NUM_AXES || gamepad_axes_is_trigger(lane) ? 0 : -GAMEPAD_AXES_FULL;
+        ax->hi[lane] = lane >= GAMEPAD_NUM_AXES ? 0 : GAMEPAD_AXES_FULL;
+        ax->derivative_alpha[lane] = gamepad_axes_lowpass_alpha(ax->config.derivative_cutoff_hz, interval);
+    }
+    for (int i = 0; i < GAMEPAD_AXES_SPEED_STEPS; i++) {
+        // Middle of the step, in full ranges per second.
+        double speed = (((double)i + 0.5) * (1 << GAMEPAD_AXES_SPEED_SHIFT)) / GAMEPAD_AXES_FULL / interval;
+        ax->alpha[i] = gamepad_axes_lowpass_alpha(ax->config.min_cutoff_hz + ax->config.beta * speed, interval);
+    }
+
+    for (int a = 0; a < GAMEPAD_NUM_AXES; a++) {
+        ax->stats[a].min = INT32_MAX;
+        ax->stats[a].max = INT32_MIN;
+    }
+    gamepad_axes_update(ax);
+}
+
+// Report axes into lanes: sticks as they are, triggers 0..255 to 0..32767.
+static inline void gamepad_axes_load(const GamepadReport *r, int16_t in[GAMEPAD_AXES_LANES]) {
+    in[GAMEPAD_AXIS_LX] = r->left_x;
+    in[GAMEPAD_AXIS_LY] = r->left_y;
+    in[GAMEPAD_AXIS_RX] = r->right_x;
+    in[GAMEPAD_AXIS_RY] = r->right_y;
+    in[GAMEPAD_AXIS_LT] = (int16_t)(r->trigger_left << 7 | r->trigger_left >> 1);
+    in[GAMEPAD_AXIS_RT] = (int16_t)(r->trigger_right << 7 | r->trigger_right >> 1);
+    in[6] = in[7] = 0;
+}
+
+static inline void gamepad_axes_store(GamepadReport *r, const int16_t out[GAMEPAD_AXES_LANES]) {
+    r->left_x = out[GAMEPAD_AXIS_LX];
+    r->left_y = out[GAMEPAD_AXIS_LY];
+    r->right_x = out[GAMEPAD_AXIS_RX];
+    r->right_y = out[GAMEPAD_AXIS_RY];
+    r->trigger_left = (uint8_t)(out[GAMEPAD_AXIS_LT] >> 7);
+    r->trigger_right = (uint8_t)(out[GAMEPAD_AXIS_RT] >> 7);
+}
+
+// Q14 scale for a distance `r` from rest with deadzone `dz`: 0 inside it,
+// outside it (r - dz) stretched to the full range. Capped at 1.5, beyond
+// which the result is clamped anyway (stick diagonals reach 1.41 * full).
+static inline int16_t gamepad_axes_deadzone_scale(int32_t r, int32_t dz) {
+    if (r <= dz) return 0;
+    // 32-bit divisions: r < 46341 and dz <= 32767 / 2 keep both inside 31 bits.
+    int32_t stretched = (int32_t)((uint32_t)(r - dz) * GAMEPAD_AXES_FULL / (uint32_t)(GAMEPAD_AXES_FULL - dz));
+    int32_t scale = (stretched << GAMEPAD_AXES_SCALE_SHIFT) / r;
+    return (int16_t)(scale > 24576 ? 24576 : scale);
+}
+
+// Deadzone scale per lane from the calibrated input. The distance is
+// compared squared first, so a stick at rest costs no square root.
+static inline void gamepad_axes_deadzone_scales(const GamepadAxes *ax, const int16_t x[GAMEPAD_AXES_LANES],
+                                                int16_t scale[GAMEPAD_AXES_LANES]) {
+    for (int stick = 0; stick < 2; stick++) {
+        int32_t a = x[2 * stick], b = x[2 * stick + 1], dz = ax->deadzone[stick];
+        uint32_t r2 = (uint32_t)(a * a) + (uint32_t)(b * b);
+        int16_t s = r2 <= (uint32_t)(dz * dz) ? 0 : gamepad_axes_deadzone_scale((int32_t)gamepad_axes_isqrt(r2), dz);
+        scale[2 * stick] = scale[2 * stick + 1] = s;
+    }
+    scale[4] = gamepad_axes_deadzone_scale(x[4], ax->deadzone[2]);
+    scale[5] = gamepad_axes_deadzone_scale(x[5], ax->deadzone[3]);
+    scale[6] = scale[7] = 0;
+}
+
+// Welford update of the statistics with the raw input, then every
+// GAMEPAD_AXES_UPDATE_EVERY reports new parameters.
+static inline void gamepad_axes_learn(GamepadAxes *ax, const int16_t in[GAMEPAD_AXES_LANES]) {
+    for (int a = 0; a < GAMEPAD_NUM_AXES; a++) {
+        GamepadAxisStats *s = &ax->stats[a];
+        int32_t v = in[a];
+        if (v < s->min) s->min = v;
+        if (v > s->max) s->max = v;
+
+        int64_t x_q8 = (int64_t)v << 8;
+        int64_t d = x_q8 - s->mean_q8;
+        if (d >= (int64_t)GAMEPAD_AXES_REST_WINDOW << 8 || d <= -((int64_t)GAMEPAD_AXES_REST_WINDOW << 8)) continue;
+        if (s->n < GAMEPAD_AXES_WELFORD_MAX) {
+            s->n++;
+            s->mean_q8 += (int32_t)d / (int32_t)s->n;  // |d| < GAMEPAD_AXES_REST_WINDOW << 8
+            s->m2_q16 += d * (x_q8 - s->mean_q8);
+        } else {
+            // Exponentially weighted from here on, window GAMEPAD_AXES_WELFORD_MAX.
+            s->mean_q8 += d / GAMEPAD_AXES_WELFORD_MAX;
+            s->m2_q16 += d * (x_q8 - s->mean_q8) - s->m2_q16 / GAMEPAD_AXES_WELFORD_MAX;
+        }
+    }
+    if (++ax->reports % GAMEPAD_AXES_UPDATE_EVERY == 0) gamepad_axes_update(ax);
+}
+
+static inline int32_t gamepad_axes_sat16(int32_t v) {
+    return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+}
+
+static inline int32_t gamepad_axes_clamp(int32_t v, int32_t lo, int32_t hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+// gamepad_axes_process() one lane at a time, with the same saturation.
+static inline void gamepad_axes_process_scalar(GamepadAxes *ax, GamepadReport *r) {
+    int16_t in[GAMEPAD_AXES_LANES], x[GAMEPAD_AXES_LANES], scale[GAMEPAD_AXES_LANES];
+    gamepad_axes_load(r, in);
+
+    for (int lane = 0; lane < GAMEPAD_AXES_LANES; lane++) {
+        int32_t half = gamepad_axes_sat16((in[lane] >> 1) - (ax->center[lane] >> 1));
+        int32_t gain = half < 0 ? ax->gain_neg[lane] : ax->gain_pos[lane];
+        int32_t v = gamepad_axes_sat16((half * gain) >> (GAMEPAD_AXES_GAIN_SHIFT - 1));
+        x[lane] = (int16_t)gamepad_axes_clamp(v, ax->lo[lane], ax->hi[lane]);
+    }
+    gamepad_axes_deadzone_scales(ax, x, scale);
+    for (int lane = 0; lane < GAMEPAD_AXES_LANES; lane++) {
+        int32_t v = gamepad_axes_sat16((x[lane] * scale[lane]) >> GAMEPAD_AXES_SCALE_SHIFT);
+        v = gamepad_axes_clamp(v, ax->lo[lane], ax->hi[lane]);
+
+        int32_t prev = ax->reports == 0 ? v : ax->prev[lane];
+        int32_t y = ax->reports == 0 ? v : ax->out[lane];
+        int32_t speed = ax->speed[lane];
+        int32_t change = gamepad_axes_sat16(gamepad_axes_sat16(v - prev) - speed);
+        speed = gamepad_axes_sat16(speed + gamepad_axes_sat16((change * ax->derivative_alpha[lane]) >> GAMEPAD_AXES_ALPHA_SHIFT));
+        int32_t magnitude = speed < 0 ? gamepad_axes_sat16(-speed) : speed;
+        int32_t half = gamepad_axes_sat16((v >> 1) - (y >> 1));
+        int32_t alpha = ax->alpha[magnitude >> GAMEPAD_AXES_SPEED_SHIFT];
+        y = gamepad_axes_sat16(y + gamepad_axes_sat16((half * alpha) >> (GAMEPAD_AXES_ALPHA_SHIFT - 1)));
+        if (v == 0 || v == ax->lo[lane] || v == ax->hi[lane]) y = v;
+
+        ax->prev[lane] = (int16_t)v;
+        ax->speed[lane] = (int16_t)speed;
+        ax->out[lane] = (int16_t)y;
+    }
+    gamepad_axes_store(r, ax->out);
+    gamepad_axes_learn(ax, in);
+}
+
+#if defined(GAMEPAD_AXES_SSE2)
+
+typedef __m128i gamepad_axes_v;
+
+#define gamepad_axes_vload(p) _mm_loadu_si128((const __m128i *)(p))
+#define gamepad_axes_vstore(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define gamepad_axes_vadds _mm_adds_epi16
+#define gamepad_axes_vsubs _mm_subs_epi16
+#define gamepad_axes_vhalf(v) _mm_srai_epi16(v, 1)
+#define gamepad_axes_vmin _mm_min_epi16
+#define gamepad_axes_vmax _mm_max_epi16
+#define gamepad_axes_vlt _mm_cmplt_epi16
+#define gamepad_axes_veq _mm_cmpeq_epi16
+#define gamepad_axes_vor _mm_or_si128
+#define gamepad_axes_vzero() _mm_setzero_si128()
+
+static inline __m128i gamepad_axes_vselect(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// (a * b) >> shift per lane, products at 32 bits, saturated to 16.
+static inline __m128i gamepad_axes_vmulshift(__m128i a, __m128i b, int shift) {
+    __m128i lo = _mm_mullo_epi16(a, b), hi = _mm_mulhi_epi16(a, b);
+    __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), shift);
+    __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), shift);
+    return _mm_packs_epi32(p0, p1);
+}
+
+#elif defined(GAMEPAD_AXES_NEON)
+
+typedef int16x8_t gamepad_axes_v;
+
+#define gamepad_axes_vload(p) vld1q_s16(p)
+#define gamepad_axes_vstore(p, v) vst1q_s16(p, v)
+#define gamepad_axes_vadds vqaddq_s16
+#define gamepad_axes_vsubs vqsubq_s16
+#define gamepad_axes_vhalf(v) vshrq_n_s16(v, 1)
+#define gamepad_axes_vmin vminq_s16
+#define gamepad_axes_vmax vmaxq_s16
+#define gamepad_axes_vlt(a, b) vreinterpretq_s16_u16(vcltq_s16(a, b))
+#define gamepad_axes_veq(a, b) vreinterpretq_s16_u16(vceqq_s16(a, b))
+#define gamepad_axes_vor vorrq_s16
+#define gamepad_axes_vzero() vdupq_n_s16(0)
+
+static inline int16x8_t gamepad_axes_vselect(int16x8_t mask, int16x8_t a, int16x8_t b) {
+    return vbslq_s16(vreinterpretq_u16_s16(mask), a, b);
+}
+
+static inline int16x8_t gamepad_axes_vmulshift(int16x8_t a, int16x8_t b, int shift) {
+    int32x4_t n = vdupq_n_s32(-shift);
+    int32x4_t p0 = vshlq_s32(vmull_s16(vget_low_s16(a), vget_low_s16(b)), n);
+    int32x4_t p1 = vshlq_s32(vmull_s16(vget_high_s16(a), vget_high_s16(b)), n);
+    return vcombine_s16(vqmovn_s32(p0), vqmovn_s32(p1));
+}
+
+#endif
+
+#if defined(GAMEPAD_AXES_SSE2) || defined(GAMEPAD_AXES_NEON)
+
+static inline void gamepad_axes_process(GamepadAxes *ax, GamepadReport *r) {
+    int16_t in[GAMEPAD_AXES_LANES], lanes[GAMEPAD_AXES_LANES], scale[GAMEPAD_AXES_LANES], alpha[GAMEPAD_AXES_LANES];
+    gamepad_axes_load(r, in);
+    gamepad_axes_v lo = gamepad_axes_vload(ax->lo), hi = gamepad_axes_vload(ax->hi);
+
+    // 1. Calibration.
+    gamepad_axes_v half = gamepad_axes_vsubs(gamepad_axes_vhalf(gamepad_axes_vload(in)),
+                                             gamepad_axes_vhalf(gamepad_axes_vload(ax->center)));
+    gamepad_axes_v gain = gamepad_axes_vselect(gamepad_axes_vlt(half, gamepad_axes_vzero()),
+                                               gamepad_axes_vload(ax->gain_neg), gamepad_axes_vload(ax->gain_pos));
+    gamepad_axes_v x = gamepad_axes_vmulshift(half, gain, GAMEPAD_AXES_GAIN_SHIFT - 1);
+    x = gamepad_axes_vmin(gamepad_axes_vmax(x, lo), hi);
+
+    // 2. Deadzone.
+    gamepad_axes_vstore(lanes, x);
+    gamepad_axes_deadzone_scales(ax, lanes, scale);
+    x = gamepad_axes_vmulshift(x, gamepad_axes_vload(scale), GAMEPAD_AXES_SCALE_SHIFT);
+    x = gamepad_axes_vmin(gamepad_axes_vmax(x, lo), hi);
+
+    // 3. One-euro filter.
+    gamepad_axes_v y = ax->reports == 0 ? x : gamepad_axes_vload(ax->out);
+    gamepad_axes_v prev = ax->reports == 0 ? x : gamepad_axes_vload(ax->prev);
+    gamepad_axes_v speed = gamepad_axes_vload(ax->speed);
+    gamepad_axes_v change = gamepad_axes_vsubs(gamepad_axes_vsubs(x, prev), speed);
+    speed = gamepad_axes_vadds(speed, gamepad_axes_vmulshift(change, gamepad_axes_vload(ax->derivative_alpha),
+                                                             GAMEPAD_AXES_ALPHA_SHIFT));
+    gamepad_axes_vstore(ax->speed, speed);
+    speed = gamepad_axes_vmax(speed, gamepad_axes_vsubs(gamepad_axes_vzero(), speed));
+    gamepad_axes_vstore(lanes, speed);
+    for (int lane = 0; lane < GAMEPAD_AXES_LANES; lane++) alpha[lane] = ax->alpha[lanes[lane] >> GAMEPAD_AXES_SPEED_SHIFT];
+    half = gamepad_axes_vsubs(gamepad_axes_vhalf(x), gamepad_axes_vhalf(y));
+    y = gamepad_axes_vadds(y, gamepad_axes_vmulshift(half, gamepad_axes_vload(alpha), GAMEPAD_AXES_ALPHA_SHIFT - 1));
+    gamepad_axes_v at_rest_or_end = gamepad_axes_vor(gamepad_axes_veq(x, gamepad_axes_vzero()),
+                                                     gamepad_axes_vor(gamepad_axes_veq(x, lo), gamepad_axes_veq(x, hi)));
+    y = gamepad_axes_vselect(at_rest_or_end, x, y);
+
+    gamepad_axes_vstore(ax->prev, x);
+    gamepad_axes_vstore(ax->out, y);
+    gamepad_axes_store(r, ax->out);
+    gamepad_axes_learn(ax, in);
+}
+
+#else
+
+static inline void gamepad_axes_process(GamepadAxes *ax, GamepadReport *r) {
+    gamepad_axes_process_scalar(ax, r);
+}
+
+#endif
+
+#endif // GAMEPAD_AXES_H
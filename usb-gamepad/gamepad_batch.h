@@ -0,0 +1,217 @@
+#ifndef GAMEPAD_BATCH_H
+#define GAMEPAD_BATCH_H
+
+/*
+ * Batch decoder for recorded 20-byte gamepad reports
+ *
+ * Decodes an array of N raw reports (the GamepadReport layout of
+ * gamepad_decode.h, back to back) in one pass into one array per control,
+ * for offline analysis of long sessions.
+ *
+ * Usage:
+ *   GamepadColumns cols = { buttons, trig_l, trig_r, lx, ly, rx, ry };  // N entries each
+ *   gamepad_batch_decode(reports, n, &cols);
+ *
+ * Kernels: scalar, SSE2 (8 reports per step), AVX2 (16) and NEON (8).
+ * gamepad_batch_decode() picks the widest one the CPU supports; the others
+ * are exposed for benchmarks. Every vector kernel loads the 16 bytes at
+ * offset 2 of each report (bytes 2..17, inside the report), transposes
+ * the first six 16-bit lanes of 8 reports and stores them as columns. The
+ * tail that does not fill a step goes through the scalar kernel.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GAMEPAD_BATCH_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define GAMEPAD_BATCH_NEON 1
+#endif
+
+#define GAMEPAD_REPORT_SIZE 20
+
+typedef struct {
+    uint16_t *buttons;      // byte 2 (D-pad, system) | byte 3 (L1/R1/Home, ABXY) << 8
+    uint8_t *trigger_left;
+    uint8_t *trigger_right;
+    int16_t *left_x;
+    int16_t *left_y;
+    int16_t *right_x;
+    int16_t *right_y;
+} GamepadColumns;
+
+typedef void (*gamepad_batch_fn)(const uint8_t *reports, size_t n, const GamepadColumns *out);
+
+static inline uint16_t gamepad_batch_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline void gamepad_batch_decode_scalar(const uint8_t *reports, size_t n, const GamepadColumns *out) {
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *r = reports + i * GAMEPAD_REPORT_SIZE;
+        out->buttons[i] = gamepad_batch_le16(r + 2);
+        out->trigger_left[i] = r[4];
+        out->trigger_right[i] = r[5];
+        out->left_x[i] = (int16_t)gamepad_batch_le16(r + 6);
+        out->left_y[i] = (int16_t)gamepad_batch_le16(r + 8);
+        out->right_x[i] = (int16_t)gamepad_batch_le16(r + 10);
+        out->right_y[i] = (int16_t)gamepad_batch_le16(r + 12);
+    }
+}
+
+#ifdef GAMEPAD_BATCH_X86
+
+// Lanes 0..5 of eight reports (v[0..7]) into columns c[0..5].
+#define GAMEPAD_TRANSPOSE_8X6(unpacklo16, unpackhi16, unpacklo32, unpackhi32, unpacklo64, unpackhi64, v, c) \
+    do {                                                                                           \
+        __typeof__(v[0]) a0 = unpacklo16(v[0], v[1]), a1 = unpackhi16(v[0], v[1]);                 \
+        __typeof__(v[0]) a2 = unpacklo16(v[2], v[3]), a3 = unpackhi16(v[2], v[3]);                 \
+        __typeof__(v[0]) a4 = unpacklo16(v[4], v[5]), a5 = unpackhi16(v[4], v[5]);                 \
+        __typeof__(v[0]) a6 = unpacklo16(v[6], v[7]), a7 = unpackhi16(v[6], v[7]);                 \
+        __typeof__(v[0]) b0 = unpacklo32(a0, a2), b1 = unpackhi32(a0, a2);                         \
+        __typeof__(v[0]) b2 = unpacklo32(a4, a6), b3 = unpackhi32(a4, a6);                         \
+        __typeof__(v[0]) b4 = unpacklo32(a1, a3), b5 = unpacklo32(a5, a7);                         \
+        c[0] = unpacklo64(b0, b2);                                                                 \
+        c[1] = unpackhi64(b0, b2);                                                                 \
+        c[2] = unpacklo64(b1, b3);                                                                 \
+        c[3] = unpackhi64(b1, b3);                                                                 \
+        c[4] = unpacklo64(b4, b5);                                                                 \
+        c[5] = unpackhi64(b4, b5);                                                                 \
+    } while (0)
+
+static inline void gamepad_batch_decode_sse2(const uint8_t *reports, size_t n, const GamepadColumns *out) {
+    const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const uint8_t *r = reports + i * GAMEPAD_REPORT_SIZE + 2;
+        __m128i v[8], c[6];
+        for (int k = 0; k < 8; k++) v[k] = _mm_loadu_si128((const __m128i *)(r + k * GAMEPAD_REPORT_SIZE));
+        GAMEPAD_TRANSPOSE_8X6(_mm_unpacklo_epi16, _mm_unpackhi_epi16, _mm_unpacklo_epi32, _mm_unpackhi_epi32,
+                              _mm_unpacklo_epi64, _mm_unpackhi_epi64, v, c);
+
+        _mm_storeu_si128((__m128i *)(out->buttons + i), c[0]);
+        __m128i tl = _mm_packus_epi16(_mm_and_si128(c[1], low_bytes), _mm_setzero_si128());
+        __m128i tr = _mm_packus_epi16(_mm_srli_epi16(c[1], 8), _mm_setzero_si128());
+        _mm_storel_epi64((__m128i *)(out->trigger_left + i), tl);
+        _mm_storel_epi64((__m128i *)(out->trigger_right + i), tr);
+        _mm_storeu_si128((__m128i *)(out->left_x + i), c[2]);
+        _mm_storeu_si128((__m128i *)(out->left_y + i), c[3]);
+        _mm_storeu_si128((__m128i *)(out->right_x + i), c[4]);
+        _mm_storeu_si128((__m128i *)(out->right_y + i), c[5]);
+    }
+    if (i < n) {
+        GamepadColumns tail = { out->buttons + i, out->trigger_left + i, out->trigger_right + i,
+                                out->left_x + i, out->left_y + i, out->right_x + i, out->right_y + i };
+        gamepad_batch_decode_scalar(reports + i * GAMEPAD_REPORT_SIZE, n - i, &tail);
+    }
+}
+
+// Reports i..i+7 in the low 128-bit lane and i+8..i+15 in the high one, so
+// the per-lane unpacks give columns of 16 in report order.
+__attribute__((target("avx2")))
+static inline void gamepad_batch_decode_avx2(const uint8_t *reports, size_t n, const GamepadColumns *out) {
+    const __m256i low_bytes = _mm256_set1_epi16(0x00ff);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const uint8_t *r = reports + i * GAMEPAD_REPORT_SIZE + 2;
+        __m256i v[8], c[6];
+        for (int k = 0; k < 8; k++) {
+            __m128i lo = _mm_loadu_si128((const __m128i *)(r + k * GAMEPAD_REPORT_SIZE));
+            __m128i hi = _mm_loadu_si128((const __m128i *)(r + (k + 8) * GAMEPAD_REPORT_SIZE));
+            v[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        }
+        GAMEPAD_TRANSPOSE_8X6(_mm256_unpacklo_epi16, _mm256_unpackhi_epi16, _mm256_unpacklo_epi32,
+                              _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64, v, c);
+
+        _mm256_storeu_si256((__m256i *)(out->buttons + i), c[0]);
+        // packus works per lane: bytes 0-7 and 16-23 hold the 16 values.
+        __m256i tl = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(c[1], low_bytes), low_bytes), 0x08);
+        __m256i tr = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(c[1], 8), low_bytes), 0x08);
+        _mm_storeu_si128((__m128i *)(out->trigger_left + i), _mm256_castsi256_si128(tl));
+        _mm_storeu_si128((__m128i *)(out->trigger_right + i), _mm256_castsi256_si128(tr));
+        _mm256_storeu_si256((__m256i *)(out->left_x + i), c[2]);
+        _mm256_storeu_si256((__m256i *)(out->left_y + i), c[3]);
+        _mm256_storeu_si256((__m256i *)(out->right_x + i), c[4]);
+        _mm256_storeu_si256((__m256i *)(out->right_y + i), c[5]);
+    }
+    if (i < n) {
+        GamepadColumns tail = { out->buttons + i, out->trigger_left + i, out->trigger_right + i,
+                                out->left_x + i, out->left_y + i, out->right_x + i, out->right_y + i };
+        gamepad_batch_decode_sse2(reports + i * GAMEPAD_REPORT_SIZE, n - i, &tail);
+    }
+}
+
+#endif // GAMEPAD_BATCH_X86
+
+#ifdef GAMEPAD_BATCH_NEON
+
+static inline void gamepad_batch_decode_neon(const uint8_t *reports, size_t n, const GamepadColumns *out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const uint8_t *r = reports + i * GAMEPAD_REPORT_SIZE + 2;
+        uint16x8_t v[8];
+        for (int k = 0; k < 8; k++) v[k] = vreinterpretq_u16_u8(vld1q_u8(r + k * GAMEPAD_REPORT_SIZE));
+
+        // 16-bit then 32-bit transposes of pairs, then recombine the halves.
+        uint16x8x2_t a01 = vtrnq_u16(v[0], v[1]), a23 = vtrnq_u16(v[2], v[3]);
+        uint16x8x2_t a45 = vtrnq_u16(v[4], v[5]), a67 = vtrnq_u16(v[6], v[7]);
+        uint32x4x2_t b0 = vtrnq_u32(vreinterpretq_u32_u16(a01.val[0]), vreinterpretq_u32_u16(a23.val[0]));
+        uint32x4x2_t b1 = vtrnq_u32(vreinterpretq_u32_u16(a01.val[1]), vreinterpretq_u32_u16(a23.val[1]));
+        uint32x4x2_t c0 = vtrnq_u32(vreinterpretq_u32_u16(a45.val[0]), vreinterpretq_u32_u16(a67.val[0]));
+        uint32x4x2_t c1 = vtrnq_u32(vreinterpretq_u32_u16(a45.val[1]), vreinterpretq_u32_u16(a67.val[1]));
+
+        uint16x8_t lane0 = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(b0.val[0]), vget_low_u32(c0.val[0])));
+        uint16x8_t lane1 = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(b1.val[0]), vget_low_u32(c1.val[0])));
+        uint16x8_t lane2 = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(b0.val[1]), vget_low_u32(c0.val[1])));
+        uint16x8_t lane3 = vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(b1.val[1]), vget_low_u32(c1.val[1])));
+        uint16x8_t lane4 = vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(b0.val[0]), vget_high_u32(c0.val[0])));
+        uint16x8_t lane5 = vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(b1.val[0]), vget_high_u32(c1.val[0])));
+
+        vst1q_u16(out->buttons + i, lane0);
+        vst1_u8(out->trigger_left + i, vmovn_u16(lane1));
+        vst1_u8(out->trigger_right + i, vshrn_n_u16(lane1, 8));
+        vst1q_s16(out->left_x + i, vreinterpretq_s16_u16(lane2));
+        vst1q_s16(out->left_y + i, vreinterpretq_s16_u16(lane3));
+        vst1q_s16(out->right_x + i, vreinterpretq_s16_u16(lane4));
+        vst1q_s16(out->right_y + i, vreinterpretq_s16_u16(lane5));
+    }
+    if (i < n) {
+        GamepadColumns tail = { out->buttons + i, out->trigger_left + i, out->trigger_right + i,
+                                out->left_x + i, out->left_y + i, out->right_x + i, out->right_y + i };
+        gamepad_batch_decode_scalar(reports + i * GAMEPAD_REPORT_SIZE, n - i, &tail);
+    }
+}
+
+#endif // GAMEPAD_BATCH_NEON
+
+// Widest kernel the CPU supports, and its name.
+static inline gamepad_batch_fn gamepad_batch_best(const char **name) {
+#if defined(GAMEPAD_BATCH_X86)
+    if (__builtin_cpu_supports("avx2")) {
+        if (name) *name = "avx2";
+        return gamepad_batch_decode_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        if (name) *name = "sse2";
+        return gamepad_batch_decode_sse2;
+    }
+#elif defined(GAMEPAD_BATCH_NEON)
+    if (name) *name = "neon";
+    return gamepad_batch_decode_neon;
+#endif
+    if (name) *name = "scalar";
+    return gamepad_batch_decode_scalar;
+}
+
+static inline void gamepad_batch_decode(const uint8_t *reports, size_t n, const GamepadColumns *out) {
+    static gamepad_batch_fn best;
+    if (!best) best = gamepad_batch_best(NULL);
+    best(reports, n, out);
+}
+
+#endif // GAMEPAD_BATCH_H
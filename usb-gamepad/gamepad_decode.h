@@ -12,6 +12,13 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+
+#include "../common/hid_parser.h"
+
+// Largest report the tools read. Xbox 360 pads send 20 bytes in 32-byte
+// packets, the DualShock 4 64; a full-speed interrupt endpoint carries at most 64.
+#define GAMEPAD_MAX_REPORT 64
 
 /* =========================================================
  * Byte 2 – D-Pad + System Buttons
@@ -106,4 +113,153 @@ typedef struct
  * - Stick range: -32768 .. +32767
  * - Structure size MUST be exactly 20 bytes
  */
+/* =========================================================
+ * Generic HID gamepads
+ * =========================================================
+ *
+ * Pads that are HID class describe their reports in a report descriptor.
+ * gamepad_layout_from_plan() picks the controls out of the compiled plan
+ * (common/hid_parser.h) once, and gamepad_translate_report() rewrites each
+ * report into the 20-byte layout above so the rest of the code only knows
+ * one format:
+ *
+ *   X/Y            left stick
+ *   Z/Rz or Rx/Ry  right stick (Z/Rz preferred, as on most HID pads)
+ *   Brake/Accel.   triggers (Simulation page), else Rx/Ry if not a stick
+ *   Hat switch     D-pad (0 = up, clockwise in 8 steps)
+ *   Button 1..11   A, B, X, Y, L1, R1, Back, Start, L3, R3, Home
+ *
+ * Axes are rescaled from their logical range; HID Y grows downwards, the
+ * Xbox layout upwards, so Y axes are inverted.
+ */
+
+enum {
+    GAMEPAD_AXIS_LX, GAMEPAD_AXIS_LY, GAMEPAD_AXIS_RX, GAMEPAD_AXIS_RY,
+    GAMEPAD_AXIS_LT, GAMEPAD_AXIS_RT, GAMEPAD_NUM_AXES
+};
+
+#define GAMEPAD_MAX_BUTTONS 11
+
+typedef struct {
+    int valid;                          // 0: reports are already in the 20-byte layout
+    uint8_t report_id;
+    HidField axes[GAMEPAD_NUM_AXES];    // bit_size 0 if missing
+    HidField hat;
+    HidField buttons;                   // buttons 1..n as one bit field
+} GamepadLayout;
+
+// Bind the layout to `plan`. Returns 0, or -1 if the plan has no X/Y stick.
+static inline int gamepad_layout_from_plan(GamepadLayout *layout, const HidPlan *plan) {
+    memset(layout, 0, sizeof(*layout));
+    int x = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_X);
+    int y = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_Y);
+    if (x < 0 || y < 0 || plan->fields[x].report_id != plan->fields[y].report_id) return -1;
+    layout->report_id = plan->fields[x].report_id;
+
+    int z = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_Z);
+    int rx = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_RX);
+    int ry = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_RY);
+    int rz = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_RZ);
+    int brake = hid_plan_find(plan, HID_PAGE_SIMULATION, 0xc5);
+    int accel = hid_plan_find(plan, HID_PAGE_SIMULATION, 0xc4);
+
+    int idx[GAMEPAD_NUM_AXES] = { x, y, -1, -1, brake, accel };
+    if (z >= 0 && rz >= 0) {
+        idx[GAMEPAD_AXIS_RX] = z;
+        idx[GAMEPAD_AXIS_RY] = rz;
+        if (brake < 0 && accel < 0) {
+            idx[GAMEPAD_AXIS_LT] = rx;
+            idx[GAMEPAD_AXIS_RT] = ry;
+        }
+    } else {
+        idx[GAMEPAD_AXIS_RX] = rx;
+        idx[GAMEPAD_AXIS_RY] = ry;
+    }
+    for (int a = 0; a < GAMEPAD_NUM_AXES; a++) {
+        if (idx[a] >= 0 && plan->fields[idx[a]].report_id == layout->report_id) {
+            layout->axes[a] = plan->fields[idx[a]];
+        }
+    }
+
+    int hat = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_HAT);
+    if (hat >= 0 && plan->fields[hat].report_id == layout->report_id) layout->hat = plan->fields[hat];
+
+    int b = hid_plan_find(plan, HID_PAGE_BUTTON, 1);
+    if (b >= 0 && plan->fields[b].report_id == layout->report_id && plan->fields[b].bit_size == 1) {
+        layout->buttons = plan->fields[b];
+        for (int i = b + 1; i < plan->count && layout->buttons.bit_size < GAMEPAD_MAX_BUTTONS; i++) {
+            const HidField *f = &plan->fields[i];
+            if (f->usage_page != HID_PAGE_BUTTON || f->bit_size != 1 || f->report_id != layout->report_id ||
+                f->bit_offset != layout->buttons.bit_offset + layout->buttons.bit_size) {
+                break;
+            }
+            layout->buttons.bit_size++;
+        }
+    }
+    layout->valid = 1;
+    return 0;
+}
+
+// Position of `f`'s value within its logical range, 0..65535.
+static inline uint32_t gamepad_axis_unit(const HidField *f, const uint8_t *data, int len) {
+    int64_t v = hid_field_value(f, data, len);
+    int64_t lo = f->logical_min, hi = f->logical_max;
+    if (hi <= lo) return 0;
+    if (v < lo) v = lo;
+    if (v > hi) v = hi;
+    return (uint32_t)((v - lo) * 65535 / (hi - lo));
+}
+
+// Rewrite a report described by `layout` into the 20-byte layout.
+// Returns 0, or -1 if it is not a gamepad report (other report ID).
+static inline int gamepad_translate_report(const GamepadLayout *layout, const uint8_t *data, int len, GamepadReport *out) {
+    // Bit n of the button field -> (byte 2 or 3, bit) in the Xbox layout.
+    static const uint8_t button_byte[GAMEPAD_MAX_BUTTONS] = { 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 3 };
+    static const uint8_t button_bit[GAMEPAD_MAX_BUTTONS] = {
+        BTN_A, BTN_B, BTN_X, BTN_Y, BTN_L1, BTN_R1, BTN_BACK, BTN_START, BTN_L3, BTN_R3, BTN_HOME
+    };
+    // Hat positions 0..7, clockwise from up.
+    static const uint8_t hat_dpad[8] = {
+        DPAD_UP, DPAD_UP | DPAD_RIGHT, DPAD_RIGHT, DPAD_DOWN | DPAD_RIGHT,
+        DPAD_DOWN, DPAD_DOWN | DPAD_LEFT, DPAD_LEFT, DPAD_UP | DPAD_LEFT
+    };
+
+    if (layout->report_id && (len < 1 || data[0] != layout->report_id)) return -1;
+    memset(out, 0, sizeof(*out));
+    out->length = sizeof(GamepadReport);
+
+    int16_t *sticks[4] = { &out->left_x, &out->left_y, &out->right_x, &out->right_y };
+    for (int a = GAMEPAD_AXIS_LX; a <= GAMEPAD_AXIS_RY; a++) {
+        if (!layout->axes[a].bit_size) continue;
+        int32_t v = (int32_t)gamepad_axis_unit(&layout->axes[a], data, len) - 32768;
+        if (a == GAMEPAD_AXIS_LY || a == GAMEPAD_AXIS_RY) v = -1 - v;
+        *sticks[a] = (int16_t)v;
+    }
+    if (layout->axes[GAMEPAD_AXIS_LT].bit_size) {
+        out->trigger_left = (uint8_t)(gamepad_axis_unit(&layout->axes[GAMEPAD_AXIS_LT], data, len) >> 8);
+    }
+    if (layout->axes[GAMEPAD_AXIS_RT].bit_size) {
+        out->trigger_right = (uint8_t)(gamepad_axis_unit(&layout->axes[GAMEPAD_AXIS_RT], data, len) >> 8);
+    }
+
+    if (layout->hat.bit_size) {
+        // Out of range is the null state: centred.
+        int32_t pos = hid_field_value(&layout->hat, data, len) - layout->hat.logical_min;
+        if (pos >= 0 && pos < 8) out->dpad_system |= hat_dpad[pos];
+    }
+
+    if (layout->buttons.bit_size) {
+        uint32_t bits = (uint32_t)hid_field_value(&layout->buttons, data, len);
+        for (int i = 0; i < layout->buttons.bit_size; i++) {
+            if (!(bits & (1u << i))) continue;
+            if (button_byte[i] == 2) {
+                out->dpad_system |= button_bit[i];
+            } else {
+                out->buttons |= button_bit[i];
+            }
+        }
+    }
+    return 0;
+}
+
 #endif // GAMEPAD_DECODE_H
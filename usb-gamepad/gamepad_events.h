@@ -0,0 +1,252 @@
+#ifndef GAMEPAD_EVENTS_H
+#define GAMEPAD_EVENTS_H
+
+/*
+ * Delta-encoded event stream of a gamepad
+ *
+ * Pads resend their full 20-byte state at the report rate, also when
+ * nothing moves. gamepad_events_feed() keeps the last report and turns the
+ * next one into the changes since then:
+ *   - button edges: the 16 bits of dpad_system | buttons << 8 XOR the
+ *     previous ones, one press or release event per flipped bit
+ *   - axis events: a stick or trigger moved at least the threshold away from
+ *     the value last sent for it (so slow drift still adds up), or reached
+ *     its rest or end position, which is always sent exactly
+ * A report equal to the previous one costs one 20-byte memcmp() and
+ * produces nothing. The first report sends the full state: every pressed
+ * button and every axis.
+ *
+ * Encodings of the events of one report:
+ *   GAMEPAD_EVENTS_TEXT, one line:
+ *     <seconds since the first report> +A -B LX=-1234 LT=200
+ *   GAMEPAD_EVENTS_BINARY, one record, little endian:
+ *     u8 count, u32 microseconds since the previous record (saturated),
+ *     count x { u8 code, i16 value }
+ *   Codes 0..15 are the button bits (value 1 pressed, 0 released), codes
+ *   16 + GAMEPAD_AXIS_* the axes. A button edge costs 8 bytes, the
+ *   report it came in 20.
+ *
+ * The reader's side: gamepad_events_parse() splits a binary record into
+ * events and gamepad_events_apply() updates a GamepadReport from them.
+ *
+ * Usage:
+ *   GamepadEvents ev;
+ *   gamepad_events_init(&ev, GAMEPAD_EVENTS_TEXT, 512, 4);
+ *   char out[GAMEPAD_EVENTS_MAX_RECORD];
+ *   size_t n = gamepad_events_feed(&ev, &report, now_ns, out);  // 0: nothing changed
+ *   if (n) write(STDOUT_FILENO, out, n);
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gamepad_decode.h"
+
+#define GAMEPAD_EVENTS_NUM_BUTTONS 16
+#define GAMEPAD_EVENTS_AXIS_CODE 16             // code of GAMEPAD_AXIS_LX; the others follow
+#define GAMEPAD_EVENTS_MAX (GAMEPAD_EVENTS_NUM_BUTTONS + GAMEPAD_NUM_AXES)
+#define GAMEPAD_EVENTS_RECORD_HEADER 5
+#define GAMEPAD_EVENTS_MAX_RECORD 256           // longest text line or binary record
+
+typedef enum {
+    GAMEPAD_EVENTS_TEXT,
+    GAMEPAD_EVENTS_BINARY
+} GamepadEventEncoding;
+
+typedef struct {
+    uint8_t code;
+    int16_t value;
+} GamepadEvent;
+
+typedef struct {
+    GamepadEventEncoding encoding;
+    int stick_threshold;
+    int trigger_threshold;
+
+    GamepadReport last;                         // previous report, for the identical check and the edges
+    int16_t sent[GAMEPAD_NUM_AXES];             // axis values as last sent
+    int have_last;
+    uint64_t first_ns;
+    uint64_t last_record_ns;
+
+    uint64_t reports;
+    uint64_t identical;
+    uint64_t events;
+    uint64_t bytes;
+} GamepadEvents;
+
+// Button bit i of dpad_system | buttons << 8.
+static const char *const gamepad_event_button_names[GAMEPAD_EVENTS_NUM_BUTTONS] = {
+    "UP", "DOWN", "RIGHT", "LEFT", "START", "BACK", "L3", "R3",
+    "L1", "R1", "HOME", "BTN11", "A", "B", "X", "Y",
+};
+
+static const char *const gamepad_event_axis_names[GAMEPAD_NUM_AXES] = {
+    "LX", "LY", "RX", "RY", "LT", "RT",
+};
+
+static inline void gamepad_events_init(GamepadEvents *ev, GamepadEventEncoding encoding,
+                                       int stick_threshold, int trigger_threshold) {
+    memset(ev, 0, sizeof(*ev));
+    ev->encoding = encoding;
+    ev->stick_threshold = stick_threshold > 0 ? stick_threshold : 1;
+    ev->trigger_threshold = trigger_threshold > 0 ? trigger_threshold : 1;
+}
+
+static inline uint16_t gamepad_events_buttons(const GamepadReport *r) {
+    return (uint16_t)(r->dpad_system | r->buttons << 8);
+}
+
+static inline void gamepad_events_axes(const GamepadReport *r, int16_t axes[GAMEPAD_NUM_AXES]) {
+    axes[GAMEPAD_AXIS_LX] = r->left_x;
+    axes[GAMEPAD_AXIS_LY] = r->left_y;
+    axes[GAMEPAD_AXIS_RX] = r->right_x;
+    axes[GAMEPAD_AXIS_RY] = r->right_y;
+    axes[GAMEPAD_AXIS_LT] = r->trigger_left;
+    axes[GAMEPAD_AXIS_RT] = r->trigger_right;
+}
+
+// Changes from the previous report into `out`; returns their number.
+static inline int gamepad_events_diff(GamepadEvents *ev, const GamepadReport *r, GamepadEvent out[GAMEPAD_EVENTS_MAX]) {
+    int n = 0;
+    uint16_t now = gamepad_events_buttons(r);
+    uint16_t before = ev->have_last ? gamepad_events_buttons(&ev->last) : 0;
+    uint16_t edges = now ^ before;
+    while (edges) {
+        int bit = __builtin_ctz(edges);
+        out[n].code = (uint8_t)bit;
+        out[n].value = (int16_t)((now >> bit) & 1);
+        n++;
+        edges &= (uint16_t)(edges - 1);
+    }
+
+    int16_t axes[GAMEPAD_NUM_AXES];
+    gamepad_events_axes(r, axes);
+    for (int a = 0; a < GAMEPAD_NUM_AXES; a++) {
+        int v = axes[a];
+        int trigger = a == GAMEPAD_AXIS_LT || a == GAMEPAD_AXIS_RT;
+        if (ev->have_last) {
+            int moved = v - ev->sent[a];
+            if (moved == 0) continue;
+            int threshold = trigger ? ev->trigger_threshold : ev->stick_threshold;
+            int at_end = trigger ? v == 0 || v == 255 : v == 0 || v == INT16_MIN || v == INT16_MAX;
+            if (!at_end && moved < threshold && moved > -threshold) continue;
+        }
+        ev->sent[a] = (int16_t)v;
+        out[n].code = (uint8_t)(GAMEPAD_EVENTS_AXIS_CODE + a);
+        out[n].value = (int16_t)v;
+        n++;
+    }
+    return n;
+}
+
+static inline size_t gamepad_events_encode_text(const GamepadEvents *ev, const GamepadEvent *events, int n,
+                                                uint64_t now_ns, char *out) {
+    uint64_t us = (now_ns - ev->first_ns) / 1000;
+    int len = snprintf(out, GAMEPAD_EVENTS_MAX_RECORD, "%llu.%06u", (unsigned long long)(us / 1000000),
+                       (unsigned)(us % 1000000));
+    for (int i = 0; i < n; i++) {
+        if (events[i].code < GAMEPAD_EVENTS_AXIS_CODE) {
+            len += snprintf(out + len, GAMEPAD_EVENTS_MAX_RECORD - (size_t)len, " %c%s", events[i].value ? '+' : '-',
+                            gamepad_event_button_names[events[i].code]);
+        } else {
+            len += snprintf(out + len, GAMEPAD_EVENTS_MAX_RECORD - (size_t)len, " %s=%d",
+                            gamepad_event_axis_names[events[i].code - GAMEPAD_EVENTS_AXIS_CODE], events[i].value);
+        }
+    }
+    out[len++] = '\n';
+    return (size_t)len;
+}
+
+static inline size_t gamepad_events_encode_binary(const GamepadEvents *ev, const GamepadEvent *events, int n,
+                                                  uint64_t now_ns, unsigned char *out) {
+    uint64_t delta_us = (now_ns - ev->last_record_ns) / 1000;
+    uint32_t d = delta_us > UINT32_MAX ? UINT32_MAX : (uint32_t)delta_us;
+    size_t len = 0;
+    out[len++] = (unsigned char)n;
+    out[len++] = (unsigned char)d;
+    out[len++] = (unsigned char)(d >> 8);
+    out[len++] = (unsigned char)(d >> 16);
+    out[len++] = (unsigned char)(d >> 24);
+    for (int i = 0; i < n; i++) {
+        uint16_t v = (uint16_t)events[i].value;
+        out[len++] = events[i].code;
+        out[len++] = (unsigned char)v;
+        out[len++] = (unsigned char)(v >> 8);
+    }
+    return len;
+}
+
+// Encode what changed since the previous report into `out`
+// (GAMEPAD_EVENTS_MAX_RECORD bytes). Returns the number of bytes, 0 if
+// nothing changed enough to be sent.
+static inline size_t gamepad_events_feed(GamepadEvents *ev, const GamepadReport *r, uint64_t now_ns, void *out) {
+    ev->reports++;
+    if (ev->have_last && memcmp(r, &ev->last, sizeof(*r)) == 0) {
+        ev->identical++;
+        return 0;
+    }
+    if (!ev->have_last) ev->first_ns = ev->last_record_ns = now_ns;
+
+    GamepadEvent events[GAMEPAD_EVENTS_MAX];
+    int n = gamepad_events_diff(ev, r, events);
+    ev->last = *r;
+    ev->have_last = 1;
+    if (n == 0) return 0;
+
+    size_t len = ev->encoding == GAMEPAD_EVENTS_TEXT ? gamepad_events_encode_text(ev, events, n, now_ns, out)
+                                                     : gamepad_events_encode_binary(ev, events, n, now_ns, out);
+    ev->last_record_ns = now_ns;
+    ev->events += (uint64_t)n;
+    ev->bytes += len;
+    return len;
+}
+
+// Reader's side: split the binary record at `data` into `out`. Returns the
+// record's length in bytes, 0 if `len` does not hold all of it yet or -1 if
+// it is not a valid record.
+static inline int gamepad_events_parse(const unsigned char *data, size_t len, GamepadEvent out[GAMEPAD_EVENTS_MAX],
+                                       int *count, uint32_t *delta_us) {
+    if (len < GAMEPAD_EVENTS_RECORD_HEADER) return 0;
+    int n = data[0];
+    if (n == 0 || n > GAMEPAD_EVENTS_MAX) return -1;
+    size_t size = GAMEPAD_EVENTS_RECORD_HEADER + (size_t)n * 3;
+    if (len < size) return 0;
+
+    *delta_us = (uint32_t)data[1] | (uint32_t)data[2] << 8 | (uint32_t)data[3] << 16 | (uint32_t)data[4] << 24;
+    const unsigned char *p = data + GAMEPAD_EVENTS_RECORD_HEADER;
+    for (int i = 0; i < n; i++, p += 3) {
+        if (p[0] >= GAMEPAD_EVENTS_AXIS_CODE + GAMEPAD_NUM_AXES) return -1;
+        out[i].code = p[0];
+        out[i].value = (int16_t)(p[1] | p[2] << 8);
+    }
+    *count = n;
+    return (int)size;
+}
+
+// Reader's side: apply decoded events to `state` (start from all zero).
+static inline void gamepad_events_apply(GamepadReport *state, const GamepadEvent *events, int n) {
+    for (int i = 0; i < n; i++) {
+        int code = events[i].code;
+        int v = events[i].value;
+        if (code < 8) {
+            state->dpad_system = (uint8_t)(v ? state->dpad_system | 1 << code : state->dpad_system & ~(1 << code));
+        } else if (code < GAMEPAD_EVENTS_NUM_BUTTONS) {
+            int bit = code - 8;
+            state->buttons = (uint8_t)(v ? state->buttons | 1 << bit : state->buttons & ~(1 << bit));
+        } else {
+            switch (code - GAMEPAD_EVENTS_AXIS_CODE) {
+                case GAMEPAD_AXIS_LX: state->left_x = (int16_t)v; break;
+                case GAMEPAD_AXIS_LY: state->left_y = (int16_t)v; break;
+                case GAMEPAD_AXIS_RX: state->right_x = (int16_t)v; break;
+                case GAMEPAD_AXIS_RY: state->right_y = (int16_t)v; break;
+                case GAMEPAD_AXIS_LT: state->trigger_left = (uint8_t)v; break;
+                case GAMEPAD_AXIS_RT: state->trigger_right = (uint8_t)v; break;
+                default: break;
+            }
+        }
+    }
+}
+
+#endif // GAMEPAD_EVENTS_H
@@ -0,0 +1,168 @@
+#ifndef GAMEPAD_PROFILES_H
+#define GAMEPAD_PROFILES_H
+
+/*
+ * Gamepad decoders specialised per device profile
+ *
+ * gamepad_translate_report() rewrites the report of any HID pad into the
+ * 20-byte layout, reading each control at the offset, size and logical
+ * range the report descriptor gave: per axis a bit extraction, a clamp and
+ * a 64-bit division, then a loop over the buttons. For the pads in
+ * GAMEPAD_PROFILES() the X-macro generates one translator per pad with
+ * the layout as constants: 8-bit axes become a multiply, the buttons a few
+ * shifts and masks, and the result is the same byte for byte.
+ *
+ * As for mice (usb-mouse/mouse_profiles.h), gamepad_decoder_select() only
+ * keeps a specialised translator if the layout compiled from the report
+ * descriptor agrees with the profile, or if there is no descriptor to
+ * compare with; otherwise it warns and uses the generic path. Reports
+ * shorter than the profile's length take the generic path as well.
+ * Profiles without an entry here (the Xbox 360 pad, which already sends
+ * the 20-byte layout) are left to the generic path.
+ *
+ * Usage:
+ *   GamepadDecoder decoder;
+ *   gamepad_decoder_select(&decoder, usb_profile_find(handle, USB_KIND_GAMEPAD), &layout_from_descriptor);
+ *   if (decoder.layout.valid && gamepad_decoder_run(&decoder, data, len, &report) == 0) ...;
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../common/usb_profiles.h"
+#include "gamepad_decode.h"
+
+// X(profile, report_id, length, lx_byte, ly_byte, rx_byte, ry_byte, lt_byte, rt_byte, hat_byte, buttons_bit, buttons)
+// Axes are single bytes with a logical range of 0..255, the hat the low
+// nibble of hat_byte (0..7, anything else centred), the buttons one bit
+// each from bit buttons_bit on. Offsets count the report ID byte.
+#define GAMEPAD_PROFILES(X) \
+    X(DUALSHOCK4, 1, 10, 1, 2, 3, 4, 8, 9, 5, 44, 14)
+
+typedef struct {
+    UsbProfileId profile;       // a GAMEPAD_PROFILES() entry, or USB_NUM_PROFILES: generic
+    GamepadLayout layout;       // generic path; not valid: reports are already in the 20-byte layout
+} GamepadDecoder;
+
+// The field at `bit` (counting the report ID) as the descriptor would describe it.
+static inline HidField gamepad_profile_field(int report_id, int bit, int bits, int32_t logical_max) {
+    HidField f;
+    memset(&f, 0, sizeof(f));
+    f.bit_offset = (uint16_t)(bit - (report_id ? 8 : 0));
+    f.bit_size = (uint8_t)bits;
+    f.report_id = (uint8_t)report_id;
+    f.logical_max = logical_max;
+    return f;
+}
+
+// Buttons 1..11 of a HID pad (see gamepad_decode.h) into the Xbox layout.
+static inline void gamepad_profile_buttons(uint32_t bits, GamepadReport *out) {
+    out->buttons = (uint8_t)((bits & 0x0f) << 4 | (bits >> 4 & 0x03) | (bits >> 10 & 0x01) << 2);
+    out->dpad_system |= (uint8_t)((bits >> 6 & 0x01) << 5 | (bits >> 7 & 0x01) << 4 | (bits >> 8 & 0x03) << 6);
+}
+
+// 0..255 -> -32768..32767, the same as gamepad_axis_unit() for that range.
+#define GAMEPAD_PROFILE_STICK(raw) ((int32_t)(raw) * 257 - 32768)
+
+#define GAMEPAD_PROFILE_DECODER(name, id, report_len, lx, ly, rx, ry, lt, rt, hat_byte, b_bit, n_buttons) \
+    _Static_assert((report_len) >= (b_bit) / 8 + 3, #name ": the buttons are read as three bytes"); \
+    static inline void gamepad_profile_layout_##name(GamepadLayout *layout) { \
+        static const int axis_byte[GAMEPAD_NUM_AXES] = { (lx), (ly), (rx), (ry), (lt), (rt) }; \
+        memset(layout, 0, sizeof(*layout)); \
+        layout->valid = 1; \
+        layout->report_id = (id); \
+        for (int a = 0; a < GAMEPAD_NUM_AXES; a++) { \
+            layout->axes[a] = gamepad_profile_field((id), axis_byte[a] * 8, 8, 255); \
+        } \
+        layout->hat = gamepad_profile_field((id), (hat_byte) * 8, 4, 7); \
+        layout->buttons = gamepad_profile_field((id), (b_bit), \
+                                                (n_buttons) < GAMEPAD_MAX_BUTTONS ? (n_buttons) : GAMEPAD_MAX_BUTTONS, 1); \
+    } \
+    static inline int decode_gamepad_##name(const uint8_t *d, int len, GamepadReport *out) { \
+        static const uint8_t hat_dpad[16] = { \
+            DPAD_UP, DPAD_UP | DPAD_RIGHT, DPAD_RIGHT, DPAD_DOWN | DPAD_RIGHT, \
+            DPAD_DOWN, DPAD_DOWN | DPAD_LEFT, DPAD_LEFT, DPAD_UP | DPAD_LEFT \
+        }; \
+        if (len < (report_len)) { \
+            GamepadLayout layout; \
+            gamepad_profile_layout_##name(&layout); \
+            return gamepad_translate_report(&layout, d, len, out); \
+        } \
+        if ((id) && d[0] != (id)) return -1; \
+        memset(out, 0, sizeof(*out)); \
+        out->length = sizeof(GamepadReport); \
+        out->left_x = (int16_t)GAMEPAD_PROFILE_STICK(d[(lx)]); \
+        out->left_y = (int16_t)(-1 - GAMEPAD_PROFILE_STICK(d[(ly)])); \
+        out->right_x = (int16_t)GAMEPAD_PROFILE_STICK(d[(rx)]); \
+        out->right_y = (int16_t)(-1 - GAMEPAD_PROFILE_STICK(d[(ry)])); \
+        out->trigger_left = d[(lt)]; \
+        out->trigger_right = d[(rt)]; \
+        out->dpad_system = hat_dpad[d[(hat_byte)] & 0x0f]; \
+        uint32_t bits = (uint32_t)(d[(b_bit) / 8] | d[(b_bit) / 8 + 1] << 8 | d[(b_bit) / 8 + 2] << 16) >> ((b_bit) % 8); \
+        gamepad_profile_buttons(bits & ((1u << ((n_buttons) < GAMEPAD_MAX_BUTTONS ? (n_buttons) : GAMEPAD_MAX_BUTTONS)) - 1), out); \
+        return 0; \
+    }
+
+GAMEPAD_PROFILES(GAMEPAD_PROFILE_DECODER)
+#undef GAMEPAD_PROFILE_DECODER
+
+static inline int gamepad_field_same(const HidField *a, const HidField *b) {
+    if (a->bit_size == 0 || b->bit_size == 0) return a->bit_size == b->bit_size;
+    return a->bit_offset == b->bit_offset && a->bit_size == b->bit_size && a->is_signed == b->is_signed &&
+           a->logical_min == b->logical_min;
+}
+
+// Nonzero if both layouts translate every report the same way.
+static inline int gamepad_layout_same(const GamepadLayout *a, const GamepadLayout *b) {
+    if (a->report_id != b->report_id || !gamepad_field_same(&a->hat, &b->hat) ||
+        !gamepad_field_same(&a->buttons, &b->buttons)) {
+        return 0;
+    }
+    for (int i = 0; i < GAMEPAD_NUM_AXES; i++) {
+        if (!gamepad_field_same(&a->axes[i], &b->axes[i]) || a->axes[i].logical_max != b->axes[i].logical_max) return 0;
+    }
+    return 1;
+}
+
+// The layout `profile` bakes in. Returns 0, or -1 if it has no specialised decoder.
+static inline int gamepad_profile_layout(UsbProfileId profile, GamepadLayout *layout) {
+    switch (profile) {
+#define GAMEPAD_PROFILE_CASE(name, ...) \
+        case USB_PROFILE_##name: gamepad_profile_layout_##name(layout); return 0;
+        GAMEPAD_PROFILES(GAMEPAD_PROFILE_CASE)
+#undef GAMEPAD_PROFILE_CASE
+        default: return -1;
+    }
+}
+
+// Use the specialised translator of `profile` if there is one and the
+// descriptor (`compiled`, not valid if there was none) agrees with it;
+// else the generic path with `compiled`. Says which if there was a choice.
+static inline void gamepad_decoder_select(GamepadDecoder *d, const UsbProfile *profile, const GamepadLayout *compiled) {
+    GamepadLayout baked;
+    d->profile = USB_NUM_PROFILES;
+    d->layout = *compiled;
+    if (gamepad_profile_layout(profile->id, &baked) < 0) return;
+    if (compiled->valid && !gamepad_layout_same(compiled, &baked)) {
+        fprintf(stderr, "WARN: The report descriptor does not match profile %s, using the generic decoder.\n",
+                profile->name);
+        return;
+    }
+    d->profile = profile->id;
+    d->layout = baked;
+    fprintf(stderr, "DEBUG: Report decoder specialised for %s\n", profile->name);
+}
+
+// Same contract as gamepad_translate_report(); only for a valid d->layout.
+static inline int gamepad_decoder_run(const GamepadDecoder *d, const uint8_t *data, int len, GamepadReport *out) {
+    switch (d->profile) {
+#define GAMEPAD_PROFILE_CASE(name, ...) \
+        case USB_PROFILE_##name: return decode_gamepad_##name(data, len, out);
+        GAMEPAD_PROFILES(GAMEPAD_PROFILE_CASE)
+#undef GAMEPAD_PROFILE_CASE
+        default: return gamepad_translate_report(&d->layout, data, len, out);
+    }
+}
+
+#endif // GAMEPAD_PROFILES_H
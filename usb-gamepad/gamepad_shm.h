@@ -0,0 +1,213 @@
+#ifndef GAMEPAD_SHM_H
+#define GAMEPAD_SHM_H
+
+/*
+ * Live gamepad state in shared memory, guarded by a seqlock
+ *
+ * read_gamepad -m <file> maps a small file and stores every report in it:
+ * the 20-byte GamepadReport (after the HID translation and -c, like the
+ * screen), a sequence number and the CLOCK_MONOTONIC time its transfer
+ * completed. Any number of processes map the same file read-only and poll
+ * the latest state. There is one writer and no lock: the writer makes the
+ * sequence word odd, stores the state, and makes it even again. A reader
+ * copies the state between two loads of that word and tries again if it was odd
+ * or changed in between. Neither side makes a system call or waits for the
+ * other, so readers cannot slow the USB loop down, and a read is a few
+ * nanoseconds when the writer is not in the middle of a store.
+ *
+ * The state is stored as 32-bit atomic words with relaxed ordering and
+ * fences around them (the C11 seqlock pattern): no data race, and plain
+ * loads and stores on every CPU, including 32-bit ARM where a 64-bit
+ * atomic might need a lock.
+ *
+ * Any file works: /dev/shm/... on Linux is memory only; on Termux
+ * (no /dev/shm) a file in $TMPDIR is kept in the page cache and written
+ * back now and then, which costs the USB loop nothing. The file is left
+ * in place at exit with writer_pid set to 0, so readers can tell the
+ * state went stale.
+ *
+ * Usage (writer):
+ *   GamepadShm shm;
+ *   if (gamepad_shm_create(&shm, "/dev/shm/gamepad") < 0) perror(...);
+ *   gamepad_shm_publish(&shm, &report, complete_ns);    // every report
+ *   gamepad_shm_close(&shm);
+ *
+ * Usage (reader):
+ *   GamepadShm shm;
+ *   if (gamepad_shm_open(&shm, "/dev/shm/gamepad") < 0) ...;
+ *   GamepadShmState st;
+ *   if (gamepad_shm_read(&shm, &st) >= 0 && st.sequence != last) ...;
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gamepad_decode.h"
+
+#define GAMEPAD_SHM_MAGIC 0x4d485047u       // "GPHM" in memory order
+#define GAMEPAD_SHM_VERSION 1
+#define GAMEPAD_SHM_MAX_RETRIES 1000        // a writer that died mid-store leaves the word odd
+#define GAMEPAD_SHM_SPIN_RETRIES 64         // then yield: the writer may have been preempted mid-store
+
+// What a reader gets: one consistent snapshot.
+typedef struct {
+    uint64_t sequence;          // reports published, 1 for the first, 0: none yet
+    uint64_t timestamp_ns;      // CLOCK_MONOTONIC when the report's transfer completed
+    GamepadReport report;
+    uint8_t pad[4];
+} GamepadShmState;
+
+#define GAMEPAD_SHM_WORDS (sizeof(GamepadShmState) / sizeof(uint32_t))
+
+// The mapped file.
+typedef struct {
+    atomic_uint magic;          // stored last by the writer: the segment is ready
+    uint32_t version;
+    uint32_t size;              // sizeof(GamepadShmSegment)
+    atomic_int writer_pid;      // 0 once the writer exited
+    _Alignas(64) atomic_uint seq;   // odd while the state is being written
+    atomic_uint words[GAMEPAD_SHM_WORDS];
+} GamepadShmSegment;
+
+typedef struct {
+    GamepadShmSegment *seg;
+    uint64_t sequence;          // writer: last sequence number published
+} GamepadShm;
+
+_Static_assert(sizeof(GamepadShmState) % sizeof(uint32_t) == 0, "state must be whole words");
+
+static inline int gamepad_shm_map(GamepadShm *shm, const char *path, int writable) {
+    memset(shm, 0, sizeof(*shm));
+    int fd = open(path, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    struct stat st;
+    int err = 0;
+    if (fstat(fd, &st) < 0) {
+        err = errno;
+    } else if (writable && st.st_size != (off_t)sizeof(GamepadShmSegment)) {
+        if (ftruncate(fd, sizeof(GamepadShmSegment)) < 0) err = errno;
+    } else if (!writable && st.st_size < (off_t)sizeof(GamepadShmSegment)) {
+        err = EAGAIN; // the writer has not sized it yet
+    }
+    if (err) {
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    void *p = mmap(NULL, sizeof(GamepadShmSegment), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    shm->seg = p;
+    return 0;
+}
+
+// Writer: create the segment at `path`, or take it over from a writer that
+// exited. Returns 0, or -1 with errno set (EBUSY: another writer is running).
+static inline int gamepad_shm_create(GamepadShm *shm, const char *path) {
+    if (gamepad_shm_map(shm, path, 1) < 0) return -1;
+    GamepadShmSegment *seg = shm->seg;
+    int pid = atomic_load_explicit(&seg->writer_pid, memory_order_relaxed);
+    if (atomic_load_explicit(&seg->magic, memory_order_acquire) == GAMEPAD_SHM_MAGIC && pid > 0 &&
+        pid != (int)getpid() && (kill(pid, 0) == 0 || errno == EPERM)) {
+        munmap(seg, sizeof(GamepadShmSegment));
+        shm->seg = NULL;
+        errno = EBUSY;
+        return -1;
+    }
+    // Readers of a previous run see magic 0 (not ready) until the new state is in place.
+    atomic_store_explicit(&seg->magic, 0, memory_order_release);
+    seg->version = GAMEPAD_SHM_VERSION;
+    seg->size = sizeof(GamepadShmSegment);
+    atomic_store_explicit(&seg->seq, 0, memory_order_relaxed);
+    for (size_t i = 0; i < GAMEPAD_SHM_WORDS; i++) atomic_store_explicit(&seg->words[i], 0, memory_order_relaxed);
+    atomic_store_explicit(&seg->writer_pid, (int)getpid(), memory_order_relaxed);
+    atomic_store_explicit(&seg->magic, GAMEPAD_SHM_MAGIC, memory_order_release);
+    return 0;
+}
+
+// Writer: store `report` as the latest state.
+static inline void gamepad_shm_publish(GamepadShm *shm, const GamepadReport *report, uint64_t now_ns) {
+    GamepadShmSegment *seg = shm->seg;
+    GamepadShmState st;
+    uint32_t w[GAMEPAD_SHM_WORDS];
+
+    st.sequence = ++shm->sequence;
+    st.timestamp_ns = now_ns;
+    st.report = *report;
+    memset(st.pad, 0, sizeof(st.pad));
+    memcpy(w, &st, sizeof(w));
+
+    unsigned int s = atomic_load_explicit(&seg->seq, memory_order_relaxed);
+    atomic_store_explicit(&seg->seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < GAMEPAD_SHM_WORDS; i++) atomic_store_explicit(&seg->words[i], w[i], memory_order_relaxed);
+    atomic_store_explicit(&seg->seq, s + 2, memory_order_release);
+}
+
+// Writer: mark the state stale and unmap. The file stays for the readers.
+static inline void gamepad_shm_close(GamepadShm *shm) {
+    if (!shm->seg) return;
+    atomic_store_explicit(&shm->seg->writer_pid, 0, memory_order_release);
+    munmap(shm->seg, sizeof(GamepadShmSegment));
+    shm->seg = NULL;
+}
+
+// Reader: map the segment at `path` read-only. Returns 0, or -1 with errno
+// set (EAGAIN: the writer has not set it up yet, EPROTO: another version).
+static inline int gamepad_shm_open(GamepadShm *shm, const char *path) {
+    if (gamepad_shm_map(shm, path, 0) < 0) return -1;
+    GamepadShmSegment *seg = shm->seg;
+    int err = 0;
+    if (atomic_load_explicit(&seg->magic, memory_order_acquire) != GAMEPAD_SHM_MAGIC) err = EAGAIN;
+    else if (seg->version != GAMEPAD_SHM_VERSION || seg->size != sizeof(GamepadShmSegment)) err = EPROTO;
+    if (err) {
+        munmap(shm->seg, sizeof(GamepadShmSegment));
+        shm->seg = NULL;
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+// Reader: copy the latest state into `out`. Returns the number of retries
+// it took (0 unless the writer was storing at that moment), or -1 if the
+// writer kept the state locked for GAMEPAD_SHM_MAX_RETRIES tries. After a
+// few spins each try yields the CPU, so a writer preempted in the middle of
+// a store (on a single core, by this very reader) gets to finish it.
+static inline int gamepad_shm_read(const GamepadShm *shm, GamepadShmState *out) {
+    GamepadShmSegment *seg = shm->seg;
+    uint32_t w[GAMEPAD_SHM_WORDS];
+
+    for (int tries = 0; tries < GAMEPAD_SHM_MAX_RETRIES; tries++) {
+        if (tries >= GAMEPAD_SHM_SPIN_RETRIES) sched_yield();
+        unsigned int s1 = atomic_load_explicit(&seg->seq, memory_order_acquire);
+        if (s1 & 1) continue;
+        for (size_t i = 0; i < GAMEPAD_SHM_WORDS; i++) w[i] = atomic_load_explicit(&seg->words[i], memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&seg->seq, memory_order_relaxed) == s1) {
+            memcpy(out, w, sizeof(*out));
+            return tries;
+        }
+    }
+    return -1;
+}
+
+// Reader: nonzero while the writer process is still publishing.
+static inline int gamepad_shm_writer_alive(const GamepadShm *shm) {
+    return atomic_load_explicit(&shm->seg->writer_pid, memory_order_acquire) != 0;
+}
+
+static inline void gamepad_shm_unmap(GamepadShm *shm) {
+    if (shm->seg) munmap(shm->seg, sizeof(GamepadShmSegment));
+    shm->seg = NULL;
+}
+
+#endif // GAMEPAD_SHM_H
@@ -6,13 +6,22 @@
 #include <unistd.h> // For close
 #include <string.h> // For memset
 #include <time.h>     // For time()
+#include <stdarg.h>
+#include <signal.h>
 
 #include "gamepad_decode.h" // Include our new header
+#include "gamepad_events.h"
+#include "gamepad_axes.h"
+#include "gamepad_shm.h"
+#include "gamepad_profiles.h"
+#include "../common/term_buf.h"
+#include "../common/latency_hist.h"
+#include "../common/desc_cache.h"
+#include "../common/usb_async.h"
+#include "../common/usb_wait.h"
+#include "../common/usb_session.h"
 
 
-#define VENDOR_ID 0x045e // ZhiXu Controller Vendor ID
-#define PRODUCT_ID 0x028e // ZhiXu Controller Product ID
-
 // Helper function to convert transfer type to string for better readability
 const char* libusb_transfer_type_to_string(enum libusb_transfer_type type) {
     switch (type) {
@@ -24,133 +33,496 @@ const char* libusb_transfer_type_to_string(enum libusb_transfer_type type) {
     }
 }
 
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t latency_dump_requested = 0;
+static UsbWait waiter;
+static UsbSession session;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+    usb_wait_wake(&waiter);
+}
+
+static void handle_dump_signal(int sig) {
+    (void)sig;
+    latency_dump_requested = 1;
+    usb_wait_wake(&waiter);
+}
+
+
+
+
+/* =========================================================
+ * Screen template
+ * =========================================================
+ *
+ * The screen is laid out once into `screen_template`, with a fixed-width
+ * slot for every value. A report only rewrites the slots whose text
+ * changed, and sends just those slots (each behind an absolute cursor
+ * position) to the terminal in a single write(). The first report draws
+ * the whole template.
+ */
+
+enum {
+    F_RAW,
+    F_DPAD_NIBBLE, F_UP, F_DOWN, F_LEFT, F_RIGHT,
+    F_SYSTEM_NIBBLE, F_L3, F_R3, F_START, F_BACK,
+    F_ABXY_NIBBLE, F_A, F_B, F_X, F_Y,
+    F_LOW_NIBBLE, F_L1, F_R1, F_HOME,
+    F_LT_RAW, F_RT_RAW, F_LT_BAR, F_RT_BAR,
+    F_LX_RAW, F_LY_RAW, F_LX, F_LY,
+    F_RX_RAW, F_RY_RAW, F_RX, F_RY,
+    F_STATUS,
+    F_COUNT
+};
+
+typedef struct {
+    int row;        // 1-based terminal row and column
+    int col;
+    int width;
+    size_t offset;  // position in screen_template
+} ScreenField;
+
+#define TRIGGER_BAR_WIDTH 20
+
+static char screen_template[2048];
+static size_t screen_len = 0;
+static int screen_row = 1;
+static int screen_col = 1;
+static ScreenField fields[F_COUNT];
+static int screen_drawn = 0;
+
+static TermBuf frame;
+static unsigned char last_report[GAMEPAD_MAX_REPORT];
+static GamepadDecoder report_decoder;   // layout valid if the interface has a HID report descriptor or a profile
+static int last_length = -1;
+static uint64_t reports_received = 0;
+static uint64_t reports_skipped = 0;
+static ReportLatency report_latency;
+static int event_mode = 0;              // -e: write the changes to stdout instead of drawing the screen
+static GamepadEvents events;
+static int condition_axes = 0;          // -c: calibration, deadzone and filter on the axes
+static GamepadAxes axes;
+static const char *state_path = NULL;   // -m: publish every report to this shared-memory file
+static GamepadShm state_shm;
+
+static void template_text(const char *text) {
+    for (; *text; text++) {
+        if (screen_len < sizeof(screen_template)) screen_template[screen_len++] = *text;
+        if (*text == '\n') {
+            screen_row++;
+            screen_col = 1;
+        } else {
+            screen_col++;
+        }
+    }
+}
+
+static void template_field(int id, int width) {
+    fields[id].row = screen_row;
+    fields[id].col = screen_col;
+    fields[id].width = width;
+    fields[id].offset = screen_len;
+    for (int i = 0; i < width; i++) template_text(" ");
+}
+
+// Label, value slot, rest of the line.
+static void template_line(const char *label, int id, int width, const char *after) {
+    template_text(label);
+    template_field(id, width);
+    template_text(after);
+}
+
+static void build_screen_template(void) {
+    template_text("--- Gamepad State ---\n\n");
+    template_line("Raw: ", F_RAW, 20 * 3, "\n\n");
+
+    template_text("DPAD:\n");
+    template_line("Raw[2 low] = ", F_DPAD_NIBBLE, 3, "\n\n");
+    template_line("Up: ", F_UP, 8, "\n");
+    template_line("Down: ", F_DOWN, 8, "\n");
+    template_line("Left: ", F_LEFT, 8, "\n");
+    template_line("Right: ", F_RIGHT, 8, "\n\n");
+
+    template_text("Buttons:\n");
+    template_line("Raw[2 high] = ", F_SYSTEM_NIBBLE, 3, "\n\n");
+    template_line("L3: ", F_L3, 8, "\n");
+    template_line("R3: ", F_R3, 8, "\n");
+    template_line("Start: ", F_START, 8, "\n");
+    template_line("Back: ", F_BACK, 8, "\n\n");
+
+    template_line("Raw[3 high] = ", F_ABXY_NIBBLE, 3, "\n\n");
+    template_line("A: ", F_A, 8, "\n");
+    template_line("B: ", F_B, 8, "\n");
+    template_line("X: ", F_X, 8, "\n");
+    template_line("Y: ", F_Y, 8, "\n\n");
+
+    template_line("Raw[3 low] = ", F_LOW_NIBBLE, 3, "\n\n");
+    template_line("L1: ", F_L1, 8, "\n");
+    template_line("R1: ", F_R1, 8, "\n");
+    template_line("Home: ", F_HOME, 8, "\n\n");
+
+    template_text("Analog Triggers:\n");
+    template_line("Raw[4] = ", F_LT_RAW, 4, "\n");
+    template_line("Raw[5] = ", F_RT_RAW, 4, "\n\n");
+    template_line("Left Trigger:    [", F_LT_BAR, TRIGGER_BAR_WIDTH, "]\n");
+    template_line("Right Trigger:   [", F_RT_BAR, TRIGGER_BAR_WIDTH, "]\n\n");
+
+    template_text("Left Stick:\n");
+    template_line("Raw[6-7] = ", F_LX_RAW, 6, "\n");
+    template_line("Raw[8-9] = ", F_LY_RAW, 6, "\n\n");
+    template_line("X: ", F_LX, 6, "\n");
+    template_line("Y: ", F_LY, 6, "\n\n");
+
+    template_text("Right Stick:\n");
+    template_line("Raw[10-11] = ", F_RX_RAW, 6, "\n");
+    template_line("Raw[12-13] = ", F_RY_RAW, 6, "\n\n");
+    template_line("X: ", F_RX, 6, "\n");
+    template_line("Y: ", F_RY, 6, "\n\n");
+
+    template_text("---------------------------------------------------------\n");
+    template_field(F_STATUS, 72);
+    template_text("\n");
+}
+
+// Store `text` (padded to the slot width) in field `id`; queue it for the
+// terminal if it differs from what is on screen.
+static void patch_field(int id, const char *text, size_t len) {
+    ScreenField *f = &fields[id];
+    char padded[80];
+    if (len > (size_t)f->width) len = (size_t)f->width;
+    memcpy(padded, text, len);
+    memset(padded + len, ' ', (size_t)f->width - len);
+
+    char *slot = screen_template + f->offset;
+    if (memcmp(slot, padded, (size_t)f->width) == 0) return;
+    memcpy(slot, padded, (size_t)f->width);
+    if (screen_drawn) {
+        term_buf_printf(&frame, "\033[%d;%dH", f->row, f->col);
+        term_buf_putn(&frame, slot, (size_t)f->width);
+    }
+}
+
+static void patch_fieldf(int id, const char *fmt, ...) {
+    char text[80];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    patch_field(id, text, n < (int)sizeof(text) ? (size_t)n : sizeof(text) - 1);
+}
 
+static void patch_pressed(int id, int pressed) {
+    patch_field(id, pressed ? "Pressed" : "Released", pressed ? 7 : 8);
+}
 
+static void patch_trigger_bar(int id, uint8_t value) {
+    char bar[TRIGGER_BAR_WIDTH];
+    int bar_length = (int)(value / 255.0 * TRIGGER_BAR_WIDTH);
+    memset(bar, '#', (size_t)bar_length);
+    memset(bar + bar_length, '-', (size_t)(TRIGGER_BAR_WIDTH - bar_length));
+    patch_field(id, bar, sizeof(bar));
+}
+
+// Send the queued fields (or the whole screen the first time) in one write().
+static void flush_screen(void) {
+    if (!screen_drawn) {
+        term_buf_puts(&frame, "\033[2J\033[H"); // Clear once, the template stays in place afterwards
+        term_buf_putn(&frame, screen_template, screen_len);
+        screen_drawn = 1;
+    }
+    term_buf_flush(&frame, STDERR_FILENO);
+    latency_note_frame(&report_latency, latency_now_ns());
+}
+
+// Put the terminal cursor below the screen, e.g. before exiting.
+static void finish_screen(void) {
+    if (!screen_drawn) return;
+    term_buf_printf(&frame, "\033[%d;1H", screen_row);
+    term_buf_flush(&frame, STDERR_FILENO);
+}
+
+// HID class pads describe their reports; compile the descriptor once so
+// every report can be rewritten into the 20-byte layout. Xbox 360 pads are
+// vendor class, have no report descriptor and already send that layout.
+static void load_report_layout(libusb_device_handle *handle, DescCache *cache, int interface_number,
+                               GamepadLayout *layout) {
+    unsigned char desc[512];
+    HidPlan plan;
+
+    int len = desc_cache_report_descriptor(cache, handle, interface_number, desc, sizeof(desc));
+    if (len <= 0) {
+        fprintf(stderr, "DEBUG: No HID report descriptor on interface %d, expecting 20-byte Xbox 360 reports.\n", interface_number);
+        return;
+    }
+    if (hid_plan_compile(&plan, desc, len) < 0 || gamepad_layout_from_plan(layout, &plan) < 0) {
+        fprintf(stderr, "WARN: HID report descriptor on interface %d has no X/Y stick, expecting 20-byte Xbox 360 reports.\n",
+                interface_number);
+        return;
+    }
+    fprintf(stderr, "DEBUG: Report layout from descriptor: report id %u, %d fields, %u buttons%s.\n",
+            layout->report_id, plan.count, layout->buttons.bit_size,
+            layout->hat.bit_size ? ", hat switch" : "");
+}
+
+// SIGUSR1: print the latency percentiles below the screen. The fields are
+// patched at absolute positions, so the screen above keeps updating.
+static void dump_latency(void) {
+    latency_dump_requested = 0;
+    finish_screen();
+    latency_print(&report_latency, stderr);
+}
+
+static int report_changed(const unsigned char *data, int actual_length) {
+    return actual_length != last_length || memcmp(data, last_report, (size_t)actual_length) != 0;
+}
 
 // Function to interpret the 20-byte raw gamepad data
 void interpret_gamepad_report(unsigned char *data, int actual_length) {
-    // Clear screen and move cursor to home (0,0) position
-    fprintf(stderr, "\033[2J\033[H");
-    
+    reports_received++;
+
+    // Controllers resend their state at the report rate; nothing to do if it did not change.
+    if (!report_changed(data, actual_length)) {
+        reports_skipped++;
+        return;
+    }
+    last_length = actual_length > (int)sizeof(last_report) ? (int)sizeof(last_report) : actual_length;
+    memcpy(last_report, data, (size_t)last_length);
+
     if (actual_length != 20) {
-        fprintf(stderr, "Warning: Expected 20 bytes, but received %d bytes for interpretation.\n", actual_length);
+        patch_fieldf(F_STATUS, "Warning: Expected 20 bytes, but received %d bytes for interpretation.", actual_length);
+        flush_screen();
         return;
     }
+    patch_field(F_STATUS, "", 0);
 
     // --- DPAD Parsing from data[2] (bitfield) ---
     uint8_t dpad_byte = data[2];
-    int DPAD_UP_STATE = (dpad_byte & DPAD_UP) ? 1 : 0;
-    int DPAD_DOWN_STATE = (dpad_byte & DPAD_DOWN) ? 1 : 0;
-    int DPAD_LEFT_STATE = (dpad_byte & DPAD_LEFT) ? 1 : 0;
-    int DPAD_RIGHT_STATE = (dpad_byte & DPAD_RIGHT) ? 1 : 0;
-
     // --- Buttons from data[3] (bitfield) ---
     uint8_t buttons_byte = data[3];
-    int BUTTON_L1_STATE = (buttons_byte & BTN_L1) ? 1 : 0;
-    int BUTTON_R1_STATE = (buttons_byte & BTN_R1) ? 1 : 0;
-    int BUTTON_HOME_STATE = (buttons_byte & BTN_HOME) ? 1 : 0;
-    int BUTTON_A_STATE = (buttons_byte & BTN_A) ? 1 : 0;
-    int BUTTON_B_STATE = (buttons_byte & BTN_B) ? 1 : 0;
-    int BUTTON_X_STATE = (buttons_byte & BTN_X) ? 1 : 0;
-    int BUTTON_Y_STATE = (buttons_byte & BTN_Y) ? 1 : 0;
-
-    // --- System / Stick Buttons from data[2] (HIGH nibble of dpad_byte) ---
-    int BUTTON_L3_STATE = (dpad_byte & BTN_L3) ? 1 : 0;
-    int BUTTON_R3_STATE = (dpad_byte & BTN_R3) ? 1 : 0;
-    int BUTTON_BACK_STATE = (dpad_byte & BTN_BACK) ? 1 : 0;
-    int BUTTON_START_STATE = (dpad_byte & BTN_START) ? 1 : 0;
-
     // --- Analog Triggers from data[4] and data[5] ---
     uint8_t LEFT_TRIGGER_ANALOG_VALUE = data[4];
     uint8_t RIGHT_TRIGGER_ANALOG_VALUE = data[5];
-
     // --- Analog Sticks (Little Endian signed 16-bit) ---
     int16_t LEFT_X = (int16_t)((data[7] << 8) | data[6]);   // LSB data[6], MSB data[7]
     int16_t LEFT_Y = (int16_t)((data[9] << 8) | data[8]);  // LSB data[8], MSB data[9]
     int16_t RIGHT_X = (int16_t)((data[11] << 8) | data[10]);// LSB data[10], MSB data[11]
     int16_t RIGHT_Y = (int16_t)((data[13] << 8) | data[12]);// LSB data[12], MSB data[13]
 
+    static const char hex[] = "0123456789abcdef";
+    char raw[20 * 3];
+    for (int i = 0; i < 20; ++i) {
+        raw[i * 3] = hex[data[i] >> 4];
+        raw[i * 3 + 1] = hex[data[i] & 0x0F];
+        raw[i * 3 + 2] = ' ';
+    }
+    patch_field(F_RAW, raw, sizeof(raw));
+
+    patch_fieldf(F_DPAD_NIBBLE, "0x%x", dpad_byte & 0x0F); // Low nibble for DPAD
+    patch_pressed(F_UP, dpad_byte & DPAD_UP);
+    patch_pressed(F_DOWN, dpad_byte & DPAD_DOWN);
+    patch_pressed(F_LEFT, dpad_byte & DPAD_LEFT);
+    patch_pressed(F_RIGHT, dpad_byte & DPAD_RIGHT);
+
+    patch_fieldf(F_SYSTEM_NIBBLE, "0x%x", (dpad_byte >> 4) & 0x0F); // High nibble for System Buttons
+    patch_pressed(F_L3, dpad_byte & BTN_L3);
+    patch_pressed(F_R3, dpad_byte & BTN_R3);
+    patch_pressed(F_START, dpad_byte & BTN_START);
+    patch_pressed(F_BACK, dpad_byte & BTN_BACK);
+
+    patch_fieldf(F_ABXY_NIBBLE, "0x%x", (buttons_byte >> 4) & 0x0F); // High nibble for ABXY
+    patch_pressed(F_A, buttons_byte & BTN_A);
+    patch_pressed(F_B, buttons_byte & BTN_B);
+    patch_pressed(F_X, buttons_byte & BTN_X);
+    patch_pressed(F_Y, buttons_byte & BTN_Y);
+
+    patch_fieldf(F_LOW_NIBBLE, "0x%x", buttons_byte & 0x0F); // Low nibble for L1/R1/Home
+    patch_pressed(F_L1, buttons_byte & BTN_L1);
+    patch_pressed(F_R1, buttons_byte & BTN_R1);
+    patch_pressed(F_HOME, buttons_byte & BTN_HOME);
+
+    patch_fieldf(F_LT_RAW, "0x%02x", LEFT_TRIGGER_ANALOG_VALUE);
+    patch_fieldf(F_RT_RAW, "0x%02x", RIGHT_TRIGGER_ANALOG_VALUE);
+    patch_trigger_bar(F_LT_BAR, LEFT_TRIGGER_ANALOG_VALUE);
+    patch_trigger_bar(F_RT_BAR, RIGHT_TRIGGER_ANALOG_VALUE);
+
+    patch_fieldf(F_LX_RAW, "0x%04x", (unsigned short)LEFT_X);
+    patch_fieldf(F_LY_RAW, "0x%04x", (unsigned short)LEFT_Y);
+    patch_fieldf(F_LX, "%d", LEFT_X);
+    patch_fieldf(F_LY, "%d", LEFT_Y);
+
+    patch_fieldf(F_RX_RAW, "0x%04x", (unsigned short)RIGHT_X);
+    patch_fieldf(F_RY_RAW, "0x%04x", (unsigned short)RIGHT_Y);
+    patch_fieldf(F_RX, "%d", RIGHT_X);
+    patch_fieldf(F_RY, "%d", RIGHT_Y);
+
+    flush_screen();
+}
 
-    // Print human-readable output in the specified format
-    fprintf(stderr, "--- Gamepad State ---\n\n");
+// Event mode: write what changed since the previous report to stdout.
+static void write_events(const unsigned char *data, int actual_length, uint64_t complete_ns) {
+    unsigned char record[GAMEPAD_EVENTS_MAX_RECORD];
+    GamepadReport report;
+    if (actual_length != (int)sizeof(report)) {
+        reports_skipped++;
+        return;
+    }
+    memcpy(&report, data, sizeof(report));
+    size_t n = gamepad_events_feed(&events, &report, complete_ns, record);
+    latency_note_report(&report_latency, complete_ns, latency_now_ns(), n > 0);
+    if (n == 0) return;
+    if (write(STDOUT_FILENO, record, n) < 0) {
+        fprintf(stderr, "ERROR: Writing events failed: %s\n", strerror(errno));
+        stop_requested = 1;
+        return;
+    }
+    latency_note_frame(&report_latency, latency_now_ns());
+}
 
-    fprintf(stderr, "Raw: ");
-    for (int i = 0; i < actual_length; ++i) {
-        fprintf(stderr, "%02x ", data[i]);
+// Translate (HID pads) and show one report. `complete_ns` is when its
+// transfer came back to the program.
+static void handle_report(unsigned char *data, int actual_length, uint64_t complete_ns) {
+    usb_session_first_data(&session);
+    unsigned char *report_data = data;
+    int report_length = actual_length;
+    GamepadReport report;
+    if (report_decoder.layout.valid) {
+        if (gamepad_decoder_run(&report_decoder, data, actual_length, &report) < 0) return;
+        report_data = (unsigned char *)&report;
+        report_length = sizeof(report);
+    }
+    if (condition_axes && report_length == (int)sizeof(report)) {
+        if (report_data != (unsigned char *)&report) memcpy(&report, report_data, sizeof(report));
+        gamepad_axes_process(&axes, &report);
+        report_data = (unsigned char *)&report;
     }
-    fprintf(stderr, "\n\n");
-
-    fprintf(stderr, "DPAD:\n");
-    fprintf(stderr, "Raw[2 low] = 0x%x\n\n", dpad_byte & 0x0F); // Low nibble for DPAD
-    fprintf(stderr, "Up: %s\n", DPAD_UP_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "Down: %s\n", DPAD_DOWN_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "Left: %s\n", DPAD_LEFT_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "Right: %s\n\n", DPAD_RIGHT_STATE ? "Pressed" : "Released");
-
-    fprintf(stderr, "Buttons:\n");
-    fprintf(stderr, "Raw[2 high] = 0x%x\n\n", (dpad_byte >> 4) & 0x0F); // High nibble for System Buttons
-    fprintf(stderr, "L3: %s\n", BUTTON_L3_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "R3: %s\n", BUTTON_R3_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "Start: %s\n", BUTTON_START_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "Back: %s\n\n", BUTTON_BACK_STATE ? "Pressed" : "Released");
-
-    fprintf(stderr, "Raw[3 high] = 0x%x\n\n", (buttons_byte >> 4) & 0x0F); // High nibble for ABXY
-    fprintf(stderr, "A: %s\n", BUTTON_A_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "B: %s\n", BUTTON_B_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "X: %s\n", BUTTON_X_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "Y: %s\n\n", BUTTON_Y_STATE ? "Pressed" : "Released");
-
-    fprintf(stderr, "Raw[3 low] = 0x%x\n\n", buttons_byte & 0x0F); // Low nibble for L1/R1/Home
-    fprintf(stderr, "L1: %s\n", BUTTON_L1_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "R1: %s\n", BUTTON_R1_STATE ? "Pressed" : "Released");
-    fprintf(stderr, "Home: %s\n\n", BUTTON_HOME_STATE ? "Pressed" : "Released");
-
-    // Analog Triggers
-    fprintf(stderr, "Analog Triggers:\n");
-    fprintf(stderr, "Raw[4] = 0x%02x\n", LEFT_TRIGGER_ANALOG_VALUE);
-    fprintf(stderr, "Raw[5] = 0x%02x\n\n", RIGHT_TRIGGER_ANALOG_VALUE);
-
-    // Helper function for drawing trigger bar
-    char trigger_bar[21]; // 20 chars + null terminator
-    int bar_length;
-
-    // Left Trigger Bar
-    memset(trigger_bar, '-', sizeof(trigger_bar) - 1);
-    bar_length = (int)(LEFT_TRIGGER_ANALOG_VALUE / 255.0 * 20);
-    for (int i = 0; i < bar_length; ++i) {
-        trigger_bar[i] = '#';
+    if (state_path && report_length == (int)sizeof(report)) {
+        if (report_data != (unsigned char *)&report) memcpy(&report, report_data, sizeof(report));
+        gamepad_shm_publish(&state_shm, &report, complete_ns);
     }
-    trigger_bar[20] = '\0';
-    fprintf(stderr, "Left Trigger:    [%s]\n", trigger_bar);
-
-    // Right Trigger Bar
-    memset(trigger_bar, '-', sizeof(trigger_bar) - 1);
-    bar_length = (int)(RIGHT_TRIGGER_ANALOG_VALUE / 255.0 * 20);
-    for (int i = 0; i < bar_length; ++i) {
-        trigger_bar[i] = '#';
+    if (event_mode) {
+        write_events(report_data, report_length, complete_ns);
+        return;
     }
-    trigger_bar[20] = '\0';
-    fprintf(stderr, "Right Trigger:   [%s]\n\n", trigger_bar);
+    latency_note_report(&report_latency, complete_ns, latency_now_ns(), report_changed(report_data, report_length));
+    interpret_gamepad_report(report_data, report_length); // Call the interpretation function
+}
+
+// One blocking transfer at a time (original loop). Returns 0 when stopped,
+// or the libusb error that ended it.
+static int read_gamepad_sync(libusb_device_handle *handle, int endpoint_address, int max_packet_size) {
+    unsigned char data[GAMEPAD_MAX_REPORT];
+    int actual_length;
+    int r = 0;
+
+    if (max_packet_size > (int)sizeof(data)) max_packet_size = sizeof(data);
+
+    while (!stop_requested) { // Continuous polling until Ctrl+C
+        r = libusb_interrupt_transfer(handle, endpoint_address, data, max_packet_size, &actual_length, 100); // Shorter timeout for 10Hz
+        uint64_t complete_ns = latency_now_ns();
+        if (latency_dump_requested) dump_latency();
+        if (r == LIBUSB_ERROR_TIMEOUT || r == LIBUSB_ERROR_INTERRUPTED) {
+            // No need to print dots, just continue polling without new output if no data
+            continue; 
+        } else if (r < 0) {
+            finish_screen();
+            if (r == LIBUSB_ERROR_NO_DEVICE) {
+                fprintf(stderr, "\nERROR: Device disconnected. Exiting.\n");
+                break; // Exit the loop
+            } else if (r == LIBUSB_ERROR_PIPE) {
+                 fprintf(stderr, "libusb_interrupt_transfer error: LIBUSB_ERROR_PIPE (endpoint halted). Retrying...\n");
+                 libusb_clear_halt(handle, endpoint_address);
+                 usleep(100000); // Wait 100ms before retrying
+                 continue;
+            }
+            fprintf(stderr, "libusb_interrupt_transfer failed: %s\n", libusb_error_name(r));
+            break;
+        }
 
+        if (actual_length > 0) {
+            handle_report(data, actual_length, complete_ns);
+        }
+    }
+    return stop_requested ? 0 : r;
+}
 
-    // Left Stick
-    fprintf(stderr, "Left Stick:\n");
-    fprintf(stderr, "Raw[6-7] = 0x%04x\n", (unsigned short)LEFT_X);
-    fprintf(stderr, "Raw[8-9] = 0x%04x\n\n", (unsigned short)LEFT_Y);
-    fprintf(stderr, "X: %d\n", LEFT_X);
-    fprintf(stderr, "Y: %d\n\n", LEFT_Y);
+// Async completion callback, runs inside libusb_handle_events*().
+static int on_report(void *user, const unsigned char *data, int length) {
+    (void)user;
+    handle_report((unsigned char *)data, length, latency_now_ns());
+    return stop_requested;
+}
 
-    // Right Stick
-    fprintf(stderr, "Right Stick:\n");
-    fprintf(stderr, "Raw[10-11] = 0x%04x\n", (unsigned short)RIGHT_X);
-    fprintf(stderr, "Raw[12-13] = 0x%04x\n\n", (unsigned short)RIGHT_Y); // Corrected byte range
-    fprintf(stderr, "X: %d\n", RIGHT_X);
-    fprintf(stderr, "Y: %d\n\n", RIGHT_Y);
+// Keep `depth` interrupt transfers queued on the endpoint until Ctrl+C or a
+// fatal error. The transfers have no timeout: a pad that is not touched
+// (and does not resend its state) leaves the loop asleep.
+static int read_gamepad_async(libusb_context *context, libusb_device_handle *handle, int endpoint_address,
+                              int depth, int max_packet_size, usb_async_queue *q) {
+    int r = usb_wait_init(&waiter, context);
+    if (r < 0) {
+        fprintf(stderr, "Failed to set up the event loop: %s\n", libusb_error_name(r));
+        return r;
+    }
+    r = usb_async_start(q, handle, endpoint_address, LIBUSB_TRANSFER_TYPE_INTERRUPT, depth, max_packet_size, 0, on_report, NULL);
+    if (r < 0) {
+        fprintf(stderr, "Failed to start async transfers: %s\n", libusb_error_name(r));
+        usb_async_cancel(q, context);
+        usb_wait_close(&waiter);
+        return r;
+    }
 
-    fprintf(stderr, "---------------------------------------------------------\n"); // Adjusted separator
+    while (!stop_requested && !q->stopped) {
+        if (latency_dump_requested) dump_latency();
+        r = usb_wait_events(&waiter, -1);
+        if (r < 0) {
+            finish_screen();
+            fprintf(stderr, "libusb_handle_events failed: %s\n", libusb_error_name(r));
+            break;
+        }
+        if (q->stalled) {
+            finish_screen();
+            fprintf(stderr, "libusb_interrupt_transfer error: LIBUSB_ERROR_PIPE (endpoint halted). Retrying...\n");
+            r = libusb_clear_halt(handle, endpoint_address);
+            if (r < 0) {
+                fprintf(stderr, "ERROR: Could not clear halt: %s\n", libusb_error_name(r));
+                break;
+            }
+            r = usb_async_resubmit(q);
+            if (r < 0) {
+                fprintf(stderr, "ERROR: Could not resubmit transfers after clearing the halt: %s\n", libusb_error_name(r));
+                break;
+            }
+        }
+    }
 
+    finish_screen();
+    if (q->error == LIBUSB_TRANSFER_NO_DEVICE) {
+        fprintf(stderr, "\nERROR: Device disconnected. Exiting.\n");
+    } else if (q->error) {
+        fprintf(stderr, "libusb_interrupt_transfer failed: transfer status %d\n", q->error);
+    }
+    usb_async_cancel(q, context);
+    usb_wait_close(&waiter);
+    return q->error ? LIBUSB_ERROR_IO : r;
 }
 
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-a | -S] [-q depth] [-r] [-e text|bin] [-t stick[,trigger]] [-c] [-z stick[,trigger]] [-m file] <file_descriptor>\n", prog);
+    fprintf(stderr, "  -a        Asynchronous mode (default): keep several interrupt transfers queued\n");
+    fprintf(stderr, "  -S        Synchronous mode: one blocking transfer at a time, wakes up every 100 ms\n");
+    fprintf(stderr, "  -q depth  Transfers kept in flight in asynchronous mode (default 8)\n");
+    fprintf(stderr, "  -r        Read the descriptors from the device again instead of the cache\n");
+    fprintf(stderr, "  -e enc    Write only the changes to stdout (button edges, axis moves) instead of\n");
+    fprintf(stderr, "            drawing the screen: one line per report (text) or binary records (bin)\n");
+    fprintf(stderr, "  -t s[,t]  Smallest stick and trigger moves sent in event mode (default 512,4)\n");
+    fprintf(stderr, "  -c        Condition the axes: learned calibration, deadzones and a one-euro filter\n");
+    fprintf(stderr, "  -z s[,t]  Stick and trigger deadzones with -c, out of 32767 (default 4000,1000)\n");
+    fprintf(stderr, "  -m file   Also publish the latest state to this shared-memory file (e.g. /dev/shm/gamepad),\n");
+    fprintf(stderr, "            for read_gamepad_shm and other readers (gamepad_shm.h)\n");
+    fprintf(stderr, "Send SIGUSR1 to print report latency percentiles while running.\n");
+}
 
 int main(int argc, char **argv) {
     setvbuf(stdout, NULL, _IONBF, 0);
@@ -158,109 +530,127 @@ int main(int argc, char **argv) {
     libusb_device_handle *handle = NULL;
     int fd = -1;
     int r = 0;
-    unsigned char data[32]; // Max packet size is 32 bytes from descriptor dump
-    int actual_length;
-    int interface_number = 0; // Interface 0 based on descriptor dump
-    int endpoint_address = 0x81; // Interrupt IN endpoint 0x81 based on descriptor dump
-    int max_packet_size = 32;
-
-    if (argc < 2 || sscanf(argv[1], "%d", &fd) != 1) {
-        fprintf(stderr, "Usage: %s <file_descriptor>\n", argv[0]);
+    int max_packet_size = 32;           // Xbox 360 pads; the endpoint's own size once it is known
+    usb_async_queue queue = {0};
+    int async_mode = 1;
+    int queue_depth = 8;
+    int refresh_cache = 0;
+    GamepadEventEncoding encoding = GAMEPAD_EVENTS_TEXT;
+    int stick_threshold = 512;
+    int trigger_threshold = 4;
+    GamepadAxesConfig axes_config = gamepad_axes_defaults;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "aSq:re:t:cz:m:")) != -1) {
+        switch (opt) {
+            case 'a': async_mode = 1; break;
+            case 'S': async_mode = 0; break;
+            case 'q': queue_depth = atoi(optarg); break;
+            case 'r': refresh_cache = 1; break;
+            case 'e':
+                event_mode = 1;
+                if (strcmp(optarg, "text") == 0) encoding = GAMEPAD_EVENTS_TEXT;
+                else if (strcmp(optarg, "bin") == 0) encoding = GAMEPAD_EVENTS_BINARY;
+                else { usage(argv[0]); return 1; }
+                break;
+            case 't':
+                if (sscanf(optarg, "%d,%d", &stick_threshold, &trigger_threshold) < 1) { usage(argv[0]); return 1; }
+                break;
+            case 'c': condition_axes = 1; break;
+            case 'z':
+                if (sscanf(optarg, "%d,%d", &axes_config.stick_deadzone, &axes_config.trigger_deadzone) < 1) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm': state_path = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || sscanf(argv[optind], "%d", &fd) != 1 || queue_depth < 1) {
+        usage(argv[0]);
         return 1;
     }
-
-    libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
-    r = libusb_init(&context);
-    if (r < 0) {
-        fprintf(stderr, "libusb_init failed: %s\n", libusb_error_name(r));
+    if (state_path && gamepad_shm_create(&state_shm, state_path) < 0) {
+        fprintf(stderr, "ERROR: Cannot publish the state to %s: %s\n", state_path,
+                errno == EBUSY ? "another read_gamepad is publishing to it" : strerror(errno));
         return 1;
     }
-    fprintf(stderr, "DEBUG: libusb_init successful.\n");
 
-    r = libusb_wrap_sys_device(context, (intptr_t)fd, &handle);
-    if (r < 0) {
-        fprintf(stderr, "libusb_wrap_sys_device failed: %s\n", libusb_error_name(r));
-        libusb_exit(context);
+    // Ctrl+C ends the loop so the interface is released and the counters printed.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = handle_dump_signal;
+    sigaction(SIGUSR1, &sa, NULL);
+    build_screen_template();
+    gamepad_events_init(&events, encoding, stick_threshold, trigger_threshold);
+    gamepad_axes_init(&axes, &axes_config);
+
+    if (usb_session_open(&session, fd) < 0) {
+        gamepad_shm_close(&state_shm);
         return 1;
     }
-    fprintf(stderr, "DEBUG: libusb_wrap_sys_device successful. Handle obtained.\n");
-
-    // Try to detach kernel driver if one is active for Interface 0
-    int kernel_driver_active = 0; 
-    fprintf(stderr, "DEBUG: Checking for active kernel driver on interface %d.\n", interface_number);
-    if (libusb_kernel_driver_active(handle, interface_number) == 1) {
-        fprintf(stderr, "DEBUG: Kernel driver active. Attempting to detach.\n");
-        r = libusb_detach_kernel_driver(handle, interface_number);
-        if (r < 0) {
-            fprintf(stderr, "libusb_detach_kernel_driver failed (interface %d): %s\n", interface_number, libusb_error_name(r));
-            goto error_exit_with_handle;
-        }
-        kernel_driver_active = 1;
-        fprintf(stderr, "DEBUG: Kernel driver detached.\n");
-    } else {
-        fprintf(stderr, "DEBUG: No active kernel driver found or already detached.\n");
-    }
+    context = session.ctx;
+    handle = session.handle;
 
-    fprintf(stderr, "DEBUG: Attempting to claim interface %d.\n", interface_number);
-    r = libusb_claim_interface(handle, interface_number);
-    if (r < 0) {
-        fprintf(stderr, "libusb_claim_interface failed (interface %d): %s\n", interface_number, libusb_error_name(r));
-        if (kernel_driver_active) {
-            fprintf(stderr, "DEBUG: Reattaching kernel driver.\n");
-            libusb_attach_kernel_driver(handle, interface_number); // Reattach if we detached it
-        }
+    const UsbProfile *profile = usb_profile_find(handle, USB_KIND_GAMEPAD);
+    int interface_number = profile->interface;
+    int endpoint_address = profile->endpoint_in;
+    if (usb_session_claim(&session, interface_number) < 0) {
         goto error_exit_with_handle;
     }
-    fprintf(stderr, "DEBUG: Interface %d claimed successfully.\n", interface_number);
+    // A whole packet: a report longer than the transfer would end it with an overflow.
+    int packet_size = libusb_get_max_packet_size(libusb_get_device(handle), endpoint_address);
+    if (packet_size > 0) max_packet_size = packet_size < GAMEPAD_MAX_REPORT ? packet_size : GAMEPAD_MAX_REPORT;
+    DescCache cache;
+    desc_cache_open(&cache, handle, refresh_cache);
+    GamepadLayout report_layout = {0};
+    load_report_layout(handle, &cache, interface_number, &report_layout);
+    gamepad_decoder_select(&report_decoder, profile, &report_layout);
+    desc_cache_close(&cache);
+    usb_session_mark(&session, "descriptors");
 
     fprintf(stderr, "Reading raw HID input from device (Press Ctrl+C to stop):\n");
     fprintf(stderr, "Endpoint Address: 0x%02x, Interface: %d, Max Packet Size: %d\n", endpoint_address, interface_number, max_packet_size);
     // Removed 2-second time limit for continuous polling
-    fprintf(stderr, "DEBUG: Entering continuous polling loop.\n");
-
-    while (1) { // Continuous polling
-        r = libusb_interrupt_transfer(handle, endpoint_address, data, max_packet_size, &actual_length, 100); // Shorter timeout for 10Hz
-        if (r == LIBUSB_ERROR_TIMEOUT) {
-            // No need to print dots, just continue polling without new output if no data
-            continue; 
-        } else if (r < 0) {
-            if (r == LIBUSB_ERROR_NO_DEVICE) {
-                fprintf(stderr, "\nERROR: Device disconnected. Exiting.\n");
-                break; // Exit the loop
-            } else if (r == LIBUSB_ERROR_PIPE) {
-                 fprintf(stderr, "libusb_interrupt_transfer error: LIBUSB_ERROR_PIPE (endpoint halted). Retrying...\n");
-                 libusb_clear_halt(handle, endpoint_address);
-                 usleep(100000); // Wait 100ms before retrying
-                 continue;
-            }
-            fprintf(stderr, "libusb_interrupt_transfer failed: %s\n", libusb_error_name(r));
-            break;
-        }
+    if (async_mode) {
+        fprintf(stderr, "DEBUG: Entering async polling loop (%d transfers queued).\n", queue_depth);
+        r = read_gamepad_async(context, handle, endpoint_address, queue_depth, max_packet_size, &queue);
+    } else {
+        fprintf(stderr, "DEBUG: Entering continuous polling loop.\n");
+        r = read_gamepad_sync(handle, endpoint_address, max_packet_size);
+    }
 
-        if (actual_length > 0) {
-            // Removed raw byte printing here to rely solely on interpret_gamepad_report
-            interpret_gamepad_report(data, actual_length); // Call the interpretation function
+    finish_screen();
+    if (event_mode) {
+        fprintf(stderr, "DEBUG: %llu reports (%llu bytes), %llu identical ones dropped, %llu events in %llu bytes written\n",
+                (unsigned long long)events.reports, (unsigned long long)events.reports * sizeof(GamepadReport),
+                (unsigned long long)events.identical, (unsigned long long)events.events,
+                (unsigned long long)events.bytes);
+        if (reports_skipped) {
+            fprintf(stderr, "WARN: %llu reports were not 20 bytes long and were ignored\n", (unsigned long long)reports_skipped);
         }
+    } else {
+        fprintf(stderr, "DEBUG: %llu reports, %llu identical ones skipped, %llu frames, %llu bytes written to the terminal\n",
+                (unsigned long long)reports_received, (unsigned long long)reports_skipped,
+                (unsigned long long)frame.frames, (unsigned long long)frame.bytes);
     }
-
-    // Cleanup upon successful exit or break from loop
-    libusb_release_interface(handle, interface_number);
-    if (kernel_driver_active) {
-        libusb_attach_kernel_driver(handle, interface_number); // Reattach if we detached it
+    if (state_path) {
+        fprintf(stderr, "DEBUG: %llu reports published to %s\n", (unsigned long long)state_shm.sequence, state_path);
     }
-    
-    libusb_close(handle);
-    libusb_exit(context);
-    return 0;
+    latency_print(&report_latency, stderr);
+
+    usb_session_report(&session);
+    usb_session_close(&session);
+    usb_async_free(&queue);
+    gamepad_shm_close(&state_shm);
+    return r == 0 ? 0 : 1;
 
 error_exit_with_handle:
-    if (handle) { // Only close handle if it was successfully opened
-        libusb_close(handle);
-    }
-    // Fall through to common context exit
-// error_exit_no_config: // Label removed as it's not needed for this simplified code
-    if (context) { // Only exit context if it was successfully initialized
-        libusb_exit(context);
-    }
+    usb_session_close(&session);
+    gamepad_shm_close(&state_shm);
     return 1;
 }
\ No newline at end of file
@@ -5,9 +5,15 @@
 #include <errno.h>
 #include <unistd.h> // For close
 #include <string.h> // For memset
+#include <signal.h>
+#include <getopt.h>
 
-#define VENDOR_ID 0x045e // ZhiXu Controller Vendor ID
-#define PRODUCT_ID 0x028e // ZhiXu Controller Product ID
+#include "gamepad_decode.h"
+#include "../common/capture.h"
+#include "../common/usb_async.h"
+#include "../common/usb_wait.h"
+#include "../common/usb_session.h"
+#include "../common/usb_profiles.h"
 
 // Helper function to convert transfer type to string for better readability
 const char* libusb_transfer_type_to_string(enum libusb_transfer_type type) {
@@ -20,74 +26,58 @@ const char* libusb_transfer_type_to_string(enum libusb_transfer_type type) {
     }
 }
 
-int main(int argc, char **argv) {
-    setvbuf(stdout, NULL, _IONBF, 0);
-    libusb_context *context = NULL;
-    libusb_device_handle *handle = NULL;
-    int fd = -1;
-    int r = 0;
-    unsigned char data[32]; // Max packet size is 32 bytes from descriptor dump
-    int actual_length;
-    int interface_number = 0; // Interface 0 based on descriptor dump
-    int endpoint_address = 0x81; // Interrupt IN endpoint 0x81 based on descriptor dump
-    int max_packet_size = 32;
+static CaptureWriter capture;           // -w: every transfer is also written here
+static int capturing = 0;
+static uint8_t capture_endpoint;
+static volatile sig_atomic_t stop_requested = 0;
+static UsbWait waiter;
+static UsbSession session;
 
-    if (argc < 2 || sscanf(argv[1], "%d", &fd) != 1) {
-        fprintf(stderr, "Usage: %s <file_descriptor>\n", argv[0]);
-        return 1;
-    }
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+    usb_wait_wake(&waiter); // the capture thread may be the one that got the signal
+}
 
-    libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
-    r = libusb_init(&context);
-    if (r < 0) {
-        fprintf(stderr, "libusb_init failed: %s\n", libusb_error_name(r));
-        return 1;
-    }
-    fprintf(stderr, "DEBUG: libusb_init successful.\n");
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-a | -S] [-q depth] [-w file] <file_descriptor>\n", prog);
+    fprintf(stderr, "  -a        Asynchronous mode (default): keep several interrupt transfers queued\n");
+    fprintf(stderr, "  -S        Synchronous mode: one blocking transfer at a time, wakes up every 100 ms\n");
+    fprintf(stderr, "  -q depth  Transfers kept in flight in asynchronous mode (default 8)\n");
+    fprintf(stderr, "  -w file   Also write every report to a capture file (see util/capture_dump)\n");
+}
 
-    r = libusb_wrap_sys_device(context, (intptr_t)fd, &handle);
-    if (r < 0) {
-        fprintf(stderr, "libusb_wrap_sys_device failed: %s\n", libusb_error_name(r));
-        libusb_exit(context);
-        return 1;
-    }
-    fprintf(stderr, "DEBUG: libusb_wrap_sys_device successful. Handle obtained.\n");
-
-    // Try to detach kernel driver if one is active for Interface 0
-    int kernel_driver_active = 0; 
-    fprintf(stderr, "DEBUG: Checking for active kernel driver on interface %d.\n", interface_number);
-    if (libusb_kernel_driver_active(handle, interface_number) == 1) {
-        fprintf(stderr, "DEBUG: Kernel driver active. Attempting to detach.\n");
-        r = libusb_detach_kernel_driver(handle, interface_number);
-        if (r < 0) {
-            fprintf(stderr, "libusb_detach_kernel_driver failed (interface %d): %s\n", interface_number, libusb_error_name(r));
-            goto error_exit_with_handle;
-        }
-        kernel_driver_active = 1;
-        fprintf(stderr, "DEBUG: Kernel driver detached.\n");
-    } else {
-        fprintf(stderr, "DEBUG: No active kernel driver found or already detached.\n");
+static void print_report(const unsigned char *data, int actual_length) {
+    usb_session_first_data(&session);
+    if (capturing) capture_record(&capture, capture_endpoint, 0, data, actual_length);
+    fprintf(stderr, "Received %d bytes: ", actual_length);
+    for (int i = 0; i < actual_length; ++i) {
+        fprintf(stderr, "%02x ", data[i]);
     }
+    fprintf(stderr, "\n");
+}
 
-    fprintf(stderr, "DEBUG: Attempting to claim interface %d.\n", interface_number);
-    r = libusb_claim_interface(handle, interface_number);
-    if (r < 0) {
-        fprintf(stderr, "libusb_claim_interface failed (interface %d): %s\n", interface_number, libusb_error_name(r));
-        if (kernel_driver_active) {
-            fprintf(stderr, "DEBUG: Reattaching kernel driver.\n");
-            libusb_attach_kernel_driver(handle, interface_number); // Reattach if we detached it
-        }
-        goto error_exit_with_handle;
-    }
-    fprintf(stderr, "DEBUG: Interface %d claimed successfully.\n", interface_number);
+// Async completion callback, runs inside libusb_handle_events*().
+static int on_report(void *user, const unsigned char *data, int length) {
+    (void)user;
+    print_report(data, length);
+    return stop_requested;
+}
 
-    fprintf(stderr, "Reading raw HID input from device (Press Ctrl+C to stop):\n");
-    fprintf(stderr, "Endpoint Address: 0x%02x, Interface: %d, Max Packet Size: %d\n", endpoint_address, interface_number, max_packet_size);
-    fprintf(stderr, "DEBUG: Entering polling loop.\n");
+// One blocking transfer at a time (original loop). Returns 0 when stopped,
+// or the libusb error that ended it.
+static int read_gamepad_sync(libusb_device_handle *handle, int endpoint_address, int max_packet_size) {
+    unsigned char data[GAMEPAD_MAX_REPORT];
+    int actual_length;
+    int r = 0;
+
+    if (max_packet_size > (int)sizeof(data)) max_packet_size = sizeof(data);
 
-    while (1) {
+    while (!stop_requested) {
         r = libusb_interrupt_transfer(handle, endpoint_address, data, max_packet_size, &actual_length, 100); // Shorter timeout for more frequent dots
-        if (r == LIBUSB_ERROR_TIMEOUT) {
+        if (r == LIBUSB_ERROR_INTERRUPTED) {
+            continue;
+        } else if (r == LIBUSB_ERROR_TIMEOUT) {
             fprintf(stderr, "."); // Indicate polling
             fflush(stdout); // Ensure the dot is printed immediately
             continue; // No data received yet, continue polling
@@ -106,32 +96,145 @@ int main(int argc, char **argv) {
         }
 
         if (actual_length > 0) {
-            fprintf(stderr, "Received %d bytes: ", actual_length);
-            for (int i = 0; i < actual_length; ++i) {
-                fprintf(stderr, "%02x ", data[i]);
+            print_report(data, actual_length);
+        }
+    }
+    return stop_requested ? 0 : r;
+}
+
+// Keep `depth` interrupt transfers queued on the endpoint until Ctrl+C or a
+// fatal error. The transfers have no timeout, so there are no polling dots:
+// the loop sleeps until the pad sends something.
+static int read_gamepad_async(libusb_context *context, libusb_device_handle *handle, int endpoint_address,
+                              int depth, int max_packet_size, usb_async_queue *q) {
+    int r = usb_wait_init(&waiter, context);
+    if (r < 0) {
+        fprintf(stderr, "Failed to set up the event loop: %s\n", libusb_error_name(r));
+        return r;
+    }
+    r = usb_async_start(q, handle, endpoint_address, LIBUSB_TRANSFER_TYPE_INTERRUPT, depth, max_packet_size, 0, on_report, NULL);
+    if (r < 0) {
+        fprintf(stderr, "Failed to start async transfers: %s\n", libusb_error_name(r));
+        usb_async_cancel(q, context);
+        usb_wait_close(&waiter);
+        return r;
+    }
+
+    while (!stop_requested && !q->stopped) {
+        r = usb_wait_events(&waiter, -1);
+        if (r < 0) {
+            fprintf(stderr, "libusb_handle_events failed: %s\n", libusb_error_name(r));
+            break;
+        }
+        if (q->stalled) {
+            fprintf(stderr, "libusb_interrupt_transfer error: LIBUSB_ERROR_PIPE (endpoint halted). Retrying...\n");
+            r = libusb_clear_halt(handle, endpoint_address);
+            if (r < 0) {
+                fprintf(stderr, "ERROR: Could not clear halt: %s\n", libusb_error_name(r));
+                break;
+            }
+            r = usb_async_resubmit(q);
+            if (r < 0) {
+                fprintf(stderr, "ERROR: Could not resubmit transfers after clearing the halt: %s\n", libusb_error_name(r));
+                break;
             }
-            fprintf(stderr, "\n");
         }
     }
 
-    // Cleanup upon successful exit or break from loop
-    libusb_release_interface(handle, interface_number);
-    if (kernel_driver_active) {
-        libusb_attach_kernel_driver(handle, interface_number); // Reattach if we detached it
+    if (q->error == LIBUSB_TRANSFER_NO_DEVICE) {
+        fprintf(stderr, "\nERROR: Device disconnected. Exiting.\n");
+    } else if (q->error) {
+        fprintf(stderr, "libusb_interrupt_transfer failed: transfer status %d\n", q->error);
     }
-    
-    libusb_close(handle);
-    libusb_exit(context);
-    return 0;
+    usb_async_cancel(q, context);
+    usb_wait_close(&waiter);
+    return q->error ? LIBUSB_ERROR_IO : r;
+}
 
-error_exit_with_handle:
-    if (handle) { // Only close handle if it was successfully opened
-        libusb_close(handle);
+int main(int argc, char **argv) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+    libusb_context *context = NULL;
+    libusb_device_handle *handle = NULL;
+    int fd = -1;
+    int r = 0;
+    int max_packet_size = 32;           // Xbox 360 pads; the endpoint's own size once it is known
+    usb_async_queue queue = {0};
+    int async_mode = 1;
+    int queue_depth = 8;
+    const char *capture_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "aSq:w:")) != -1) {
+        switch (opt) {
+            case 'a': async_mode = 1; break;
+            case 'S': async_mode = 0; break;
+            case 'q': queue_depth = atoi(optarg); break;
+            case 'w': capture_path = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || sscanf(argv[optind], "%d", &fd) != 1 || queue_depth < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Ctrl+C ends the loop so the interface is released and the capture file completed.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (usb_session_open(&session, fd) < 0) {
+        return 1;
     }
-    // Fall through to common context exit
-// error_exit_no_config: // Label removed as it's not needed for this simplified code
-    if (context) { // Only exit context if it was successfully initialized
-        libusb_exit(context);
+    context = session.ctx;
+    handle = session.handle;
+
+    const UsbProfile *profile = usb_profile_find(handle, USB_KIND_GAMEPAD);
+    int interface_number = profile->interface;
+    int endpoint_address = profile->endpoint_in;
+    if (usb_session_claim(&session, interface_number) < 0) {
+        goto error_exit_with_handle;
     }
+    // A whole packet: a report longer than the transfer would end it with an overflow.
+    int packet_size = libusb_get_max_packet_size(libusb_get_device(handle), endpoint_address);
+    if (packet_size > 0) max_packet_size = packet_size < GAMEPAD_MAX_REPORT ? packet_size : GAMEPAD_MAX_REPORT;
+
+    fprintf(stderr, "Reading raw HID input from device (Press Ctrl+C to stop):\n");
+    fprintf(stderr, "Endpoint Address: 0x%02x, Interface: %d, Max Packet Size: %d\n", endpoint_address, interface_number, max_packet_size);
+    if (capture_path) {
+        if (capture_open(&capture, capture_path) < 0) {
+            fprintf(stderr, "ERROR: Cannot create capture file %s: %s\n", capture_path, strerror(errno));
+            goto error_exit_with_handle;
+        }
+        capturing = 1;
+        capture_endpoint = (uint8_t)endpoint_address;
+        fprintf(stderr, "DEBUG: Writing reports to %s.\n", capture_path);
+    }
+    if (async_mode) {
+        fprintf(stderr, "DEBUG: Entering async polling loop (%d transfers queued).\n", queue_depth);
+        r = read_gamepad_async(context, handle, endpoint_address, queue_depth, max_packet_size, &queue);
+    } else {
+        fprintf(stderr, "DEBUG: Entering polling loop.\n");
+        r = read_gamepad_sync(handle, endpoint_address, max_packet_size);
+    }
+
+    if (capture_path) {
+        if (capture_close(&capture) < 0) {
+            fprintf(stderr, "ERROR: Writing %s failed: %s\n", capture_path, strerror(errno));
+        }
+        fprintf(stderr, "\nDEBUG: Captured %llu reports (%llu bytes), %llu dropped.\n",
+                (unsigned long long)capture.records, (unsigned long long)capture.bytes_written,
+                (unsigned long long)capture.dropped);
+    }
+
+    usb_session_report(&session);
+    usb_session_close(&session);
+    usb_async_free(&queue);
+    return r == 0 ? 0 : 1;
+
+error_exit_with_handle:
+    usb_session_close(&session);
     return 1;
 }
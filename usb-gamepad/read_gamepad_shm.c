@@ -0,0 +1,121 @@
+// Reader example for the shared-memory state of read_gamepad -m.
+//
+// Maps the file read-only and polls it: every time the sequence number has
+// moved on, prints the state with its age (now minus the time the report's
+// transfer completed). Polling is a few loads from memory, no system call
+// except the sleep between polls.
+//
+// Usage: read_gamepad_shm [-i interval_ms] [-n count] <file>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gamepad_decode.h"
+#include "gamepad_events.h"
+#include "gamepad_shm.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-i interval_ms] [-n count] <file>\n", prog);
+    fprintf(stderr, "  -i ms     Poll every this many milliseconds (default 100, 0: spin)\n");
+    fprintf(stderr, "  -n count  Stop after printing this many states (default: until Ctrl+C)\n");
+    fprintf(stderr, "The file is the one given to read_gamepad -m.\n");
+}
+
+static void print_state(const GamepadShmState *st, uint64_t now) {
+    const GamepadReport *r = &st->report;
+    char pressed[128];
+    size_t len = 0;
+    uint16_t buttons = gamepad_events_buttons(r);
+
+    pressed[0] = '\0';
+    for (int b = 0; b < GAMEPAD_EVENTS_NUM_BUTTONS; b++) {
+        if (!(buttons & (1u << b))) continue;
+        len += (size_t)snprintf(pressed + len, sizeof(pressed) - len, " %s", gamepad_event_button_names[b]);
+        if (len >= sizeof(pressed)) break;
+    }
+    printf("seq=%llu age=%.3f ms LX=%d LY=%d RX=%d RY=%d LT=%u RT=%u%s\n", (unsigned long long)st->sequence,
+           now > st->timestamp_ns ? (double)(now - st->timestamp_ns) / 1e6 : 0.0, r->left_x, r->left_y,
+           r->right_x, r->right_y, r->trigger_left, r->trigger_right, pressed);
+}
+
+int main(int argc, char **argv) {
+    int interval_ms = 100;
+    long count = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+        switch (opt) {
+            case 'i': interval_ms = atoi(optarg); break;
+            case 'n': count = atol(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || interval_ms < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    GamepadShm shm;
+    if (gamepad_shm_open(&shm, argv[optind]) < 0) {
+        fprintf(stderr, "ERROR: Cannot map %s: %s\n", argv[optind],
+                errno == EAGAIN ? "read_gamepad has not set it up yet" : strerror(errno));
+        return 1;
+    }
+
+    uint64_t last_sequence = 0;
+    uint64_t reads = 0, retries = 0, printed = 0;
+    int warned_stale = 0;
+    struct timespec pause = { interval_ms / 1000, (long)(interval_ms % 1000) * 1000000L };
+
+    while (!stop_requested && (count < 0 || (long)printed < count)) {
+        GamepadShmState st;
+        int r = gamepad_shm_read(&shm, &st);
+        reads++;
+        if (r < 0) {
+            fprintf(stderr, "WARN: The state stayed locked; the writer may have died while storing it.\n");
+        } else {
+            retries += (uint64_t)r;
+            if (st.sequence != last_sequence && st.sequence != 0) {
+                print_state(&st, now_ns());
+                last_sequence = st.sequence;
+                printed++;
+            }
+        }
+        if (!gamepad_shm_writer_alive(&shm)) {
+            if (!warned_stale) fprintf(stderr, "WARN: read_gamepad has exited, the state is no longer updated.\n");
+            warned_stale = 1;
+        } else {
+            warned_stale = 0;
+        }
+        if (interval_ms > 0) nanosleep(&pause, NULL);
+    }
+
+    fprintf(stderr, "DEBUG: %llu reads, %llu retries, %llu states printed\n", (unsigned long long)reads,
+            (unsigned long long)retries, (unsigned long long)printed);
+    gamepad_shm_unmap(&shm);
+    return 0;
+}
@@ -5,23 +5,33 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "../common/hid_parser.h"
+
+// Largest report the tools read. Boot mice send 3 to 8 bytes, high-resolution
+// and gaming mice up to 16; a full-speed interrupt endpoint carries at most 64.
+#define MOUSE_MAX_REPORT 64
+
 // Struct for a USB HID mouse report
 typedef struct {
     uint8_t buttons;    // buttons bitmap (Bit 0=Left, Bit 1=Right, Bit 2=Middle)
-    int8_t  x;          // delta X
-    int8_t  y;          // delta Y
-    int8_t  wheel;      // vertical scroll wheel
+    int16_t x;          // delta X
+    int16_t y;          // delta Y
+    int16_t wheel;      // vertical scroll wheel
+    int16_t hwheel;     // horizontal scroll (AC Pan), 0 if the mouse has none
 } MouseReport;
 
-// Decode and print a single report
+// Decode a single report with the fixed layout of the original test mouse:
+// report ID, buttons, X and Y as 16-bit little endian deltas, wheel and,
+// in an 8-byte report, AC Pan.
 static inline MouseReport interpret_mouse_report(const uint8_t* data, size_t len) {
     MouseReport report = {0};
 
     if (len >= 7) { // Expect at least 7 bytes
         report.buttons = data[1];
-        report.x = (int8_t)data[2];
-        report.y = (int8_t)data[4];
+        report.x = (int16_t)(data[2] | data[3] << 8);
+        report.y = (int16_t)(data[4] | data[5] << 8);
         report.wheel = (int8_t)data[6];
+        if (len >= 8) report.hwheel = (int8_t)data[7];
     } else {
         fprintf(stderr, "Warning: Expected at least 7 bytes, but received %zu bytes for interpretation.\n", len);
     }
@@ -29,4 +39,78 @@ static inline MouseReport interpret_mouse_report(const uint8_t* data, size_t len
     return report;
 }
 
+/*
+ * Layout compiled from the interface's HID report descriptor
+ * (common/hid_parser.h): the four fields the tools use, pulled out of the
+ * plan once so decoding a report is a handful of extractions.
+ */
+typedef struct {
+    int valid;          // 0: fall back to interpret_mouse_report()
+    uint8_t report_id;  // reports with another ID are ignored
+    HidField buttons;   // buttons 1..n as one bit field
+    HidField x;
+    HidField y;
+    HidField wheel;     // bit_size 0 if the mouse has no wheel
+    HidField hwheel;    // AC Pan on the consumer page, bit_size 0 if absent
+} MouseLayout;
+
+// Bind the layout to `plan`. Returns 0, or -1 if the plan has no X/Y motion.
+static inline int mouse_layout_from_plan(MouseLayout *layout, const HidPlan *plan) {
+    memset(layout, 0, sizeof(*layout));
+    int x = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_X);
+    int y = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_Y);
+    if (x < 0 || y < 0 || plan->fields[x].report_id != plan->fields[y].report_id) return -1;
+
+    layout->report_id = plan->fields[x].report_id;
+    layout->x = plan->fields[x];
+    layout->y = plan->fields[y];
+
+    int wheel = hid_plan_find(plan, HID_PAGE_GENERIC_DESKTOP, HID_USAGE_WHEEL);
+    if (wheel >= 0 && plan->fields[wheel].report_id == layout->report_id) {
+        layout->wheel = plan->fields[wheel];
+    }
+    int pan = hid_plan_find(plan, HID_PAGE_CONSUMER, HID_USAGE_AC_PAN);
+    if (pan >= 0 && plan->fields[pan].report_id == layout->report_id) {
+        layout->hwheel = plan->fields[pan];
+    }
+
+    // Button 1 and the buttons packed right after it, up to 8.
+    int b = hid_plan_find(plan, HID_PAGE_BUTTON, 1);
+    if (b >= 0 && plan->fields[b].report_id == layout->report_id && plan->fields[b].bit_size == 1) {
+        layout->buttons = plan->fields[b];
+        for (int i = b + 1; i < plan->count && layout->buttons.bit_size < 8; i++) {
+            const HidField *f = &plan->fields[i];
+            if (f->usage_page != HID_PAGE_BUTTON || f->bit_size != 1 || f->report_id != layout->report_id ||
+                f->bit_offset != layout->buttons.bit_offset + layout->buttons.bit_size) {
+                break;
+            }
+            layout->buttons.bit_size++;
+        }
+    }
+    layout->valid = 1;
+    return 0;
+}
+
+static inline int16_t mouse_clamp16(int32_t v) {
+    return (int16_t)(v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v);
+}
+
+// Decode `data` with `layout`, or with the fixed layout if it is not valid.
+// Returns 0, or -1 if the report is not a mouse report (other report ID).
+static inline int decode_mouse_report(const MouseLayout *layout, const uint8_t *data, size_t len, MouseReport *out) {
+    if (!layout->valid) {
+        *out = interpret_mouse_report(data, len);
+        return 0;
+    }
+    int n = (int)len;
+    if (layout->report_id && (n < 1 || data[0] != layout->report_id)) return -1;
+
+    out->buttons = layout->buttons.bit_size ? (uint8_t)hid_field_value(&layout->buttons, data, n) : 0;
+    out->x = mouse_clamp16(hid_field_value(&layout->x, data, n));
+    out->y = mouse_clamp16(hid_field_value(&layout->y, data, n));
+    out->wheel = layout->wheel.bit_size ? mouse_clamp16(hid_field_value(&layout->wheel, data, n)) : 0;
+    out->hwheel = layout->hwheel.bit_size ? mouse_clamp16(hid_field_value(&layout->hwheel, data, n)) : 0;
+    return 0;
+}
+
 #endif // MOUSE_DECODE_H
\ No newline at end of file
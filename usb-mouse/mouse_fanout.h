@@ -0,0 +1,361 @@
+#ifndef MOUSE_FANOUT_H
+#define MOUSE_FANOUT_H
+
+/*
+ * Fan-out of decoded mouse reports to local subscribers over a Unix socket
+ *
+ * read_mouse -p <socket> listens on a SOCK_SEQPACKET Unix socket; every
+ * program that connects (a recorder, a visualiser, a game) gets every
+ * decoded report as one MouseFanoutEvent message. A path starting with
+ * '@' is an abstract socket (no file, nothing to clean up), which also
+ * works where the file system is not shared, e.g. between Termux and
+ * another app.
+ *
+ * Each subscriber has a queue of its own, a ring of `capacity` events.
+ * A report is appended to every queue; when a queue is full its oldest
+ * event is dropped and counted, so a subscriber that stops reading loses
+ * old motion, never the newest, and the reader never waits for it. After
+ * each pass of the event loop the queues are sent with one
+ * sendmmsg(MSG_DONTWAIT) per subscriber, as many events per call as are
+ * queued. A subscriber whose socket buffer is full is left alone until
+ * its socket is writable again (EPOLLOUT on the fan-out's own epoll set,
+ * which the caller's loop watches), so a slow subscriber costs the USB
+ * loop one failed send, not a delay. Events carry the report's sequence
+ * number, so a subscriber sees from the gaps how many it lost.
+ *
+ * The subscriber sockets get a small send buffer: with the default one the
+ * kernel would hold a few hundred events that can no longer be dropped,
+ * and a slow subscriber would see motion from a quarter second ago.
+ *
+ * Usage:
+ *   MouseFanout fanout;
+ *   if (mouse_fanout_open(&fanout, "@read_mouse", 256) < 0) perror(...);
+ *   usb_wait_watch(&waiter, mouse_fanout_fd(&fanout));
+ *   mouse_fanout_publish(&fanout, &report, complete_ns);  // every report
+ *   if (waiter.watched_ready) mouse_fanout_service(&fanout); // connects, hangups, writable
+ *   mouse_fanout_flush(&fanout);                            // after each loop pass
+ *   mouse_fanout_print(&fanout, stderr);
+ *   mouse_fanout_close(&fanout);
+ *
+ * sendmmsg() and accept4() need _GNU_SOURCE, defined before the first
+ * #include of the program.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "mouse_decode.h"
+
+#define MOUSE_FANOUT_MAX_SUBSCRIBERS 16
+#define MOUSE_FANOUT_BATCH 64          // events per sendmmsg() call
+#define MOUSE_FANOUT_DEFAULT_QUEUE 256 // events per subscriber, ~32 ms at 8 kHz
+#define MOUSE_FANOUT_SNDBUF 4096       // socket buffer per subscriber: a few dozen events
+
+// One message on the socket, in host byte order (the subscribers run on
+// the same machine).
+typedef struct {
+    uint64_t time_ns;       // CLOCK_MONOTONIC when the report's transfer completed
+    uint32_t sequence;      // report number, 1 for the first; a gap means events were dropped
+    uint8_t buttons;        // bit 0 left, 1 right, 2 middle, ...
+    uint8_t reserved[3];
+    int16_t dx;             // motion in counts
+    int16_t dy;
+    int16_t wheel;
+    int16_t hwheel;
+} MouseFanoutEvent;
+
+_Static_assert(sizeof(MouseFanoutEvent) == 24, "MouseFanoutEvent is part of the socket protocol");
+
+typedef struct {
+    int fd;                 // -1: slot unused or subscriber gone
+    int id;                 // 1 for the first subscriber of the run
+    MouseFanoutEvent *queue;
+    uint32_t head;          // next event to queue
+    uint32_t tail;          // next event to send; head - tail is the depth
+    uint32_t max_depth;
+    int blocked;            // socket full, waiting for EPOLLOUT
+
+    uint64_t sent;
+    uint64_t sends;         // sendmmsg() calls that sent something
+    uint64_t dropped;
+} MouseFanoutSubscriber;
+
+typedef struct {
+    int listen_fd;
+    int epfd;               // listening socket and subscribers, for mouse_fanout_service()
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    uint32_t capacity;      // power of two
+    uint32_t sequence;
+    int next_id;
+    int pending;            // events queued since the last flush
+
+    MouseFanoutSubscriber subs[MOUSE_FANOUT_MAX_SUBSCRIBERS];
+    uint64_t refused;       // connections closed because every slot was live
+    int gone;               // subscribers whose slot was reused, and their totals
+    uint64_t gone_sent;
+    uint64_t gone_dropped;
+} MouseFanout;
+
+#define MOUSE_FANOUT_LISTENER MOUSE_FANOUT_MAX_SUBSCRIBERS   // epoll tag of the listening socket
+
+static inline int mouse_fanout_fd(const MouseFanout *f) {
+    return f->epfd;
+}
+
+static inline uint32_t mouse_fanout_depth(const MouseFanoutSubscriber *s) {
+    return s->head - s->tail;
+}
+
+// Listen on `path` ('@name': abstract) with room for `capacity` events per
+// subscriber (rounded up to a power of two). Returns 0, or -1 with errno
+// set (EADDRINUSE: another read_mouse is serving that path).
+static inline int mouse_fanout_open(MouseFanout *f, const char *path, unsigned int capacity) {
+    memset(f, 0, sizeof(*f));
+    f->listen_fd = -1;
+    f->epfd = -1;
+    for (int i = 0; i < MOUSE_FANOUT_MAX_SUBSCRIBERS; i++) f->subs[i].fd = -1;
+    for (f->capacity = 1; f->capacity < capacity; f->capacity <<= 1) {
+    }
+
+    size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(f->addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    f->addr.sun_family = AF_UNIX;
+    memcpy(f->addr.sun_path, path, len);
+    if (path[0] == '@') f->addr.sun_path[0] = '\0';
+    f->addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len + (path[0] == '@' ? 0 : 1));
+
+    f->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (f->listen_fd < 0) return -1;
+    if (path[0] != '@') {
+        // A socket file left by a reader that crashed would make bind() fail;
+        // one that still answers belongs to a live reader. Anything but a
+        // socket is left alone (EEXIST).
+        int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr *)&f->addr, f->addr_len) == 0;
+        if (probe >= 0) close(probe);
+        struct stat st;
+        int other = !live && lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode);
+        if (live || other) {
+            close(f->listen_fd);
+            f->listen_fd = -1;
+            errno = live ? EADDRINUSE : EEXIST;
+            return -1;
+        }
+        unlink(path);
+    }
+    f->epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN;
+    ev.data.u32 = MOUSE_FANOUT_LISTENER;
+    if (bind(f->listen_fd, (struct sockaddr *)&f->addr, f->addr_len) < 0 || listen(f->listen_fd, 8) < 0 ||
+        f->epfd < 0 || epoll_ctl(f->epfd, EPOLL_CTL_ADD, f->listen_fd, &ev) < 0) {
+        int err = errno;
+        close(f->listen_fd);
+        if (f->epfd >= 0) close(f->epfd);
+        f->listen_fd = f->epfd = -1;
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static inline void mouse_fanout_drop_subscriber(MouseFanout *f, MouseFanoutSubscriber *s) {
+    epoll_ctl(f->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    s->fd = -1;
+    s->blocked = 0;
+    s->dropped += mouse_fanout_depth(s); // queued but never sent
+    s->tail = s->head;
+}
+
+// Wait for the subscriber's socket to take more (EPOLLOUT) or only for a hangup.
+static inline void mouse_fanout_arm(MouseFanout *f, MouseFanoutSubscriber *s, int blocked) {
+    struct epoll_event ev = { 0 };
+    ev.events = blocked ? EPOLLOUT : 0; // EPOLLHUP and EPOLLERR are always reported
+    ev.data.u32 = (uint32_t)(s - f->subs);
+    epoll_ctl(f->epfd, EPOLL_CTL_MOD, s->fd, &ev);
+    s->blocked = blocked;
+}
+
+// Send what `s` has queued without blocking, MOUSE_FANOUT_BATCH events per call.
+static inline void mouse_fanout_send(MouseFanout *f, MouseFanoutSubscriber *s) {
+    struct mmsghdr msgs[MOUSE_FANOUT_BATCH];
+    struct iovec iov[MOUSE_FANOUT_BATCH];
+
+    while (mouse_fanout_depth(s) > 0) {
+        uint32_t n = mouse_fanout_depth(s);
+        if (n > MOUSE_FANOUT_BATCH) n = MOUSE_FANOUT_BATCH;
+        for (uint32_t i = 0; i < n; i++) {
+            iov[i].iov_base = &s->queue[(s->tail + i) & (f->capacity - 1)];
+            iov[i].iov_len = sizeof(MouseFanoutEvent);
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int r = sendmmsg(s->fd, msgs, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                mouse_fanout_arm(f, s, 1);
+            } else {
+                mouse_fanout_drop_subscriber(f, s); // EPIPE, ECONNRESET: it went away
+            }
+            return;
+        }
+        s->tail += (uint32_t)r;
+        s->sent += (uint64_t)r;
+        s->sends++;
+        if ((uint32_t)r < n) {
+            mouse_fanout_arm(f, s, 1); // the socket buffer filled up part way
+            return;
+        }
+    }
+}
+
+static inline void mouse_fanout_accept(MouseFanout *f) {
+    for (;;) {
+        int fd = accept4(f->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return; // EAGAIN: no more pending connections
+
+        // A free slot, else the slot of a subscriber that left (its totals are kept).
+        MouseFanoutSubscriber *s = NULL;
+        for (int i = 0; i < MOUSE_FANOUT_MAX_SUBSCRIBERS && !s; i++) {
+            if (f->subs[i].fd < 0 && f->subs[i].id == 0) s = &f->subs[i];
+        }
+        for (int i = 0; i < MOUSE_FANOUT_MAX_SUBSCRIBERS && !s; i++) {
+            if (f->subs[i].fd < 0) {
+                s = &f->subs[i];
+                f->gone++;
+                f->gone_sent += s->sent;
+                f->gone_dropped += s->dropped;
+            }
+        }
+        if (s && !s->queue) s->queue = malloc(f->capacity * sizeof(MouseFanoutEvent));
+        if (!s || !s->queue) {
+            close(fd);
+            f->refused++;
+            continue;
+        }
+        int sndbuf = MOUSE_FANOUT_SNDBUF;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        MouseFanoutEvent *queue = s->queue;
+        memset(s, 0, sizeof(*s));
+        s->queue = queue;
+        s->fd = fd;
+        s->id = ++f->next_id;
+
+        struct epoll_event ev = { 0 };
+        ev.data.u32 = (uint32_t)(s - f->subs);
+        epoll_ctl(f->epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+// Queue one decoded report for every subscriber.
+static inline void mouse_fanout_publish(MouseFanout *f, const MouseReport *report, uint64_t complete_ns) {
+    MouseFanoutEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.time_ns = complete_ns;
+    ev.sequence = ++f->sequence;
+    ev.buttons = report->buttons;
+    ev.dx = report->x;
+    ev.dy = report->y;
+    ev.wheel = report->wheel;
+    ev.hwheel = report->hwheel;
+
+    for (int i = 0; i < MOUSE_FANOUT_MAX_SUBSCRIBERS; i++) {
+        MouseFanoutSubscriber *s = &f->subs[i];
+        if (s->fd < 0) continue;
+        if (mouse_fanout_depth(s) == f->capacity) {
+            s->tail++; // full: drop the oldest
+            s->dropped++;
+        }
+        s->queue[s->head++ & (f->capacity - 1)] = ev;
+        if (mouse_fanout_depth(s) > s->max_depth) s->max_depth = mouse_fanout_depth(s);
+        f->pending = 1;
+    }
+}
+
+// Send the queued events to every subscriber that can take them. Makes no
+// system call when nothing was published since the last flush.
+static inline void mouse_fanout_flush(MouseFanout *f) {
+    if (!f->pending) return;
+    f->pending = 0;
+    for (int i = 0; i < MOUSE_FANOUT_MAX_SUBSCRIBERS; i++) {
+        MouseFanoutSubscriber *s = &f->subs[i];
+        if (s->fd >= 0 && !s->blocked) mouse_fanout_send(f, s);
+    }
+}
+
+// Accept new subscribers, forget the ones that hung up, and send to the
+// ones whose socket has room again. Never blocks.
+static inline void mouse_fanout_service(MouseFanout *f) {
+    struct epoll_event events[MOUSE_FANOUT_MAX_SUBSCRIBERS + 1];
+    int n = epoll_wait(f->epfd, events, MOUSE_FANOUT_MAX_SUBSCRIBERS + 1, 0);
+    for (int i = 0; i < n; i++) {
+        uint32_t slot = events[i].data.u32;
+        if (slot == MOUSE_FANOUT_LISTENER) {
+            mouse_fanout_accept(f);
+            continue;
+        }
+        MouseFanoutSubscriber *s = &f->subs[slot];
+        if (s->fd < 0) continue;
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+            mouse_fanout_drop_subscriber(f, s);
+        } else if (events[i].events & EPOLLOUT) {
+            mouse_fanout_arm(f, s, 0);
+            mouse_fanout_send(f, s);
+        }
+    }
+}
+
+// One line per subscriber of this run: events sent, sendmmsg() calls,
+// events dropped, and the queue depth now and at its highest.
+static inline void mouse_fanout_print(const MouseFanout *f, FILE *out) {
+    fprintf(out, "DEBUG: Fan-out: %u reports, %d subscribers, queues of %u events\n",
+            f->sequence, f->next_id, f->capacity);
+    for (int i = 0; i < MOUSE_FANOUT_MAX_SUBSCRIBERS; i++) {
+        const MouseFanoutSubscriber *s = &f->subs[i];
+        if (s->id == 0) continue;
+        fprintf(out, "DEBUG:   subscriber %d%s: %llu sent in %llu sendmmsg calls, %llu dropped, queue depth %u (max %u)\n",
+                s->id, s->fd < 0 ? " (gone)" : s->blocked ? " (blocked)" : "", (unsigned long long)s->sent,
+                (unsigned long long)s->sends, (unsigned long long)s->dropped, mouse_fanout_depth(s), s->max_depth);
+    }
+    if (f->gone > 0) {
+        fprintf(out, "DEBUG:   %d earlier subscribers: %llu sent, %llu dropped\n", f->gone,
+                (unsigned long long)f->gone_sent, (unsigned long long)f->gone_dropped);
+    }
+    if (f->refused > 0) {
+        fprintf(out, "DEBUG:   %llu connections refused, all %d slots in use\n", (unsigned long long)f->refused,
+                MOUSE_FANOUT_MAX_SUBSCRIBERS);
+    }
+}
+
+static inline void mouse_fanout_close(MouseFanout *f) {
+    for (int i = 0; i < MOUSE_FANOUT_MAX_SUBSCRIBERS; i++) {
+        if (f->subs[i].fd >= 0) close(f->subs[i].fd);
+        f->subs[i].fd = -1;
+        free(f->subs[i].queue);
+        f->subs[i].queue = NULL;
+    }
+    if (f->listen_fd >= 0) {
+        close(f->listen_fd);
+        if (f->addr.sun_path[0] != '\0') unlink(f->addr.sun_path);
+    }
+    if (f->epfd >= 0) close(f->epfd);
+    f->listen_fd = f->epfd = -1;
+}
+
+#endif // MOUSE_FANOUT_H
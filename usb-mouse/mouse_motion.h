@@ -0,0 +1,69 @@
+#ifndef MOUSE_MOTION_H
+#define MOUSE_MOTION_H
+
+/*
+ * Mouse motion mapped onto a grid of character cells
+ *
+ * A high-resolution mouse reports thousands of counts per inch and at up to
+ * 8 kHz each report carries only a few of them, so adding the deltas to a
+ * cell position directly either races across the screen (one count per
+ * cell) or, scaled down with integer division, loses every report smaller
+ * than a cell. The position is kept in cells as Q16.16 fixed point instead:
+ * every delta is multiplied by the cells per count (Q16) and added, and the
+ * fraction of a cell left over carries into the next report. A report
+ * costs two multiplies and two clamps, whatever the rate.
+ *
+ * The position stops at the edges of the grid like the cursor does, so
+ * moving back from an edge starts at once instead of first undoing the
+ * motion that went past it.
+ *
+ * Usage:
+ *   MouseMotion m;
+ *   mouse_motion_init(&m, 40, 20, 100.0);        // 100 counts per cell
+ *   mouse_motion_add(&m, report.x, report.y);
+ *   draw_at(mouse_motion_cell_x(&m), mouse_motion_cell_y(&m));
+ */
+
+#include <stdint.h>
+
+#define MOUSE_MOTION_ONE 65536          // one cell in Q16.16
+
+typedef struct {
+    int32_t x;          // position in cells, Q16.16
+    int32_t y;
+    int32_t max_x;      // last position inside the last column / row
+    int32_t max_y;
+    int32_t gain;       // cells per count, Q16
+} MouseMotion;
+
+// Start in the middle of the center cell of a `width` x `height` grid;
+// `counts_per_cell` of motion move the cursor by one cell.
+static inline void mouse_motion_init(MouseMotion *m, int width, int height, double counts_per_cell) {
+    double gain = counts_per_cell > 0 ? MOUSE_MOTION_ONE / counts_per_cell + 0.5 : MOUSE_MOTION_ONE;
+    m->gain = gain < 1 ? 1 : gain > MOUSE_MOTION_ONE ? MOUSE_MOTION_ONE : (int32_t)gain;
+    m->max_x = width * MOUSE_MOTION_ONE - 1;
+    m->max_y = height * MOUSE_MOTION_ONE - 1;
+    m->x = (width / 2) * MOUSE_MOTION_ONE + MOUSE_MOTION_ONE / 2;
+    m->y = (height / 2) * MOUSE_MOTION_ONE + MOUSE_MOTION_ONE / 2;
+}
+
+static inline int32_t mouse_motion_step(int32_t pos, int32_t delta, int32_t gain, int32_t max) {
+    int64_t v = (int64_t)pos + (int64_t)delta * gain;
+    return v < 0 ? 0 : v > max ? max : (int32_t)v;
+}
+
+// Add one report's motion in counts.
+static inline void mouse_motion_add(MouseMotion *m, int32_t dx, int32_t dy) {
+    m->x = mouse_motion_step(m->x, dx, m->gain, m->max_x);
+    m->y = mouse_motion_step(m->y, dy, m->gain, m->max_y);
+}
+
+static inline int mouse_motion_cell_x(const MouseMotion *m) {
+    return m->x >> 16;
+}
+
+static inline int mouse_motion_cell_y(const MouseMotion *m) {
+    return m->y >> 16;
+}
+
+#endif // MOUSE_MOTION_H
@@ -0,0 +1,145 @@
+#ifndef MOUSE_PROFILES_H
+#define MOUSE_PROFILES_H
+
+/*
+ * Mouse decoders specialised per device profile
+ *
+ * decode_mouse_report() works for any mouse: every field is a HidField
+ * pulled out of the report descriptor at startup, so each report costs
+ * five bit extractions at offsets and sizes read from memory, with a
+ * branch per optional field and a clamp per value. For the mice in
+ * MOUSE_PROFILES() the layout is known when the program is compiled: the
+ * X-macro generates one decoder per mouse with its byte offsets and field
+ * widths as constants, which compiles to a length check, a report ID
+ * compare and a few byte loads.
+ *
+ * A profile is only trusted as far as the device agrees with it:
+ * mouse_decoder_select() compares the profile's layout with the one
+ * compiled from the report descriptor and falls back to the generic path
+ * on any difference (another firmware, another mode of the receiver).
+ * Without a descriptor the profile is used as is. A report shorter than
+ * the profile's length goes through the generic path too, so both give
+ * the same result for any input; bench/bench_profile_decode checks that
+ * on every report it times.
+ *
+ * Usage:
+ *   MouseDecoder decoder;
+ *   mouse_decoder_select(&decoder, usb_profile_find(handle, USB_KIND_MOUSE), &layout_from_descriptor);
+ *   if (mouse_decoder_run(&decoder, data, len, &report) == 0) ...;
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../common/usb_profiles.h"
+#include "mouse_decode.h"
+
+// X(profile, report_id, length, buttons_byte, buttons, x_byte, y_byte, xy_bits, wheel_byte, pan_byte)
+// Byte offsets count the report ID byte; X and Y are signed little-endian
+// deltas of xy_bits (8 or 16), wheel and pan signed bytes, -1 if absent.
+#define MOUSE_PROFILES(X) \
+    X(LOGITECH_C534, 2, 8, 1, 8, 2, 4, 16, 6, 7)
+
+typedef struct {
+    UsbProfileId profile;       // a MOUSE_PROFILES() entry, or USB_NUM_PROFILES: generic
+    MouseLayout layout;         // generic path
+} MouseDecoder;
+
+// The field at `byte` (counting the report ID) as the descriptor would describe it.
+static inline HidField mouse_profile_field(int report_id, int byte, int bits) {
+    HidField f;
+    memset(&f, 0, sizeof(f));
+    if (byte < 0) return f;
+    f.bit_offset = (uint16_t)((byte - (report_id ? 1 : 0)) * 8);
+    f.bit_size = (uint8_t)bits;
+    f.report_id = (uint8_t)report_id;
+    return f;
+}
+
+#define MOUSE_PROFILE_DELTA(d, byte, bits) \
+    ((bits) == 16 ? (int16_t)((d)[(byte)] | (d)[(byte) + 1] << 8) : (int16_t)(int8_t)(d)[(byte)])
+
+#define MOUSE_PROFILE_DECODER(name, id, length, b_byte, n_buttons, x_byte, y_byte, xy_bits, w_byte, p_byte) \
+    static inline void mouse_profile_layout_##name(MouseLayout *layout) { \
+        memset(layout, 0, sizeof(*layout)); \
+        layout->valid = 1; \
+        layout->report_id = (id); \
+        layout->buttons = mouse_profile_field((id), (b_byte), (n_buttons)); \
+        layout->x = mouse_profile_field((id), (x_byte), (xy_bits)); \
+        layout->y = mouse_profile_field((id), (y_byte), (xy_bits)); \
+        layout->wheel = mouse_profile_field((id), (w_byte), 8); \
+        layout->hwheel = mouse_profile_field((id), (p_byte), 8); \
+        layout->x.is_signed = layout->y.is_signed = layout->wheel.is_signed = layout->hwheel.is_signed = 1; \
+    } \
+    static inline int decode_mouse_##name(const uint8_t *d, size_t len, MouseReport *out) { \
+        if (len < (length)) { \
+            MouseLayout layout; \
+            mouse_profile_layout_##name(&layout); \
+            return decode_mouse_report(&layout, d, len, out); \
+        } \
+        if ((id) && d[0] != (id)) return -1; \
+        out->buttons = (b_byte) >= 0 ? (uint8_t)(d[(b_byte) < 0 ? 0 : (b_byte)] & ((1u << (n_buttons)) - 1)) : 0; \
+        out->x = MOUSE_PROFILE_DELTA(d, (x_byte), (xy_bits)); \
+        out->y = MOUSE_PROFILE_DELTA(d, (y_byte), (xy_bits)); \
+        out->wheel = (w_byte) >= 0 ? (int16_t)(int8_t)d[(w_byte) < 0 ? 0 : (w_byte)] : 0; \
+        out->hwheel = (p_byte) >= 0 ? (int16_t)(int8_t)d[(p_byte) < 0 ? 0 : (p_byte)] : 0; \
+        return 0; \
+    }
+
+MOUSE_PROFILES(MOUSE_PROFILE_DECODER)
+#undef MOUSE_PROFILE_DECODER
+
+static inline int mouse_field_same(const HidField *a, const HidField *b) {
+    if (a->bit_size == 0 || b->bit_size == 0) return a->bit_size == b->bit_size;
+    return a->bit_offset == b->bit_offset && a->bit_size == b->bit_size && a->is_signed == b->is_signed;
+}
+
+// Nonzero if both layouts decode every report the same way.
+static inline int mouse_layout_same(const MouseLayout *a, const MouseLayout *b) {
+    return a->report_id == b->report_id && mouse_field_same(&a->buttons, &b->buttons) &&
+           mouse_field_same(&a->x, &b->x) && mouse_field_same(&a->y, &b->y) &&
+           mouse_field_same(&a->wheel, &b->wheel) && mouse_field_same(&a->hwheel, &b->hwheel);
+}
+
+// The layout `profile` bakes in. Returns 0, or -1 if it has no specialised decoder.
+static inline int mouse_profile_layout(UsbProfileId profile, MouseLayout *layout) {
+    switch (profile) {
+#define MOUSE_PROFILE_CASE(name, ...) \
+        case USB_PROFILE_##name: mouse_profile_layout_##name(layout); return 0;
+        MOUSE_PROFILES(MOUSE_PROFILE_CASE)
+#undef MOUSE_PROFILE_CASE
+        default: return -1;
+    }
+}
+
+// Use the specialised decoder of `profile` if there is one and the
+// descriptor (`compiled`, possibly invalid) agrees with it; else the generic
+// path with `compiled`. Says which if there was a choice.
+static inline void mouse_decoder_select(MouseDecoder *d, const UsbProfile *profile, const MouseLayout *compiled) {
+    MouseLayout baked;
+    d->profile = USB_NUM_PROFILES;
+    d->layout = *compiled;
+    if (mouse_profile_layout(profile->id, &baked) < 0) return;
+    if (compiled->valid && !mouse_layout_same(compiled, &baked)) {
+        fprintf(stderr, "WARN: The report descriptor does not match profile %s, using the generic decoder.\n",
+                profile->name);
+        return;
+    }
+    d->profile = profile->id;
+    d->layout = baked;
+    fprintf(stderr, "DEBUG: Report decoder specialised for %s\n", profile->name);
+}
+
+// Same contract as decode_mouse_report().
+static inline int mouse_decoder_run(const MouseDecoder *d, const uint8_t *data, size_t len, MouseReport *out) {
+    switch (d->profile) {
+#define MOUSE_PROFILE_CASE(name, ...) \
+        case USB_PROFILE_##name: return decode_mouse_##name(data, len, out);
+        MOUSE_PROFILES(MOUSE_PROFILE_CASE)
+#undef MOUSE_PROFILE_CASE
+        default: return decode_mouse_report(&d->layout, data, len, out);
+    }
+}
+
+#endif // MOUSE_PROFILES_H
@@ -0,0 +1,133 @@
+#ifndef MOUSE_READER_H
+#define MOUSE_READER_H
+
+/*
+ * Report timing bookkeeping shared by read_mouse and read_mouse_raw
+ *
+ * A mouse answers every poll of its interrupt endpoint with either a report
+ * or a NAK, once per bInterval. While it is moving it has a report for every
+ * slot, so a gap of more than 1.5 intervals after a report with motion means
+ * the endpoint was not polled in time or the report waited on the host side
+ * before it was handled: the report is counted as late, the intervals that
+ * passed without a report as gap slots. Most mice fold the motion of unpolled
+ * slots into the next report; with 16-bit X/Y deltas (mouse_decode.h) that
+ * only saturates after 32767 counts, but some devices drop the motion
+ * instead, which is what makes the on-screen position drift.
+ *
+ * Queue underruns (the async queue ran empty, so the endpoint was not polled
+ * until the next resubmit) are counted by usb_async_queue itself.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <libusb-1.0/libusb.h>
+
+#include "../common/desc_cache.h"
+#include "../common/usb_async.h"
+#include "mouse_decode.h"
+
+#define MOUSE_QUEUE_US 8000         // polling slots the default queue covers
+#define MOUSE_QUEUE_MIN 8
+#define MOUSE_QUEUE_MAX 128
+
+typedef struct {
+    int interval_us;        // report period derived from bInterval and the bus speed
+    double last_report;     // time of the previous report, 0 before the first
+    int last_moving;
+
+    uint64_t reports;
+    uint64_t late;          // reports that came > 1.5 intervals after a moving one
+    uint64_t gap_slots;     // intervals that passed without a report before them
+    uint64_t errors;        // failed transfers
+    int64_t sum_x;          // motion received, not clamped to the screen
+    int64_t sum_y;
+} MouseReportStats;
+
+static inline double mouse_now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Polling interval of `endpoint` in microseconds, 1000 if it cannot be determined.
+static inline int mouse_endpoint_interval_us(libusb_device_handle *handle, const DescCache *cache, unsigned char endpoint) {
+    DescCacheEndpoint ep;
+
+    if (desc_cache_endpoint(cache, endpoint, &ep) < 0 || ep.interval == 0) return 1000;
+    if (libusb_get_device_speed(libusb_get_device(handle)) >= LIBUSB_SPEED_HIGH) {
+        // High speed and up: 2^(bInterval-1) microframes of 125 us.
+        int exp = ep.interval > 16 ? 16 : ep.interval;
+        return 125 << (exp - 1);
+    }
+    return ep.interval * 1000;
+}
+
+// Transfers to keep queued on an endpoint polled every `interval_us`, so
+// that the loop can be scheduled up to MOUSE_QUEUE_US late without leaving
+// a slot unpolled. A fixed 8 covers 8 ms at 1 kHz but only 1 ms at 8 kHz.
+// The queue's underrun counter does not see that case: the late
+// completions are handled and resubmitted one at a time, so the queue
+// never looks empty, but the slots that passed meanwhile are gone.
+static inline int mouse_queue_depth(int interval_us) {
+    int depth = interval_us > 0 ? (MOUSE_QUEUE_US + interval_us - 1) / interval_us : MOUSE_QUEUE_MIN;
+    if (depth < MOUSE_QUEUE_MIN) depth = MOUSE_QUEUE_MIN;
+    if (depth > MOUSE_QUEUE_MAX) depth = MOUSE_QUEUE_MAX;
+    return depth;
+}
+
+// Read the report descriptor of the claimed interface and compile it into
+// `layout`. On failure the layout stays invalid and reports are decoded with
+// the fixed layout of mouse_decode.h.
+static inline void mouse_layout_load(libusb_device_handle *handle, DescCache *cache, int interface_number, MouseLayout *layout) {
+    unsigned char desc[512];
+    HidPlan plan;
+
+    memset(layout, 0, sizeof(*layout));
+    int len = desc_cache_report_descriptor(cache, handle, interface_number, desc, sizeof(desc));
+    if (len <= 0) {
+        fprintf(stderr, "WARN: No HID report descriptor on interface %d (%s), using the fixed report layout.\n",
+                interface_number, len < 0 ? libusb_error_name(len) : "empty");
+        return;
+    }
+    if (hid_plan_compile(&plan, desc, len) < 0 || mouse_layout_from_plan(layout, &plan) < 0) {
+        fprintf(stderr, "WARN: HID report descriptor on interface %d has no X/Y motion, using the fixed report layout.\n",
+                interface_number);
+        return;
+    }
+    fprintf(stderr, "DEBUG: Report layout from descriptor: id %u, buttons %u+%u, X %u+%u, Y %u+%u, wheel %u+%u, pan %u+%u (bit offset+size)\n",
+            layout->report_id, layout->buttons.bit_offset, layout->buttons.bit_size,
+            layout->x.bit_offset, layout->x.bit_size, layout->y.bit_offset, layout->y.bit_size,
+            layout->wheel.bit_offset, layout->wheel.bit_size, layout->hwheel.bit_offset, layout->hwheel.bit_size);
+}
+
+// Account one received report. `moving` is nonzero if it carried X/Y motion.
+static inline void mouse_stats_note(MouseReportStats *stats, double now, int moving, int dx, int dy) {
+    if (stats->last_report > 0 && stats->last_moving) {
+        double gap_us = (now - stats->last_report) * 1e6;
+        if (gap_us > 1.5 * stats->interval_us) {
+            stats->late++;
+            stats->gap_slots += (uint64_t)(gap_us / stats->interval_us + 0.5) - 1;
+        }
+    }
+    stats->last_report = now;
+    stats->last_moving = moving;
+    stats->reports++;
+    stats->sum_x += dx;
+    stats->sum_y += dy;
+}
+
+// `q` is the async queue, or NULL for the synchronous loop.
+static inline void mouse_stats_print(const MouseReportStats *stats, const usb_async_queue *q) {
+    fprintf(stderr, "DEBUG: %llu reports (interval %d us), %llu late after ~%llu intervals without a report, %llu transfer errors\n",
+            (unsigned long long)stats->reports, stats->interval_us, (unsigned long long)stats->late,
+            (unsigned long long)stats->gap_slots, (unsigned long long)stats->errors);
+    if (q) {
+        fprintf(stderr, "DEBUG: Queue of %d transfers ran empty %llu times\n",
+                q->depth, (unsigned long long)q->underruns);
+    }
+    fprintf(stderr, "DEBUG: Total motion received: x=%lld y=%lld\n",
+            (long long)stats->sum_x, (long long)stats->sum_y);
+}
+
+#endif // MOUSE_READER_H
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // accept4, sendmmsg (mouse_fanout.h)
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,184 +6,484 @@
 #include <libusb-1.0/libusb.h>
 #include <errno.h>
 #include <stdint.h>
+#include <signal.h>
+#include <getopt.h>
 
 #include "mouse_decode.h"
+#include "mouse_reader.h"
+#include "mouse_motion.h"
+#include "mouse_fanout.h"
+#include "mouse_profiles.h"
+#include "../common/term_buf.h"
+#include "../common/latency_hist.h"
+#include "../common/usb_wait.h"
+#include "../common/usb_session.h"
 
 #define SCREEN_WIDTH 40
 #define SCREEN_HEIGHT 20
-#define POLLING_RATE_HZ 30
-#define POLLING_INTERVAL_US (1000000 / POLLING_RATE_HZ)
+#define FRAME_RATE_HZ 30 // default redraw cap, independent of the report rate
 
-// UI and mouse state
-char screen[SCREEN_HEIGHT][SCREEN_WIDTH];
+// Box layout, in rows below the top border: the field is rows 1..SCREEN_HEIGHT,
+// then the bottom border, the status line and the line the cursor rests on.
+#define STATUS_ROW (SCREEN_HEIGHT + 2)
+#define END_ROW (SCREEN_HEIGHT + 3)
+
+// Mouse state
 int mouse_x = SCREEN_WIDTH / 2;
 int mouse_y = SCREEN_HEIGHT / 2;
 uint8_t mouse_buttons = 0;
-int8_t mouse_wheel = 0;
+int16_t mouse_wheel = 0;
+int16_t mouse_hwheel = 0;
+MouseMotion motion;           // position with the fraction of a cell, see mouse_motion.h
 
 int prev_mouse_x = -1;
 int prev_mouse_y = -1;
 uint8_t prev_mouse_buttons = -1;
-int8_t prev_mouse_wheel = 0;
+int16_t prev_mouse_wheel = 0;
+int16_t prev_mouse_hwheel = 0;
+
+// Renderer state: what the terminal currently shows
+TermBuf frame;
+int term_row = 0;             // terminal cursor, relative to the top-left corner of the box
+int term_col = 0;
+int drawn_x = -1;             // cell showing the cursor glyph, -1 before the first frame
+int drawn_y = -1;
+const char *drawn_glyph = NULL;
+char drawn_status[80];
+int frame_interval_us = 1000000 / FRAME_RATE_HZ;
+double next_frame = 0;
+
+MouseReportStats report_stats;
+MouseDecoder report_decoder; // picked from the profile and the report descriptor at claim time
+ReportLatency report_latency;
+
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t latency_dump_requested = 0;
+static UsbWait waiter;
+static UsbSession session;
+static const char *publish_path = NULL;   // -p: also send every report to the subscribers of this socket
+static MouseFanout fanout;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+    usb_wait_wake(&waiter);
+}
 
+static void handle_dump_signal(int sig) {
+    (void)sig;
+    latency_dump_requested = 1;
+    usb_wait_wake(&waiter);
+}
 
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-a | -S] [-q depth] [-f fps] [-s counts] [-r] [-p socket [-Q depth]] <file_descriptor>\n", prog);
+    fprintf(stderr, "  -a        Asynchronous mode (default): keep several interrupt transfers queued\n");
+    fprintf(stderr, "  -S        Synchronous mode: one blocking transfer at a time, wakes up every 34 ms\n");
+    fprintf(stderr, "  -q depth  Transfers kept in flight in asynchronous mode (default: %d ms of\n"
+                    "            polling slots, at least %d)\n", MOUSE_QUEUE_US / 1000, MOUSE_QUEUE_MIN);
+    fprintf(stderr, "  -f fps    Redraw at most this many times per second (default %d)\n", FRAME_RATE_HZ);
+    fprintf(stderr, "  -s counts Counts of motion per screen cell (default 1); fractions of a cell add up\n");
+    fprintf(stderr, "  -r        Read the descriptors from the device again instead of the cache\n");
+    fprintf(stderr, "  -p socket Send every decoded report to the programs connected to this Unix socket\n");
+    fprintf(stderr, "            (SOCK_SEQPACKET; '@name' for an abstract one), see mouse_fanout.h\n");
+    fprintf(stderr, "  -Q depth  Reports queued per subscriber before the oldest is dropped (default %d)\n",
+            MOUSE_FANOUT_DEFAULT_QUEUE);
+    fprintf(stderr, "Send SIGUSR1 to print report latency percentiles while running.\n");
+}
 
+static int ui_changed(void) {
+    return mouse_x != prev_mouse_x || mouse_y != prev_mouse_y || mouse_buttons != prev_mouse_buttons ||
+           mouse_wheel != prev_mouse_wheel || mouse_hwheel != prev_mouse_hwheel;
+}
 
-void draw_ui() {
-    fprintf(stderr, "\033[u"); // Restore cursor to saved position
+// Fold one report into the mouse state. Only updates state, never draws.
+// `complete_ns` is when its transfer came back to the program.
+static void apply_report(const unsigned char *data, int length, uint64_t complete_ns) {
+    MouseReport report;
+    usb_session_first_data(&session);
+    if (mouse_decoder_run(&report_decoder, data, length, &report) < 0) return; // not a mouse report
+    if (publish_path) mouse_fanout_publish(&fanout, &report, complete_ns); // sent after this loop pass
+
+    mouse_buttons = report.buttons;
+    mouse_motion_add(&motion, report.x, report.y); // clamped to the field
+    mouse_x = mouse_motion_cell_x(&motion);
+    mouse_y = mouse_motion_cell_y(&motion);
+    mouse_wheel = report.wheel;
+    mouse_hwheel = report.hwheel;
+
+    latency_note_report(&report_latency, complete_ns, latency_now_ns(), ui_changed());
+    mouse_stats_note(&report_stats, mouse_now_sec(), report.x || report.y, report.x, report.y);
+}
 
-    // Determine cursor string
-    const char* cursor_str;
+// Async completion callback, runs inside libusb_handle_events*().
+static int on_report(void *user, const unsigned char *data, int length) {
+    (void)user;
+    apply_report(data, length, latency_now_ns());
+    return stop_requested;
+}
+
+static const char *cursor_glyph(void) {
     if (mouse_buttons & 0x01) { // Left button
-        cursor_str = "L";
+        return "L";
     } else if (mouse_buttons & 0x02) { // Right button
-        cursor_str = "R";
+        return "R";
     } else if (mouse_buttons & 0x04) { // Middle button
-        cursor_str = "M";
-    } else {
-        cursor_str = "⇖"; // Default cursor
+        return "M";
     }
+    return "⇖"; // Default cursor
+}
 
-    // Prepare screen buffer (fills with spaces, cursor will be printed directly)
-    memset(screen, ' ', sizeof(screen));
-
-    // Print screen buffer with border
-    fprintf(stderr, "╭");
-    for (int x = 0; x < SCREEN_WIDTH; x++) {
-        fprintf(stderr, "─");
+static void format_status(char *out, size_t size) {
+    const char* wheel_status_str = "---";
+    if (mouse_wheel < 0) {
+        wheel_status_str = "Down ";
+    } else if (mouse_wheel > 0) {
+        wheel_status_str = " Up ";
     }
-    fprintf(stderr, "╮\n");
+    const char *pan_status_str = "";
+    if (mouse_hwheel < 0) {
+        pan_status_str = "Left ";
+    } else if (mouse_hwheel > 0) {
+        pan_status_str = "Right ";
+    }
+
+    snprintf(out, size, "  Buttons: L=%d R=%d M=%d | Wheel: %s %s",
+             (mouse_buttons & 0x01) ? 1 : 0,
+             (mouse_buttons >> 1) & 0x01 ? 1 : 0,
+             (mouse_buttons >> 2) & 0x01 ? 1 : 0,
+             wheel_status_str, pan_status_str);
+}
 
+// Move the terminal cursor within the box and remember where it is.
+static void ui_move(int row, int col) {
+    term_buf_move(&frame, term_row, term_col, row, col);
+    term_row = row;
+    term_col = col;
+}
+
+// Draw one cell of the field; every glyph used is one column wide.
+static void ui_put_cell(int x, int y, const char *glyph) {
+    ui_move(y + 1, x + 1);
+    term_buf_puts(&frame, glyph);
+    term_col++;
+}
+
+// The whole box, once at startup. Leaves the cursor below the status line.
+static void draw_full(void) {
+    term_buf_puts(&frame, "╭");
+    for (int x = 0; x < SCREEN_WIDTH; x++) term_buf_puts(&frame, "─");
+    term_buf_puts(&frame, "╮\n");
     for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        fprintf(stderr, "│");
+        term_buf_puts(&frame, "│");
         for (int x = 0; x < SCREEN_WIDTH; x++) {
-            if (y == mouse_y && x == mouse_x) {
-                fprintf(stderr, "%s", cursor_str); // Print the cursor string
-            } else {
-                fputc(screen[y][x], stderr); // Print space from buffer
-            }
+            term_buf_puts(&frame, y == mouse_y && x == mouse_x ? cursor_glyph() : " ");
         }
-        fprintf(stderr, "│\n");
+        term_buf_puts(&frame, "│\n");
     }
+    term_buf_puts(&frame, "╰");
+    for (int x = 0; x < SCREEN_WIDTH; x++) term_buf_puts(&frame, "─");
+    term_buf_puts(&frame, "╯\n");
+    format_status(drawn_status, sizeof(drawn_status));
+    term_buf_puts(&frame, drawn_status);
+    term_buf_puts(&frame, "\n");
+    term_row = END_ROW;
+    term_col = 0;
+}
 
-    fprintf(stderr, "╰");
-    for (int x = 0; x < SCREEN_WIDTH; x++) {
-        fprintf(stderr, "─");
-    }
-    fprintf(stderr, "╯\n");
+// Render one frame: only the cells that changed since the last frame (old
+// cursor cell, new cursor cell, status line), written with a single write().
+void draw_ui() {
+    const char *glyph = cursor_glyph();
 
-    // Print status
-    const char* wheel_status_str = "---";
-    if (mouse_wheel < 0) {
-        wheel_status_str = "Down ";
-    } else if (mouse_wheel > 0) {
-        wheel_status_str = " Up ";
+    if (drawn_x < 0) {
+        draw_full();
+    } else {
+        if (mouse_x != drawn_x || mouse_y != drawn_y) {
+            ui_put_cell(drawn_x, drawn_y, " ");
+            ui_put_cell(mouse_x, mouse_y, glyph);
+        } else if (glyph != drawn_glyph) {
+            ui_put_cell(mouse_x, mouse_y, glyph);
+        }
+
+        char status[sizeof(drawn_status)];
+        format_status(status, sizeof(status));
+        if (strcmp(status, drawn_status) != 0) {
+            ui_move(STATUS_ROW, 0);
+            term_buf_puts(&frame, status);
+            term_buf_puts(&frame, "\033[K"); // Clear what is left of a longer status
+            term_col = (int)strlen(status);
+            memcpy(drawn_status, status, sizeof(status));
+        }
     }
+    term_buf_flush(&frame, STDERR_FILENO);
+    latency_note_frame(&report_latency, latency_now_ns());
+
+    drawn_x = mouse_x;
+    drawn_y = mouse_y;
+    drawn_glyph = glyph;
+    prev_mouse_x = mouse_x;
+    prev_mouse_y = mouse_y;
+    prev_mouse_buttons = mouse_buttons;
+    prev_mouse_wheel = mouse_wheel;
+    prev_mouse_hwheel = mouse_hwheel;
+}
+
+// Draw if something changed and the next frame is due. Returns 1 if it drew.
+static int draw_ui_if_due(void) {
+    double now = mouse_now_sec();
+    if (!ui_changed() || now < next_frame) return 0;
+    draw_ui();
+    next_frame = now + frame_interval_us / 1e6;
+    return 1;
+}
+
+// Put the terminal cursor back below the box, e.g. before printing a message.
+static void ui_finish(void) {
+    if (drawn_x < 0) return;
+    if (ui_changed()) draw_ui();
+    ui_move(END_ROW, 0);
+    term_buf_flush(&frame, STDERR_FILENO);
+}
 
-    fprintf(stderr, "  Buttons: L=%d R=%d M=%d | Wheel: %s \n",
-           (mouse_buttons & 0x01) ? 1 : 0,
-           (mouse_buttons >> 1) & 0x01 ? 1 : 0,
-           (mouse_buttons >> 2) & 0x01 ? 1 : 0,
-           wheel_status_str);
+// After a message was printed below the box: draw a fresh one under it.
+static void ui_restart(void) {
+    drawn_x = -1;
+    prev_mouse_x = -1;
+    term_row = 0;
+    term_col = 0;
+}
 
+// SIGUSR1: print the latency percentiles below the box, then start a new box.
+static void dump_latency(void) {
+    latency_dump_requested = 0;
+    ui_finish();
+    fprintf(stderr, "\n");
+    latency_print(&report_latency, stderr);
+    if (publish_path) mouse_fanout_print(&fanout, stderr);
+    ui_restart();
+}
+
+// One blocking transfer at a time (original loop), redrawing between transfers when a frame is due.
+static int read_mouse_sync(libusb_device_handle *handle, int endpoint_address) {
+    unsigned char data[MOUSE_MAX_REPORT];
+    int actual_length;
+    int r = 0;
+
+    // A whole packet: a report longer than the buffer would end the transfer with an overflow.
+    int packet_size = libusb_get_max_packet_size(libusb_get_device(handle), endpoint_address);
+    if (packet_size <= 0 || packet_size > (int)sizeof(data)) packet_size = sizeof(data);
+
+    while (!stop_requested) {
+        r = libusb_interrupt_transfer(handle, endpoint_address, data, packet_size, &actual_length, 34); // ~30Hz timeout
+        uint64_t complete_ns = latency_now_ns();
+
+        if (latency_dump_requested) dump_latency();
+        if (r == 0 && actual_length > 0) {
+            apply_report(data, actual_length, complete_ns);
+        } else if (r == LIBUSB_ERROR_INTERRUPTED) {
+            continue;
+        } else if (r != 0 && r != LIBUSB_ERROR_TIMEOUT) {
+            report_stats.errors++;
+            ui_finish();
+            fprintf(stderr, "\nlibusb_interrupt_transfer error: %s\n", libusb_error_name(r));
+            break;
+        }
 
-    fflush(stderr);
+        if (publish_path) {
+            mouse_fanout_service(&fanout);
+            mouse_fanout_flush(&fanout);
+        }
+        draw_ui_if_due();
+    }
+    return stop_requested ? 0 : r;
 }
 
+// Keep `depth` interrupt transfers queued so no polling slot goes unserved.
+// Reports are applied from the completion callback; the screen is redrawn
+// from this loop, at most once per frame interval. A mouse that does not
+// move leaves the loop asleep: there is no timeout to wake it.
+static int read_mouse_async(libusb_context *context, libusb_device_handle *handle, int endpoint_address,
+                            int depth, usb_async_queue *q) {
+    int packet_size = libusb_get_max_packet_size(libusb_get_device(handle), endpoint_address);
+    if (packet_size <= 0) packet_size = 8;
+
+    // Timeout 0: an idle mouse just NAKs, the transfers stay queued until it moves.
+    int r = usb_wait_init(&waiter, context);
+    if (r < 0) {
+        fprintf(stderr, "\nFailed to set up the event loop: %s\n", libusb_error_name(r));
+        return r;
+    }
+    if (publish_path) usb_wait_watch(&waiter, mouse_fanout_fd(&fanout));
+    r = usb_async_start(q, handle, endpoint_address, LIBUSB_TRANSFER_TYPE_INTERRUPT, depth, packet_size, 0, on_report, NULL);
+    if (r < 0) {
+        fprintf(stderr, "\nFailed to start async transfers: %s\n", libusb_error_name(r));
+        usb_async_cancel(q, context);
+        usb_wait_close(&waiter);
+        return r;
+    }
+
+    while (!stop_requested && !q->stopped) {
+        if (latency_dump_requested) dump_latency();
+        draw_ui_if_due();
+
+        // Sleep until the next frame is due if there is something to draw,
+        // otherwise until a report arrives or a signal wakes us.
+        long wait_us = -1;
+        if (ui_changed()) {
+            wait_us = (long)((next_frame - mouse_now_sec()) * 1e6);
+            if (wait_us < 0) wait_us = 0;
+        }
+        r = usb_wait_events(&waiter, wait_us);
+        if (r < 0) {
+            fprintf(stderr, "\nlibusb_handle_events failed: %s\n", libusb_error_name(r));
+            break;
+        }
+        r = 0;
+
+        // The reports of this pass go out now, without waiting for any subscriber.
+        if (publish_path) {
+            if (waiter.watched_ready) {
+                waiter.watched_ready = 0;
+                mouse_fanout_service(&fanout);
+            }
+            mouse_fanout_flush(&fanout);
+        }
+
+        if (q->stalled) {
+            ui_finish();
+            fprintf(stderr, "\nlibusb_interrupt_transfer error: LIBUSB_ERROR_PIPE (endpoint halted). Clearing...\n");
+            ui_restart();
+            report_stats.errors++;
+            r = libusb_clear_halt(handle, endpoint_address);
+            if (r < 0) {
+                ui_finish();
+                fprintf(stderr, "ERROR: Could not clear halt: %s\n", libusb_error_name(r));
+                break;
+            }
+            r = usb_async_resubmit(q);
+            if (r < 0) {
+                ui_finish();
+                fprintf(stderr, "ERROR: Could not resubmit transfers after clearing the halt: %s\n", libusb_error_name(r));
+                break;
+            }
+        }
+    }
+
+    ui_finish();
+    if (q->error) {
+        report_stats.errors++;
+        fprintf(stderr, "\nlibusb_interrupt_transfer error: transfer status %d\n", q->error);
+        r = q->error == LIBUSB_TRANSFER_NO_DEVICE ? LIBUSB_ERROR_NO_DEVICE : LIBUSB_ERROR_IO;
+    }
+    usb_async_cancel(q, context);
+    usb_wait_close(&waiter);
+    return r;
+}
 
 int main(int argc, char **argv) {
     libusb_context *context = NULL;
     libusb_device_handle *handle = NULL;
+    usb_async_queue queue = {0};
+    int async_mode = 1;
+    int queue_depth = 0;        // 0: from the polling interval
+    int refresh_cache = 0;
     int fd = -1;
     int r;
-
-    if (argc < 2 || sscanf(argv[1], "%d", &fd) != 1) {
-        fprintf(stderr, "Usage: %s <file_descriptor>\n", argv[0]);
+    int opt;
+
+    int fps = FRAME_RATE_HZ;
+    double counts_per_cell = 1.0;
+    int subscriber_queue = MOUSE_FANOUT_DEFAULT_QUEUE;
+
+    while ((opt = getopt(argc, argv, "aSq:f:s:rp:Q:")) != -1) {
+        switch (opt) {
+            case 'a': async_mode = 1; break;
+            case 'S': async_mode = 0; break;
+            case 'q': queue_depth = atoi(optarg); break;
+            case 'f': fps = atoi(optarg); break;
+            case 's': counts_per_cell = atof(optarg); break;
+            case 'r': refresh_cache = 1; break;
+            case 'p': publish_path = optarg; break;
+            case 'Q': subscriber_queue = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || sscanf(argv[optind], "%d", &fd) != 1 || queue_depth < 0 || fps < 1 || counts_per_cell < 1 ||
+        subscriber_queue < 1 || subscriber_queue > 65536) {
+        usage(argv[0]);
+        return 1;
+    }
+    frame_interval_us = 1000000 / fps;
+    mouse_motion_init(&motion, SCREEN_WIDTH, SCREEN_HEIGHT, counts_per_cell);
+    if (publish_path && mouse_fanout_open(&fanout, publish_path, (unsigned int)subscriber_queue) < 0) {
+        fprintf(stderr, "ERROR: Cannot listen on %s: %s\n", publish_path,
+                errno == EADDRINUSE ? "another read_mouse is serving it" : strerror(errno));
         return 1;
     }
 
+    // Ctrl+C ends the loop so the cursor is restored and the counters printed.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = handle_dump_signal;
+    sigaction(SIGUSR1, &sa, NULL);
+
     fprintf(stderr, "\033[?25l"); // Hide cursor
-    fprintf(stderr, "\033[s"); // Save cursor position
 
-    libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
-    r = libusb_init(&context);
+    r = usb_session_open(&session, fd);
     if (r < 0) {
-        fprintf(stderr, "libusb_init failed: %s\n", libusb_error_name(r));
         goto cleanup_cursor;
     }
+    context = session.ctx;
+    handle = session.handle;
 
-    r = libusb_wrap_sys_device(context, (intptr_t)fd, &handle);
+    const UsbProfile *profile = usb_profile_find(handle, USB_KIND_MOUSE);
+    int interface_number = profile->interface;
+    r = usb_session_claim(&session, interface_number);
     if (r < 0) {
-        fprintf(stderr, "libusb_wrap_sys_device failed: %s\n", libusb_error_name(r));
-        libusb_exit(context);
-        goto cleanup_cursor;
+        goto cleanup_libusb;
     }
 
-    int interface_number = 1; // From original working file
-    int kernel_driver_active = 0;
-    if (libusb_kernel_driver_active(handle, interface_number) == 1) {
-        r = libusb_detach_kernel_driver(handle, interface_number);
-        if (r < 0) {
-            fprintf(stderr, "libusb_detach_kernel_driver failed: %s\n", libusb_error_name(r));
-            goto cleanup_libusb;
-        }
-        kernel_driver_active = 1;
-    }
-
-    r = libusb_claim_interface(handle, interface_number);
-    if (r < 0) {
-        fprintf(stderr, "libusb_claim_interface failed: %s\n", libusb_error_name(r));
-        goto cleanup_driver;
-    }
+    DescCache cache;
+    desc_cache_open(&cache, handle, refresh_cache);
+    MouseLayout report_layout;
+    mouse_layout_load(handle, &cache, interface_number, &report_layout);
+    mouse_decoder_select(&report_decoder, profile, &report_layout);
 
-    int endpoint_address = 0x82; // From original working file
-    unsigned char data[8];
-    int actual_length;
+    int endpoint_address = profile->endpoint_in;
+    report_stats.interval_us = mouse_endpoint_interval_us(handle, &cache, endpoint_address);
+    if (queue_depth == 0) queue_depth = mouse_queue_depth(report_stats.interval_us);
+    desc_cache_close(&cache);
+    usb_session_mark(&session, "descriptors");
 
     draw_ui(); // Initial draw
 
-    while (1) {
-        r = libusb_interrupt_transfer(handle, endpoint_address, data, sizeof(data), &actual_length, 34); // ~30Hz timeout
-
-        if (r == 0 && actual_length > 0) {
-            MouseReport report = interpret_mouse_report(data, actual_length);
-
-            mouse_buttons = report.buttons;
-            mouse_x += report.x;
-            mouse_y += report.y;
-            mouse_wheel = report.wheel;
-
-            // Clamp coordinates
-            if (mouse_x < 0) mouse_x = 0;
-            if (mouse_x >= SCREEN_WIDTH) mouse_x = SCREEN_WIDTH - 1;
-            if (mouse_y < 0) mouse_y = 0;
-            if (mouse_y >= SCREEN_HEIGHT) mouse_y = SCREEN_HEIGHT - 1;
-        } else if (r != LIBUSB_ERROR_TIMEOUT) {
-            fprintf(stderr, "\nlibusb_interrupt_transfer error: %s\n", libusb_error_name(r));
-            break;
-        }
-
-        if (mouse_x != prev_mouse_x || mouse_y != prev_mouse_y || mouse_buttons != prev_mouse_buttons || mouse_wheel != prev_mouse_wheel) {
-            draw_ui();
-            prev_mouse_x = mouse_x;
-            prev_mouse_y = mouse_y;
-            prev_mouse_buttons = mouse_buttons;
-            prev_mouse_wheel = mouse_wheel;
-        }
-
-
+    if (async_mode) {
+        r = read_mouse_async(context, handle, endpoint_address, queue_depth, &queue);
+    } else {
+        r = read_mouse_sync(handle, endpoint_address);
     }
 
-    libusb_release_interface(handle, interface_number);
-cleanup_driver:
-    if (kernel_driver_active) {
-        libusb_attach_kernel_driver(handle, interface_number);
-    }
 cleanup_libusb:
-    libusb_close(handle);
-    libusb_exit(context);
+    usb_session_close(&session);
 cleanup_cursor:
+    ui_finish();
     fprintf(stderr, "\n"); // Move to a new line to not overwrite the UI
     fprintf(stderr, "\033[?25h"); // Show cursor again
+    if (report_stats.reports > 0 || report_stats.errors > 0) {
+        mouse_stats_print(&report_stats, async_mode ? &queue : NULL);
+        fprintf(stderr, "DEBUG: %llu frames, %llu bytes written to the terminal\n",
+                (unsigned long long)frame.frames, (unsigned long long)frame.bytes);
+        latency_print(&report_latency, stderr);
+        usb_session_report(&session);
+    }
+    if (publish_path) {
+        mouse_fanout_print(&fanout, stderr);
+        mouse_fanout_close(&fanout);
+    }
+    usb_async_free(&queue);
     return r;
 }
\ No newline at end of file
@@ -0,0 +1,130 @@
+// Subscriber example for read_mouse -p.
+//
+// Connects to the socket and prints every MouseFanoutEvent it receives,
+// one line each. Gaps in the sequence numbers are the events read_mouse
+// dropped because this subscriber fell behind; they are counted and
+// printed at exit. -d makes it slow on purpose (a pause after every
+// event), to watch read_mouse drop old events while the mouse and every
+// other subscriber carry on.
+//
+// Usage: read_mouse_sub [-d delay_us] [-n count] [-q] <socket>
+
+#define _GNU_SOURCE // sendmmsg, accept4 in mouse_fanout.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mouse_fanout.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-d delay_us] [-n count] [-q] <socket>\n", prog);
+    fprintf(stderr, "  -d us     Pause this long after every event, to play a slow subscriber\n");
+    fprintf(stderr, "  -n count  Stop after this many events (default: until Ctrl+C or read_mouse exits)\n");
+    fprintf(stderr, "  -q        Do not print the events, only the counters at exit\n");
+    fprintf(stderr, "The socket is the one given to read_mouse -p ('@name' for an abstract one).\n");
+}
+
+int main(int argc, char **argv) {
+    long delay_us = 0;
+    long count = -1;
+    int quiet = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:n:q")) != -1) {
+        switch (opt) {
+            case 'd': delay_us = atol(optarg); break;
+            case 'n': count = atol(optarg); break;
+            case 'q': quiet = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || delay_us < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *path = argv[optind];
+
+    struct sockaddr_un addr;
+    size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "ERROR: Socket path too long: %s\n", path);
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, len);
+    if (path[0] == '@') addr.sun_path[0] = '\0';
+    socklen_t addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len + (path[0] == '@' ? 0 : 1));
+
+    int s = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (s < 0 || connect(s, (struct sockaddr *)&addr, addr_len) < 0) {
+        fprintf(stderr, "ERROR: Cannot connect to %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    uint64_t received = 0, missed = 0;
+    uint32_t last_sequence = 0;
+    double sum_age_ms = 0, max_age_ms = 0;
+    struct timespec pause = { delay_us / 1000000, (delay_us % 1000000) * 1000 };
+
+    while (!stop_requested && (count < 0 || (long)received < count)) {
+        MouseFanoutEvent ev;
+        ssize_t n = recv(s, &ev, sizeof(ev), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            fprintf(stderr, "ERROR: recv failed: %s\n", strerror(errno));
+            break;
+        }
+        if (n == 0) {
+            fprintf(stderr, "DEBUG: read_mouse closed the connection\n");
+            break;
+        }
+        if (n != (ssize_t)sizeof(ev)) continue; // not an event of this version
+
+        uint64_t now = now_ns();
+        double age_ms = now > ev.time_ns ? (double)(now - ev.time_ns) / 1e6 : 0.0;
+        sum_age_ms += age_ms;
+        if (age_ms > max_age_ms) max_age_ms = age_ms;
+        if (last_sequence != 0 && ev.sequence != last_sequence + 1) missed += ev.sequence - last_sequence - 1;
+        last_sequence = ev.sequence;
+        received++;
+
+        if (!quiet) {
+            printf("seq=%u age=%.3f ms dx=%d dy=%d buttons=0x%02x wheel=%d pan=%d\n", ev.sequence, age_ms, ev.dx,
+                   ev.dy, ev.buttons, ev.wheel, ev.hwheel);
+        }
+        if (delay_us > 0) nanosleep(&pause, NULL);
+    }
+
+    fprintf(stderr, "DEBUG: %llu events received, %llu dropped by read_mouse, age avg %.3f ms max %.3f ms\n",
+            (unsigned long long)received, (unsigned long long)missed, received ? sum_age_ms / (double)received : 0.0,
+            max_age_ms);
+    close(s);
+    return 0;
+}
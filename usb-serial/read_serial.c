@@ -2,14 +2,144 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <libusb-1.0/libusb.h>
 
-#define ARDUINO_CONTROL_INTERFACE 0
-#define ARDUINO_DATA_INTERFACE 1
-#define ARDUINO_ENDPOINT_IN 0x83
-#define ARDUINO_ENDPOINT_OUT 0x02
+#include "serial_reader.h"
+#include "serial_pipeline.h"
+#include "serial_writer.h"
+#include "serial_framer.h"
+#include "../common/out_sink.h"
+#include "../common/capture.h"
+#include "../common/usb_wait.h"
+#include "../common/usb_session.h"
+#include "../common/usb_profiles.h"
+
 #define ARDUINO_MAX_PACKET_SIZE 64
 
+#define DEFAULT_QUEUE_DEPTH 8
+#define DEFAULT_TRANSFER_SIZE 16384
+#define DEFAULT_FLUSH_BYTES 65536
+#define DEFAULT_FLUSH_US 10000
+#define DEFAULT_RING_BYTES (4 * 1024 * 1024)
+#define DEFAULT_MAX_MESSAGE 65536
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-a | -t | -S] [-T seconds] [-q depth] [-s transfer_size] [-R ring_bytes] [-o file] [-B bytes] [-F usec] [-w file] [-i file] [-f lines|cobs|slip] [-m bytes] <file_descriptor>\n", prog);
+    fprintf(stderr, "  -a                 Asynchronous mode (default): keep several bulk transfers in flight\n");
+    fprintf(stderr, "  -t                 Threaded mode: async USB, processing and output threads joined by lock-free rings\n");
+    fprintf(stderr, "  -S                 Synchronous mode: one blocking 64-byte transfer at a time\n");
+    fprintf(stderr, "  -T seconds         Exit after this long without data (default %d, 0: never)\n", SERIAL_QUIET_MS / 1000);
+    fprintf(stderr, "  -R ring_bytes      Size of each ring in threaded mode (default %d)\n", DEFAULT_RING_BYTES);
+    fprintf(stderr, "  -q depth           Number of queued transfers in async mode (default %d)\n", DEFAULT_QUEUE_DEPTH);
+    fprintf(stderr, "  -s transfer_size   Bytes per transfer in async mode, rounded to wMaxPacketSize (default %d)\n", DEFAULT_TRANSFER_SIZE);
+    fprintf(stderr, "  -o file            Write received bytes to file instead of stdout\n");
+    fprintf(stderr, "  -B bytes           Flush output once this many bytes are pending (default %d)\n", DEFAULT_FLUSH_BYTES);
+    fprintf(stderr, "  -F usec            Flush output when the oldest pending byte is this old (default %d)\n", DEFAULT_FLUSH_US);
+    fprintf(stderr, "  -w file            Also write every transfer to a capture file (see util/capture_dump)\n");
+    fprintf(stderr, "  -i file            Full duplex: send file (- for stdin) to the device while reading,\n");
+    fprintf(stderr, "                     with -q transfers of -s bytes in flight\n");
+    fprintf(stderr, "  -f lines|cobs|slip Split the stream into messages: text lines, or COBS or SLIP frames\n");
+    fprintf(stderr, "                     (written one per line as hex)\n");
+    fprintf(stderr, "  -m bytes           Longest message with -f, longer ones are dropped (default %d)\n", DEFAULT_MAX_MESSAGE);
+}
+
+static volatile sig_atomic_t stop_requested = 0;
+static const UsbProfile *board;         // interfaces and endpoints, from the device descriptor
+static UsbWait waiter;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+    usb_wait_wake(&waiter); // the writer or capture thread may be the one that got the signal
+}
+
+// Raw bytes go to the sink unchanged; a failed write (e.g. closed pipe) stops the loop.
+static int sink_chunk(void *user, const unsigned char *data, int len) {
+    return out_sink_write(user, data, (size_t)len) < 0;
+}
+
+static long sink_idle(void *user) {
+    OutSink *sink = user;
+    out_sink_poll(sink);
+    return out_sink_timeout_us(sink);
+}
+
+// -f: splits the stream into messages and writes one per line, to the sink
+// or (threaded mode) to the pipeline's output ring.
+typedef struct {
+    SerialFramer framer;
+    int (*write)(void *out, const void *data, size_t len);
+    void *out;
+    OutSink *sink;
+} FrameStage;
+
+static int frame_write_sink(void *out, const void *data, size_t len) {
+    return out_sink_write(out, data, len);
+}
+
+static int frame_write_pipeline(void *out, const void *data, size_t len) {
+    return serial_pipeline_put(out, data, len);
+}
+
+static int frame_message(void *user, const unsigned char *msg, size_t len) {
+    FrameStage *stage = user;
+    if (stage->framer.mode == SERIAL_FRAME_LINES) {
+        return stage->write(stage->out, msg, len) < 0 || stage->write(stage->out, "\n", 1) < 0;
+    }
+    // Binary messages: hex, one message per line.
+    static const char digits[] = "0123456789abcdef";
+    char line[3 * 256];
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        line[n++] = digits[msg[i] >> 4];
+        line[n++] = digits[msg[i] & 15];
+        line[n++] = i + 1 < len ? ' ' : '\n';
+        if (n == sizeof(line) || i + 1 == len) {
+            if (stage->write(stage->out, line, n) < 0) return 1;
+            n = 0;
+        }
+    }
+    return len == 0 ? stage->write(stage->out, "\n", 1) < 0 : 0;
+}
+
+// The transfer buffer is only reused after this returns, so the framer may
+// decode in it.
+static int frame_chunk(void *user, const unsigned char *data, int len) {
+    FrameStage *stage = user;
+    return serial_framer_feed(&stage->framer, (unsigned char *)data, (size_t)len);
+}
+
+static long frame_idle(void *user) {
+    FrameStage *stage = user;
+    return sink_idle(stage->sink);
+}
+
+// -w: records each transfer, then passes it on to the wrapped handler.
+typedef struct {
+    CaptureWriter writer;
+    SerialReadHandler next;
+} CaptureTap;
+
+static int tap_data(void *user, const unsigned char *data, int len) {
+    CaptureTap *tap = user;
+    capture_record(&tap->writer, board->endpoint_in, 0, data, len);
+    return tap->next.on_data(tap->next.user, data, len);
+}
+
+static long tap_idle(void *user) {
+    CaptureTap *tap = user;
+    return tap->next.on_idle(tap->next.user);
+}
+
+static SerialReadHandler capture_tap(CaptureTap *tap, SerialReadHandler next) {
+    SerialReadHandler h = { tap_data, next.on_idle ? tap_idle : NULL, tap, next.stop, next.busy };
+    tap->next = next;
+    return h;
+}
+
 int main(int argc, char **argv) {
     setvbuf(stdout, NULL, _IONBF, 0);
     setvbuf(stderr, NULL, _IONBF, 0);
@@ -18,157 +148,240 @@ int main(int argc, char **argv) {
     libusb_device_handle *handle = NULL;
     int fd = -1;
     int r = 0;
-    int kernel_driver_detached_control = 0;
-    int kernel_driver_detached_data = 0;
+    int exit_code = 1;          // 0 once the read loop has ended without an error
+    UsbSession session;
+    int async_mode = 1;
+    int threaded_mode = 0;
+    long ring_bytes = DEFAULT_RING_BYTES;
+    int queue_depth = DEFAULT_QUEUE_DEPTH;
+    int transfer_size = DEFAULT_TRANSFER_SIZE;
+    const char *output_path = NULL;
+    const char *capture_path = NULL;
+    const char *input_path = NULL;
+    const char *frame_name = NULL;
+    SerialFrameMode frame_mode = SERIAL_FRAME_LINES;
+    long max_message = DEFAULT_MAX_MESSAGE;
+    double quiet_sec = SERIAL_QUIET_MS / 1e3;
+    FrameStage frame;
+    int in_fd = -1;
+    SerialWriter writer;
+    CaptureTap tap;
+    long flush_bytes = DEFAULT_FLUSH_BYTES;
+    long flush_us = DEFAULT_FLUSH_US;
+    int out_fd = STDOUT_FILENO;
+    OutSink sink;
+    int opt;
 
     fprintf(stderr, "DEBUG: Starting read_serial...\n");
 
-    if (argc < 2 || sscanf(argv[1], "%d", &fd) != 1) {
-        fprintf(stderr, "Usage: %s <file_descriptor>\n", argv[0]);
+    while ((opt = getopt(argc, argv, "atST:q:s:R:o:B:F:w:i:f:m:")) != -1) {
+        switch (opt) {
+            case 'a': async_mode = 1; break;
+            case 't': async_mode = 1; threaded_mode = 1; break;
+            case 'S': async_mode = 0; threaded_mode = 0; break;
+            case 'T': quiet_sec = atof(optarg); break;
+            case 'R': ring_bytes = atol(optarg); break;
+            case 'q': queue_depth = atoi(optarg); break;
+            case 's': transfer_size = atoi(optarg); break;
+            case 'o': output_path = optarg; break;
+            case 'B': flush_bytes = atol(optarg); break;
+            case 'F': flush_us = atol(optarg); break;
+            case 'w': capture_path = optarg; break;
+            case 'i': input_path = optarg; break;
+            case 'f': frame_name = optarg; break;
+            case 'm': max_message = atol(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || sscanf(argv[optind], "%d", &fd) != 1 || queue_depth < 1 || transfer_size < 1 ||
+        flush_bytes < 1 || flush_us < 0 || ring_bytes < 1 || max_message < 1 || quiet_sec < 0 ||
+        (frame_name && serial_frame_mode_parse(frame_name, &frame_mode) < 0)) {
+        usage(argv[0]);
         return 1;
     }
-    fprintf(stderr, "DEBUG: File descriptor from argument: %d\n", fd);
 
-    libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
-    fprintf(stderr, "DEBUG: Calling libusb_init()...\n");
-    r = libusb_init(&context);
-    if (r < 0) {
-        fprintf(stderr, "ERROR: libusb_init failed: %s\n", libusb_error_name(r));
+    if (output_path) {
+        out_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out_fd < 0) {
+            fprintf(stderr, "ERROR: Cannot open %s: %s\n", output_path, strerror(errno));
+            return 1;
+        }
+    }
+    if (input_path) {
+        in_fd = strcmp(input_path, "-") == 0 ? STDIN_FILENO : open(input_path, O_RDONLY | O_CLOEXEC);
+        if (in_fd < 0) {
+            fprintf(stderr, "ERROR: Cannot open %s: %s\n", input_path, strerror(errno));
+            return 1;
+        }
+    }
+    if (out_sink_init(&sink, out_fd, (size_t)flush_bytes, (unsigned int)flush_us) < 0) {
+        fprintf(stderr, "ERROR: Cannot allocate %ld byte output buffer\n", flush_bytes);
         return 1;
     }
-    fprintf(stderr, "DEBUG: libusb_init() successful.\n");
+    // A closed pipe or Ctrl+C should end the read loop, not kill the process before the final flush.
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    fprintf(stderr, "DEBUG: File descriptor from argument: %d\n", fd);
 
-    fprintf(stderr, "DEBUG: Calling libusb_wrap_sys_device()...\n");
-    r = libusb_wrap_sys_device(context, (intptr_t)fd, &handle);
-    if (r < 0) {
-        fprintf(stderr, "ERROR: libusb_wrap_sys_device failed: %s\n", libusb_error_name(r));
-        libusb_exit(context);
+    if (usb_session_open(&session, fd) < 0) {
         return 1;
     }
-    if (!handle) {
-        fprintf(stderr, "ERROR: libusb_wrap_sys_device returned a null handle.\n");
-        libusb_exit(context);
-        return 1;
+    context = session.ctx;
+    handle = session.handle;
+
+    board = usb_profile_find(handle, USB_KIND_SERIAL);
+    if ((board->control_interface >= 0 && usb_session_claim(&session, board->control_interface) < 0) ||
+        usb_session_claim(&session, board->interface) < 0) {
+        goto cleanup_and_exit;
     }
-    fprintf(stderr, "DEBUG: libusb_wrap_sys_device() successful. Handle is not NULL.\n");
 
-    // Detach kernel drivers if active
-    if (libusb_kernel_driver_active(handle, ARDUINO_CONTROL_INTERFACE) == 1) {
-        fprintf(stderr, "DEBUG: Detaching kernel driver from control interface %d\n", ARDUINO_CONTROL_INTERFACE);
-        r = libusb_detach_kernel_driver(handle, ARDUINO_CONTROL_INTERFACE);
-        if (r == 0) {
-            kernel_driver_detached_control = 1;
-        } else {
-             fprintf(stderr, "ERROR: Failed to detach kernel driver from control interface: %s\n", libusb_error_name(r));
+    // CDC-ACM line coding (9600 baud, 8-N-1), then DTR and RTS. Both are only
+    // queued: they complete while the read loop below already waits for data.
+    unsigned char line_coding[7] = { 0x80, 0x25, 0x00, 0x00, 0x00, 0x00, 0x08 };
+    if (board->control_interface >= 0) {
+        usb_session_control_out(&session, "SET_LINE_CODING", 0x21, 0x20, 0, board->control_interface,
+                                line_coding, sizeof(line_coding));
+        usb_session_control_out(&session, "SET_CONTROL_LINE_STATE", 0x21, 0x22, 0x03, board->control_interface, NULL, 0);
+    }
+
+    if (async_mode && usb_wait_init(&waiter, context) < 0) {
+        fprintf(stderr, "ERROR: Could not set up the event loop: %s\n", strerror(errno));
+        goto cleanup_and_exit;
+    }
+
+    SerialReadStats stats = {0};
+    unsigned int quiet_ms = (unsigned int)(quiet_sec * 1000);
+    SerialReadHandler handler = { sink_chunk, sink_idle, &sink, &stop_requested, NULL };
+
+    if (frame_name) {
+        if (serial_framer_init(&frame.framer, frame_mode, (size_t)max_message, frame_message, &frame) < 0) {
+            fprintf(stderr, "ERROR: Cannot allocate %ld byte message buffer\n", max_message);
+            goto cleanup_and_exit;
         }
+        frame.write = frame_write_sink;
+        frame.out = &sink;
+        frame.sink = &sink;
+        const char *kernel;
+        serial_framer_best(&kernel);
+        fprintf(stderr, "DEBUG: Framing the stream as %s (%s delimiter scan).\n", serial_frame_mode_name(frame_mode), kernel);
+        SerialReadHandler framed = { frame_chunk, frame_idle, &frame, &stop_requested, NULL };
+        handler = framed;
+    }
+
+    if (async_mode) {
+        int max_packet = libusb_get_max_packet_size(libusb_get_device(handle), board->endpoint_in);
+        if (max_packet <= 0) max_packet = ARDUINO_MAX_PACKET_SIZE;
+        transfer_size = serial_round_transfer_size(transfer_size, max_packet);
     }
-    if (libusb_kernel_driver_active(handle, ARDUINO_DATA_INTERFACE) == 1) {
-        fprintf(stderr, "DEBUG: Detaching kernel driver from data interface %d\n", ARDUINO_DATA_INTERFACE);
-        r = libusb_detach_kernel_driver(handle, ARDUINO_DATA_INTERFACE);
-        if (r == 0) {
-            kernel_driver_detached_data = 1;
-        } else {
-            fprintf(stderr, "ERROR: Failed to detach kernel driver from data interface: %s\n", libusb_error_name(r));
+
+    if (capture_path) {
+        // A transfer has to fit one capture record; keep it a multiple of any bulk packet size.
+        if (transfer_size > CAPTURE_MAX_PAYLOAD) {
+            transfer_size = CAPTURE_MAX_PAYLOAD & ~511;
+            fprintf(stderr, "WARN: Transfer size limited to %d bytes while capturing\n", transfer_size);
+        }
+        if (capture_open(&tap.writer, capture_path) < 0) {
+            fprintf(stderr, "ERROR: Cannot create capture file %s: %s\n", capture_path, strerror(errno));
+            goto free_framer;
         }
+        fprintf(stderr, "DEBUG: Writing transfers to %s.\n", capture_path);
+        handler = capture_tap(&tap, handler);
     }
 
-    fprintf(stderr, "DEBUG: Claiming control interface %d...\n", ARDUINO_CONTROL_INTERFACE);
-    r = libusb_claim_interface(handle, ARDUINO_CONTROL_INTERFACE);
-    if (r < 0) {
-        fprintf(stderr, "ERROR: libusb_claim_interface (control) failed: %s\n", libusb_error_name(r));
-        goto cleanup_and_exit;
+    if (input_path) {
+        r = serial_writer_start(&writer, handle, board->endpoint_out, in_fd, queue_depth, transfer_size);
+        if (r < 0) {
+            fprintf(stderr, "ERROR: Could not start the writer: %s\n", libusb_error_name(r));
+            serial_writer_free(&writer);
+            goto close_capture;
+        }
+        fprintf(stderr, "DEBUG: Sending %s to endpoint %02x (%d transfers x %d bytes).\n",
+                in_fd == STDIN_FILENO ? "stdin" : input_path, board->endpoint_out, queue_depth, transfer_size);
+        handler.busy = &writer.busy;
     }
 
-    // CDC-ACM line coding setup (baud rate, etc.)
-    unsigned char line_coding[7] = { 0x80, 0x25, 0x00, 0x00, 0x00, 0x00, 0x08 }; // 9600 baud, 8-N-1
-    fprintf(stderr, "DEBUG: Calling libusb_control_transfer(SET_LINE_CODING) on interface %d...\n", ARDUINO_CONTROL_INTERFACE);
-    r = libusb_control_transfer(handle, 0x21, 0x20, 0, ARDUINO_CONTROL_INTERFACE, line_coding, sizeof(line_coding), 100);
-    if (r < 0) {
-        fprintf(stderr, "WARN: libusb_control_transfer(SET_LINE_CODING) failed: %s\n", libusb_error_name(r));
+    if (threaded_mode) {
+        SerialPipeline pipeline;
+        if (frame_name) {
+            frame.write = frame_write_pipeline;
+            frame.out = &pipeline;
+        }
+        if (serial_pipeline_start(&pipeline, &sink, frame_name ? &frame.framer : NULL, (size_t)ring_bytes) < 0) {
+            fprintf(stderr, "ERROR: Could not start pipeline threads\n");
+            goto stop_writer;
+        }
+        // The USB stage only copies into ring1; the output thread owns the sink.
+        SerialReadHandler usb_handler = { serial_pipeline_usb_data, NULL, &pipeline, &stop_requested, handler.busy };
+        if (capture_path) usb_handler = capture_tap(&tap, usb_handler);
+        fprintf(stderr, "DEBUG: Entering threaded read loop (%d transfers x %d bytes, rings %zu bytes)...\n",
+                queue_depth, transfer_size, pipeline.ring1.capacity);
+        r = serial_read_async(&waiter, handle, board->endpoint_in, queue_depth, transfer_size, quiet_ms, &usb_handler, &stats);
+        serial_pipeline_finish(&pipeline);
+        serial_pipeline_report(&pipeline);
+        serial_pipeline_free(&pipeline);
+    } else if (async_mode) {
+        fprintf(stderr, "DEBUG: Entering async read loop (%d transfers x %d bytes)...\n",
+                queue_depth, transfer_size);
+        r = serial_read_async(&waiter, handle, board->endpoint_in, queue_depth, transfer_size, quiet_ms, &handler, &stats);
     } else {
-        fprintf(stderr, "DEBUG: libusb_control_transfer(SET_LINE_CODING) successful (sent %d bytes).\n", r);
+        fprintf(stderr, "DEBUG: Entering read loop...\n");
+        r = serial_read_sync(handle, board->endpoint_in, ARDUINO_MAX_PACKET_SIZE, quiet_ms, &handler, &stats);
     }
+    if (r == 0) exit_code = 0;
 
-    // Set DTR (Data Terminal Ready) and RTS (Request to Send)
-    fprintf(stderr, "DEBUG: Calling libusb_control_transfer(SET_CONTROL_LINE_STATE) on interface %d...\n", ARDUINO_CONTROL_INTERFACE);
-    r = libusb_control_transfer(handle, 0x21, 0x22, 0x03, ARDUINO_CONTROL_INTERFACE, NULL, 0, 100);
-    if (r < 0) {
-        fprintf(stderr, "WARN: libusb_control_transfer(SET_CONTROL_LINE_STATE) failed: %s\n", libusb_error_name(r));
-    } else {
-        fprintf(stderr, "DEBUG: libusb_control_transfer(SET_CONTROL_LINE_STATE) successful.\n");
+    session.first_data = stats.first_data;
+    fprintf(stderr, "\nDEBUG: Read %llu bytes in %llu transfers over %.2f s (%.3f MB/s)\n",
+            (unsigned long long)stats.bytes, (unsigned long long)stats.transfers,
+            stats.seconds, serial_stats_mb_per_sec(&stats));
+    if (frame_name) {
+        if (!threaded_mode) serial_framer_finish(&frame.framer);
+        serial_framer_report(&frame.framer);
     }
 
-    fprintf(stderr, "DEBUG: Claiming data interface %d...\n", ARDUINO_DATA_INTERFACE);
-    r = libusb_claim_interface(handle, ARDUINO_DATA_INTERFACE);
-    if (r < 0) {
-        fprintf(stderr, "ERROR: libusb_claim_interface (data) failed: %s\n", libusb_error_name(r));
-        goto cleanup_and_exit;
+    // Unwound in the reverse order of setup; a failed step jumps to the
+    // label after its own.
+stop_writer:
+    if (input_path) {
+        serial_writer_stop(&writer, context);
+        serial_writer_report(&writer);
+        serial_writer_free(&writer);
     }
-    fprintf(stderr, "DEBUG: Successfully claimed data interface %d.\n", ARDUINO_DATA_INTERFACE);
-
-    // Give device a moment
-    usleep(50000); // 50ms should be enough
-
-    unsigned char buffer[ARDUINO_MAX_PACKET_SIZE + 1];
-    int actual_length;
-    int timeout_errors = 0;
-
-    fprintf(stderr, "DEBUG: Entering read loop...\n");
-    while (1) {
-        r = libusb_bulk_transfer(
-            handle, ARDUINO_ENDPOINT_IN, buffer, ARDUINO_MAX_PACKET_SIZE, &actual_length, 2000
-        );
-
-        if (r == LIBUSB_SUCCESS) {
-            timeout_errors = 0; // Reset counter on success
-            if (actual_length > 0) {
-                buffer[actual_length] = '\0';
-                fprintf(stderr, "%s", buffer); // Print to stderr to bypass stdout buffering
-            }
-        } else if (r == LIBUSB_ERROR_TIMEOUT) {
-            timeout_errors++;
-            fprintf(stderr, ".\n"); // Print a dot for timeout
-            if (timeout_errors >= 3) {
-                fprintf(stderr, "ERROR: Exiting after 3 consecutive timeouts.\n");
-                break;
-            }
-        } else {
-            fprintf(stderr, "ERROR: libusb_bulk_transfer failed: %s\n", libusb_error_name(r));
-            if (r == LIBUSB_ERROR_PIPE) {
-                fprintf(stderr, "DEBUG: Pipe error detected. Clearing halt on endpoint %02x...\n", ARDUINO_ENDPOINT_IN);
-                int rh = libusb_clear_halt(handle, ARDUINO_ENDPOINT_IN);
-                if (rh == 0) {
-                    fprintf(stderr, "DEBUG: Halt cleared successfully. Retrying transfer.\n");
-                    continue;
-                } else {
-                    fprintf(stderr, "ERROR: Could not clear halt: %s\n", libusb_error_name(rh));
-                }
-            }
-            if (r == LIBUSB_ERROR_NO_DEVICE) {
-                fprintf(stderr, "ERROR: Device disconnected. Exiting loop.\n");
-                break;
-            }
-            // Break on other errors too
-            break;
+close_capture:
+    if (capture_path) {
+        if (capture_close(&tap.writer) < 0) {
+            fprintf(stderr, "ERROR: Writing %s failed: %s\n", capture_path, strerror(errno));
+            exit_code = 1;
         }
+        fprintf(stderr, "DEBUG: Captured %llu transfers (%llu bytes), %llu dropped.\n",
+                (unsigned long long)tap.writer.records, (unsigned long long)tap.writer.bytes_written,
+                (unsigned long long)tap.writer.dropped);
     }
+free_framer:
+    if (frame_name) serial_framer_free(&frame.framer);
 
 cleanup_and_exit:
     fprintf(stderr, "\nDEBUG: Cleaning up and exiting...\n");
-    libusb_release_interface(handle, ARDUINO_CONTROL_INTERFACE);
-    libusb_release_interface(handle, ARDUINO_DATA_INTERFACE);
-
-    if (kernel_driver_detached_control) {
-        libusb_attach_kernel_driver(handle, ARDUINO_CONTROL_INTERFACE);
+    if (waiter.active) usb_wait_close(&waiter);
+    out_sink_close(&sink);
+    fprintf(stderr, "DEBUG: Wrote %llu bytes of output in %llu writes.\n",
+            (unsigned long long)sink.bytes_written, (unsigned long long)sink.writes);
+    if (sink.error) {
+        fprintf(stderr, "ERROR: Output write failed: %s\n", strerror(sink.error));
+        exit_code = 1;
     }
-    if (kernel_driver_detached_data) {
-        libusb_attach_kernel_driver(handle, ARDUINO_DATA_INTERFACE);
+    if (output_path) {
+        close(out_fd);
     }
-
-    fprintf(stderr, "DEBUG: Closing device handle.\n");
-    libusb_close(handle);
-    fprintf(stderr, "DEBUG: Exiting libusb.\n");
-    libusb_exit(context);
+    if (in_fd > STDIN_FILENO) {
+        close(in_fd);
+    }
+    usb_session_report(&session);
+    fprintf(stderr, "DEBUG: Releasing the device.\n");
+    usb_session_close(&session);
     fprintf(stderr, "DEBUG: End of program.\n");
-    return 0;
+    return exit_code;
 }
@@ -0,0 +1,372 @@
+#ifndef SERIAL_FRAMER_H
+#define SERIAL_FRAMER_H
+
+/*
+ * Message framing for the serial byte stream
+ *
+ * Splits the bytes read from a CDC-ACM device into messages, whatever the
+ * transfer boundaries:
+ *   SERIAL_FRAME_LINES  text lines ending in '\n' (a '\r' before it is dropped)
+ *   SERIAL_FRAME_COBS   Consistent Overhead Byte Stuffing, frames end in 0x00
+ *   SERIAL_FRAME_SLIP   RFC 1055, frames end in 0xC0 (END)
+ *
+ * Messages are handed to `on_message` as (pointer, length) views. A message
+ * that lies inside one chunk points straight into the chunk; COBS and SLIP
+ * frames are decoded in place there (the decoded message is never longer
+ * than the frame), so the chunk must be writable. Only a message that
+ * straddles two chunks is copied, into a carry buffer sized for the
+ * longest message.
+ * A view is valid until `on_message` returns.
+ *
+ * The delimiter scan compares 16 (SSE2, NEON) or 32 (AVX2) bytes at a time
+ * and walks the resulting bit mask, so a block holding several short
+ * messages is compared once. serial_framer_init() picks the widest kernel
+ * the CPU supports; the others are exposed for benchmarks.
+ *
+ * Usage:
+ *   SerialFramer f;
+ *   serial_framer_init(&f, SERIAL_FRAME_LINES, 65536, on_message, user);
+ *   serial_framer_feed(&f, chunk, len);   // for every chunk, in order
+ *   serial_framer_finish(&f);             // a last line without '\n'
+ *   serial_framer_report(&f);
+ *   serial_framer_free(&f);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SERIAL_FRAMER_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define SERIAL_FRAMER_NEON 1
+#endif
+
+#define SLIP_END 0xc0
+#define SLIP_ESC 0xdb
+#define SLIP_ESC_END 0xdc
+#define SLIP_ESC_ESC 0xdd
+
+typedef enum {
+    SERIAL_FRAME_LINES,
+    SERIAL_FRAME_COBS,
+    SERIAL_FRAME_SLIP,
+} SerialFrameMode;
+
+// Returns nonzero to stop (serial_framer_feed() then returns nonzero too).
+typedef int (*serial_message_cb)(void *user, const unsigned char *msg, size_t len);
+
+typedef struct SerialFramer SerialFramer;
+
+// Emits every message ending in [p, end). Returns the start of the
+// unterminated rest, or NULL if `on_message` asked to stop.
+typedef unsigned char *(*serial_framer_split_fn)(SerialFramer *f, unsigned char *p, unsigned char *end);
+
+struct SerialFramer {
+    SerialFrameMode mode;
+    unsigned char delimiter;
+    size_t max_message;
+    serial_message_cb on_message;
+    void *user;
+    serial_framer_split_fn split;
+
+    unsigned char *carry;        // start of a message that straddles chunks
+    size_t carry_len;
+    size_t carry_size;
+    int skipping;                // carried message outgrew max_message, drop up to the next delimiter
+
+    uint64_t messages;
+    uint64_t message_bytes;      // after decoding
+    uint64_t carried;            // messages reassembled from several chunks
+    uint64_t carried_bytes;      // bytes copied to do that
+    uint64_t oversized;          // longer than max_message, dropped
+    uint64_t bad_frames;         // invalid COBS/SLIP encoding, dropped
+};
+
+static inline const char *serial_frame_mode_name(SerialFrameMode mode) {
+    switch (mode) {
+        case SERIAL_FRAME_COBS: return "cobs";
+        case SERIAL_FRAME_SLIP: return "slip";
+        default: return "lines";
+    }
+}
+
+// Returns 0 and sets *mode, or -1 for an unknown name.
+static inline int serial_frame_mode_parse(const char *name, SerialFrameMode *mode) {
+    if (strcmp(name, "lines") == 0) *mode = SERIAL_FRAME_LINES;
+    else if (strcmp(name, "cobs") == 0) *mode = SERIAL_FRAME_COBS;
+    else if (strcmp(name, "slip") == 0) *mode = SERIAL_FRAME_SLIP;
+    else return -1;
+    return 0;
+}
+
+// Decode a COBS frame (without its 0x00 delimiter) in place. The message
+// starts at buf + 1: every code byte but the first becomes the 0x00 it
+// stands for, so nothing moves unless a 0xFF group (no 0x00 after it)
+// comes before. Returns the message length, or -1 if the frame is malformed.
+static inline long serial_cobs_decode(unsigned char *buf, size_t len) {
+    unsigned char *msg = buf + 1;
+    size_t in = 0, out = 0;
+    int zero = 0;
+    while (in < len) {
+        unsigned char code = buf[in];
+        if (code == 0 || in + code > len) return -1;
+        if (zero) msg[out++] = 0; // overwrites the code byte just read
+        if (out != in) memmove(msg + out, buf + in + 1, (size_t)code - 1);
+        out += (size_t)code - 1;
+        in += code;
+        zero = code < 0xff;
+    }
+    return (long)out;
+}
+
+// Undo SLIP escaping in place, moving the runs between escapes down.
+// Returns the message length, or -1 for an escape that is not ESC_END or
+// ESC_ESC.
+static inline long serial_slip_decode(unsigned char *buf, size_t len) {
+    unsigned char *esc = memchr(buf, SLIP_ESC, len);
+    if (!esc) return (long)len;
+    size_t in = (size_t)(esc - buf), out = in;
+    while (in < len) {
+        // buf[in] is an ESC
+        if (in + 1 == len) return -1;
+        if (buf[in + 1] == SLIP_ESC_END) buf[out++] = SLIP_END;
+        else if (buf[in + 1] == SLIP_ESC_ESC) buf[out++] = SLIP_ESC;
+        else return -1;
+        in += 2;
+        esc = memchr(buf + in, SLIP_ESC, len - in);
+        size_t run = (esc ? (size_t)(esc - buf) : len) - in;
+        memmove(buf + out, buf + in, run);
+        out += run;
+        in += run;
+    }
+    return (long)out;
+}
+
+// Decode one frame in place and hand it out. Returns nonzero to stop.
+static inline int serial_framer_emit(SerialFramer *f, unsigned char *frame, size_t len) {
+    unsigned char *msg = frame;
+    long n = (long)len;
+    switch (f->mode) {
+        case SERIAL_FRAME_LINES:
+            if (len > 0 && frame[len - 1] == '\r') n--;
+            break;
+        case SERIAL_FRAME_COBS:
+            if (len == 0) return 0; // back-to-back delimiters: nothing in between
+            n = serial_cobs_decode(frame, len);
+            msg = frame + 1;
+            break;
+        case SERIAL_FRAME_SLIP:
+            if (len == 0) return 0; // senders put END before frames too
+            n = serial_slip_decode(frame, len);
+            break;
+    }
+    if (n < 0) {
+        f->bad_frames++;
+        return 0;
+    }
+    if ((size_t)n > f->max_message) {
+        f->oversized++;
+        return 0;
+    }
+    f->messages++;
+    f->message_bytes += (uint64_t)n;
+    return f->on_message(f->user, msg, (size_t)n);
+}
+
+static inline unsigned char *serial_framer_split_scalar(SerialFramer *f, unsigned char *p, unsigned char *end) {
+    unsigned char *q;
+    while (p < end && (q = memchr(p, f->delimiter, (size_t)(end - p))) != NULL) {
+        if (serial_framer_emit(f, p, (size_t)(q - p))) return NULL;
+        p = q + 1;
+    }
+    return p;
+}
+
+#ifdef SERIAL_FRAMER_X86
+
+// Each set bit of a block's mask is one delimiter. Decoding only writes
+// before the delimiter it ends at, so the mask of the block stays valid.
+static inline unsigned char *serial_framer_split_sse2(SerialFramer *f, unsigned char *p, unsigned char *end) {
+    const __m128i delim = _mm_set1_epi8((char)f->delimiter);
+    unsigned char *start = p;
+    for (; p + 16 <= end; p += 16) {
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), delim));
+        while (mask) {
+            unsigned char *q = p + __builtin_ctz(mask);
+            if (serial_framer_emit(f, start, (size_t)(q - start))) return NULL;
+            start = q + 1;
+            mask &= mask - 1;
+        }
+    }
+    // The last partial block: carry on from `start`, but only look for delimiters from `p`.
+    unsigned char *q;
+    while (p < end && (q = memchr(p, f->delimiter, (size_t)(end - p))) != NULL) {
+        if (serial_framer_emit(f, start, (size_t)(q - start))) return NULL;
+        start = p = q + 1;
+    }
+    return start;
+}
+
+__attribute__((target("avx2")))
+static inline unsigned char *serial_framer_split_avx2(SerialFramer *f, unsigned char *p, unsigned char *end) {
+    const __m256i delim = _mm256_set1_epi8((char)f->delimiter);
+    unsigned char *start = p;
+    for (; p + 32 <= end; p += 32) {
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), delim));
+        while (mask) {
+            unsigned char *q = p + __builtin_ctz(mask);
+            if (serial_framer_emit(f, start, (size_t)(q - start))) return NULL;
+            start = q + 1;
+            mask &= mask - 1;
+        }
+    }
+    unsigned char *q;
+    while (p < end && (q = memchr(p, f->delimiter, (size_t)(end - p))) != NULL) {
+        if (serial_framer_emit(f, start, (size_t)(q - start))) return NULL;
+        start = p = q + 1;
+    }
+    return start;
+}
+
+#endif // SERIAL_FRAMER_X86
+
+#ifdef SERIAL_FRAMER_NEON
+
+// NEON has no movemask: narrowing the compare result by 4 bits per byte
+// gives a 64-bit mask with one nibble per byte.
+static inline unsigned char *serial_framer_split_neon(SerialFramer *f, unsigned char *p, unsigned char *end) {
+    const uint8x16_t delim = vdupq_n_u8(f->delimiter);
+    unsigned char *start = p;
+    for (; p + 16 <= end; p += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(p), delim);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        while (mask) {
+            int bit = __builtin_ctzll(mask);
+            unsigned char *q = p + bit / 4;
+            if (serial_framer_emit(f, start, (size_t)(q - start))) return NULL;
+            start = q + 1;
+            mask &= ~(0xfull << (bit & ~3));
+        }
+    }
+    unsigned char *q;
+    while (p < end && (q = memchr(p, f->delimiter, (size_t)(end - p))) != NULL) {
+        if (serial_framer_emit(f, start, (size_t)(q - start))) return NULL;
+        start = p = q + 1;
+    }
+    return start;
+}
+
+#endif // SERIAL_FRAMER_NEON
+
+// Widest kernel the CPU supports, and its name.
+static inline serial_framer_split_fn serial_framer_best(const char **name) {
+#if defined(SERIAL_FRAMER_X86)
+    if (__builtin_cpu_supports("avx2")) {
+        if (name) *name = "avx2";
+        return serial_framer_split_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        if (name) *name = "sse2";
+        return serial_framer_split_sse2;
+    }
+#elif defined(SERIAL_FRAMER_NEON)
+    if (name) *name = "neon";
+    return serial_framer_split_neon;
+#endif
+    if (name) *name = "scalar";
+    return serial_framer_split_scalar;
+}
+
+// Returns 0 or -1 (out of memory).
+static inline int serial_framer_init(SerialFramer *f, SerialFrameMode mode, size_t max_message,
+                                     serial_message_cb on_message, void *user) {
+    memset(f, 0, sizeof(*f));
+    f->mode = mode;
+    f->delimiter = mode == SERIAL_FRAME_COBS ? 0x00 : mode == SERIAL_FRAME_SLIP ? SLIP_END : '\n';
+    f->max_message = max_message;
+    f->on_message = on_message;
+    f->user = user;
+    f->split = serial_framer_best(NULL);
+    // The longest message as it is sent: a SLIP frame of nothing but escapes is twice as long.
+    f->carry_size = max_message * 2 + 2;
+    f->carry = malloc(f->carry_size);
+    return f->carry ? 0 : -1;
+}
+
+// Keep the start of a message that continues in the next chunk.
+static inline void serial_framer_carry(SerialFramer *f, const unsigned char *data, size_t len) {
+    if (f->skipping) return;
+    if (f->carry_len + len > f->carry_size) {
+        f->oversized++;
+        f->skipping = 1;
+        f->carry_len = 0;
+        return;
+    }
+    memcpy(f->carry + f->carry_len, data, len);
+    f->carry_len += len;
+    f->carried_bytes += len;
+}
+
+// Feed the next chunk of the stream. Decoding happens in place, so `data`
+// is modified. Returns nonzero if `on_message` asked to stop.
+static inline int serial_framer_feed(SerialFramer *f, unsigned char *data, size_t len) {
+    unsigned char *p = data, *end = data + len;
+
+    if (f->carry_len || f->skipping) {
+        unsigned char *q = memchr(p, f->delimiter, len);
+        serial_framer_carry(f, p, q ? (size_t)(q - p) : len);
+        if (!q) return 0;
+        p = q + 1;
+        if (f->skipping) {
+            f->skipping = 0;
+        } else {
+            uint64_t before = f->messages;
+            size_t n = f->carry_len;
+            f->carry_len = 0;
+            if (serial_framer_emit(f, f->carry, n)) return 1;
+            f->carried += f->messages - before;
+        }
+    }
+
+    unsigned char *rest = f->split(f, p, end);
+    if (!rest) return 1;
+    if (rest < end) serial_framer_carry(f, rest, (size_t)(end - rest));
+    return 0;
+}
+
+// End of the stream: a last line without '\n' is still a message; an
+// unterminated COBS or SLIP frame is dropped. Returns nonzero if
+// `on_message` asked to stop.
+static inline int serial_framer_finish(SerialFramer *f) {
+    size_t n = f->carry_len;
+    f->carry_len = 0;
+    if (f->skipping || n == 0) return 0;
+    if (f->mode != SERIAL_FRAME_LINES) {
+        f->bad_frames++;
+        return 0;
+    }
+    uint64_t before = f->messages;
+    int r = serial_framer_emit(f, f->carry, n);
+    f->carried += f->messages - before;
+    return r;
+}
+
+static inline void serial_framer_report(const SerialFramer *f) {
+    fprintf(stderr, "DEBUG: Framing (%s): %llu messages, %llu bytes; %llu reassembled across transfers (%llu bytes copied), %llu oversized and %llu bad frames dropped\n",
+            serial_frame_mode_name(f->mode), (unsigned long long)f->messages, (unsigned long long)f->message_bytes,
+            (unsigned long long)f->carried, (unsigned long long)f->carried_bytes,
+            (unsigned long long)f->oversized, (unsigned long long)f->bad_frames);
+}
+
+static inline void serial_framer_free(SerialFramer *f) {
+    free(f->carry);
+    f->carry = NULL;
+}
+
+#endif // SERIAL_FRAMER_H
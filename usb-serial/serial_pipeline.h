@@ -0,0 +1,242 @@
+#ifndef SERIAL_PIPELINE_H
+#define SERIAL_PIPELINE_H
+
+/*
+ * Three-stage threaded pipeline for read_serial
+ *
+ *   USB event thread  --ring1-->  processing thread  --ring2-->  output thread
+ *   (caller's thread,             (serial_pipeline_              (writes to the
+ *    serial_read_async)            process_main)                  OutSink)
+ *
+ * Both rings are preallocated lock-free SPSC byte rings (common/spsc_ring.h).
+ * The USB stage never blocks: if ring1 is full the chunk is dropped and
+ * counted, so the bulk endpoint keeps being serviced no matter how slow
+ * the output is. The processing stage waits for space in ring2, so a slow
+ * sink first fills ring2, then ring1, and only then costs data.
+ *
+ * With a framer (serial_framer.h) the processing stage splits ring1 into
+ * messages, decoding them in place in ring1, and the framer's callback
+ * writes them to ring2 with serial_pipeline_put().
+ *
+ * Each stage reports when it falls behind (at most once per second) and
+ * serial_pipeline_report() prints the counters at exit.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "serial_reader.h"
+#include "serial_framer.h"
+#include "../common/spsc_ring.h"
+#include "../common/out_sink.h"
+
+typedef struct {
+    SpscRing ring1;              // USB -> processing
+    SpscRing ring2;              // processing -> output
+    OutSink *sink;
+    SerialFramer *framer;        // optional
+    double start;
+
+    // USB stage (written by the USB thread only)
+    uint64_t usb_bytes;
+    uint64_t usb_dropped_bytes;
+    uint64_t usb_drop_events;
+    double usb_last_warn;
+
+    // Processing stage
+    uint64_t proc_bytes;
+    uint64_t proc_stalls;
+    double proc_stall_seconds;
+    double proc_last_warn;
+
+    // Output stage
+    uint64_t out_bytes;
+    atomic_int out_error;        // set by the output thread, polled by the USB thread
+
+    pthread_t proc_thread;
+    pthread_t out_thread;
+} SerialPipeline;
+
+static inline void serial_pipeline_warn(SerialPipeline *p, double *last_warn, const char *what, uint64_t count) {
+    double now = serial_now_sec();
+    if (now - *last_warn < 1.0) return;
+    *last_warn = now;
+    fprintf(stderr, "WARN: [%.3f s] %s (%llu so far)\n", now - p->start, what, (unsigned long long)count);
+}
+
+// USB stage: called from libusb's event handling, must not block.
+static inline int serial_pipeline_usb_data(void *user, const unsigned char *data, int len) {
+    SerialPipeline *p = user;
+    size_t n = spsc_ring_write(&p->ring1, data, (size_t)len);
+    p->usb_bytes += n;
+    if (n < (size_t)len) {
+        p->usb_dropped_bytes += (size_t)len - n;
+        p->usb_drop_events++;
+        serial_pipeline_warn(p, &p->usb_last_warn,
+                             "processing stage fell behind: usb->process ring full, dropped bytes",
+                             p->usb_dropped_bytes);
+    }
+    return atomic_load_explicit(&p->out_error, memory_order_relaxed);
+}
+
+// Processing stage: wait until ring2 has room. Returns -1 if the output
+// stage gave up.
+static inline int serial_pipeline_wait_ring2(SerialPipeline *p) {
+    p->ring2.full_events++;
+    p->proc_stalls++;
+    serial_pipeline_warn(p, &p->proc_last_warn,
+                         "output stage fell behind: process->output ring full, processing stalled",
+                         p->proc_stalls);
+    double t0 = serial_now_sec();
+    spsc_ring_wait_writable(&p->ring2, 1, -1);
+    p->proc_stall_seconds += serial_now_sec() - t0;
+    return atomic_load(&p->ring2.closed) ? -1 : 0;
+}
+
+// Processing stage: copy `len` bytes to ring2, waiting for room as needed.
+// Returns 0 or -1 (output stage gave up).
+static inline int serial_pipeline_put(SerialPipeline *p, const void *data, size_t len) {
+    const unsigned char *src = data;
+    while (len > 0) {
+        unsigned char *out;
+        size_t space = spsc_ring_write_span(&p->ring2, &out);
+        if (space == 0) {
+            if (serial_pipeline_wait_ring2(p) < 0) return -1;
+            continue;
+        }
+        size_t n = len < space ? len : space;
+        memcpy(out, src, n);
+        spsc_ring_produce(&p->ring2, n);
+        src += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Processing stage: moves bytes from ring1 to ring2, through the framer if
+// there is one.
+static inline void *serial_pipeline_process_main(void *arg) {
+    SerialPipeline *p = arg;
+    for (;;) {
+        const unsigned char *in;
+        size_t avail = spsc_ring_read_span(&p->ring1, &in);
+        if (avail == 0) {
+            if (spsc_ring_drained(&p->ring1)) break;
+            spsc_ring_wait_readable(&p->ring1, -1);
+            continue;
+        }
+
+        if (p->framer) {
+            // The span is ours until it is consumed, so it can be decoded in place.
+            int stop = serial_framer_feed(p->framer, (unsigned char *)in, avail);
+            spsc_ring_consume(&p->ring1, avail);
+            p->proc_bytes += avail;
+            if (stop) break; // output stage gave up
+            continue;
+        }
+
+        unsigned char *out;
+        size_t space = spsc_ring_write_span(&p->ring2, &out);
+        if (space == 0) {
+            if (serial_pipeline_wait_ring2(p) < 0) break;
+            continue;
+        }
+
+        size_t n = avail < space ? avail : space;
+        memcpy(out, in, n);
+        spsc_ring_produce(&p->ring2, n);
+        spsc_ring_consume(&p->ring1, n);
+        p->proc_bytes += n;
+    }
+    if (p->framer && !atomic_load(&p->ring2.closed)) serial_framer_finish(p->framer);
+    spsc_ring_close(&p->ring2);
+    return NULL;
+}
+
+// Output stage: drains ring2 into the sink, honouring the sink's flush deadline.
+static inline void *serial_pipeline_output_main(void *arg) {
+    SerialPipeline *p = arg;
+    for (;;) {
+        const unsigned char *data;
+        size_t avail = spsc_ring_read_span(&p->ring2, &data);
+        if (avail > 0) {
+            if (out_sink_write(p->sink, data, avail) < 0) break;
+            spsc_ring_consume(&p->ring2, avail);
+            p->out_bytes += avail;
+            continue;
+        }
+        if (spsc_ring_drained(&p->ring2)) break;
+        spsc_ring_wait_readable(&p->ring2, out_sink_timeout_us(p->sink));
+        if (out_sink_poll(p->sink) < 0) break;
+    }
+    if (out_sink_flush(p->sink) < 0 || p->sink->error) {
+        // Tell the other stages to stop instead of filling rings nobody reads.
+        atomic_store(&p->out_error, 1);
+        spsc_ring_close(&p->ring2);
+    }
+    return NULL;
+}
+
+// Allocate the rings and start the processing and output threads. `framer`
+// may be NULL for a pass-through. Returns 0 or -1.
+static inline int serial_pipeline_start(SerialPipeline *p, OutSink *sink, SerialFramer *framer, size_t ring_bytes) {
+    memset(p, 0, sizeof(*p));
+    p->sink = sink;
+    p->framer = framer;
+    p->start = serial_now_sec();
+    if (spsc_ring_init(&p->ring1, ring_bytes) < 0) return -1;
+    if (spsc_ring_init(&p->ring2, ring_bytes) < 0) {
+        spsc_ring_free(&p->ring1);
+        return -1;
+    }
+
+    // Signals (Ctrl+C, SIGPIPE) stay with the USB thread that owns the read loop.
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int r = pthread_create(&p->proc_thread, NULL, serial_pipeline_process_main, p);
+    if (r == 0) {
+        r = pthread_create(&p->out_thread, NULL, serial_pipeline_output_main, p);
+        if (r != 0) {
+            spsc_ring_close(&p->ring1);
+            pthread_join(p->proc_thread, NULL);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (r != 0) {
+        spsc_ring_free(&p->ring1);
+        spsc_ring_free(&p->ring2);
+        return -1;
+    }
+    return 0;
+}
+
+// Called by the USB thread after its read loop ended: drain both stages and join.
+static inline void serial_pipeline_finish(SerialPipeline *p) {
+    spsc_ring_close(&p->ring1);
+    pthread_join(p->proc_thread, NULL);
+    pthread_join(p->out_thread, NULL);
+}
+
+static inline void serial_pipeline_report(SerialPipeline *p) {
+    fprintf(stderr, "DEBUG: Pipeline usb stage:     %llu bytes in, %llu bytes dropped in %llu events (ring1 %zu bytes, high water %zu)\n",
+            (unsigned long long)p->usb_bytes, (unsigned long long)p->usb_dropped_bytes,
+            (unsigned long long)p->usb_drop_events, p->ring1.capacity, p->ring1.high_water);
+    fprintf(stderr, "DEBUG: Pipeline process stage: %llu bytes, stalled %llu times for %.3f s on a full ring2 (ring2 %zu bytes, high water %zu)\n",
+            (unsigned long long)p->proc_bytes, (unsigned long long)p->proc_stalls,
+            p->proc_stall_seconds, p->ring2.capacity, p->ring2.high_water);
+    fprintf(stderr, "DEBUG: Pipeline output stage:  %llu bytes%s\n",
+            (unsigned long long)p->out_bytes, atomic_load(&p->out_error) ? " (stopped on write error)" : "");
+}
+
+static inline void serial_pipeline_free(SerialPipeline *p) {
+    spsc_ring_free(&p->ring1);
+    spsc_ring_free(&p->ring2);
+}
+
+#endif // SERIAL_PIPELINE_H
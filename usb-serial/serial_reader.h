@@ -0,0 +1,241 @@
+#ifndef SERIAL_READER_H
+#define SERIAL_READER_H
+
+/*
+ * Bulk IN read loops for CDC-ACM serial devices
+ *
+ * serial_read_sync():  the original loop, one blocking libusb_bulk_transfer
+ *                      of one packet at a time.
+ * serial_read_async(): keeps `depth` URBs of `transfer_size` bytes queued on
+ *                      the endpoint (see common/usb_async.h). They have no
+ *                      timeout, and the loop sleeps in usb_wait_events()
+ *                      (common/usb_wait.h) until data or a deadline is due.
+ *
+ * Both hand received bytes to `handler->on_data` and stop when it returns
+ * nonzero, when the device has sent nothing for `quiet_ms` (0: never), or on
+ * a fatal transfer error. Every SERIAL_READ_TIMEOUT_MS without data prints a
+ * dot; the sync loop needs that timeout to notice a stop request anyway, the
+ * async loop only wakes up for it while `quiet_ms` is set.
+ * The optional `handler->on_idle` runs every time the loop wakes up and
+ * bounds how long the loop may sleep (used for output flush deadlines).
+ * The loops also end when `*handler->stop` becomes nonzero, e.g. from a
+ * SIGINT handler. While `*handler->busy` is nonzero (e.g. serial_writer.h is
+ * still sending), timeouts do not end them.
+ * They return 0 when stopped, or a libusb error code when they ended on an
+ * error (LIBUSB_ERROR_TIMEOUT when `quiet_ms` ran out).
+ */
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <libusb-1.0/libusb.h>
+
+#include "../common/usb_async.h"
+#include "../common/usb_wait.h"
+
+#define SERIAL_READ_TIMEOUT_MS 2000
+#define SERIAL_QUIET_MS (3 * SERIAL_READ_TIMEOUT_MS)
+
+typedef struct {
+    usb_async_data_cb on_data;
+    // Returns the longest time in microseconds the loop may sleep before
+    // calling it again, or -1 for no limit.
+    long (*on_idle)(void *user);
+    void *user;
+    const volatile sig_atomic_t *stop; // optional
+    atomic_int *busy;                  // optional
+} SerialReadHandler;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t transfers;
+    double seconds;
+    double first_data;  // serial_now_sec() when the first bytes came in, 0 if none did
+} SerialReadStats;
+
+static inline double serial_now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static inline double serial_stats_mb_per_sec(const SerialReadStats *stats) {
+    return stats->seconds > 0 ? (double)stats->bytes / stats->seconds / 1e6 : 0.0;
+}
+
+// Round `size` up to a whole number of `max_packet` packets.
+static inline int serial_round_transfer_size(int size, int max_packet) {
+    if (max_packet <= 0) return size;
+    if (size < max_packet) return max_packet;
+    return (size + max_packet - 1) / max_packet * max_packet;
+}
+
+static inline int serial_stop_requested(const SerialReadHandler *handler) {
+    return handler->stop && *handler->stop;
+}
+
+static inline int serial_busy(const SerialReadHandler *handler) {
+    return handler->busy && atomic_load(handler->busy);
+}
+
+static inline long serial_idle(const SerialReadHandler *handler) {
+    return handler->on_idle ? handler->on_idle(handler->user) : -1;
+}
+
+static inline int serial_read_sync(libusb_device_handle *handle, unsigned char endpoint, int packet_size,
+                                   unsigned int quiet_ms, const SerialReadHandler *handler, SerialReadStats *stats) {
+    unsigned char buffer[512];
+    int actual_length;
+    int timeout_errors = 0;
+    int status = 0;
+    double start = serial_now_sec();
+
+    if (packet_size > (int)sizeof(buffer)) packet_size = sizeof(buffer);
+
+    while (!serial_stop_requested(handler)) {
+        // Wake up early if the handler has a deadline, without counting it as a device timeout.
+        long idle_us = serial_idle(handler);
+        unsigned int timeout = SERIAL_READ_TIMEOUT_MS;
+        if (idle_us >= 0 && idle_us / 1000 < SERIAL_READ_TIMEOUT_MS) {
+            timeout = idle_us < 1000 ? 1 : (unsigned int)(idle_us / 1000);
+        }
+
+        actual_length = 0;
+        int r = libusb_bulk_transfer(handle, endpoint, buffer, packet_size, &actual_length, timeout);
+
+        if (actual_length > 0) {
+            if (stats->first_data == 0) stats->first_data = serial_now_sec();
+            stats->bytes += (uint64_t)actual_length;
+            if (handler->on_data(handler->user, buffer, actual_length)) break;
+        }
+
+        if (r == LIBUSB_SUCCESS) {
+            timeout_errors = 0; // Reset counter on success
+            stats->transfers++;
+        } else if (r == LIBUSB_ERROR_TIMEOUT && timeout < SERIAL_READ_TIMEOUT_MS) {
+            continue;
+        } else if (r == LIBUSB_ERROR_TIMEOUT && serial_busy(handler)) {
+            timeout_errors = 0; // quiet while we are sending
+            continue;
+        } else if (r == LIBUSB_ERROR_TIMEOUT) {
+            timeout_errors++;
+            fprintf(stderr, ".\n"); // Print a dot for timeout
+            if (quiet_ms && (unsigned int)timeout_errors * SERIAL_READ_TIMEOUT_MS >= quiet_ms) {
+                fprintf(stderr, "ERROR: Exiting after %d consecutive timeouts.\n", timeout_errors);
+                status = LIBUSB_ERROR_TIMEOUT;
+                break;
+            }
+        } else {
+            fprintf(stderr, "ERROR: libusb_bulk_transfer failed: %s\n", libusb_error_name(r));
+            if (r == LIBUSB_ERROR_PIPE) {
+                fprintf(stderr, "DEBUG: Pipe error detected. Clearing halt on endpoint %02x...\n", endpoint);
+                int rh = libusb_clear_halt(handle, endpoint);
+                if (rh == 0) {
+                    fprintf(stderr, "DEBUG: Halt cleared successfully. Retrying transfer.\n");
+                    continue;
+                } else {
+                    fprintf(stderr, "ERROR: Could not clear halt: %s\n", libusb_error_name(rh));
+                }
+            }
+            if (r == LIBUSB_ERROR_NO_DEVICE) {
+                fprintf(stderr, "ERROR: Device disconnected. Exiting loop.\n");
+            }
+            // Break on other errors too
+            status = r;
+            break;
+        }
+    }
+
+    stats->seconds = serial_now_sec() - start;
+    return status;
+}
+
+static inline int serial_read_async(UsbWait *wait, libusb_device_handle *handle, unsigned char endpoint,
+                                    int depth, int transfer_size, unsigned int quiet_ms,
+                                    const SerialReadHandler *handler, SerialReadStats *stats) {
+    usb_async_queue q;
+    int dots = 0;
+    double start = serial_now_sec();
+    double last_data = start;
+    uint64_t seen = 0;
+    int status = 0;
+
+    // No timeout: a quiet device leaves the URBs queued and the loop asleep.
+    int r = usb_async_start(&q, handle, endpoint, LIBUSB_TRANSFER_TYPE_BULK, depth, transfer_size,
+                            0, handler->on_data, handler->user);
+    if (r < 0) {
+        fprintf(stderr, "ERROR: Could not queue bulk transfers: %s\n", libusb_error_name(r));
+        usb_async_cancel(&q, wait->ctx);
+        usb_async_free(&q);
+        return r;
+    }
+
+    while (!q.stopped && !serial_stop_requested(handler)) {
+        long wait_us = serial_idle(handler);
+        if (quiet_ms) {
+            // Next dot, or the end of the quiet limit. Also while the writer
+            // is busy: nothing would wake us when it finishes.
+            double due_ms = (double)(dots + 1) * SERIAL_READ_TIMEOUT_MS;
+            if (due_ms > quiet_ms) due_ms = quiet_ms;
+            long due_us = (long)((last_data + due_ms / 1e3 - serial_now_sec()) * 1e6);
+            if (due_us < 0) due_us = 0;
+            if (wait_us < 0 || due_us < wait_us) wait_us = due_us;
+        }
+        r = usb_wait_events(wait, wait_us);
+        if (r < 0) {
+            fprintf(stderr, "ERROR: libusb_handle_events failed: %s\n", libusb_error_name(r));
+            status = r;
+            break;
+        }
+        if (q.stalled) {
+            fprintf(stderr, "DEBUG: Pipe error detected. Clearing halt on endpoint %02x...\n", endpoint);
+            int rh = libusb_clear_halt(handle, endpoint);
+            if (rh != 0) {
+                fprintf(stderr, "ERROR: Could not clear halt: %s\n", libusb_error_name(rh));
+                status = rh;
+                break;
+            }
+            rh = usb_async_resubmit(&q);
+            if (rh < 0) {
+                fprintf(stderr, "ERROR: Could not resubmit transfers after clearing the halt: %s\n", libusb_error_name(rh));
+                status = rh;
+                break;
+            }
+        }
+
+        double now = serial_now_sec();
+        if (stats->first_data == 0 && q.bytes) stats->first_data = now;
+        if (q.completions != seen || serial_busy(handler)) {
+            seen = q.completions;
+            last_data = now; // quiet while we are sending
+            dots = 0;
+        } else if (quiet_ms && (now - last_data) * 1e3 >= (double)(dots + 1) * SERIAL_READ_TIMEOUT_MS) {
+            dots++;
+            fprintf(stderr, ".\n");
+        }
+        if (quiet_ms && (now - last_data) * 1e3 >= quiet_ms) {
+            fprintf(stderr, "ERROR: Exiting after %.1f s without data.\n", quiet_ms / 1e3);
+            status = LIBUSB_ERROR_TIMEOUT;
+            break;
+        }
+    }
+
+    if (q.error == LIBUSB_TRANSFER_NO_DEVICE) {
+        fprintf(stderr, "ERROR: Device disconnected. Exiting loop.\n");
+        if (!status) status = LIBUSB_ERROR_NO_DEVICE;
+    } else if (q.error) {
+        fprintf(stderr, "ERROR: Bulk transfer failed with status %d\n", q.error);
+        if (!status) status = LIBUSB_ERROR_IO;
+    }
+
+    usb_async_cancel(&q, wait->ctx);
+    stats->seconds = serial_now_sec() - start;
+    stats->bytes = q.bytes;
+    stats->transfers = q.completions;
+    usb_async_free(&q);
+    return status;
+}
+
+#endif // SERIAL_READER_H
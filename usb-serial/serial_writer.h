@@ -0,0 +1,278 @@
+#ifndef SERIAL_WRITER_H
+#define SERIAL_WRITER_H
+
+/*
+ * Bulk OUT streaming for CDC-ACM serial devices
+ *
+ * serial_writer_start() starts a thread that reads `input_fd` straight into
+ * the buffers of `depth` OUT transfers and submits each one as soon as it
+ * holds data. The completions are handled by whichever thread runs libusb's
+ * event handling (the IN read loop), which hands the buffer back. With
+ * several transfers queued the endpoint always has the next one waiting, so
+ * an upload goes as fast as the bus and the device take it instead of one
+ * round trip per transfer.
+ *
+ * Flow control: a CDC-ACM device that cannot take more data NAKs its OUT
+ * endpoint. The transfers have no timeout, so they stay queued and nothing
+ * is lost (a timed-out transfer could also let the ones behind it overtake
+ * it). Once all `depth` are queued the writer stops reading its input, and
+ * the producer on the other side of a pipe blocks instead of memory filling
+ * up. A WARN: line (at most once per second) says when the device has taken
+ * nothing for a second while data is waiting; serial_writer_report() shows
+ * how long the writer waited for the device and for its input.
+ *
+ * Usage:
+ *   SerialWriter w;
+ *   serial_writer_start(&w, handle, 0x02, STDIN_FILENO, 8, 16384);
+ *   handler.busy = &w.busy;              // the IN loop keeps running meanwhile
+ *   serial_read_async(...);
+ *   serial_writer_stop(&w, context);     // cancels what is still queued
+ *   serial_writer_report(&w);
+ *   serial_writer_free(&w);
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libusb-1.0/libusb.h>
+
+#include "serial_reader.h"
+
+#define SERIAL_WRITER_POLL_MS 200
+
+typedef struct {
+    libusb_device_handle *handle;
+    unsigned char endpoint;
+    int input_fd;
+    int depth;
+    int transfer_size;
+    struct libusb_transfer **transfers;
+    unsigned char *buffers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t returned;     // a transfer came back
+    int *idle;                   // indexes of transfers not queued
+    int num_idle;
+    int in_flight;
+    int error;                   // first failed libusb_transfer_status, 0 if none
+    uint64_t bytes;              // accepted by the device
+    uint64_t completions;
+    double last_completion;
+
+    atomic_int busy;             // input not finished or data still queued
+    atomic_int stop;
+
+    // Writer thread only
+    double start;                // first submit
+    double end;                  // everything sent, or stopped
+    double device_wait;          // all transfers queued, waiting for one to come back
+    double input_wait;
+    double last_warn;
+    int input_error;             // errno of a failed read
+    int started;                 // thread running
+
+    pthread_t thread;
+} SerialWriter;
+
+static inline void LIBUSB_CALL serial_writer_transfer_cb(struct libusb_transfer *transfer) {
+    SerialWriter *w = transfer->user_data;
+    pthread_mutex_lock(&w->lock);
+    w->in_flight--;
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+        w->bytes += (uint64_t)transfer->actual_length;
+        w->completions++;
+        w->last_completion = serial_now_sec();
+    } else if (transfer->status != LIBUSB_TRANSFER_CANCELLED && !w->error) {
+        w->error = transfer->status;
+    }
+    for (int i = 0; i < w->depth; i++) {
+        if (w->transfers[i] == transfer) w->idle[w->num_idle++] = i;
+    }
+    pthread_cond_signal(&w->returned);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Wait on `returned` for up to SERIAL_WRITER_POLL_MS with the lock held, and
+// warn if the device has taken nothing for a second although data is queued.
+static inline void serial_writer_wait(SerialWriter *w) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += SERIAL_WRITER_POLL_MS * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&w->returned, &w->lock, &ts);
+
+    double now = serial_now_sec();
+    if (w->in_flight > 0 && now - w->last_completion >= 1.0 && now - w->last_warn >= 1.0) {
+        w->last_warn = now;
+        fprintf(stderr, "WARN: [%.3f s] Device has accepted no data for %.1f s (flow control), %d transfers queued\n",
+                now - w->start, now - w->last_completion, w->in_flight);
+    }
+}
+
+// Read what the input has, up to `size` bytes. Returns 0 at the end of the
+// input or on a stop request, -1 on error.
+static inline ssize_t serial_writer_read(SerialWriter *w, unsigned char *buf, int size) {
+    struct pollfd p = { w->input_fd, POLLIN, 0 };
+    while (!atomic_load(&w->stop)) {
+        int r = poll(&p, 1, SERIAL_WRITER_POLL_MS);
+        if (r < 0 && errno != EINTR) break;
+        if (r <= 0) continue;
+        ssize_t n = read(w->input_fd, buf, (size_t)size);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n < 0) w->input_error = errno;
+        return n;
+    }
+    return 0;
+}
+
+static inline void *serial_writer_main(void *arg) {
+    SerialWriter *w = arg;
+
+    while (!atomic_load(&w->stop)) {
+        double t0 = serial_now_sec();
+        pthread_mutex_lock(&w->lock);
+        while (w->num_idle == 0 && !w->error && !atomic_load(&w->stop)) serial_writer_wait(w);
+        if (w->error || atomic_load(&w->stop)) {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        int i = w->idle[--w->num_idle];
+        pthread_mutex_unlock(&w->lock);
+        double t1 = serial_now_sec();
+        w->device_wait += t1 - t0;
+
+        struct libusb_transfer *t = w->transfers[i];
+        ssize_t n = serial_writer_read(w, t->buffer, w->transfer_size);
+        w->input_wait += serial_now_sec() - t1;
+        if (n <= 0) {
+            pthread_mutex_lock(&w->lock);
+            w->idle[w->num_idle++] = i;
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+
+        t->length = (int)n;
+        if (w->start == 0) w->start = serial_now_sec();
+        pthread_mutex_lock(&w->lock);
+        if (w->completions == 0) w->last_completion = serial_now_sec();
+        w->in_flight++;
+        pthread_mutex_unlock(&w->lock);
+        // Not under the lock: the completion of another transfer may need it meanwhile.
+        int r = libusb_submit_transfer(t);
+        if (r < 0) {
+            fprintf(stderr, "ERROR: Could not submit bulk OUT transfer: %s\n", libusb_error_name(r));
+            pthread_mutex_lock(&w->lock);
+            w->in_flight--;
+            w->idle[w->num_idle++] = i;
+            if (!w->error) w->error = LIBUSB_TRANSFER_ERROR;
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+    }
+
+    // End of the input: wait until the device has taken everything.
+    pthread_mutex_lock(&w->lock);
+    while (w->in_flight > 0 && !w->error && !atomic_load(&w->stop)) serial_writer_wait(w);
+    pthread_mutex_unlock(&w->lock);
+    w->end = serial_now_sec();
+    atomic_store(&w->busy, 0);
+    return NULL;
+}
+
+// Allocate `depth` transfers of `transfer_size` bytes and start the writer
+// thread. Returns 0 or a libusb error code.
+static inline int serial_writer_start(SerialWriter *w, libusb_device_handle *handle, unsigned char endpoint,
+                                      int input_fd, int depth, int transfer_size) {
+    memset(w, 0, sizeof(*w));
+    w->handle = handle;
+    w->endpoint = endpoint;
+    w->input_fd = input_fd;
+    w->depth = depth;
+    w->transfer_size = transfer_size;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->returned, NULL);
+
+    w->transfers = calloc((size_t)depth, sizeof(*w->transfers));
+    w->idle = calloc((size_t)depth, sizeof(*w->idle));
+    w->buffers = malloc((size_t)depth * (size_t)transfer_size);
+    if (!w->transfers || !w->idle || !w->buffers) return LIBUSB_ERROR_NO_MEM;
+    for (int i = 0; i < depth; i++) {
+        struct libusb_transfer *t = libusb_alloc_transfer(0);
+        if (!t) return LIBUSB_ERROR_NO_MEM;
+        // No timeout: a NAKing device holds the queue, it does not lose data.
+        libusb_fill_bulk_transfer(t, handle, endpoint, w->buffers + (size_t)i * (size_t)transfer_size,
+                                  transfer_size, serial_writer_transfer_cb, w, 0);
+        w->transfers[i] = t;
+        w->idle[w->num_idle++] = i;
+    }
+
+    atomic_store(&w->busy, 1);
+    if (pthread_create(&w->thread, NULL, serial_writer_main, w) != 0) {
+        atomic_store(&w->busy, 0);
+        return LIBUSB_ERROR_OTHER;
+    }
+    w->started = 1;
+    return 0;
+}
+
+// Stop reading the input, cancel what is still queued and wait until libusb
+// has returned every transfer.
+static inline void serial_writer_stop(SerialWriter *w, libusb_context *context) {
+    if (!w->started) return;
+    atomic_store(&w->stop, 1);
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_broadcast(&w->returned);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    w->started = 0;
+
+    for (int i = 0; i < w->depth; i++) libusb_cancel_transfer(w->transfers[i]);
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        int in_flight = w->in_flight;
+        pthread_mutex_unlock(&w->lock);
+        if (in_flight == 0) break;
+        struct timeval tv = { 1, 0 };
+        if (libusb_handle_events_timeout(context, &tv) < 0) break;
+    }
+}
+
+static inline void serial_writer_report(SerialWriter *w) {
+    double seconds = w->start > 0 && w->end > w->start ? w->end - w->start : 0.0;
+    fprintf(stderr, "DEBUG: Wrote %llu bytes in %llu transfers over %.2f s (%.3f MB/s)\n",
+            (unsigned long long)w->bytes, (unsigned long long)w->completions, seconds,
+            seconds > 0 ? (double)w->bytes / seconds / 1e6 : 0.0);
+    fprintf(stderr, "DEBUG: Writer waited %.2f s for the device (queue of %d full) and %.2f s for input\n",
+            w->device_wait, w->depth, w->input_wait);
+    if (w->error) {
+        fprintf(stderr, "ERROR: Bulk OUT transfer failed with status %d\n", w->error);
+    }
+    if (w->input_error) {
+        fprintf(stderr, "ERROR: Reading the input failed: %s\n", strerror(w->input_error));
+    }
+}
+
+static inline void serial_writer_free(SerialWriter *w) {
+    if (w->transfers) {
+        for (int i = 0; i < w->depth; i++) libusb_free_transfer(w->transfers[i]);
+    }
+    free(w->transfers);
+    free(w->idle);
+    free(w->buffers);
+    w->transfers = NULL;
+    w->idle = NULL;
+    w->buffers = NULL;
+    pthread_cond_destroy(&w->returned);
+    pthread_mutex_destroy(&w->lock);
+}
+
+#endif // SERIAL_WRITER_H
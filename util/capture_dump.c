@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include "../common/capture.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s seconds] [-n count] [-i] <capture_file>\n", prog);
+    fprintf(stderr, "  -s seconds  Start at this time from the beginning of the capture\n");
+    fprintf(stderr, "  -n count    Print at most this many records\n");
+    fprintf(stderr, "  -i          Only print the time index (one line per chunk)\n");
+}
+
+int main(int argc, char **argv) {
+    double start_sec = 0;
+    long long max_records = -1;
+    int index_only = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:i")) != -1) {
+        switch (opt) {
+            case 's': start_sec = atof(optarg); break;
+            case 'n': max_records = atoll(optarg); break;
+            case 'i': index_only = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    CaptureReader reader;
+    if (capture_reader_open(&reader, argv[optind]) < 0) {
+        fprintf(stderr, "ERROR: Cannot read capture %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    const CaptureFileHeader *h = reader.header;
+    uint64_t total = 0, last_ns = h->start_ns;
+    for (size_t k = 0; k < reader.num_chunks; k++) {
+        total += capture_chunk(&reader, k)->records;
+    }
+    if (reader.num_chunks > 0) last_ns = capture_chunk(&reader, reader.num_chunks - 1)->last_ns;
+    time_t wall = (time_t)(h->start_realtime_ns / 1000000000ull);
+    char when[64];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&wall));
+    printf("Capture started %s, %zu chunks, %" PRIu64 " records, %.3f s\n",
+           when, reader.num_chunks, total, (double)(last_ns - h->start_ns) / 1e9);
+
+    if (index_only) {
+        for (size_t k = 0; k < reader.num_chunks; k++) {
+            const CaptureChunkHeader *c = capture_chunk(&reader, k);
+            printf("chunk %6u  %12.6f .. %12.6f s  %6u records  %6u bytes\n", c->seq,
+                   (double)(c->first_ns - h->start_ns) / 1e9, (double)(c->last_ns - h->start_ns) / 1e9,
+                   c->records, c->used);
+        }
+        capture_reader_close(&reader);
+        return 0;
+    }
+
+    CaptureCursor cursor;
+    CaptureRecord rec;
+    const uint8_t *payload;
+    capture_seek(&reader, h->start_ns + (uint64_t)(start_sec * 1e9), &cursor);
+    for (long long n = 0; (max_records < 0 || n < max_records) && capture_next(&reader, &cursor, &rec, &payload); n++) {
+        printf("%12.6f  ep 0x%02x", (double)(rec.t_ns - h->start_ns) / 1e9, rec.endpoint);
+        if (rec.status) printf("  status %u", rec.status);
+        printf("  %3u bytes:", rec.len);
+        for (int i = 0; i < rec.len; i++) printf(" %02x", payload[i]);
+        printf("\n");
+    }
+
+    capture_reader_close(&reader);
+    return 0;
+}
@@ -6,6 +6,12 @@
 #include <unistd.h> // For close
 #include <string.h> // For memset
 
+#include "../common/hid_parser.h"
+#include "../common/desc_cache.h"
+#include "../common/usb_session.h"
+
+static DescCache cache;
+
 // Function to get a string descriptor
 static void print_string_descriptor(libusb_device_handle *handle, uint8_t index) {
     if (index == 0) {
@@ -13,7 +19,7 @@ static void print_string_descriptor(libusb_device_handle *handle, uint8_t index)
         return;
     }
     char s_desc[256];
-    int r = libusb_get_string_descriptor_ascii(handle, index, (unsigned char*)s_desc, sizeof(s_desc));
+    int r = desc_cache_string(&cache, handle, index, s_desc, sizeof(s_desc));
     if (r > 0) {
         printf(" (%s)", s_desc);
     } else {
@@ -32,41 +38,42 @@ const char* libusb_transfer_type_to_string(enum libusb_transfer_type type) {
     }
 }
 
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-r] <file_descriptor>\n", prog);
+    fprintf(stderr, "  -r  Read all descriptors from the device again instead of the cache\n");
+}
+
 #define VENDOR_ID 0x045e // ZhiXu Controller Vendor ID
 #define PRODUCT_ID 0x028e // ZhiXu Controller Product ID
 
 int main(int argc, char **argv) {
-    libusb_context *context = NULL;
     libusb_device_handle *handle = NULL;
     int fd = -1;
     int r = 0;
+    int refresh = 0;
+    int opt;
 
-    if (argc < 2 || sscanf(argv[1], "%d", &fd) != 1) {
-        fprintf(stderr, "Usage: %s <file_descriptor>\n", argv[0]);
-        return 1;
+    while ((opt = getopt(argc, argv, "r")) != -1) {
+        switch (opt) {
+            case 'r': refresh = 1; break;
+            default: usage(argv[0]); return 1;
+        }
     }
-
-    libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
-    r = libusb_init(&context);
-    if (r < 0) {
-        fprintf(stderr, "libusb_init failed: %s\n", libusb_error_name(r));
+    if (optind >= argc || sscanf(argv[optind], "%d", &fd) != 1) {
+        usage(argv[0]);
         return 1;
     }
-    fprintf(stderr, "DEBUG: libusb_init successful.\n");
 
-    r = libusb_wrap_sys_device(context, (intptr_t)fd, &handle);
-    if (r < 0) {
-        fprintf(stderr, "libusb_wrap_sys_device failed: %s\n", libusb_error_name(r));
-        libusb_exit(context);
+    UsbSession session;
+    if (usb_session_open(&session, fd) < 0) {
         return 1;
     }
-    fprintf(stderr, "DEBUG: libusb_wrap_sys_device successful. Handle obtained.\n");
+    handle = session.handle;
 
     libusb_device *device = libusb_get_device(handle);
     if (!device) {
         fprintf(stderr, "libusb_get_device failed.\n");
-        libusb_close(handle);
-        libusb_exit(context);
+        usb_session_close(&session);
         return 1;
     }
     fprintf(stderr, "DEBUG: libusb_get_device successful.\n");
@@ -75,11 +82,11 @@ int main(int argc, char **argv) {
     r = libusb_get_device_descriptor(device, &dev_desc);
     if (r < 0) {
         fprintf(stderr, "libusb_get_device_descriptor failed: %s\n", libusb_error_name(r));
-        libusb_close(handle);
-        libusb_exit(context);
+        usb_session_close(&session);
         return 1;
     }
     fprintf(stderr, "DEBUG: libusb_get_device_descriptor successful.\n");
+    desc_cache_open(&cache, handle, refresh);
 
     printf("== Device Descriptor ==\n");
     printf("  bLength: %d\n", dev_desc.bLength);
@@ -150,10 +157,8 @@ int main(int argc, char **argv) {
                     printf("    Attempting to read HID Report Descriptor...\n");
                     unsigned char hid_report_desc[512]; // Max 512 bytes for HID report descriptor
                     memset(hid_report_desc, 0, sizeof(hid_report_desc));
-                    // The HID descriptor is usually embedded within the configuration descriptor data.
-                    // libusb_get_descriptor with LIBUSB_DT_REPORT type targets the HID report descriptor.
-                    // The wIndex for HID report descriptor is the interface number.
-                    r = libusb_get_descriptor(handle, LIBUSB_DT_REPORT, if_desc->bInterfaceNumber, hid_report_desc, sizeof(hid_report_desc));
+                    // The report descriptor is requested from the interface (wIndex = interface number).
+                    r = desc_cache_report_descriptor(&cache, handle, if_desc->bInterfaceNumber, hid_report_desc, sizeof(hid_report_desc));
 
                     if (r > 0) {
                         printf("    HID Report Descriptor (%d bytes):\n", r);
@@ -163,6 +168,14 @@ int main(int argc, char **argv) {
                             if ((i + 1) % 16 == 0) printf("\n      "); // 16 bytes per line
                         }
                         printf("\n");
+
+                        HidPlan plan;
+                        if (hid_plan_compile(&plan, hid_report_desc, r) < 0) {
+                            printf("    Could not parse the HID Report Descriptor.\n");
+                        } else {
+                            printf("    Input fields (%d):\n", plan.count);
+                            hid_plan_print(&plan, stdout, 6);
+                        }
                     } else if (r == LIBUSB_ERROR_NOT_FOUND) {
                         printf("    HID Report Descriptor not found for this interface.\n");
                     }
@@ -194,7 +207,9 @@ int main(int argc, char **argv) {
         libusb_free_config_descriptor(config_desc);
     }
 
-    libusb_close(handle);
-    libusb_exit(context);
+    desc_cache_close(&cache);
+    usb_session_mark(&session, "descriptors");
+    usb_session_report(&session);
+    usb_session_close(&session);
     return 0;
 }
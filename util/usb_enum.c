@@ -0,0 +1,623 @@
+#define _GNU_SOURCE // accept4, MSG_CMSG_CLOEXEC
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <libusb-1.0/libusb.h>
+
+#define MAX_DEVICES 64
+#define STRING_TIMEOUT_MS 1000
+#define LANGID_EN_US 0x0409
+
+// What a helper run by termux-usb sends, together with its device fd as SCM_RIGHTS.
+typedef struct {
+    char path[64];
+} FdMessage;
+
+enum { STRING_MANUFACTURER, STRING_PRODUCT, STRING_SERIAL, NUM_STRINGS };
+static const char *string_names[NUM_STRINGS] = { "manufacturer", "product", "serial" };
+
+// One string descriptor request. It is first asked for in US English, which
+// nearly every device has; only if that fails is the language table read
+// and the request repeated in the device's first language.
+enum { REQ_IDLE, REQ_EN_US, REQ_LANGIDS, REQ_DEVICE_LANG, REQ_DONE };
+
+typedef struct EnumDevice EnumDevice;
+
+typedef struct {
+    EnumDevice *dev;
+    uint8_t index;
+    int state;
+    int ok;
+    char text[128];
+    struct libusb_transfer *transfer;
+    unsigned char buf[LIBUSB_CONTROL_SETUP_SIZE + 255];
+} StringRequest;
+
+struct EnumDevice {
+    char path[64];
+    int fd;
+    pid_t helper;                 // termux-usb run fetching the fd, 0 if none
+    const char *error;            // NULL while fine
+    libusb_device_handle *handle;
+    struct libusb_device_descriptor desc;
+    int speed;
+    StringRequest strings[NUM_STRINGS];
+};
+
+static EnumDevice devices[MAX_DEVICES];
+static int num_devices = 0;
+static int strings_pending = 0;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-t] [-S] [-w seconds] [device_path...]\n", prog);
+    fprintf(stderr, "  -t          tab-separated output (default JSON)\n");
+    fprintf(stderr, "  -S          one device at a time, like list_all_usb_info.sh (for comparison)\n");
+    fprintf(stderr, "  -w seconds  how long to wait for termux-usb to hand over the devices (default 30)\n");
+    fprintf(stderr, "Without paths, all devices from `termux-usb -l` are listed.\n");
+}
+
+/* =========================================================
+ * Device paths
+ * ========================================================= */
+
+static int add_path(const char *path) {
+    if (num_devices == MAX_DEVICES) {
+        fprintf(stderr, "WARN: More than %d devices, ignoring %s\n", MAX_DEVICES, path);
+        return -1;
+    }
+    EnumDevice *d = &devices[num_devices++];
+    memset(d, 0, sizeof(*d));
+    snprintf(d->path, sizeof(d->path), "%s", path);
+    d->fd = -1;
+    return 0;
+}
+
+// `termux-usb -l` prints a JSON array of path strings; take every string in it.
+static int list_termux_devices(void) {
+    char text[8192];
+    FILE *p = popen("termux-usb -l", "r");
+    if (!p) {
+        fprintf(stderr, "ERROR: Cannot run termux-usb -l: %s\n", strerror(errno));
+        return -1;
+    }
+    size_t len = fread(text, 1, sizeof(text) - 1, p);
+    text[len] = '\0';
+    if (pclose(p) != 0) {
+        fprintf(stderr, "ERROR: termux-usb -l failed. Is the termux-api package installed?\n");
+        return -1;
+    }
+    for (char *s = strchr(text, '"'); s; ) {
+        char *end = strchr(s + 1, '"');
+        if (!end) break;
+        *end = '\0';
+        add_path(s + 1);
+        s = strchr(end + 1, '"');
+    }
+    return 0;
+}
+
+/* =========================================================
+ * File descriptors
+ *
+ * Android only lets the Termux:API app open USB devices; termux-usb -e
+ * runs a program with the fd it was given. For every device we start
+ * `termux-usb -r -e <this program>` at once; each of those runs sends its
+ * fd back over a Unix socket and exits, so the permission round trips to
+ * the app overlap instead of queueing. Where the device node can be
+ * opened directly (plain Linux with access rights), that is used instead.
+ * ========================================================= */
+
+static int make_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "ERROR: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Run by termux-usb in place of usb_info: hand `usb_fd` to the enumerator.
+static int send_fd(const char *socket_path, const char *device_path, int usb_fd) {
+    struct sockaddr_un addr;
+    FdMessage m;
+    char ack;
+
+    if (make_address(&addr, socket_path) < 0) return 1;
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0 || connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "ERROR: Cannot connect to %s: %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+    memset(&m, 0, sizeof(m));
+    snprintf(m.path, sizeof(m.path), "%s", device_path ? device_path : "");
+
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { &m, sizeof(m) };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &usb_fd, sizeof(int));
+
+    int ok = sendmsg(s, &msg, 0) == (ssize_t)sizeof(m) && recv(s, &ack, 1, 0) == 1;
+    close(s);
+    return ok ? 0 : 1;
+}
+
+static EnumDevice *find_device(const char *path) {
+    for (int i = 0; i < num_devices; i++) {
+        if (strcmp(devices[i].path, path) == 0) return &devices[i];
+    }
+    return NULL;
+}
+
+static void start_helper(EnumDevice *d, const char *self, const char *socket_path) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        d->error = "fork failed";
+        return;
+    }
+    if (pid == 0) {
+        // Keep our stdout for the listing; whatever termux-usb prints goes to stderr.
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        setenv("USB_ENUM_SOCKET", socket_path, 1);
+        setenv("USB_ENUM_PATH", d->path, 1);
+        execlp("termux-usb", "termux-usb", "-r", "-e", self, d->path, (char *)NULL);
+        fprintf(stderr, "ERROR: Cannot run termux-usb: %s\n", strerror(errno));
+        _exit(127);
+    }
+    d->helper = pid;
+}
+
+static void receive_fd(int s) {
+    FdMessage m;
+    int fd = -1;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = { &m, sizeof(m) };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct pollfd p = { s, POLLIN, 0 };
+    if (poll(&p, 1, 1000) != 1) return;
+    ssize_t n = recvmsg(s, &msg, MSG_CMSG_CLOEXEC);
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS && c->cmsg_len == CMSG_LEN(sizeof(int))) {
+            memcpy(&fd, CMSG_DATA(c), sizeof(int));
+        }
+    }
+    if (fd < 0) return;
+    m.path[sizeof(m.path) - 1] = '\0';
+    EnumDevice *d = n == (ssize_t)sizeof(m) ? find_device(m.path) : NULL;
+    if (!d || d->fd >= 0) {
+        close(fd);
+        return;
+    }
+    d->fd = fd;
+    if (send(s, "k", 1, MSG_NOSIGNAL) < 0) {
+        // The helper is gone already; the fd is ours anyway.
+    }
+}
+
+// Notice helpers that exited without delivering their fd.
+static void reap_helpers(void) {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int i = 0; i < num_devices; i++) {
+            EnumDevice *d = &devices[i];
+            if (d->helper != pid) continue;
+            d->helper = 0;
+            if (d->fd < 0 && !d->error) d->error = "termux-usb failed (permission denied?)";
+        }
+    }
+}
+
+static int fds_outstanding(int upto) {
+    int n = 0;
+    for (int i = 0; i < upto; i++) {
+        if (devices[i].fd < 0 && !devices[i].error) n++;
+    }
+    return n;
+}
+
+// Get an fd for every device. `serial` waits for each one before asking
+// for the next, which is what the shell script does.
+static void collect_fds(int serial, double wait_ms) {
+    char self[4096];
+    char socket_path[108];
+    struct sockaddr_un addr;
+    int listener = -1;
+    const char *dir = getenv("TMPDIR");
+
+    ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (n <= 0) {
+        fprintf(stderr, "ERROR: Cannot find this program's path\n");
+        return;
+    }
+    self[n] = '\0';
+    snprintf(socket_path, sizeof(socket_path), "%s/usb_enum.%d.sock", dir && dir[0] ? dir : "/tmp", (int)getpid());
+
+    double deadline = now_ms() + wait_ms;
+    for (int i = 0; i < num_devices; i++) {
+        EnumDevice *d = &devices[i];
+        d->fd = open(d->path, O_RDWR | O_CLOEXEC);
+        if (d->fd >= 0) continue;
+
+        if (listener < 0) {
+            if (make_address(&addr, socket_path) < 0) return;
+            listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            unlink(socket_path);
+            mode_t old_umask = umask(077); // only this user may hand us devices
+            int r = listener < 0 ? -1 : bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+            umask(old_umask);
+            if (r < 0 || listen(listener, MAX_DEVICES) < 0) {
+                fprintf(stderr, "ERROR: Cannot listen on %s: %s\n", socket_path, strerror(errno));
+                if (listener >= 0) close(listener);
+                return;
+            }
+        }
+        start_helper(d, self, socket_path);
+        if (!serial) continue;
+
+        while (fds_outstanding(i + 1) > 0 && now_ms() < deadline) {
+            struct pollfd p = { listener, POLLIN, 0 };
+            if (poll(&p, 1, 50) == 1) {
+                int s = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+                if (s >= 0) {
+                    receive_fd(s);
+                    close(s);
+                }
+            }
+            reap_helpers();
+        }
+    }
+
+    while (listener >= 0 && fds_outstanding(num_devices) > 0 && now_ms() < deadline) {
+        struct pollfd p = { listener, POLLIN, 0 };
+        if (poll(&p, 1, 50) == 1) {
+            int s = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+            if (s >= 0) {
+                receive_fd(s);
+                close(s);
+            }
+        }
+        reap_helpers();
+    }
+
+    for (int i = 0; i < num_devices; i++) {
+        EnumDevice *d = &devices[i];
+        if (d->fd < 0 && !d->error) d->error = "timed out waiting for termux-usb";
+        if (d->helper) kill(d->helper, SIGTERM);
+    }
+    while (waitpid(-1, NULL, 0) > 0) {
+    }
+    if (listener >= 0) {
+        close(listener);
+        unlink(socket_path);
+    }
+}
+
+/* =========================================================
+ * Descriptors
+ * ========================================================= */
+
+static void submit_string(StringRequest *s, uint8_t index, uint16_t langid, int state) {
+    libusb_fill_control_setup(s->buf, LIBUSB_ENDPOINT_IN, LIBUSB_REQUEST_GET_DESCRIPTOR,
+                              (uint16_t)((LIBUSB_DT_STRING << 8) | index), langid, 255);
+    s->transfer->buffer = s->buf;
+    s->transfer->length = (int)sizeof(s->buf);
+    s->state = state;
+    if (libusb_submit_transfer(s->transfer) < 0) {
+        s->state = REQ_DONE;
+        strings_pending--;
+    }
+}
+
+// Same conversion as libusb_get_string_descriptor_ascii(): UTF-16LE to
+// ASCII, '?' for everything outside it.
+static void decode_string(StringRequest *s, const unsigned char *d, int len) {
+    int n = 0;
+    if (d[0] < len) len = d[0];
+    for (int i = 2; i + 1 < len && n < (int)sizeof(s->text) - 1; i += 2) {
+        s->text[n++] = d[i + 1] || d[i] & 0x80 ? '?' : (char)d[i];
+    }
+    s->text[n] = '\0';
+    s->ok = 1;
+}
+
+static void LIBUSB_CALL string_callback(struct libusb_transfer *t) {
+    StringRequest *s = t->user_data;
+    const unsigned char *d = libusb_control_transfer_get_data(t);
+    int valid = t->status == LIBUSB_TRANSFER_COMPLETED && t->actual_length >= 2 && d[1] == LIBUSB_DT_STRING;
+
+    switch (s->state) {
+        case REQ_EN_US:
+            if (valid) {
+                decode_string(s, d, t->actual_length);
+            } else if (t->status != LIBUSB_TRANSFER_NO_DEVICE) {
+                submit_string(s, 0, 0, REQ_LANGIDS);
+                return;
+            }
+            break;
+        case REQ_LANGIDS:
+            if (valid && t->actual_length >= 4) {
+                uint16_t langid = (uint16_t)(d[2] | d[3] << 8);
+                if (langid != LANGID_EN_US) {
+                    submit_string(s, s->index, langid, REQ_DEVICE_LANG);
+                    return;
+                }
+            }
+            break;
+        case REQ_DEVICE_LANG:
+            if (valid) decode_string(s, d, t->actual_length);
+            break;
+    }
+    s->state = REQ_DONE;
+    strings_pending--;
+}
+
+// Wrap every device on one context and put all their string requests in
+// flight at once. Control requests to one device still take turns on its
+// endpoint 0, but different devices answer in parallel.
+static int describe_parallel(void) {
+    libusb_context *context;
+    int r;
+
+    libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
+    r = libusb_init(&context);
+    if (r < 0) {
+        fprintf(stderr, "ERROR: libusb_init failed: %s\n", libusb_error_name(r));
+        return -1;
+    }
+
+    for (int i = 0; i < num_devices; i++) {
+        EnumDevice *d = &devices[i];
+        if (d->fd < 0) continue;
+        r = libusb_wrap_sys_device(context, (intptr_t)d->fd, &d->handle);
+        if (r < 0) {
+            d->error = libusb_error_name(r);
+            d->handle = NULL;
+            continue;
+        }
+        libusb_device *dev = libusb_get_device(d->handle);
+        libusb_get_device_descriptor(dev, &d->desc);
+        d->speed = libusb_get_device_speed(dev);
+
+        uint8_t indexes[NUM_STRINGS] = { d->desc.iManufacturer, d->desc.iProduct, d->desc.iSerialNumber };
+        for (int k = 0; k < NUM_STRINGS; k++) {
+            StringRequest *s = &d->strings[k];
+            s->dev = d;
+            s->index = indexes[k];
+            if (!s->index) continue;
+            s->transfer = libusb_alloc_transfer(0);
+            if (!s->transfer) continue;
+            libusb_fill_control_transfer(s->transfer, d->handle, s->buf, string_callback, s, STRING_TIMEOUT_MS);
+            strings_pending++;
+            submit_string(s, s->index, LANGID_EN_US, REQ_EN_US);
+        }
+    }
+
+    while (strings_pending > 0) {
+        struct timeval tv = { 1, 0 };
+        r = libusb_handle_events_timeout(context, &tv);
+        if (r < 0 && r != LIBUSB_ERROR_INTERRUPTED) {
+            fprintf(stderr, "ERROR: libusb_handle_events failed: %s\n", libusb_error_name(r));
+            break;
+        }
+    }
+
+    for (int i = 0; i < num_devices; i++) {
+        EnumDevice *d = &devices[i];
+        for (int k = 0; k < NUM_STRINGS; k++) {
+            // A transfer still in flight after an error is leaked with the context.
+            if (d->strings[k].transfer && d->strings[k].state == REQ_DONE) libusb_free_transfer(d->strings[k].transfer);
+        }
+        if (d->handle) libusb_close(d->handle);
+    }
+    libusb_exit(context);
+    return 0;
+}
+
+// What the script does per device: a fresh libusb context, then the three
+// strings one after the other, each costing a language table request and
+// the string request.
+static int describe_serial(void) {
+    for (int i = 0; i < num_devices; i++) {
+        EnumDevice *d = &devices[i];
+        libusb_context *context;
+        if (d->fd < 0) continue;
+
+        libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
+        int r = libusb_init(&context);
+        if (r < 0) {
+            fprintf(stderr, "ERROR: libusb_init failed: %s\n", libusb_error_name(r));
+            return -1;
+        }
+        r = libusb_wrap_sys_device(context, (intptr_t)d->fd, &d->handle);
+        if (r < 0) {
+            d->error = libusb_error_name(r);
+            libusb_exit(context);
+            continue;
+        }
+        libusb_device *dev = libusb_get_device(d->handle);
+        libusb_get_device_descriptor(dev, &d->desc);
+        d->speed = libusb_get_device_speed(dev);
+
+        uint8_t indexes[NUM_STRINGS] = { d->desc.iManufacturer, d->desc.iProduct, d->desc.iSerialNumber };
+        for (int k = 0; k < NUM_STRINGS; k++) {
+            StringRequest *s = &d->strings[k];
+            s->index = indexes[k];
+            if (s->index && libusb_get_string_descriptor_ascii(d->handle, s->index, (unsigned char *)s->text, sizeof(s->text)) >= 0) {
+                s->ok = 1;
+            }
+        }
+        libusb_close(d->handle);
+        d->handle = NULL;
+        libusb_exit(context);
+    }
+    return 0;
+}
+
+/* =========================================================
+ * Output
+ * ========================================================= */
+
+static const char *speed_name(int speed) {
+    switch (speed) {
+        case LIBUSB_SPEED_LOW: return "low";
+        case LIBUSB_SPEED_FULL: return "full";
+        case LIBUSB_SPEED_HIGH: return "high";
+        case LIBUSB_SPEED_SUPER: return "super";
+        case LIBUSB_SPEED_SUPER_PLUS: return "super+";
+        default: return "unknown";
+    }
+}
+
+static void print_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+static void print_json(void) {
+    printf("[");
+    for (int i = 0; i < num_devices; i++) {
+        const EnumDevice *d = &devices[i];
+        printf("%s\n  {\"path\": ", i ? "," : "");
+        print_json_string(d->path);
+        if (d->fd < 0 || d->error) {
+            printf(", \"error\": ");
+            print_json_string(d->error ? d->error : "no file descriptor");
+            printf("}");
+            continue;
+        }
+        printf(", \"vendor_id\": \"%04x\", \"product_id\": \"%04x\", \"class\": %u, \"usb\": \"%x.%02x\", \"speed\": \"%s\"",
+               d->desc.idVendor, d->desc.idProduct, d->desc.bDeviceClass,
+               d->desc.bcdUSB >> 8, d->desc.bcdUSB & 0xff, speed_name(d->speed));
+        for (int k = 0; k < NUM_STRINGS; k++) {
+            printf(", \"%s\": ", string_names[k]);
+            if (d->strings[k].ok) {
+                print_json_string(d->strings[k].text);
+            } else {
+                printf("null");
+            }
+        }
+        printf("}");
+    }
+    printf("%s]\n", num_devices ? "\n" : "");
+}
+
+// Tabs and newlines in strings become spaces; unavailable fields are empty.
+static void print_tsv_field(const char *s) {
+    putchar('\t');
+    for (; *s; s++) putchar(*s == '\t' || *s == '\n' || *s == '\r' ? ' ' : *s);
+}
+
+static void print_tsv(void) {
+    printf("path\tvendor_id\tproduct_id\tclass\tusb\tspeed\tmanufacturer\tproduct\tserial\terror\n");
+    for (int i = 0; i < num_devices; i++) {
+        const EnumDevice *d = &devices[i];
+        printf("%s", d->path);
+        if (d->fd < 0 || d->error) {
+            printf("\t\t\t\t\t\t\t\t");
+            print_tsv_field(d->error ? d->error : "no file descriptor");
+            putchar('\n');
+            continue;
+        }
+        printf("\t%04x\t%04x\t%u\t%x.%02x\t%s", d->desc.idVendor, d->desc.idProduct, d->desc.bDeviceClass,
+               d->desc.bcdUSB >> 8, d->desc.bcdUSB & 0xff, speed_name(d->speed));
+        for (int k = 0; k < NUM_STRINGS; k++) print_tsv_field(d->strings[k].ok ? d->strings[k].text : "");
+        printf("\t\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    int tsv = 0, serial = 0;
+    double wait_ms = 30000;
+    int opt;
+
+    // Started by termux-usb from collect_fds() with the device fd.
+    const char *socket_path = getenv("USB_ENUM_SOCKET");
+    if (socket_path && argc == 2) {
+        int fd;
+        if (sscanf(argv[1], "%d", &fd) != 1) return 1;
+        return send_fd(socket_path, getenv("USB_ENUM_PATH"), fd);
+    }
+
+    while ((opt = getopt(argc, argv, "tSw:")) != -1) {
+        switch (opt) {
+            case 't': tsv = 1; break;
+            case 'S': serial = 1; break;
+            case 'w': wait_ms = atof(optarg) * 1e3; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    double start = now_ms();
+    if (optind < argc) {
+        for (int i = optind; i < argc; i++) add_path(argv[i]);
+    } else if (list_termux_devices() < 0) {
+        return 1;
+    }
+    double listed = now_ms();
+    collect_fds(serial, wait_ms);
+    double opened = now_ms();
+    if ((serial ? describe_serial() : describe_parallel()) < 0) return 1;
+    double described = now_ms();
+
+    if (tsv) {
+        print_tsv();
+    } else {
+        print_json();
+    }
+    for (int i = 0; i < num_devices; i++) {
+        if (devices[i].fd >= 0) close(devices[i].fd);
+    }
+    fprintf(stderr, "DEBUG: %d devices in %.1f ms (%s): list %.1f ms, open %.1f ms, descriptors %.1f ms\n",
+            num_devices, described - start, serial ? "one at a time" : "concurrent",
+            listed - start, opened - listed, described - opened);
+    return 0;
+}
@@ -2,41 +2,45 @@
 #include <assert.h>
 #include <libusb-1.0/libusb.h>
 
+#include "../common/desc_cache.h"
+#include "../common/usb_session.h"
+
 int main(int argc, char **argv) {
-    libusb_context *context;
+    UsbSession session;
     libusb_device_handle *handle;
     libusb_device *device;
     struct libusb_device_descriptor desc;
-    unsigned char buffer[256];
+    char buffer[256];
     int fd;
     assert((argc > 1) && (sscanf(argv[1], "%d", &fd) == 1));
-    libusb_set_option(NULL, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
-    assert(!libusb_init(&context));
-    assert(!libusb_wrap_sys_device(context, (intptr_t) fd, &handle));
+    assert(!usb_session_open(&session, fd));
+    handle = session.handle;
     device = libusb_get_device(handle);
     assert(!libusb_get_device_descriptor(device, &desc));
     printf("Vendor ID: %04x\n", desc.idVendor);
     printf("Product ID: %04x\n", desc.idProduct);
 
     // Handle Manufacturer string
-    if (desc.iManufacturer && libusb_get_string_descriptor_ascii(handle, desc.iManufacturer, buffer, 256) >= 0) {
+    if (desc.iManufacturer && desc_cache_fetch_string(handle, desc.iManufacturer, buffer, 256) >= 0) {
         printf("Manufacturer: %s\n", buffer);
     } else {
         printf("Manufacturer: (unavailable)\n");
     }
 
     // Handle Product string
-    if (desc.iProduct && libusb_get_string_descriptor_ascii(handle, desc.iProduct, buffer, 256) >= 0) {
+    if (desc.iProduct && desc_cache_fetch_string(handle, desc.iProduct, buffer, 256) >= 0) {
         printf("Product: %s\n", buffer);
     } else {
         printf("Product: (unavailable)\n");
     }
 
     // Handle Serial Number string
-    if (desc.iSerialNumber && libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, buffer, 256) >= 0) {
+    if (desc.iSerialNumber && desc_cache_fetch_string(handle, desc.iSerialNumber, buffer, 256) >= 0) {
         printf("Serial No: %s\n", buffer);
     } else {
         printf("Serial No: (unavailable)\n");
     }
-    libusb_exit(context);
+    usb_session_mark(&session, "strings");
+    usb_session_report(&session);
+    usb_session_close(&session);
 }